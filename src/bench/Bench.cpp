@@ -0,0 +1,424 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QtGlobal>
+#include <QDebug>
+
+#include <osg/Version>
+#include <osgUtil/IntersectionVisitor>
+
+#include "RootScene.h"
+#include "UserScene.h"
+#include "StrokeIntersector.h"
+#include "EditEntityCommand.h"
+#include "GLWidget.h"
+#include "EventRecorder.h"
+
+#ifndef CHERISH_VERSION
+#define CHERISH_VERSION "unknown"
+#endif
+
+/* the Bezier sampling of entity::Stroke is protected, it is used by the benchmark through a derived class */
+class StrokeSampler : public entity::Stroke
+{
+public:
+    using entity::Stroke::getCurvePoints;
+};
+
+Bench::Options::Options()
+    : scene()
+    , picks(100)
+    , repeat(5)
+    , filter()
+{
+}
+
+Bench::Bench(const Bench::Options &options, QWidget *parent)
+    : MainWindow(parent)
+    , m_options(options)
+    , m_generator(options.scene)
+    , m_random(options.scene.seed)
+    , m_directory()
+{
+}
+
+QJsonObject Bench::run()
+{
+    QJsonObject scene;
+    scene["canvases"] = m_options.scene.canvases;
+    scene["strokes"] = m_options.scene.strokes;
+    scene["points"] = m_options.scene.points;
+    scene["photos"] = m_options.scene.photos;
+    scene["photo_size"] = m_options.scene.photoSize;
+    scene["bookmarks"] = m_options.scene.bookmarks;
+    scene["seed"] = static_cast<int>(m_options.scene.seed);
+    scene["picks"] = m_options.picks;
+    scene["repeat"] = m_options.repeat;
+
+    QJsonObject result = this->createResult();
+    result["scene"] = scene;
+
+    QJsonArray benchmarks;
+    QElapsedTimer timer;
+    timer.start();
+    if (!this->generate()){
+        result["error"] = QString("Could not create the synthetic scene");
+        result["benchmarks"] = benchmarks;
+        return result;
+    }
+    result["generate_ms"] = timer.nsecsElapsed() * 1e-6;
+
+    /* the scene is not changed by the benchmarks before the save and load ones */
+    if (this->isSelected("fitting")) benchmarks.append(this->benchmarkFitting());
+    if (this->isSelected("sampling")) benchmarks.append(this->benchmarkSampling());
+    if (this->isSelected("picking")) benchmarks.append(this->benchmarkPicking());
+    if (this->isSelected("push_strokes")) benchmarks.append(this->benchmarkPushStrokes());
+    if (this->isSelected("mesh")) benchmarks.append(this->benchmarkMesh());
+    if (this->isSelected("render")) benchmarks.append(this->benchmarkRender());
+    if (this->isSelected("save_chunked")) benchmarks.append(this->benchmarkSave("save_chunked", QString::fromStdString(cher::SCENE_CHUNK_EXTENSION)));
+    if (this->isSelected("save_osgt")) benchmarks.append(this->benchmarkSave("save_osgt", "osgt"));
+    if (this->isSelected("load_chunked")) benchmarks.append(this->benchmarkLoad("load_chunked", QString::fromStdString(cher::SCENE_CHUNK_EXTENSION)));
+    if (this->isSelected("load_osgt")) benchmarks.append(this->benchmarkLoad("load_osgt", "osgt"));
+    result["benchmarks"] = benchmarks;
+
+    int failed = 0;
+    for (const auto& record : benchmarks)
+        if (record.toObject().contains("error")) ++failed;
+    result["failed"] = failed;
+    return result;
+}
+
+QJsonObject Bench::replay(const QString &events, const QString &scene)
+{
+    QJsonObject result = this->createResult();
+    QJsonArray benchmarks;
+    osg::ref_ptr<EventRecorder> recording = new EventRecorder(0);
+    if (!recording->read(events.toStdString())){
+        result["error"] = QString("Could not read the recorded events");
+        result["benchmarks"] = benchmarks;
+        return result;
+    }
+
+    /* the session is replayed on the scene it was recorded on, when it is available */
+    QString path = scene;
+    if (path.isEmpty() && QFileInfo(QString::fromStdString(recording->getScene())).exists())
+        path = QString::fromStdString(recording->getScene());
+    result["scene"] = path.isEmpty() ? QString("synthetic") : path;
+
+    bool prepared = true, replayed = true;
+    std::vector<double> frames;
+    QJsonObject record = this->measure("replay", static_cast<int>(recording->getRecords().size()),
+                                       [&](){
+        prepared = (path.isEmpty() ? this->generate() : this->load(path)) && prepared;
+    },
+    [&](){
+        replayed = m_glWidget->replay(recording.get(), frames) && replayed;
+    });
+    m_rootScene->setSavedToFile(true);
+
+    /* the frame times of the last run show the hitches */
+    std::sort(frames.begin(), frames.end());
+    auto percentile = [&frames](double p){
+        return frames.empty() ? 0.0 : frames[std::min(frames.size()-1, static_cast<size_t>(p * frames.size()))];
+    };
+    record["frames"] = static_cast<int>(frames.size());
+    record["frame_p50_ms"] = percentile(0.5);
+    record["frame_p99_ms"] = percentile(0.99);
+    record["frame_max_ms"] = frames.empty() ? 0.0 : frames.back();
+    if (!prepared) record["error"] = QString("Could not prepare the scene");
+    else if (!replayed) record["error"] = QString("Could not replay the events");
+
+    benchmarks.append(record);
+    result["benchmarks"] = benchmarks;
+    result["failed"] = record.contains("error") ? 1 : 0;
+    return result;
+}
+
+QJsonObject Bench::measure(const QString &name, int items, const std::function<void ()> &prepare,
+                           const std::function<void ()> &function)
+{
+    qInfo() << "Running" << name;
+    std::vector<double> runs;
+    QElapsedTimer timer;
+    for (int i=0; i<std::max(1, m_options.repeat); ++i){
+        prepare();
+        timer.start();
+        function();
+        runs.push_back(timer.nsecsElapsed() * 1e-6);
+    }
+
+    std::vector<double> sorted(runs);
+    std::sort(sorted.begin(), sorted.end());
+    double median = sorted.size() % 2 ? sorted[sorted.size()/2]
+                                      : 0.5 * (sorted[sorted.size()/2 - 1] + sorted[sorted.size()/2]);
+    double mean = 0;
+    QJsonArray times;
+    for (double t : runs){
+        mean += t;
+        times.append(t);
+    }
+    mean /= runs.size();
+
+    QJsonObject record;
+    record["name"] = name;
+    record["items"] = items;
+    record["runs_ms"] = times;
+    record["min_ms"] = sorted.front();
+    record["median_ms"] = median;
+    record["mean_ms"] = mean;
+    record["max_ms"] = sorted.back();
+    record["median_per_item_us"] = items > 0 ? 1e3 * median / items : 0.0;
+    return record;
+}
+
+bool Bench::isSelected(const QString &name) const
+{
+    return m_options.filter.isEmpty() || name.contains(m_options.filter);
+}
+
+QJsonObject Bench::createResult() const
+{
+    QJsonObject result;
+    result["cherish"] = QString(CHERISH_VERSION);
+    result["qt"] = QString(qVersion());
+    result["osg"] = QString(osgGetVersion());
+    result["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    return result;
+}
+
+bool Bench::generate(const QString &directory)
+{
+    m_rootScene->setSavedToFile(true);
+    this->onFileClose();
+    if (!m_rootScene->getUserScene() || m_rootScene->getUserScene()->getNumCanvases() != 0){
+        qCritical("Could not clear the scene");
+        return false;
+    }
+    QString images = directory.isEmpty() ? m_directory.path() : directory;
+    if (!QDir().mkpath(images) || !m_generator.generate(m_rootScene.get(), m_bookmarkWidget, images))
+        return false;
+
+    /* the commands are not undone by the benchmarks */
+    m_undoStack->clear();
+    m_rootScene->setSavedToFile(true);
+    return true;
+}
+
+bool Bench::write(const QString &path)
+{
+    bool written = SceneGenerator::write(m_rootScene.get(), path.toStdString());
+    m_rootScene->setSavedToFile(true);
+    return written;
+}
+
+bool Bench::load(const QString &path)
+{
+    m_rootScene->setSavedToFile(true);
+    this->onFileClose();
+    m_rootScene->setFilePath(path.toStdString());
+    if (!this->loadSceneFromFile()){
+        qCritical("Could not load the scene");
+        return false;
+    }
+    m_undoStack->clear();
+    m_rootScene->setSavedToFile(true);
+    return true;
+}
+
+entity::Stroke *Bench::createStroke(entity::Canvas *canvas)
+{
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(canvas->getProgramStroke());
+    for (const auto& p : m_generator.createPath())
+        stroke->appendPoint(p.x(), p.y());
+    return stroke.release();
+}
+
+std::vector<entity::Stroke *> Bench::getStrokes(entity::Canvas *canvas) const
+{
+    std::vector<entity::Stroke*> strokes;
+    for (unsigned int i=0; i<canvas->getNumStrokes(); ++i){
+        entity::Stroke* stroke = canvas->getStroke(i);
+        if (stroke) strokes.push_back(stroke);
+    }
+    return strokes;
+}
+
+QJsonObject Bench::benchmarkFitting()
+{
+    entity::Canvas* canvas = m_rootScene->getUserScene()->getCanvas(0);
+    std::vector< osg::ref_ptr<entity::Stroke> > strokes(m_options.scene.strokes);
+    return this->measure("fitting", m_options.scene.strokes,
+                         [&](){
+        for (auto& stroke : strokes)
+            stroke = this->createStroke(canvas);
+    },
+    [&](){
+        for (auto& stroke : strokes)
+            stroke->prepareShape();
+    });
+}
+
+QJsonObject Bench::benchmarkSampling()
+{
+    std::vector<entity::Stroke*> strokes;
+    for (int i=0; i<m_rootScene->getUserScene()->getNumCanvases(); ++i){
+        std::vector<entity::Stroke*> canvasStrokes = this->getStrokes(m_rootScene->getUserScene()->getCanvas(i));
+        strokes.insert(strokes.end(), canvasStrokes.begin(), canvasStrokes.end());
+    }
+    osg::ref_ptr<StrokeSampler> sampler = new StrokeSampler;
+    unsigned int samples = 0;
+    QJsonObject record = this->measure("sampling", static_cast<int>(strokes.size()),
+                                       [&](){ samples = 0; },
+    [&](){
+        for (auto stroke : strokes){
+            osg::ref_ptr<osg::Vec3Array> points =
+                    sampler->getCurvePoints(static_cast<const osg::Vec3Array*>(stroke->getVertexArray()));
+            samples += points->size();
+        }
+    });
+    record["samples"] = static_cast<int>(samples);
+    return record;
+}
+
+QJsonObject Bench::benchmarkPicking()
+{
+    /* the rays are slightly tilted with respect to the canvas normal, as in the stroke index test */
+    struct Ray { entity::Canvas* canvas; osg::Vec3d start, end; };
+    std::vector<Ray> rays;
+    std::uniform_real_distribution<float> position(-cher::CANVAS_MINW, cher::CANVAS_MINW);
+    for (int i=0; i<m_rootScene->getUserScene()->getNumCanvases(); ++i){
+        entity::Canvas* canvas = m_rootScene->getUserScene()->getCanvas(i);
+        osg::Matrix M = canvas->getTransform()->getMatrix();
+        osg::Vec3d dir = osg::Vec3d(0.1, 0.1, 1) * osg::Matrix::rotate(M.getRotate());
+        for (int j=0; j<m_options.picks; ++j){
+            osg::Vec3d P = osg::Vec3d(position(m_random), position(m_random), 0) * M;
+            rays.push_back(Ray{canvas, P + dir * 10, P - dir * 10});
+        }
+    }
+
+    unsigned int hits = 0;
+    QJsonObject record = this->measure("picking", static_cast<int>(rays.size()),
+                                       [&](){ hits = 0; },
+    [&](){
+        for (const auto& ray : rays){
+            osg::ref_ptr<StrokeIntersector> intersector = new StrokeIntersector(osgUtil::Intersector::MODEL, ray.start, ray.end);
+            osgUtil::IntersectionVisitor iv(intersector.get());
+            ray.canvas->accept(iv);
+            hits += intersector->getIntersections().size();
+        }
+    });
+    record["hits"] = static_cast<int>(hits);
+    return record;
+}
+
+QJsonObject Bench::benchmarkPushStrokes()
+{
+    entity::UserScene* scene = m_rootScene->getUserScene();
+    if (scene->getNumCanvases() < 2){
+        QJsonObject record;
+        record["name"] = QString("push_strokes");
+        record["error"] = QString("At least two canvases are required");
+        return record;
+    }
+    entity::Canvas* source = scene->getCanvas(0);
+    entity::Canvas* target = scene->getCanvas(1);
+    std::vector<entity::Stroke*> strokes = this->getStrokes(source);
+    std::vector<entity::Entity2D*> entities(strokes.begin(), strokes.end());
+    osg::Vec3f eye = source->getCenter() + source->getNormal() * 10.f;
+
+    /* the strokes are pushed back to the source canvas before every run */
+    std::unique_ptr<fur::EditStrokesPushCommand> command;
+    QJsonObject record = this->measure("push_strokes", static_cast<int>(entities.size()),
+                                       [&](){
+        if (command) command->undo();
+        command.reset(new fur::EditStrokesPushCommand(scene, entities, source, target, eye));
+    },
+    [&](){
+        command->redo();
+    });
+    if (command) command->undo();
+    return record;
+}
+
+QJsonObject Bench::benchmarkSave(const QString &name, const QString &extension)
+{
+    QString path = QDir(m_directory.path()).filePath("scene." + extension);
+    bool saved = true;
+    QJsonObject record = this->measure(name, m_options.scene.canvases * m_options.scene.strokes,
+                                       [&](){
+        QFile::remove(path);
+        m_rootScene->setFilePath(path.toStdString());
+    },
+    [&](){
+        saved = m_rootScene->writeScenetoFile() && saved;
+    });
+    m_rootScene->setSavedToFile(true);
+    if (!saved) record["error"] = QString("Could not write scene to file");
+    record["bytes"] = static_cast<double>(QFileInfo(path).size());
+    return record;
+}
+
+QJsonObject Bench::benchmarkLoad(const QString &name, const QString &extension)
+{
+    QString path = QDir(m_directory.path()).filePath("scene." + extension);
+    bool loaded = QFileInfo(path).exists();
+    QJsonObject record = this->measure(name, m_options.scene.canvases * m_options.scene.strokes,
+                                       [&](){
+        m_rootScene->setSavedToFile(true);
+        this->onFileClose();
+        m_rootScene->setFilePath(path.toStdString());
+    },
+    [&](){
+        loaded = this->loadSceneFromFile() && loaded;
+    });
+    m_rootScene->setSavedToFile(true);
+    if (!loaded) record["error"] = QString("Could not read scene from file");
+    return record;
+}
+
+QJsonObject Bench::benchmarkMesh()
+{
+    std::vector<entity::Stroke*> strokes = this->getStrokes(m_rootScene->getUserScene()->getCanvas(0));
+    std::vector< osg::ref_ptr<osg::Node> > meshes(strokes.size());
+    return this->measure("mesh", static_cast<int>(strokes.size()),
+                         [&](){
+        for (auto& mesh : meshes) mesh = 0;
+    },
+    [&](){
+        for (unsigned int i=0; i<strokes.size(); ++i)
+            meshes[i] = strokes[i]->getMeshRepresentation();
+    });
+}
+
+QJsonObject Bench::benchmarkRender()
+{
+    /* the whole scene is in view, the first frame also uploads the buffers and is not timed */
+    float extent = m_options.scene.extent;
+    this->setCameraView(osg::Vec3d(0, -3*extent, extent), osg::Vec3d(0,0,0), osg::Vec3d(0,0,1), 60.0);
+    bool rendered = !m_glWidget->grabFramebuffer().isNull();
+    QJsonObject record = this->measure("render", m_options.scene.canvases * m_options.scene.strokes,
+                                       [](){},
+    [&](){
+        rendered = !m_glWidget->grabFramebuffer().isNull() && rendered;
+    });
+    if (!rendered) record["error"] = QString("Could not render the frame, OpenGL may not be available");
+
+    /* memory of the packed strokes, including the levels of detail drawn so far */
+    double bytes = 0;
+    for (int i=0; i<m_rootScene->getUserScene()->getNumCanvases(); ++i){
+        const entity::StrokeBatch* batch = m_rootScene->getUserScene()->getCanvas(i)->getStrokeBatch();
+        if (batch) bytes += batch->getNumBytes();
+    }
+    record["batch_bytes"] = bytes;
+    return record;
+}
@@ -0,0 +1,107 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <functional>
+#include <random>
+#include <vector>
+
+#include <QString>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QTemporaryDir>
+
+#include <osg/ref_ptr>
+
+#include "MainWindow.h"
+#include "Settings.h"
+#include "Canvas.h"
+#include "Stroke.h"
+#include "SceneGenerator.h"
+
+/*! \class Bench
+ * \brief Headless benchmark suite of the stroke and scene pipeline.
+ *
+ * The class inherits MainWindow the same way as the GUI tests do, since the scene graph entities require the main
+ * window singleton (e.g., the camera of the shader programs); the window is never shown. Each benchmark is run on
+ * a synthetic scene which is built by SceneGenerator from Options::scene, so that the scenes are the same from run
+ * to run.
+ *
+ * Every benchmark is repeated Options::repeat times, its preparation is not timed. The results are collected into
+ * a JSON object, see run(), so that they can be compared across the releases.
+*/
+class Bench : public MainWindow
+{
+    Q_OBJECT
+public:
+    /*! Benchmark settings, they are given by the command line, see main(). */
+    struct Options
+    {
+        Options();
+
+        SceneGenerator::Options scene; /*!< synthetic scene settings */
+        int picks; /*!< number of picking rays per canvas */
+        int repeat; /*!< number of runs of every benchmark */
+        QString filter; /*!< if not empty, only the benchmarks whose name contains it are run */
+    };
+
+    explicit Bench(const Options& options, QWidget* parent = 0);
+
+    /*! A method to run all the benchmarks which pass the filter on a newly generated scene.
+     * \return JSON object with the settings, the versions and a record per benchmark. */
+    QJsonObject run();
+
+    /*! A method to replay the recorded interactive session, see EventRecorder, as fast as possible.
+     * \param events is the file of the recording
+     * \param scene is the scene file to replay the session on; if empty, the scene file of the recording is used
+     * if it exists, otherwise the synthetic scene is generated. The scene is re-loaded before every run.
+     * \return JSON object with the versions and the replay record, which includes the frame time percentiles. */
+    QJsonObject replay(const QString& events, const QString& scene = QString());
+
+    /*! A method to clear the current scene and to generate the synthetic one.
+     * \param directory is the folder to write the photo images to; if empty, a temporary folder is used which
+     * is removed together with the bench. \return true upon success. */
+    bool generate(const QString& directory = QString());
+
+    /*! A method to write the current scene, the format is chosen by the file extension.
+     * \return true upon success. \sa SceneGenerator::write() */
+    bool write(const QString& path);
+
+    /*! A method to clear the current scene and to load the scene from file. \return true upon success. */
+    bool load(const QString& path);
+
+protected:
+    /*! A method to time the function, the preparation is run before every run and is not timed.
+     * \param name is the benchmark name
+     * \param items is the number of items processed by a single run, e.g., strokes
+     * \return JSON record with the run times in milliseconds. */
+    QJsonObject measure(const QString& name, int items, const std::function<void()>& prepare,
+                        const std::function<void()>& function);
+
+    bool isSelected(const QString& name) const;
+
+    /*! \return JSON object with the versions and the date of the run. */
+    QJsonObject createResult() const;
+
+    /*! \return new stroke with a random pen-like path; it is not fitted. */
+    entity::Stroke* createStroke(entity::Canvas* canvas);
+
+    /*! \return all the strokes of the canvas. */
+    std::vector<entity::Stroke*> getStrokes(entity::Canvas* canvas) const;
+
+    QJsonObject benchmarkFitting();
+    QJsonObject benchmarkSampling();
+    QJsonObject benchmarkPicking();
+    QJsonObject benchmarkPushStrokes();
+    QJsonObject benchmarkSave(const QString& name, const QString& extension);
+    QJsonObject benchmarkLoad(const QString& name, const QString& extension);
+    QJsonObject benchmarkMesh();
+    QJsonObject benchmarkRender();
+
+private:
+    Options m_options;
+    SceneGenerator m_generator;
+    std::mt19937 m_random; /* picking rays */
+    QTemporaryDir m_directory; /* scene files of save and load benchmarks */
+};
+
+#endif // BENCH_H
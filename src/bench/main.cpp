@@ -0,0 +1,92 @@
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTextStream>
+#include <QtGlobal>
+
+#include "CherishApplication.h"
+#include "Bench.h"
+
+/* Headless benchmark suite, e.g.:
+ *     cherish_bench --canvases 100 --strokes 200 --photos 20 --bookmarks 10 --output bench.json
+ * or, to only generate a large scene and write it to a file:
+ *     cherish_bench --canvases 1000 --strokes 500 --write site.cher
+ * or, to replay the input events recorded in the GUI (File > Record input events):
+ *     cherish_bench --replay session.events --scene site.cher --output replay.json
+ * It has to be run from its build folder, where the shaders are copied to. The results are written as JSON,
+ * see Bench::run(). */
+int main(int argc, char** argv)
+{
+    /* no window is shown, so the benchmarks do not need a display unless a platform is chosen explicitly */
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", QByteArray("offscreen"));
+
+    CherishApplication app(argc, argv);
+    app.setApplicationName("cherish_bench");
+
+    Bench::Options options;
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks of the cherish stroke and scene pipeline on synthetic scenes.");
+    parser.addHelpOption();
+    QCommandLineOption canvases("canvases", "Number of canvases, at least 1.", "number", QString::number(options.scene.canvases));
+    QCommandLineOption strokes("strokes", "Number of strokes per canvas.", "number", QString::number(options.scene.strokes));
+    QCommandLineOption points("points", "Number of pen events per stroke, at least 2.", "number", QString::number(options.scene.points));
+    QCommandLineOption photos("photos", "Number of photos.", "number", QString::number(options.scene.photos));
+    QCommandLineOption photoSize("photo-size", "Side of the photo images in pixels.", "pixels", QString::number(options.scene.photoSize));
+    QCommandLineOption bookmarks("bookmarks", "Number of bookmarks.", "number", QString::number(options.scene.bookmarks));
+    QCommandLineOption seed("seed", "Seed of the random scene generator.", "number", QString::number(options.scene.seed));
+    QCommandLineOption picks("picks", "Number of picking rays per canvas.", "number", QString::number(options.picks));
+    QCommandLineOption repeat("repeat", "Number of runs of every benchmark.", "number", QString::number(options.repeat));
+    QCommandLineOption filter("filter", "Run only the benchmarks whose name contains the text.", "text");
+    QCommandLineOption output("output", "JSON file to write the results to, standard output if not given.", "file");
+    QCommandLineOption replay("replay", "Replay the recorded input events instead of running the benchmarks.", "file");
+    QCommandLineOption scene("scene", "Scene file to replay the events on, the scene of the recording by default.", "file");
+    QCommandLineOption write("write", "Only generate the scene and write it to the file, the format is chosen by the "
+                                      "extension, e.g., .cher or .osgt.", "file");
+    parser.addOptions({canvases, strokes, points, photos, photoSize, bookmarks, seed, picks, repeat, filter, output,
+                       replay, scene, write});
+    parser.process(app);
+
+    options.scene.canvases = parser.value(canvases).toInt();
+    options.scene.strokes = parser.value(strokes).toInt();
+    options.scene.points = parser.value(points).toInt();
+    options.scene.photos = parser.value(photos).toInt();
+    options.scene.photoSize = parser.value(photoSize).toInt();
+    options.scene.bookmarks = parser.value(bookmarks).toInt();
+    options.scene.seed = parser.value(seed).toUInt();
+    options.picks = parser.value(picks).toInt();
+    options.repeat = parser.value(repeat).toInt();
+    options.filter = parser.value(filter);
+    if (options.scene.canvases < 1 || options.scene.strokes < 0 || options.scene.points < 2 || options.scene.photos < 0
+            || options.scene.photoSize < 1 || options.scene.bookmarks < 0 || options.picks < 0 || options.repeat < 1){
+        qCritical("Invalid benchmark settings, see --help");
+        return 2;
+    }
+
+    Bench bench(options);
+    if (parser.isSet(write)){
+        /* the photo images are kept next to the scene file */
+        QFileInfo file(parser.value(write));
+        QString images = file.absoluteDir().filePath(file.completeBaseName() + "_photos");
+        return bench.generate(images) && bench.write(file.absoluteFilePath()) ? 0 : 1;
+    }
+
+    QJsonObject result = parser.isSet(replay) ? bench.replay(parser.value(replay), parser.value(scene)) : bench.run();
+    QByteArray json = QJsonDocument(result).toJson();
+
+    if (parser.isSet(output)){
+        QFile file(parser.value(output));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()){
+            qCritical("Could not write the results to file");
+            return 2;
+        }
+    }
+    else{
+        QTextStream out(stdout);
+        out << json;
+    }
+
+    return result.contains("error") || result["failed"].toInt() > 0 ? 1 : 0;
+}
@@ -171,6 +171,7 @@ enum TraversalMask
     MASK_CANVASFRAME_IN = 0x100, /*!< sees only canvas frame drawables */
     MASK_SVMDATA_IN = 0x1000, /*!< sees only entity::SVMData */
     MASK_BOOKMARK_IN = 0x1100, /*!< sees only bookmark tools */
+    MASK_HUD_IN = 0x10000, /*!< sees only the heads-up display of GLWidget */
     MASK_ALL_IN = ~0x0
 };
 
@@ -217,10 +218,25 @@ const osg::Vec4 STROKE_CLR_NORMAL = solarized::base03;
 const osg::Vec4 STROKE_CLR_SELECTED = solarized::red;
 const float STROKE_MINL = 0.05f;
 const float STROKE_LINE_WIDTH = 4.f;
-const int STROKE_SEGMENTS_NUMBER = 11;
+const int STROKE_SEGMENTS_NUMBER = 11; // per Bezier curve when the tessellation is not adaptive
+const int STROKE_SEGMENTS_MIN = 3; // same limits as in Stroke.geom
+const int STROKE_SEGMENTS_MAX = 30;
+const float STROKE_TESSELLATION_TOLERANCE = 0.25f; // px, max distance of tessellated curve, non-positive turns it off
+const float STROKE_CULL_LENGTH = 0.5f; // px, curves which are shorter on screen are drawn as one straight segment
 const float STROKE_FOG_MIN = 4.f;
 const float STROKE_FOG_MAX = 30.f;
 const float STROKE_MESH_RADIUS = 0.03f;
+const float STROKE_FIT_TOLERANCE = 0.0001f; // curve fitting threshold on normalized coordinates
+const unsigned int STROKE_FIT_TAIL_MAX = 64; // max raw points in the open tail when fitting online
+const float STROKE_INDEX_CELL = 0.25f; // grid cell size of canvas stroke index, local units
+const long long STROKE_INDEX_MAXCELLS = 4096; // max number of cells per Bezier segment
+const bool STROKE_BATCHING = true; // draw the shadered strokes of a canvas from a single vertex buffer
+const int STROKE_BATCH_COLORS_UNIT = 1; // texture unit of the per-stroke colors of the batched strokes
+const bool STROKE_LOD = true; // draw the batched strokes of distant canvases from the simplified sets
+const unsigned int STROKE_LOD_LEVELS = 3; // number of simplified sets besides the full detail
+const float STROKE_LOD_PIXELS = 256.f; // px, projected size of the canvas strokes below which the 1st simplified set is used
+const float STROKE_LOD_STEP = 4.f; // every next set is used for a projected size smaller by this factor
+const float STROKE_LOD_TOLERANCE = 100.f; // fitting tolerance of every next set is larger by this factor
 
 // polygon settings
 const float POLYGON_LINE_WIDTH = 4.f;
@@ -283,6 +299,35 @@ const size_t APP_WIDGET_ICONSIZE_H = 80;
 // photo format, used for drag and drop functionality
 const QString MIME_PHOTO = "image/cherish";
 
+// photo base: image formats and on-disk cache of thumbnails
+const QString PHOTO_FILE_FILTERS = "*.bmp *.jpg *.jpeg *.png *.tif *.tiff";
+const QString PHOTO_THUMBNAIL_CACHE = "thumbnails"; // sub-directory of the application cache location
+
+// scene files: native chunked format and sidecar photo store
+const std::string SCENE_CHUNK_EXTENSION = "cher";
+const unsigned int SCENE_CHUNK_VERSION = 1;
+const unsigned int SCENE_CHUNK_QUANTIZATION = 65535; // levels per axis of entity points within their bounding box
+const std::string PHOTO_STORE_FORMAT = "png"; // encoding of stored photos and photo blobs
+const std::string PHOTO_STORE_SUFFIX = ".photos"; // sidecar photo directory next to the scene file
+const int SCENE_CHUNK_BUDGET = 8; // ms per event loop iteration to materialize pending canvases
+const double SCENE_CHUNK_GARBAGE = 0.5; // share of free space within the scene file that triggers a full re-write
+const int AUTOSAVE_INTERVAL = 120000; // ms between two autosaves
+const std::string AUTOSAVE_SUFFIX = ".autosave"; // autosave file is the scene file name with this suffix and the chunked extension
+
+// tiled pyramids of large photos
+const int PHOTO_PYRAMID_THRESHOLD = 4096; // px, photos with a longer side are shown from the pyramid tiles
+const int PHOTO_TILE_SIZE = 512; // px, side of a pyramid tile
+const int PHOTO_TEXTURE_MAX = 4096; // px, maximal side of the tile region that is paged in for a photo
+const int PHOTO_TILE_POLL = 50; // ms between redraws while tiles are being built or read
+const QString PHOTO_PYRAMID_CACHE = "pyramids"; // sub-directory of the application cache location
+
+// texture memory budget of photo images
+const unsigned long long PHOTO_MEMORY_BUDGET = 512ull * 1024 * 1024; // bytes of resident photo images
+const QString PHOTO_EVICTION_CACHE = "photos"; // sub-directory of the application cache location for evicted images
+
+// input-to-photon latency of sketching
+const unsigned int LATENCY_SAMPLES = 1000; // number of the last sketch events whose latency is kept
+
 // CanvasPhotoWidget roles
 const int DelegateVisibilityRole = Qt::UserRole + 1;
 const int DelegateChildRole = Qt::UserRole + 2;
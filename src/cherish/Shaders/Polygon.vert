@@ -2,6 +2,7 @@
 
 uniform mat4 ModelViewProjectionMatrix;
 uniform mat4 CanvasMatrix;
+uniform mat4 EntityMatrix; // pending 2D transform of the entity, identity by default
 
 layout(location = 0) in vec4 Vertex;
 layout(location = 1) in vec4 Color;
@@ -13,7 +14,8 @@ out VertexData{
 
 void main(void)
 {
+    vec4 V = EntityMatrix * Vertex;
     VertexOut.mColor = Color;
-    VertexOut.mVertex = CanvasMatrix * Vertex;
-    gl_Position = ModelViewProjectionMatrix * Vertex;
+    VertexOut.mVertex = CanvasMatrix * V;
+    gl_Position = ModelViewProjectionMatrix * V;
 }
@@ -2,6 +2,9 @@
 
 uniform mat4 ModelViewProjectionMatrix;
 uniform mat4 CanvasMatrix;
+uniform mat4 EntityMatrix; // pending 2D transform of the entity, identity by default
+uniform bool IsBatched; // the z of the vertex is the index of its stroke color, see entity::StrokeBatch
+uniform samplerBuffer BatchColors;
 
 layout(location = 0) in vec4 Vertex;
 layout(location = 1) in vec4 Color;
@@ -13,7 +16,13 @@ out VertexData{
 
 void main(void)
 {
+    vec4 V = Vertex;
     VertexOut.mColor = Color;
-    VertexOut.mVertex = CanvasMatrix * Vertex;
-    gl_Position = ModelViewProjectionMatrix * Vertex;
+    if (IsBatched){
+        VertexOut.mColor = texelFetch(BatchColors, int(Vertex.z));
+        V.z = 0.0;
+    }
+    V = EntityMatrix * V;
+    VertexOut.mVertex = CanvasMatrix * V;
+    gl_Position = ModelViewProjectionMatrix * V;
 }
@@ -1,5 +1,7 @@
 #include "Utilities.h"
 
+#include <algorithm>
+
 #include <QDebug>
 #include <QtGlobal>
 
@@ -279,6 +281,27 @@ double Utilities::getSkewLinesDistance(const osg::Vec3d &r1, const osg::Vec3d &r
     return std::fabs((dir*u3));
 }
 
+double Utilities::getLineSegmentDistance(const osg::Vec3d &r1, const osg::Vec3d &r2, const osg::Vec3d &v1, const osg::Vec3d &v2)
+{
+    osg::Vec3d u = r2-r1;
+    osg::Vec3d w = v2-v1;
+    osg::Vec3d p = r1-v1;
+    double a = u*u, b = u*w, c = w*w, d = u*p, e = w*p;
+    if (a == 0){
+        /* the line is a point */
+        double s = (c > 0)? std::max(0., std::min(1., e/c)) : 0.;
+        return (p - w*s).length();
+    }
+
+    /* parameter of the closest point on the segment, clamped to its end points; the closest point
+     * on the line is then found for the clamped one; parallel lines are equally close everywhere */
+    double D = a*c - b*b;
+    double s = (D > cher::EPSILON*a*c)? (a*e - b*d) / D : 0.;
+    s = std::max(0., std::min(1., s));
+    double t = (s*b - d) / a;
+    return (p + u*t - w*s).length();
+}
+
 bool Utilities::getLinesIntersection(const osg::Vec3f &La1, const osg::Vec3f &La2, const osg::Vec3f &Lb1, const osg::Vec3f &Lb2, osg::Vec3f &intersection)
 {
     // first check if lines have exact intersection point
@@ -137,6 +137,16 @@ public:
     static double getSkewLinesDistance(const osg::Vec3d &r1, const osg::Vec3d &r2,
                                        const osg::Vec3d &v1, const osg::Vec3d &v2);
 
+    /*! A method to obtain a distance between a line and a segment, e.g., between a picking ray and a stroke line.
+     * \param r1 is the first point on the line
+     * \param r2 is the second point on the line
+     * \param v1 is the start of the segment
+     * \param v2 is the end of the segment
+     * \return the shortest distance from the line to any point of the segment.
+     * \sa getSkewLinesDistance() */
+    static double getLineSegmentDistance(const osg::Vec3d &r1, const osg::Vec3d &r2,
+                                         const osg::Vec3d &v1, const osg::Vec3d &v2);
+
     /*! A method to obtain an intersection between the two lines. Each line is presented by two points in
      * 3D space. The algorithm treats the lines as skew and the intersection is calculated as average between
      * two projections on each line. The projection between the skew lines is a shortest distance between the
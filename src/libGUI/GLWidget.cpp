@@ -10,12 +10,16 @@
 #include <QMimeData>
 #include <QtGlobal>
 #include <QOpenGLContext>
+#include <QOpenGLFunctions>
 #include <QOpenGLFunctions_3_3_Core>
 #include <QSurfaceFormat>
 #include <QOpenGLFramebufferObject>
 #include <QOpenGLFramebufferObjectFormat>
 #include <QOpenGLPaintDevice>
 #include <QScopedPointer>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QImage>
 
 #include <osg/StateSet>
 #include <osg/Material>
@@ -28,6 +32,8 @@
 #include <osgGA/TrackballManipulator>
 
 #include "SceneState.h"
+#include "PhotoStore.h"
+#include "LatencyMonitor.h"
 
 GLWidget::GLWidget(RootScene *root, QUndoStack *stack, QWidget *parent, Qt::WindowFlags f)
     : QOpenGLWidget(parent, f)
@@ -45,6 +51,9 @@ GLWidget::GLWidget(RootScene *root, QUndoStack *stack, QWidget *parent, Qt::Wind
 
     , m_manipulator(new Manipulator(m_mouseMode))
     , m_EH(new EventHandler(this, m_RootScene.get(), m_mouseMode))
+    , m_recorder(new EventRecorder(m_EH.get()))
+    , m_hud(new HUDCamera(0, this->width(), 0, this->height()))
+    , m_hudText(new osgText::Text)
 
     , m_viewStack(stack)
 {
@@ -72,11 +81,27 @@ GLWidget::GLWidget(RootScene *root, QUndoStack *stack, QWidget *parent, Qt::Wind
     m_viewer->setCamera(camera);
     m_viewer->setSceneData(m_RootScene.get());
     m_viewer->setCameraManipulator(m_manipulator.get());
+    m_viewer->addEventHandler(m_recorder.get()); // sees the events before they are handled
     m_viewer->addEventHandler(m_EH.get());
     m_viewer->setThreadingModel(osgViewer::Viewer::SingleThreaded);
 
+    /* heads-up display is a child of the viewer camera, so that it is not a part of the scene */
+    m_hudText->setCharacterSize(12.f * cher::DPI_SCALING);
+    m_hudText->setPosition(osg::Vec3(10.f, 10.f, 0.f));
+    m_hudText->setColor(solarized::base01);
+    m_hudText->setDataVariance(osg::Object::DYNAMIC);
+    osg::Geode* geode = new osg::Geode;
+    geode->addDrawable(m_hudText.get());
+    m_hud->setText(geode);
+    m_hud->setNodeMask(cher::MASK_HUD_IN);
+    m_hud->setVisibility(false);
+    camera->addChild(m_hud.get());
+
     m_viewer->realize();
 
+    /* the latency of sketch events is measured in the clock of the event queue */
+    entity::LatencyMonitor::instance().setStartTick(this->getEventQueue()->getStartTick());
+
     /* OpenGL graphics context */
     m_traits->samples = 4; // multi sampling (anti-aliasing)
     m_traits->sampleBuffers = 4;
@@ -213,6 +238,74 @@ QPixmap GLWidget::getScreenShot(const osg::Vec3d &eye, const osg::Vec3d &center,
     return pmap;
 }
 
+void GLWidget::setRecording(bool record)
+{
+    if (!record){
+        m_recorder->stop();
+        return;
+    }
+    osg::Vec3d eye, center, up;
+    double fov;
+    this->getCameraView(eye, center, up, fov);
+    m_recorder->start(eye, center, up, fov, this->width(), this->height(),
+                      m_RootScene->getUserScene()->getFilePath());
+}
+
+EventRecorder *GLWidget::getEventRecorder() const
+{
+    return m_recorder.get();
+}
+
+bool GLWidget::replay(const EventRecorder *recording, std::vector<double> &frames)
+{
+    frames.clear();
+    if (!recording || recording->isRecording()){
+        qWarning("GLWidget replay: recording is NULL or is still being recorded");
+        return false;
+    }
+
+    /* the event coordinates are in the pixels of the recorded viewport */
+    if (recording->getWidth() > 0 && recording->getHeight() > 0)
+        this->resize(recording->getWidth(), recording->getHeight());
+    osg::Vec3d eye, center, up;
+    double fov;
+    recording->getCameraView(eye, center, up, fov);
+    this->setCameraView(eye, center, up, fov);
+
+    /* the first frame creates the context and uploads the scene, it is not timed */
+    if (this->grabFramebuffer().isNull()){
+        qWarning("GLWidget replay: could not render the frame");
+        return false;
+    }
+
+    osgGA::EventQueue* queue = this->getEventQueue();
+    double start = queue->getTime();
+    QElapsedTimer timer;
+    bool batch = true; // next record starts a frame
+    const std::vector<EventRecorder::Record>& records = recording->getRecords();
+    for (unsigned int i=0; i<records.size(); ++i){
+        const EventRecorder::Record& record = records[i];
+        /* the mode is only changed by GUI between the frames, EventHandler may change it within the frame */
+        if (batch && record.mode != m_mouseMode)
+            this->setMouseMode(record.mode);
+        batch = false;
+        if (record.event->getEventType() != osgGA::GUIEventAdapter::FRAME)
+            queue->addEvent(EventRecorder::createEvent(record, queue, start));
+
+        /* the events after the last frame marker are processed by an extra frame */
+        if (record.event->getEventType() == osgGA::GUIEventAdapter::FRAME || i+1 == records.size()){
+            timer.start();
+            this->makeCurrent();
+            this->paintGL();
+            this->context()->functions()->glFinish();
+            this->doneCurrent();
+            frames.push_back(timer.nsecsElapsed() * 1e-6);
+            batch = true;
+        }
+    }
+    return true;
+}
+
 /* FOV is a whole angle, not half angle */
 void GLWidget::onFOVChangedSlider(double fov)
 {
@@ -256,7 +349,10 @@ void GLWidget::initializeGL()
 
 void GLWidget::paintGL()
 {
+    entity::PhotoStore::instance().beginFrame();
+    this->updateHUD();
     m_viewer->frame();
+    entity::LatencyMonitor::instance().markFrame();
 }
 
 void GLWidget::resizeGL(int w, int h)
@@ -513,6 +609,36 @@ void GLWidget::onResize(int w, int h)
         return;
     }
     camera->setViewport(0,0, this->width(), this->height());
+    m_hud->setProjection(0, this->width(), 0, this->height());
+}
+
+void GLWidget::updateHUD()
+{
+    const entity::PhotoStore& store = entity::PhotoStore::instance();
+    const entity::LatencyMonitor& latency = entity::LatencyMonitor::instance();
+    unsigned long long resident = store.getResidentBytes(), evicted = store.getEvictedBytes();
+    bool photos = resident + evicted > 0;
+    bool visible = photos || latency.getEnabled();
+    if (m_hud->getVisibility() != visible) m_hud->setVisibility(visible);
+    if (!visible) return;
+
+    QStringList lines;
+    const double MB = 1024.0 * 1024.0;
+    if (photos)
+        lines << QString("Photos: %1 MB resident, %2 MB evicted, budget %3 MB")
+                 .arg(resident / MB, 0, 'f', 1).arg(evicted / MB, 0, 'f', 1)
+                 .arg(store.getMemoryBudget() / MB, 0, 'f', 0);
+    if (latency.getEnabled()){
+        QStringList stages;
+        for (int i=0; i<entity::LatencyMonitor::STAGE_COUNT; ++i){
+            entity::LatencyMonitor::Stage stage = static_cast<entity::LatencyMonitor::Stage>(i);
+            stages << QString("%1 %2/%3").arg(entity::LatencyMonitor::getStageName(stage))
+                      .arg(latency.getPercentile(stage, 0.5), 0, 'f', 1)
+                      .arg(latency.getPercentile(stage, 0.99), 0, 'f', 1);
+        }
+        lines << QString("Latency p50/p99 ms of %1 pen events: %2").arg(latency.getNumSamples()).arg(stages.join(", "));
+    }
+    m_hudText->setText(lines.join("\n").toStdString());
 }
 
 osgGA::EventQueue *GLWidget::getEventQueue() const
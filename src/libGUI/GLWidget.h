@@ -7,6 +7,7 @@
 #include <QStack>
 #include <QPixmap>
 #include <QScopedPointer>
+#include <vector>
 #include <QDragEnterEvent>
 #include <QDragLeaveEvent>
 #include <QDragMoveEvent>
@@ -20,11 +21,14 @@
 #include <osg/Camera>
 #include <osg/Image>
 #include <osg/GraphicsContext>
+#include <osgText/Text>
 
 #include "RootScene.h"
 #include "Settings.h"
+#include "hudcamera.h"
 #include "../libSGControls/Manipulator.h"
 #include "../libSGControls/EventHandler.h"
+#include "../libSGControls/EventRecorder.h"
 #include "../libSGControls/ViewerCommand.h"
 
 /*! \class Viewer
@@ -99,6 +103,22 @@ public:
      * This method resets the view back to what it was before the screenshot was taken. */
     QPixmap getScreenShot(const osg::Vec3d& eye, const osg::Vec3d& center, const osg::Vec3d& up);
 
+    /*! Method to start or stop recording of the events which go into EventHandler, the recording starts from the
+     * current camera view and viewport size. \sa EventRecorder */
+    void setRecording(bool record);
+
+    /*! \return the event recorder, it contains the last recording. */
+    EventRecorder* getEventRecorder() const;
+
+    /*! Method to replay the recorded events as fast as possible, the widget does not need to be shown.
+     * The viewport is resized and the camera view is set as they were at the start of the recording; the mouse
+     * mode is set before every frame as it was recorded. Every recorded frame is rendered at once after its
+     * events are added into the event queue.
+     * \param recording contains the recorded events, e.g., read from file by EventRecorder::read()
+     * \param frames is the returned duration of every frame in milliseconds
+     * \return true if all the frames were rendered. */
+    bool replay(const EventRecorder* recording, std::vector<double>& frames);
+
 public slots:
 
     /*! \param fov is the new  FOV (to change manipulator's camera) */
@@ -137,6 +157,10 @@ public:
 private:
     virtual void onResize(int w, int h);
 
+    /* heads-up display of the photo memory and of the sketch latency, see entity::PhotoStore and
+     * entity::LatencyMonitor */
+    void updateHUD();
+
     osgGA::EventQueue* getEventQueue() const; // for osg to process mouse and keyboard events
     // for more info see reference osgGA::EventQueue and osgGA::GUIEventAdapter
     // the later's enums are used in EventHandler.h
@@ -155,6 +179,9 @@ private:
     cher::MOUSE_MODE m_mousePrevious;
     osg::ref_ptr<Manipulator> m_manipulator;
     osg::ref_ptr<EventHandler> m_EH;
+    osg::ref_ptr<EventRecorder> m_recorder;
+    osg::ref_ptr<HUDCamera> m_hud;
+    osg::ref_ptr<osgText::Text> m_hudText;
 
     //QStack<osg::Matrixd> m_stackView;
 
@@ -21,6 +21,8 @@
 #include "Settings.h"
 #include "Data.h"
 #include "Utilities.h"
+#include "LatencyMonitor.h"
+#include "PhotoStore.h"
 
 MainWindow* MainWindow::m_instance = nullptr;
 
@@ -43,6 +45,8 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
     , m_glWidget(new GLWidget(m_rootScene.get(), m_viewStack))
     , m_cameraProperties( new CameraProperties(60.f, this) )
     , m_colorDialog(new QColorDialog(this))
+    , m_autosave(new entity::SceneAutosave(m_rootScene.get(), this))
+    , m_updateScheduled(false)
 {
     /* singleton check and setup */
     Q_ASSERT_X(m_instance == 0, "MainWindow ctor", "MainWindow is a singleton and cannot be created more than once");
@@ -93,6 +97,9 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
     m_colorDialog->setCurrentColor(Utilities::getQColor(cher::POLYGON_CLR_NORMALFILL));
 //    m_colorDialog->move(this->width(), this->height());
 
+    /* periodic autosave in background */
+    m_autosave->start();
+
     // test adding second window
 //    GLWidget* widget = new GLWidget(m_rootScene, m_viewStack, this);
 //    QMdiSubWindow* subwin2 = m_mdiArea->addSubWindow(widget);
@@ -103,6 +110,8 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
 
 MainWindow::~MainWindow()
 {
+    /* the evicted photo images are not needed by the next session */
+    entity::PhotoStore::instance().clearCache();
     m_instance = nullptr;
 }
 
@@ -185,6 +194,19 @@ void MainWindow::onRequestUpdate()
     m_glWidget->update();
 }
 
+void MainWindow::requestUpdateLater(int msec)
+{
+    if (m_updateScheduled) return;
+    m_updateScheduled = true;
+    QTimer::singleShot(msec, this, SLOT(onUpdateScheduled()));
+}
+
+void MainWindow::onUpdateScheduled()
+{
+    m_updateScheduled = false;
+    this->onRequestUpdate();
+}
+
 void MainWindow::onAutoSwitchMode(cher::MOUSE_MODE mode)
 {
     switch (mode){
@@ -484,7 +506,7 @@ void MainWindow::onFileNew()
 void MainWindow::onFileOpen()
 {
     QString fname = QFileDialog::getOpenFileName(this, tr("Open a scene from file"),
-                                                 QString(), tr("OSG files (*.osg *.osgt)"));
+                                                 QString(), tr("Scene files (*.cher *.osg *.osgt)"));
     if (!fname.isEmpty()){
         this->onFileClose();
         m_rootScene->setFilePath(fname.toStdString());
@@ -507,7 +529,7 @@ void MainWindow::onFileSave()
 {
     if (!m_rootScene->isSetFilePath()){
         QString fname = QFileDialog::getSaveFileName(this, tr("Saving scene to file"),
-                                                     QString(), tr("OSG file (*.osgt)"));
+                                                     QString(), tr("Cherish file (*.cher);;OSG file (*.osgt)"));
         if (fname.isEmpty()){
             QMessageBox::warning(this, tr("Chosing filename"), tr("No file name is chosen. Changes were not saved."));
             this->statusBar()->showMessage(tr("Scene was not saved to file"));
@@ -521,6 +543,7 @@ void MainWindow::onFileSave()
         this->statusBar()->showMessage(tr("Scene was not saved to file"));
         return;
     }
+    m_autosave->discard();
     this->statusBar()->showMessage(tr("Scene was successfully saved to file"));
 }
 
@@ -558,7 +581,7 @@ void MainWindow::onFileImage()
         return;
     }
     QString fileName = QFileDialog::getOpenFileName(this, tr("Load an Image File"), QString(),
-            tr("Image Files (*.bmp)"));
+            tr("Image Files (%1)").arg(cher::PHOTO_FILE_FILTERS));
 
     this->importPhoto(fileName);
 }
@@ -581,6 +604,30 @@ void MainWindow::onFilePhotoBase()
     this->statusBar()->showMessage(tr("Start dragging photos one-by-one to the current canvas to perfrom a photo import to the scene."));
 }
 
+void MainWindow::onFileRecordEvents()
+{
+    if (m_actionRecordEvents->isChecked()){
+        m_glWidget->setRecording(true);
+        this->statusBar()->showMessage(tr("Recording of input events is started."));
+        return;
+    }
+
+    m_glWidget->setRecording(false);
+    EventRecorder* recorder = m_glWidget->getEventRecorder();
+    QString fname = QFileDialog::getSaveFileName(this, tr("Saving recorded events"), QString(),
+                                                 tr("Event recordings (*.events)"));
+    if (fname.isEmpty()){
+        this->statusBar()->showMessage(tr("Recorded events were not saved."));
+        return;
+    }
+    if (!recorder->write(fname.toStdString())){
+        QMessageBox::critical(this, tr("Error"), tr("Could not write recorded events to file"));
+        return;
+    }
+    this->statusBar()->showMessage(tr("Recorded %1 events within %2 frames.").arg(recorder->getRecords().size())
+                                   .arg(recorder->getNumFrames()));
+}
+
 void MainWindow::onFileClose()
 {
     qDebug("onFileClose() called");
@@ -594,6 +641,7 @@ void MainWindow::onFileClose()
         if (!m_rootScene->isSavedToFile() && reply==QMessageBox::Yes)
             return;
     }
+    m_autosave->discard();
     m_rootScene->clearUserData();
 
     m_undoStack->clear();
@@ -991,6 +1039,39 @@ void MainWindow::onStrokeFogFactor()
     }
 }
 
+void MainWindow::onLatency()
+{
+    entity::LatencyMonitor::instance().setEnabled(m_actionLatency->isChecked());
+    m_glWidget->update();
+}
+
+void MainWindow::onLatencySave()
+{
+    const entity::LatencyMonitor& latency = entity::LatencyMonitor::instance();
+    if (!latency.getEnabled() || latency.getNumSamples() == 0){
+        QMessageBox::information(this, tr("Input latency"),
+                                 tr("No latency was measured. Enable Options > Show input latency and sketch first."));
+        return;
+    }
+    QString fname = QFileDialog::getSaveFileName(this, tr("Saving input latency"), QString(),
+                                                 tr("Text files (*.txt *.csv)"));
+    if (fname.isEmpty()){
+        this->statusBar()->showMessage(tr("Input latency was not saved."));
+        return;
+    }
+    if (!latency.write(fname.toStdString())){
+        QMessageBox::critical(this, tr("Error"), tr("Could not write input latency to file"));
+        return;
+    }
+    this->statusBar()->showMessage(tr("Input latency of %1 pen events was saved.").arg(latency.getNumSamples()));
+}
+
+void MainWindow::onAutosaved(const QString &path, int snapshot, int write)
+{
+    qDebug() << "Autosaved to" << path;
+    this->statusBar()->showMessage(tr("Scene was autosaved (snapshot %1 ms, write %2 ms)").arg(snapshot).arg(write), 5000);
+}
+
 void MainWindow::initializeActions()
 {
     // FILE
@@ -1027,6 +1108,11 @@ void MainWindow::initializeActions()
     m_actionPhotoBase = new QAction(Data::controlImagesIcon(), tr("Chose folder with photo base..."), this);
     this->connect(m_actionPhotoBase, SIGNAL(triggered(bool)), this, SLOT(onFilePhotoBase()));
 
+    m_actionRecordEvents = new QAction(tr("Record input events"), this);
+    m_actionRecordEvents->setCheckable(true);
+    m_actionRecordEvents->setChecked(false);
+    this->connect(m_actionRecordEvents, SIGNAL(toggled(bool)), this, SLOT(onFileRecordEvents()));
+
     // EDIT
 
     m_actionUndo = m_undoStack->createUndoAction(this, tr("&Undo"));
@@ -1144,6 +1230,14 @@ void MainWindow::initializeActions()
     m_actionStrokeFogFactor->setChecked(false);
     this->connect(m_actionStrokeFogFactor, SIGNAL(toggled(bool)), this, SLOT(onStrokeFogFactor()));
 
+    m_actionLatency = new QAction(tr("Show input latency"), this);
+    m_actionLatency->setCheckable(true);
+    m_actionLatency->setChecked(false);
+    this->connect(m_actionLatency, SIGNAL(toggled(bool)), this, SLOT(onLatency()));
+
+    m_actionLatencySave = new QAction(tr("Save input latency..."), this);
+    this->connect(m_actionLatencySave, SIGNAL(triggered(bool)), this, SLOT(onLatencySave()));
+
 }
 
 void MainWindow::initializeMenus()
@@ -1159,6 +1253,7 @@ void MainWindow::initializeMenus()
     menuFile->addSeparator();
     menuFile->addAction(m_actionImportImage);
     menuFile->addAction(m_actionPhotoBase);
+    menuFile->addAction(m_actionRecordEvents);
     menuFile->addSeparator();
     menuFile->addAction(m_actionClose);
     menuFile->addAction(m_actionExit);
@@ -1236,7 +1331,9 @@ void MainWindow::initializeMenus()
     QMenu* submenuVisuals = menuOptions->addMenu("Visuals");
     submenuVisuals->setIcon(Data::optionsVisibilityIcon());
     submenuVisuals->addAction(m_actionStrokeFogFactor);
-
+    menuOptions->addSeparator();
+    menuOptions->addAction(m_actionLatency);
+    menuOptions->addAction(m_actionLatencySave);
 }
 
 void MainWindow::initializeToolbars()
@@ -1417,6 +1514,10 @@ void MainWindow::initializeCallbacks()
                      this, SLOT(onRequestSceneStateSet(entity::SceneState*)),
                      Qt::UniqueConnection);
 
+    QObject::connect(m_autosave, SIGNAL(autosaved(QString,int,int)),
+                     this, SLOT(onAutosaved(QString,int,int)),
+                     Qt::UniqueConnection);
+
     /* canvas widget area */
     QObject::connect(m_rootScene->getUserScene(), SIGNAL(canvasAdded(std::string)),
                      m_canvasWidget, SLOT(onCanvasAdded(std::string)),
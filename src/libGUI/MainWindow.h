@@ -19,6 +19,7 @@
 #include <osg/Camera>
 
 #include "RootScene.h"
+#include "SceneAutosave.h"
 #include "Settings.h"
 #include "GLWidget.h"
 #include "CameraProperties.h"
@@ -80,6 +81,10 @@ public:
     /*! A method to obtain a pointer on bookmark widget. */
     BookmarkWidget* getBookmarkWidget();
 
+    /*! A method to request an update of GLWidget after the given delay, e.g., to poll background jobs from
+     * cull callbacks. The requests are coalesced: only one update is scheduled at a time. */
+    void requestUpdateLater(int msec);
+
 public slots:
     /*! Slot called whenver CherishApplication catches change of tablet proximity. */
     void onSetTabletActivity(bool active);
@@ -158,6 +163,7 @@ protected slots:
     void onFileExport();
     void onFileImage();
     void onFilePhotoBase();
+    void onFileRecordEvents();
     void onFileClose();
     void onFileExit();
 
@@ -209,6 +215,13 @@ protected slots:
     void onBookmarkEdit(const QString& name);
 
     void onStrokeFogFactor();
+    void onLatency();
+    void onLatencySave();
+
+    void onAutosaved(const QString& path, int snapshot, int write);
+
+protected slots:
+    void onUpdateScheduled();
 
 protected:
     void        initializeActions();
@@ -247,7 +260,8 @@ protected:
     // FILE actions
     QAction * m_actionNewFile, * m_actionClose, * m_actionExit,
             * m_actionImportImage, * m_actionOpenFile, * m_actionSaveFile,
-            * m_actionSaveAsFile, * m_actionExportAs, * m_actionPhotoBase;
+            * m_actionSaveAsFile, * m_actionExportAs, * m_actionPhotoBase,
+            * m_actionRecordEvents;
 
     // EDIT actions
     QAction * m_actionUndo, * m_actionRedo, * m_actionCut, * m_actionCopy,
@@ -275,11 +289,15 @@ protected:
 
     // OPTION actions
     QAction* m_actionStrokeFogFactor;
+    QAction * m_actionLatency, * m_actionLatencySave;
 
     CameraProperties*   m_cameraProperties;
 
     QColorDialog*       m_colorDialog;
 
+    entity::SceneAutosave* m_autosave;
+    bool m_updateScheduled;
+
     static MainWindow* m_instance;
 };
 
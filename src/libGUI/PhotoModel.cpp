@@ -7,9 +7,46 @@
 #include <QByteArray>
 #include <QDataStream>
 #include <QDrag>
+#include <QDateTime>
+#include <QImageReader>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QtConcurrent/QtConcurrentMap>
 
 #include "Settings.h"
 
+/* runs within the thread pool, so it only uses QImage which is safe outside of GUI thread */
+static PhotoModel::Thumbnail makeThumbnail(const PhotoModel::Thumbnail& job)
+{
+    PhotoModel::Thumbnail result = job;
+    QSize size(cher::APP_WIDGET_ICONSIZE_W * cher::DPI_SCALING, cher::APP_WIDGET_ICONSIZE_H * cher::DPI_SCALING);
+
+    QFileInfo info(job.path);
+    QByteArray key = info.absoluteFilePath().toUtf8() + '|'
+            + QByteArray::number(info.lastModified().toMSecsSinceEpoch()) + '|'
+            + QByteArray::number(size.width()) + 'x' + QByteArray::number(size.height());
+    QString cached = QDir(PhotoModel::getCacheDirectory()).filePath(
+                QString(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex()) + ".png");
+
+    if (result.image.load(cached, "PNG") && result.image.size() == size)
+        return result;
+
+    /* the reader decodes at reduced resolution when the format allows it, e.g., JPEG */
+    QImageReader reader(job.path);
+    reader.setScaledSize(size);
+    if (!reader.read(&result.image)){
+        qWarning() << "PhotoModel: could not read " << job.path << ": " << reader.errorString();
+        result.image = QImage();
+        return result;
+    }
+    if (result.image.size() != size)
+        result.image = result.image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    if (!result.image.save(cached, "PNG"))
+        qWarning() << "PhotoModel: could not cache thumbnail " << cached;
+    return result;
+}
+
 PhotoModel::PhotoModel()
     : QStandardItemModel()
 {
@@ -18,26 +55,45 @@ PhotoModel::PhotoModel()
 //    filters << "*.bmp";
 //    this->setNameFilters(filters);
 //    this->setNameFilterDisables(false);
+
+    QObject::connect(&m_watcher, SIGNAL(resultReadyAt(int)), this, SLOT(onThumbnailReady(int)));
+    QObject::connect(&m_watcher, SIGNAL(finished()), this, SLOT(onThumbnailsFinished()));
+}
+
+PhotoModel::~PhotoModel()
+{
+    m_watcher.cancel();
+    m_watcher.waitForFinished();
 }
 
 void PhotoModel::setRootPath(const QString &directory)
 {
+    m_watcher.cancel();
+    m_watcher.waitForFinished();
+
     this->clear();
     m_directory.clear();
 
     m_directory = directory;
 
     QDir dir(directory);
-    QFileInfoList fileList = dir.entryInfoList(QStringList() << "*.bmp", QDir::Files);
+    /* without QDir::CaseSensitive the name filters match any case, e.g., IMG_0001.JPG from a camera */
+    QFileInfoList fileList = dir.entryInfoList(cher::PHOTO_FILE_FILTERS.split(' '), QDir::Files);
+    QDir().mkpath(PhotoModel::getCacheDirectory());
+
+    /* all the items are shown at once, the icons are set when the thumbnails are ready */
+    QPixmap empty(cher::APP_WIDGET_ICONSIZE_W * cher::DPI_SCALING, cher::APP_WIDGET_ICONSIZE_H * cher::DPI_SCALING);
+    empty.fill(Qt::transparent);
+    QList<Thumbnail> jobs;
     int fileCount = fileList.size();
     for (int i=0; i<fileCount; ++i){
-        QPixmap originalImage(fileList[i].filePath());
-        if (!originalImage.isNull()){
-            QPixmap scaledImage = originalImage.scaled(cher::APP_WIDGET_ICONSIZE_W * cher::DPI_SCALING,
-                                                       cher::APP_WIDGET_ICONSIZE_H * cher::DPI_SCALING);
-            this->setItem(i, new QStandardItem(QIcon(scaledImage), fileList[i].fileName()));
-        }
+        this->setItem(i, new QStandardItem(QIcon(empty), fileList[i].fileName()));
+        Thumbnail job;
+        job.row = i;
+        job.path = fileList[i].filePath();
+        jobs.push_back(job);
     }
+    m_watcher.setFuture(QtConcurrent::mapped(jobs, makeThumbnail));
 }
 
 const QString &PhotoModel::getRootPath() const
@@ -45,6 +101,23 @@ const QString &PhotoModel::getRootPath() const
     return m_directory;
 }
 
+bool PhotoModel::isLoading() const
+{
+    return m_watcher.isRunning();
+}
+
+void PhotoModel::waitForThumbnails()
+{
+    m_watcher.waitForFinished();
+    for (int i=0; i<m_watcher.future().resultCount(); ++i)
+        this->onThumbnailReady(i);
+}
+
+QString PhotoModel::getCacheDirectory()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath(cher::PHOTO_THUMBNAIL_CACHE);
+}
+
 Qt::DropActions PhotoModel::supportedDragActions() const
 {
     return Qt::CopyAction;
@@ -86,3 +159,22 @@ QMimeData *PhotoModel::mimeData(const QModelIndexList &indexes) const
     mimeData->setData(cher::MIME_PHOTO, encodedData);
     return mimeData;
 }
+
+void PhotoModel::onThumbnailReady(int index)
+{
+    Thumbnail thumbnail = m_watcher.resultAt(index);
+    QStandardItem* item = this->item(thumbnail.row);
+    if (!item) return;
+
+    /* files which cannot be read stay in the list, but cannot be dragged to the scene */
+    if (thumbnail.image.isNull())
+        item->setEnabled(false);
+    else
+        item->setIcon(QIcon(QPixmap::fromImage(thumbnail.image)));
+}
+
+void PhotoModel::onThumbnailsFinished()
+{
+    if (m_watcher.isCanceled()) return;
+    emit this->thumbnailsLoaded();
+}
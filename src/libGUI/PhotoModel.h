@@ -11,24 +11,69 @@
 #include <QDropEvent>
 #include <QMimeData>
 #include <QModelIndexList>
+#include <QImage>
+#include <QFutureWatcher>
 
 // drag and drop additional info: http://doc.qt.io/qt-5/model-view-programming.html#using-drag-and-drop-with-item-views
 
+/*! \class PhotoModel
+ * \brief Model of the photo base directory: one item per image file with its thumbnail as icon.
+ *
+ * setRootPath() lists the directory and adds all the items at once with an empty icon; the thumbnails are
+ * produced by the global thread pool and set to the items as they are finished. Every thumbnail is cached
+ * within the application cache location under a key made of the file path, its modification time and size,
+ * so that re-opening the same directory only reads the small cached images.
+*/
 class PhotoModel : public QStandardItemModel
 {
+    Q_OBJECT
+
 public:
     PhotoModel();
 
+    /*! Destructor cancels the thumbnail generation and waits for the running jobs. */
+    ~PhotoModel();
+
+    /*! A method to fill the model with the images of the directory, see cher::PHOTO_FILE_FILTERS. The previous
+     * thumbnail generation is cancelled; the method returns before the thumbnails are ready. */
     void setRootPath(const QString& directory);
     const QString& getRootPath() const;
 
+    /*! \return true if thumbnails are still being generated. */
+    bool isLoading() const;
+
+    /*! A method to block until all the thumbnails are generated and set. */
+    void waitForThumbnails();
+
+    /*! \return directory of the thumbnail cache. */
+    static QString getCacheDirectory();
+
     virtual Qt::DropActions supportedDragActions() const;
     virtual Qt::ItemFlags flags(const QModelIndex &index) const;
     virtual QStringList mimeTypes() const;
     virtual QMimeData* mimeData(const QModelIndexList &indexes) const;
 
+    /*! \struct Thumbnail
+     * \brief Result of a thumbnail job: the row of the item and the scaled image, which is null if the file
+     * could not be read. */
+    struct Thumbnail
+    {
+        int row;
+        QString path;
+        QImage image;
+    };
+
+signals:
+    /*! A signal which is emitted once all the thumbnails of the directory are set. */
+    void thumbnailsLoaded();
+
+protected slots:
+    void onThumbnailReady(int index);
+    void onThumbnailsFinished();
+
 private:
     QString m_directory;
+    QFutureWatcher<Thumbnail> m_watcher;
 };
 
 #endif // PHOTOMODEL_H
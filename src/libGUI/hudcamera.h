@@ -51,6 +51,10 @@ public:
         return _switch->getChildValue(_switch->getChild(0));
     }
 
+    void setProjection(double left, double right, double bottom, double top){
+        _camera->setProjectionMatrix(osg::Matrix::ortho2D(left,right,bottom,top));
+    }
+
     bool setText(osg::Geode* text){
         if (!text){
             osg::notify(osg::WARN) << "setText(): text pointer is NULL" << std::endl;
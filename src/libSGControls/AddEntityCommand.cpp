@@ -128,6 +128,7 @@ fur::AddCanvasSeparationCommand::AddCanvasSeparationCommand(entity::UserScene *s
     m_target->setName(copy->getName());
     m_target->setMatrixRotation(copy->getMatrixRotation());
     m_target->setMatrixTranslation(copy->getMatrixTranslation());
+    m_target->setMatrixOffset(copy->getMatrixOffset());
 
     this->setText(QObject::tr("Separate to canvas %1") .arg(QString(m_target->getName().c_str())));
     for (size_t i=0; i<copy->getNumEntities(); ++i){
@@ -16,12 +16,14 @@ fur::EditCanvasOffsetCommand::EditCanvasOffsetCommand(entity::UserScene *scene,
 void fur::EditCanvasOffsetCommand::undo()
 {
     m_canvas->translate(osg::Matrix::translate(-m_translate.x(), -m_translate.y(), -m_translate.z()));
+    m_canvas->setDirty(true);
     m_scene->updateWidgets();
 }
 
 void fur::EditCanvasOffsetCommand::redo()
 {
     m_canvas->translate(osg::Matrix::translate(m_translate.x(), m_translate.y(), m_translate.z()));
+    m_canvas->setDirty(true);
     m_scene->updateWidgets();
 }
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
@@ -44,12 +46,14 @@ void fur::EditCanvasRotateCommand::undo()
     osg::Vec3d axis;
     m_rotate.getRotate(angle, axis);
     m_canvas->rotate(osg::Matrix::rotate(-angle, axis), m_center);
+    m_canvas->setDirty(true);
     m_scene->updateWidgets();
 }
 
 void fur::EditCanvasRotateCommand::redo()
 {
     m_canvas->rotate(osg::Matrix::rotate(m_rotate), m_center);
+    m_canvas->setDirty(true);
     m_scene->updateWidgets();
 }
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
@@ -96,6 +100,7 @@ void fur::EditStrokesPushCommand::doPushStrokes(entity::Canvas& source, entity::
     for (unsigned int i=0; i<m_entities.size(); ++i){
         entity::Stroke* stroke = dynamic_cast<entity::Stroke*> (m_entities.at(i));
         if (!stroke) continue;
+        stroke->detachArrays();
         osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(stroke->getVertexArray());
         for (unsigned int j=0; j<verts->size(); ++j){
             osg::Vec3f p = (*verts)[j];
@@ -106,11 +111,12 @@ void fur::EditStrokesPushCommand::doPushStrokes(entity::Canvas& source, entity::
             osg::Vec3f p_ = P_ * invM;
             (*verts)[j] = osg::Vec3f(p_.x(), p_.y(), 0.f);
         }
-        m_scene->addEntity(&target, stroke);
-        m_scene->removeEntity(&source, stroke);
-
+        /* the bound is updated before the stroke is bounded by the target canvas */
         verts->dirty();
         stroke->dirtyBound();
+
+        m_scene->addEntity(&target, stroke);
+        m_scene->removeEntity(&source, stroke);
     }
     target.updateFrame();
 }
@@ -202,6 +208,7 @@ fur::EditEntitiesMoveCommand::EditEntitiesMoveCommand(entity::UserScene *scene,
 void fur::EditEntitiesMoveCommand::undo()
 {
     m_canvas->moveEntities(m_entities, -m_du, -m_dv);
+    m_canvas->setDirty(true);
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
@@ -209,6 +216,7 @@ void fur::EditEntitiesMoveCommand::undo()
 void fur::EditEntitiesMoveCommand::redo()
 {
     m_canvas->moveEntities(m_entities, m_du, m_dv);
+    m_canvas->setDirty(true);
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
@@ -231,6 +239,7 @@ fur::EditEntitiesScaleCommand::EditEntitiesScaleCommand(entity::UserScene *scene
 void fur::EditEntitiesScaleCommand::undo()
 {
     m_canvas->scaleEntities(m_entities, 1/m_scaleX, 1/m_scaleY, m_center);
+    m_canvas->setDirty(true);
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
@@ -238,6 +247,7 @@ void fur::EditEntitiesScaleCommand::undo()
 void fur::EditEntitiesScaleCommand::redo()
 {
     m_canvas->scaleEntities(m_entities, m_scaleX, m_scaleY, m_center);
+    m_canvas->setDirty(true);
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
@@ -259,6 +269,7 @@ fur::EditEntitiesRotateCommand::EditEntitiesRotateCommand(entity::UserScene *sce
 void fur::EditEntitiesRotateCommand::undo()
 {
     m_canvas->rotateEntities(m_entities, -m_theta, m_center);
+    m_canvas->setDirty(true);
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
@@ -266,6 +277,7 @@ void fur::EditEntitiesRotateCommand::undo()
 void fur::EditEntitiesRotateCommand::redo()
 {
     m_canvas->rotateEntities(m_entities, m_theta, m_center);
+    m_canvas->setDirty(true);
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
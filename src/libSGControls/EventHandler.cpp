@@ -12,6 +12,7 @@
 #include <QMessageBox>
 
 #include "Utilities.h"
+#include "LatencyMonitor.h"
 
 EventHandler::EventHandler(GLWidget *widget, RootScene* scene, cher::MOUSE_MODE mode)
     : osgGA::GUIEventHandler()
@@ -261,6 +262,9 @@ void EventHandler::doSketch(const osgGA::GUIEventAdapter &ea, osgGA::GUIActionAd
            ))
         return;
 
+    /* the event time is set by the event queue when GLWidget receives the pen or mouse event */
+    entity::LatencyMonitor::instance().markHandled(ea.getTime());
+
     double u=0, v=0;
     switch (ea.getEventType()){
     case osgGA::GUIEventAdapter::PUSH:
@@ -423,15 +427,17 @@ void EventHandler::doEditCanvasRotate(const osgGA::GUIEventAdapter &ea, osgGA::G
         return;
 
     osg::Vec3f P = osg::Vec3f(0.f,0.f,0.f);
-    osg::Vec3f center = m_scene->getCanvasCurrent()->getCenter();
-    osg::Matrix M = m_scene->getCanvasCurrent()->getTransform()->getMatrix();
+    osg::Vec3f center = canvas->getCenter();
 
-    alongAxis = alongAxis * M - center;
+    /* the local axes are directions, so the local offset of the canvas does not apply to them */
+    osg::Vec3f U = canvas->getGlobalAxisU();
+    osg::Vec3f V = canvas->getGlobalAxisV();
+    alongAxis = U * alongAxis.x() + V * alongAxis.y();
     alongAxis.normalize();
     if (!this->getRaytracePlaneIntersection(ea, aa, alongAxis, P))
         return;
 
-    rotAxis = rotAxis * M - center;
+    rotAxis = U * rotAxis.x() + V * rotAxis.y();
     rotAxis.normalize();
 
     osg::Vec3f new_axis = P - center;
@@ -919,6 +925,7 @@ void EventHandler::doPhotoScaleBookmark(const osgGA::GUIEventAdapter &ea, osgGA:
 
             // do a photo re-scaling using SVM and camera pose
             photo->scaleAndPositionWith(svm, eye, center, up);
+            canvas->updateBounds(std::vector<entity::Entity2D*>(1, photo));
 
             // remove SVMData from scene, it will not be used again
             bool removed = m_scene->removePhotoScaleData();
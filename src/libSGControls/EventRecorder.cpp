@@ -0,0 +1,246 @@
+#include "EventRecorder.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QtGlobal>
+#include <QDebug>
+
+#include "EventHandler.h"
+
+namespace {
+const char* RECORDING_MAGIC = "cherish-events";
+const int RECORDING_VERSION = 1;
+const int RECORDING_FIELDS = 23; /* numbers per event line */
+}
+
+EventRecorder::EventRecorder(EventHandler *handler)
+    : osgGA::GUIEventHandler()
+    , m_handler(handler)
+    , m_records()
+    , m_recording(false)
+    , m_start(-1)
+    , m_eye(0,0,0)
+    , m_center(0,0,0)
+    , m_up(0,0,1)
+    , m_fov(60.0)
+    , m_width(0)
+    , m_height(0)
+    , m_scene("")
+{
+}
+
+bool EventRecorder::handle(const osgGA::GUIEventAdapter &ea, osgGA::GUIActionAdapter &aa)
+{
+    if (!m_recording || !m_handler.valid()) return false;
+
+    /* the time is counted from the first event, so that the replay does not depend on the queue start */
+    if (m_start < 0) m_start = ea.getTime();
+    Record record;
+    record.event = new osgGA::GUIEventAdapter(ea, osg::CopyOp::SHALLOW_COPY);
+    record.event->setTime(ea.getTime() - m_start);
+    record.mode = m_handler->getMode();
+    m_records.push_back(record);
+    return false;
+}
+
+void EventRecorder::start(const osg::Vec3d &eye, const osg::Vec3d &center, const osg::Vec3d &up, double fov,
+                          int width, int height, const std::string &scene)
+{
+    m_records.clear();
+    m_start = -1;
+    m_eye = eye;
+    m_center = center;
+    m_up = up;
+    m_fov = fov;
+    m_width = width;
+    m_height = height;
+    m_scene = scene;
+    m_recording = true;
+}
+
+void EventRecorder::stop()
+{
+    m_recording = false;
+}
+
+bool EventRecorder::isRecording() const
+{
+    return m_recording;
+}
+
+bool EventRecorder::write(const std::string &path) const
+{
+    QSaveFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)){
+        qWarning("EventRecorder: could not open file for writing");
+        return false;
+    }
+
+    QTextStream out(&file);
+    out.setRealNumberPrecision(12);
+    out << RECORDING_MAGIC << " " << RECORDING_VERSION << "\n";
+    out << "view " << m_eye.x() << " " << m_eye.y() << " " << m_eye.z() << " "
+        << m_center.x() << " " << m_center.y() << " " << m_center.z() << " "
+        << m_up.x() << " " << m_up.y() << " " << m_up.z() << " " << m_fov << "\n";
+    out << "viewport " << m_width << " " << m_height << "\n";
+    out << "scene " << QString::fromStdString(m_scene) << "\n";
+    out << "events " << m_records.size() << "\n";
+
+    /* time type mode x y xmin ymin xmax ymax orientation button buttonmask key unmodifiedkey modkeymask
+     * pressure tiltx tilty rotation pointer scrolling dx dy */
+    for (const auto& record : m_records){
+        const osgGA::GUIEventAdapter* ea = record.event.get();
+        out << ea->getTime() << " " << ea->getEventType() << " " << record.mode << " "
+            << ea->getX() << " " << ea->getY() << " "
+            << ea->getXmin() << " " << ea->getYmin() << " " << ea->getXmax() << " " << ea->getYmax() << " "
+            << ea->getMouseYOrientation() << " " << ea->getButton() << " " << ea->getButtonMask() << " "
+            << ea->getKey() << " " << ea->getUnmodifiedKey() << " " << ea->getModKeyMask() << " "
+            << ea->getPenPressure() << " " << ea->getPenTiltX() << " " << ea->getPenTiltY() << " "
+            << ea->getPenRotation() << " " << ea->getTabletPointerType() << " "
+            << ea->getScrollingMotion() << " " << ea->getScrollingDeltaX() << " " << ea->getScrollingDeltaY() << "\n";
+    }
+
+    out.flush();
+    if (out.status() != QTextStream::Ok || !file.commit()){
+        qWarning("EventRecorder: could not write file");
+        return false;
+    }
+    return true;
+}
+
+bool EventRecorder::read(const std::string &path)
+{
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)){
+        qWarning("EventRecorder: could not open file for reading");
+        return false;
+    }
+    QTextStream in(&file);
+
+    QStringList magic = in.readLine().split(' ');
+    if (magic.size() != 2 || magic[0] != RECORDING_MAGIC || magic[1].toInt() != RECORDING_VERSION){
+        qWarning("EventRecorder: unknown file format or version");
+        return false;
+    }
+
+    QStringList view = in.readLine().split(' ', QString::SkipEmptyParts);
+    QStringList viewport = in.readLine().split(' ', QString::SkipEmptyParts);
+    QString scene = in.readLine();
+    QStringList events = in.readLine().split(' ', QString::SkipEmptyParts);
+    if (view.size() != 11 || view[0] != "view" || viewport.size() != 3 || viewport[0] != "viewport"
+            || !scene.startsWith("scene") || events.size() != 2 || events[0] != "events"){
+        qWarning("EventRecorder: file header is corrupted");
+        return false;
+    }
+
+    std::vector<Record> records;
+    int size = events[1].toInt();
+    for (int i=0; i<size; ++i){
+        QStringList fields = in.readLine().split(' ', QString::SkipEmptyParts);
+        if (fields.size() != RECORDING_FIELDS){
+            qWarning("EventRecorder: event line is corrupted");
+            return false;
+        }
+        osg::ref_ptr<osgGA::GUIEventAdapter> ea = new osgGA::GUIEventAdapter;
+        ea->setTime(fields[0].toDouble());
+        ea->setEventType(static_cast<osgGA::GUIEventAdapter::EventType>(fields[1].toInt()));
+        ea->setX(fields[3].toFloat());
+        ea->setY(fields[4].toFloat());
+        ea->setInputRange(fields[5].toFloat(), fields[6].toFloat(), fields[7].toFloat(), fields[8].toFloat());
+        ea->setMouseYOrientation(static_cast<osgGA::GUIEventAdapter::MouseYOrientation>(fields[9].toInt()));
+        ea->setButton(fields[10].toInt());
+        ea->setButtonMask(fields[11].toInt());
+        ea->setKey(fields[12].toInt());
+        ea->setUnmodifiedKey(fields[13].toInt());
+        ea->setModKeyMask(fields[14].toInt());
+        ea->setPenPressure(fields[15].toFloat());
+        ea->setPenTiltX(fields[16].toFloat());
+        ea->setPenTiltY(fields[17].toFloat());
+        ea->setPenRotation(fields[18].toFloat());
+        ea->setTabletPointerType(static_cast<osgGA::GUIEventAdapter::TabletPointerType>(fields[19].toInt()));
+        ea->setScrollingMotion(static_cast<osgGA::GUIEventAdapter::ScrollingMotion>(fields[20].toInt()));
+        ea->setScrollingMotionDelta(fields[21].toFloat(), fields[22].toFloat());
+
+        Record record;
+        record.event = ea;
+        record.mode = static_cast<cher::MOUSE_MODE>(fields[2].toInt());
+        records.push_back(record);
+    }
+
+    m_recording = false;
+    m_start = -1;
+    m_records.swap(records);
+    m_eye = osg::Vec3d(view[1].toDouble(), view[2].toDouble(), view[3].toDouble());
+    m_center = osg::Vec3d(view[4].toDouble(), view[5].toDouble(), view[6].toDouble());
+    m_up = osg::Vec3d(view[7].toDouble(), view[8].toDouble(), view[9].toDouble());
+    m_fov = view[10].toDouble();
+    m_width = viewport[1].toInt();
+    m_height = viewport[2].toInt();
+    m_scene = scene.mid(QString("scene ").size()).toStdString();
+    return true;
+}
+
+osgGA::GUIEventAdapter *EventRecorder::createEvent(const EventRecorder::Record &record, osgGA::EventQueue *queue,
+                                                   double start)
+{
+    /* the queue state provides the graphics context, so that the viewer finds the camera of the event */
+    const osgGA::GUIEventAdapter* ea = record.event.get();
+    osgGA::GUIEventAdapter* event = queue->createEvent();
+    event->setTime(start + ea->getTime());
+    event->setEventType(ea->getEventType());
+    event->setInputRange(ea->getXmin(), ea->getYmin(), ea->getXmax(), ea->getYmax());
+    event->setX(ea->getX());
+    event->setY(ea->getY());
+    event->setMouseYOrientation(ea->getMouseYOrientation());
+    event->setButton(ea->getButton());
+    event->setButtonMask(ea->getButtonMask());
+    event->setKey(ea->getKey());
+    event->setUnmodifiedKey(ea->getUnmodifiedKey());
+    event->setModKeyMask(ea->getModKeyMask());
+    event->setPenPressure(ea->getPenPressure());
+    event->setPenTiltX(ea->getPenTiltX());
+    event->setPenTiltY(ea->getPenTiltY());
+    event->setPenRotation(ea->getPenRotation());
+    event->setTabletPointerType(ea->getTabletPointerType());
+    event->setScrollingMotion(ea->getScrollingMotion());
+    event->setScrollingMotionDelta(ea->getScrollingDeltaX(), ea->getScrollingDeltaY());
+    return event;
+}
+
+const std::vector<EventRecorder::Record> &EventRecorder::getRecords() const
+{
+    return m_records;
+}
+
+unsigned int EventRecorder::getNumFrames() const
+{
+    unsigned int frames = 0;
+    for (const auto& record : m_records)
+        if (record.event->getEventType() == osgGA::GUIEventAdapter::FRAME) ++frames;
+    return frames;
+}
+
+void EventRecorder::getCameraView(osg::Vec3d &eye, osg::Vec3d &center, osg::Vec3d &up, double &fov) const
+{
+    eye = m_eye;
+    center = m_center;
+    up = m_up;
+    fov = m_fov;
+}
+
+int EventRecorder::getWidth() const
+{
+    return m_width;
+}
+
+int EventRecorder::getHeight() const
+{
+    return m_height;
+}
+
+const std::string &EventRecorder::getScene() const
+{
+    return m_scene;
+}
@@ -0,0 +1,94 @@
+#ifndef EVENTRECORDER_H
+#define EVENTRECORDER_H
+
+#include <string>
+#include <vector>
+
+#include <osgGA/GUIEventHandler>
+#include <osgGA/GUIEventAdapter>
+#include <osgGA/GUIActionAdapter>
+#include <osgGA/EventQueue>
+#include <osg/ref_ptr>
+#include <osg/observer_ptr>
+#include <osg/Vec3d>
+
+#include "Settings.h"
+
+class EventHandler;
+
+/*! \class EventRecorder
+ * \brief Recorder of the OSG event stream which goes into EventHandler, so that an interactive session can be
+ * replayed deterministically, see GLWidget::replay().
+ *
+ * The recorder is added to the viewer before EventHandler and never consumes an event. While recording, it keeps
+ * a copy of every mouse, tablet and keyboard event together with the mouse mode which was set at the time; the
+ * frame events are kept as markers, so that the replay processes the same events per frame as the session did.
+ * The camera view, the viewport size and the scene file at the start are kept as well, since the event
+ * coordinates only make sense for them. Note, the keys which are processed by GLWidget itself (e.g., home view)
+ * are not passed to the viewer and are not recorded.
+ *
+ * The recording is saved as a text file, one event per line, see write().
+*/
+class EventRecorder : public osgGA::GUIEventHandler
+{
+public:
+    /*! A recorded event: the copy of the event with time relative to the start of the recording, and the mouse
+     * mode of the GLWidget when the event was handled. */
+    struct Record
+    {
+        osg::ref_ptr<osgGA::GUIEventAdapter> event;
+        cher::MOUSE_MODE mode;
+    };
+
+    /*! Constructor. \param handler is the event handler of GLWidget, its mouse mode is recorded. */
+    EventRecorder(EventHandler* handler);
+
+    /*! A method which copies the event when recording. \return false, so that the event is passed further. */
+    virtual bool handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa);
+
+    /*! A method to clear the previous recording and to start a new one.
+     * \param eye, center, up and fov (whole angle) are the camera view at the start,
+     * \param width and height are the viewport size,
+     * \param scene is the scene file path, it can be empty. */
+    void start(const osg::Vec3d& eye, const osg::Vec3d& center, const osg::Vec3d& up, double fov,
+               int width, int height, const std::string& scene);
+
+    /*! A method to stop recording; the recorded events are kept until the next start() or read(). */
+    void stop();
+
+    bool isRecording() const;
+
+    /*! A method to write the recording to a text file. \return true if the file was written. */
+    bool write(const std::string& path) const;
+
+    /*! A method to read the recording from a text file written by write(). \return true upon success. */
+    bool read(const std::string& path);
+
+    /*! A method to create a new event from the record to be added into the event queue.
+     * \param queue is the event queue of the viewer, the event takes its graphics context
+     * \param start is the queue time which corresponds to the start of the recording. */
+    static osgGA::GUIEventAdapter* createEvent(const Record& record, osgGA::EventQueue* queue, double start);
+
+    const std::vector<Record>& getRecords() const;
+
+    /*! \return number of the frame markers. */
+    unsigned int getNumFrames() const;
+
+    void getCameraView(osg::Vec3d& eye, osg::Vec3d& center, osg::Vec3d& up, double& fov) const;
+    int getWidth() const;
+    int getHeight() const;
+    const std::string& getScene() const;
+
+protected:
+    osg::observer_ptr<EventHandler> m_handler;
+    std::vector<Record> m_records;
+    bool m_recording;
+    double m_start; /*!< time of the first recorded event */
+
+    osg::Vec3d m_eye, m_center, m_up;
+    double m_fov;
+    int m_width, m_height;
+    std::string m_scene;
+};
+
+#endif // EVENTRECORDER_H
@@ -59,3 +59,12 @@ bool ProgramEntity2D::addUniformCanvasMatrix()
     }
     return true;
 }
+
+bool ProgramEntity2D::addUniformEntityMatrix()
+{
+    if (!this->addUniform<osg::Matrixf>("EntityMatrix", osg::Uniform::FLOAT_MAT4, osg::Matrixf::identity())){
+        qWarning("Could not add EntityMatrix uniform");
+        return false;
+    }
+    return true;
+}
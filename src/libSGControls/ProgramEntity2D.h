@@ -46,6 +46,9 @@ protected:
 
     bool addUniformCanvasMatrix();
 
+    /* identity default of the per-entity matrix, see entity::ShaderedEntity2D::moveDeferred() */
+    bool addUniformEntityMatrix();
+
     template <typename T>
     bool addUniform(const std::string& name, osg::Uniform::Type type, T value){
         if (!m_state.get()){
@@ -94,6 +94,10 @@ bool ProgramPolygon::addPresetUniforms()
         return false;
     }
 
+    /* pending transform of the entity */
+    if (!this->addUniformEntityMatrix())
+        return false;
+
     /* fog factor related */
     if (!this->addUniform<float>("FogMin", osg::Uniform::FLOAT, cher::STROKE_FOG_MIN)){
         qCritical("Could not initialize fog factor uniform");
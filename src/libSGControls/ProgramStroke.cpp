@@ -1,5 +1,8 @@
 #include "ProgramStroke.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <QtGlobal>
 #include <QDebug>
 
@@ -33,6 +36,19 @@ bool ProgramStroke::getIsFogged() const
     return m_isFogged;
 }
 
+int ProgramStroke::getSegmentsNumber(const osg::Vec2f &b0, const osg::Vec2f &b1, const osg::Vec2f &b2, const osg::Vec2f &b3,
+                                     float tolerance)
+{
+    int segments = cher::STROKE_SEGMENTS_NUMBER;
+    if (tolerance > 0.f){
+        float polygon = (b1-b0).length() + (b2-b1).length() + (b3-b2).length();
+        if (polygon < cher::STROKE_CULL_LENGTH) return 1;
+        float M = std::max((b0 - b1*2.f + b2).length(), (b1 - b2*2.f + b3).length());
+        segments = static_cast<int>(std::ceil(std::sqrt(0.75f * M / tolerance)));
+    }
+    return std::min(std::max(segments, cher::STROKE_SEGMENTS_MIN), cher::STROKE_SEGMENTS_MAX);
+}
+
 bool ProgramStroke::addPresetShaders()
 {
     if (this->getNumShaders() == 3){
@@ -115,6 +131,16 @@ bool ProgramStroke::addPresetUniforms()
             return false;
         }
 
+        /* pending transform of the entity */
+        if (!this->addUniformEntityMatrix())
+            return false;
+
+        /* the strokes are drawn one by one, see entity::StrokeBatch */
+        if (!this->addUniform<bool>("IsBatched", osg::Uniform::BOOL, false)){
+            qWarning("Could not add IsBatched uniform");
+            return false;
+        }
+
         /* stroke thickness */
         if (!this->addUniform<float>("Thickness", osg::Uniform::FLOAT, cher::STROKE_LINE_WIDTH)){
             qWarning("Could not initialize thickness uniform");
@@ -133,6 +159,17 @@ bool ProgramStroke::addPresetUniforms()
             return false;
         }
 
+        /* adaptive tessellation and culling of the curves on screen */
+        if (!this->addUniform<float>("Tolerance", osg::Uniform::FLOAT, cher::STROKE_TESSELLATION_TOLERANCE)){
+            qCritical("Could not initialize tessellation tolerance uniform");
+            return false;
+        }
+
+        if (!this->addUniform<float>("CullLength", osg::Uniform::FLOAT, cher::STROKE_CULL_LENGTH)){
+            qCritical("Could not initialize cull length uniform");
+            return false;
+        }
+
         /* fog factor related */
         if (!this->addUniform<float>("FogMin", osg::Uniform::FLOAT, cher::STROKE_FOG_MIN)){
             qCritical("Could not initialize fog factor uniform");
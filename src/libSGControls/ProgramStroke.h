@@ -6,6 +6,9 @@
 #include <osg/observer_ptr>
 #include <osg/Camera>
 #include <osg/MatrixTransform>
+#include <osg/Vec2f>
+
+#include "Settings.h"
 
 #include "ProgramEntity2D.h"
 
@@ -30,6 +33,16 @@ public:
 
     bool getIsFogged() const;
 
+    /*! A method to compute the number of line segments that Stroke.geom emits for a Bezier curve, so that the
+     * tessellation can be tested and estimated on CPU.
+     * \param b0, b1, b2, b3 are the control points in screen space pixels
+     * \param tolerance is the max distance of the tessellated curve from the true one in pixels; if it is not
+     * positive, the fixed cher::STROKE_SEGMENTS_NUMBER is used
+     * \return number of segments, or 1 if the curve is shorter than cher::STROKE_CULL_LENGTH and is drawn as a
+     * straight segment. */
+    static int getSegmentsNumber(const osg::Vec2f& b0, const osg::Vec2f& b1, const osg::Vec2f& b2, const osg::Vec2f& b3,
+                                 float tolerance = cher::STROKE_TESSELLATION_TOLERANCE);
+
 protected:
     virtual bool addPresetShaders();
     virtual bool addPresetUniforms();
@@ -1,16 +1,23 @@
 #include "StrokeIntersector.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include <osg/Geometry>
 #include <osg/BoundingBox>
 
 #include "Stroke.h"
+#include "Canvas.h"
+#include "StrokeIndex.h"
 #include "Utilities.h"
 
 StrokeIntersector::StrokeIntersector()
     : osgUtil::LineSegmentIntersector(MODEL, 0.f, 0.f)
     , m_offset(0.05f)
+    , m_useIndex(true)
+    , m_canvas(0)
+    , m_canvasIndexed(false)
 {
     m_hitIndices.clear();
 }
@@ -18,6 +25,9 @@ StrokeIntersector::StrokeIntersector()
 StrokeIntersector::StrokeIntersector(const osg::Vec3 &start, const osg::Vec3 &end)
     : osgUtil::LineSegmentIntersector(start, end)
     , m_offset(0.05f)
+    , m_useIndex(true)
+    , m_canvas(0)
+    , m_canvasIndexed(false)
 {
     m_hitIndices.clear();
 }
@@ -25,6 +35,9 @@ StrokeIntersector::StrokeIntersector(const osg::Vec3 &start, const osg::Vec3 &en
 StrokeIntersector::StrokeIntersector(osgUtil::Intersector::CoordinateFrame cf, double x, double y)
     : osgUtil::LineSegmentIntersector(cf, x, y)
     , m_offset(0.05f)
+    , m_useIndex(true)
+    , m_canvas(0)
+    , m_canvasIndexed(false)
 {
     m_hitIndices.clear();
 }
@@ -32,6 +45,9 @@ StrokeIntersector::StrokeIntersector(osgUtil::Intersector::CoordinateFrame cf, d
 StrokeIntersector::StrokeIntersector(osgUtil::Intersector::CoordinateFrame cf, const osg::Vec3d &start, const osg::Vec3d &end)
     : osgUtil::LineSegmentIntersector(cf, start, end)
     , m_offset(0.05f)
+    , m_useIndex(true)
+    , m_canvas(0)
+    , m_canvasIndexed(false)
 {
     m_hitIndices.clear();
 }
@@ -58,6 +74,16 @@ void StrokeIntersector::getHitIndices(int &first,int &last) const
     }
 }
 
+void StrokeIntersector::setUseIndex(bool use)
+{
+    m_useIndex = use;
+}
+
+bool StrokeIntersector::getUseIndex() const
+{
+    return m_useIndex;
+}
+
 osgUtil::Intersector *StrokeIntersector::clone(osgUtil::IntersectionVisitor &iv)
 {
     if ( _coordinateFrame==MODEL && iv.getModelMatrix()==0 )
@@ -65,6 +91,7 @@ osgUtil::Intersector *StrokeIntersector::clone(osgUtil::IntersectionVisitor &iv)
         osg::ref_ptr<StrokeIntersector> cloned = new StrokeIntersector( _start, _end );
         cloned->_parent = this;
         cloned->m_offset = m_offset;
+        cloned->m_useIndex = m_useIndex;
         return cloned.release();
     }
 
@@ -95,6 +122,7 @@ osgUtil::Intersector *StrokeIntersector::clone(osgUtil::IntersectionVisitor &iv)
     osg::ref_ptr<StrokeIntersector> cloned = new StrokeIntersector( _start*inverse, _end*inverse );
     cloned->_parent = this;
     cloned->m_offset = m_offset;
+    cloned->m_useIndex = m_useIndex;
     return cloned.release();
 }
 
@@ -115,23 +143,74 @@ void StrokeIntersector::intersect(osgUtil::IntersectionVisitor &iv, osg::Drawabl
         osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray());
         if (!vertices) return;
 
-        for (unsigned int i=1; i<vertices->size(); ++i)
-        {
-
-            double distance = Utilities::getSkewLinesDistance(s,e,(*vertices)[i], (*vertices)[i-1]);
-
-            if (m_offset<distance) continue;
-
-            Intersection hit;
-            hit.ratio = distance;
-            hit.nodePath = iv.getNodePath();
-            hit.drawable = drawable;
-            hit.matrix = iv.getModelMatrix();
-            hit.localIntersectionPoint = (*vertices)[i];
-            m_hitIndices.push_back(i);
-            insertIntersection(hit);
+        const std::vector<unsigned int>* segments = 0;
+        if (m_useIndex && this->getCandidates(iv, geometry, segments)){
+            if (!segments) return;
+            /* Bezier segment k covers the lines that end at control points 4k..4k+3 */
+            for (unsigned int k : *segments){
+                unsigned int first = std::max(4*k, 1u);
+                unsigned int last = std::min(4*k+4, static_cast<unsigned int>(vertices->size()));
+                for (unsigned int i=first; i<last; ++i)
+                    this->testSegment(iv, drawable, vertices, i, s, e);
+            }
+            return;
         }
+
+        for (unsigned int i=1; i<vertices->size(); ++i)
+            this->testSegment(iv, drawable, vertices, i, s, e);
     }
 }
 
+bool StrokeIntersector::getCandidates(osgUtil::IntersectionVisitor &iv, const entity::Stroke *stroke,
+                                      const std::vector<unsigned int> *&segments)
+{
+    segments = 0;
+
+    /* find the canvas that contains the stroke */
+    const osg::NodePath& path = iv.getNodePath();
+    entity::Canvas* canvas = 0;
+    for (auto it = path.rbegin(); it != path.rend() && !canvas; ++it)
+        canvas = dynamic_cast<entity::Canvas*>(*it);
+    if (!canvas) return false;
+
+    /* project the ray onto the canvas plane only once per canvas;
+     * the coordinates are local since the intersector is cloned for the canvas transform */
+    if (canvas != m_canvas){
+        m_canvas = canvas;
+        m_canvasIndexed = false;
+        m_candidates.clear();
+
+        osg::Vec3d dir = _end - _start;
+        double len = dir.length();
+        if (len < cher::EPSILON || std::fabs(dir.z()) < cher::EPSILON*len) return false;
+        osg::Vec3d P = _start - dir * (_start.z() / dir.z());
+
+        /* the more the ray is tilted towards the plane, the further the hit segments could be from P */
+        double sine = std::fabs(dir.z()) / len;
+        float radius = static_cast<float>(m_offset / sine);
+        m_canvasIndexed = canvas->getStrokeIndex()->query(osg::Vec3f(P.x(), P.y(), 0.f), radius, m_candidates);
+    }
+    if (!m_canvasIndexed) return false;
 
+    auto it = m_candidates.find(stroke);
+    if (it != m_candidates.end()) segments = &(it->second);
+    return true;
+}
+
+void StrokeIntersector::testSegment(osgUtil::IntersectionVisitor &iv, osg::Drawable *drawable, const osg::Vec3Array *vertices,
+                                    unsigned int i, const osg::Vec3d &s, const osg::Vec3d &e)
+{
+    /* the distance to the finite segment, so that a hit always lies next to the ray where the stroke index looks */
+    double distance = Utilities::getLineSegmentDistance(s,e,(*vertices)[i-1], (*vertices)[i]);
+
+    if (m_offset<distance) return;
+
+    Intersection hit;
+    hit.ratio = distance;
+    hit.nodePath = iv.getNodePath();
+    hit.drawable = drawable;
+    hit.matrix = iv.getModelMatrix();
+    hit.localIntersectionPoint = (*vertices)[i];
+    m_hitIndices.push_back(i);
+    insertIntersection(hit);
+}
@@ -2,12 +2,23 @@
 #define STROKEINTERSECTOR_H
 
 #include <vector>
+#include <unordered_map>
 
 #include <osg/ref_ptr>
 #include <osgUtil/LineSegmentIntersector>
 
+namespace entity {
+class Stroke;
+class Canvas;
+}
+
 /*! \class StrokeIntersector
- * Class description
+ * \brief Intersector to pick entity::Stroke by a ray within a given offset.
+ *
+ * By default the intersector uses entity::StrokeIndex of the canvas that contains the visited stroke:
+ * the ray is projected onto the canvas plane once per canvas, and only the segments next to the projection
+ * are tested. When the projection is not possible (the ray is parallel to the plane) or the index is
+ * disabled by setUseIndex(), all the stroke segments are tested one by one.
 */
 class StrokeIntersector : public osgUtil::LineSegmentIntersector
 {
@@ -21,15 +32,35 @@ public:
     float getOffset() const;
     void getHitIndices(int& first, int& last) const;
 
+    /*! \param use is true in order to use canvas stroke index, and false for linear search over all the segments. */
+    void setUseIndex(bool use);
+
+    /*! \return true if canvas stroke index is used for picking. */
+    bool getUseIndex() const;
+
     virtual Intersector* clone( osgUtil::IntersectionVisitor& iv );
     virtual void intersect( osgUtil::IntersectionVisitor& iv, osg::Drawable* drawable );
 
 protected:
     virtual ~StrokeIntersector(){}
 
+    /*! A method to obtain the list of Bezier segments of the stroke that lie next to the ray.
+     * \param segments is the output pointer on the segment list, NULL if there are no segments next to the ray.
+     * \return false if the index cannot be used and linear search has to be performed. */
+    bool getCandidates(osgUtil::IntersectionVisitor& iv, const entity::Stroke* stroke,
+                       const std::vector<unsigned int>*& segments);
+
+    void testSegment(osgUtil::IntersectionVisitor& iv, osg::Drawable* drawable, const osg::Vec3Array* vertices,
+                     unsigned int i, const osg::Vec3d& s, const osg::Vec3d& e);
+
 private:
     float m_offset;
     std::vector<unsigned int> m_hitIndices;
+
+    bool m_useIndex;
+    const entity::Canvas* m_canvas; /* canvas for which the candidates were obtained */
+    bool m_canvasIndexed; /* whether the candidates are valid for m_canvas */
+    std::unordered_map<const entity::Stroke*, std::vector<unsigned int> > m_candidates;
 };
 
 #endif // STROKEINTERSECTOR_H
@@ -26,7 +26,8 @@ entity::Canvas::Canvas()
     : osg::ProtectedGroup()
     , m_mR(osg::Matrix::rotate(0, cher::NORMAL))
     , m_mT(osg::Matrix::translate(0,0,0))
-    , m_transform(new osg::MatrixTransform(m_mR * m_mT))
+    , m_mO(osg::Matrix::identity())
+    , m_transform(new osg::MatrixTransform(m_mO * m_mR * m_mT))
     , m_switch(new osg::Switch)
     , m_groupData(new osg::Group)
     , m_geodeStrokes(new osg::Geode)
@@ -35,6 +36,7 @@ entity::Canvas::Canvas()
 
     , m_programStroke(new ProgramStroke)
     , m_programPolygon(new ProgramPolygon)
+    , m_strokeBatch(new entity::StrokeBatch)
 
     , m_strokeCurrent(0)
     , m_polygonCurrent(0)
@@ -42,6 +44,8 @@ entity::Canvas::Canvas()
     , m_center(osg::Vec3f(0.f,0.f,0.f)) // moves only when strokes are introduced so that to define it as centroid
     , m_normal(cher::NORMAL)
     , m_edit(false)
+    , m_dirty(true)
+    , m_revision(0)
 {
     qDebug("New Canvas ctor complete");
 }
@@ -50,6 +54,7 @@ entity::Canvas::Canvas(const entity::Canvas& cnv, const osg::CopyOp& copyop)
     : osg::ProtectedGroup(cnv, copyop)
     , m_mR(cnv.m_mR)
     , m_mT(cnv.m_mT)
+    , m_mO(cnv.m_mO)
     , m_transform(cnv.m_transform)
     , m_switch(cnv.m_switch)
     , m_groupData(cnv.m_groupData)
@@ -59,6 +64,7 @@ entity::Canvas::Canvas(const entity::Canvas& cnv, const osg::CopyOp& copyop)
 
     , m_programStroke(cnv.m_programStroke)
     , m_programPolygon(cnv.m_programPolygon)
+    , m_strokeBatch(cnv.m_strokeBatch)
 
     , m_toolFrame(cnv.m_toolFrame)
 
@@ -68,7 +74,10 @@ entity::Canvas::Canvas(const entity::Canvas& cnv, const osg::CopyOp& copyop)
     , m_center(cnv.m_center)
     , m_normal(cnv.m_normal)
     , m_edit(cnv.m_edit)
+    , m_dirty(true)
+    , m_revision(0)
 {
+    m_bounds.invalidate();
     qDebug("new Canvas by copy ctor complete");
 }
 
@@ -99,6 +108,7 @@ void entity::Canvas::initializeSG()
     m_switch->setName("Switch");
     m_switch->addChild(m_groupData.get(), true); // 1st child of m_switch
     m_groupData->addChild(m_geodeStrokes.get());
+    m_geodeStrokes->setCullCallback(m_strokeBatch.get());
     m_groupData->addChild(m_geodePhotos.get());
     m_groupData->addChild(m_geodePolygons.get());
     this->initializeTools(); // 2nd child of m_switch
@@ -222,6 +232,17 @@ const osg::Matrix&entity::Canvas::getMatrixTranslation() const
     return m_mT;
 }
 
+void entity::Canvas::setMatrixOffset(const osg::Matrix &O)
+{
+    m_mO = O;
+    this->updateTransforms();
+}
+
+const osg::Matrix &entity::Canvas::getMatrixOffset() const
+{
+    return m_mO;
+}
+
 /* This method should never be called directly.
  * It is here only to comply with serializer interface.
 */
@@ -253,6 +274,7 @@ const osg::Switch* entity::Canvas::getSwitch() const
 void entity::Canvas::setGroupData(osg::Group *group)
 {
     m_groupData = group;
+    m_bounds.invalidate();
 }
 
 const osg::Group *entity::Canvas::getGroupData() const
@@ -263,6 +285,15 @@ const osg::Group *entity::Canvas::getGroupData() const
 void entity::Canvas::setGeodeStrokes(osg::Geode *geode)
 {
     m_geodeStrokes = geode;
+
+    /* the geode read from file carries its batch, the older files do not */
+    entity::StrokeBatch* batch = geode ? dynamic_cast<entity::StrokeBatch*>(geode->getCullCallback()) : 0;
+    if (batch)
+        m_strokeBatch = batch;
+    else if (geode)
+        geode->setCullCallback(m_strokeBatch.get());
+    m_strokeIndex.invalidate();
+    m_bounds.invalidate();
 }
 
 const osg::Geode *entity::Canvas::getGeodeStrokes() const
@@ -273,6 +304,7 @@ const osg::Geode *entity::Canvas::getGeodeStrokes() const
 void entity::Canvas::setGeodePhotos(osg::Geode *geode)
 {
     m_geodePhotos = geode;
+    m_bounds.invalidate();
 }
 
 const osg::Geode *entity::Canvas::getGeodePhotos() const
@@ -283,6 +315,7 @@ const osg::Geode *entity::Canvas::getGeodePhotos() const
 void entity::Canvas::setGeodePolygons(osg::Geode *geode)
 {
     m_geodePolygons = geode;
+    m_bounds.invalidate();
 }
 
 const osg::Geode *entity::Canvas::getGeodePolygons() const
@@ -426,16 +459,10 @@ void entity::Canvas::rotate(const osg::Matrix& mr, const osg::Vec3f &c3d_new)
             qCritical("updateFrame(): local central point z-coord is not close to zero");
             return;
         }
-        /* move every child back in local delta translation (diff between old and new centers) */
+        /* shift the local origin by the delta translation (diff between old and new centers);
+         * the entities and the stroke index stay in their own coordinates */
         osg::Vec3f delta2d = c2d_old - c2d_new;
-        for (size_t i=0; i<this->getNumEntities(); ++i){
-            entity::Entity2D* entity = this->getEntity(i);
-            if (!entity){
-                qCritical("rotate canvas: could not dynamic_cast to Entity2D*");
-                return;
-            }
-            entity->moveDelta(delta2d.x(), delta2d.y());
-        }
+        m_mO = m_mO * osg::Matrix::translate(delta2d.x(), delta2d.y(), 0);
 
         /* new global center coordinate and delta translate in 3D */
         osg::Vec3f delta3d = c3d_new - m_center;
@@ -463,11 +490,14 @@ void entity::Canvas::unselectEntities()
 void entity::Canvas::selectAllEntities()
 {
     this->unselectEntities();
+    std::vector<entity::Entity2D*> entities;
+    entities.reserve(this->getNumEntities());
     for (unsigned int i = 0; i < this->getNumEntities(); i++){
         entity::Entity2D* entity = this->getEntity(i);
         if (!entity) continue;
-        this->addEntitySelected(entity);
+        entities.push_back(entity);
     }
+    this->addEntitiesSelected(entities);
 }
 
 void entity::Canvas::setStrokeCurrent(entity::Stroke *stroke)
@@ -539,6 +569,31 @@ void entity::Canvas::removeEntitySelected(Entity2D *entity)
     m_selectedGroup.removeEntity(entity);
 }
 
+void entity::Canvas::addEntitiesSelected(const std::vector<entity::Entity2D *> &entities)
+{
+    std::vector<entity::Entity2D*> strokes, photos;
+    for (auto entity : entities){
+        if (!entity) continue;
+        switch (entity->getEntityType()){
+        case cher::ENTITY_STROKE:
+            strokes.push_back(entity);
+            break;
+        case cher::ENTITY_PHOTO:
+            photos.push_back(entity);
+            break;
+        default:
+            break;
+        }
+    }
+    if (!strokes.empty()) m_selectedGroup.addEntities(strokes, m_geodeStrokes.get());
+    if (!photos.empty()) m_selectedGroup.addEntities(photos, m_geodePhotos.get());
+}
+
+void entity::Canvas::removeEntitiesSelected(const std::vector<entity::Entity2D *> &entities)
+{
+    m_selectedGroup.removeEntities(entities);
+}
+
 const std::vector<entity::Entity2D* >& entity::Canvas::getEntitiesSelected() const
 {
     return m_selectedGroup.getEntities();
@@ -602,22 +657,13 @@ osg::Vec3f entity::Canvas::getBoundingBoxCenter2D() const
 
 osg::BoundingBox entity::Canvas::getBoundingBox() const
 {
-    osg::BoundingBox result;
-    /* run through all the geodes of groupData and fing max and min og each bound box */
-    float xmin=FLT_MAX, ymin=FLT_MAX, zmin=FLT_MAX, xmax=-FLT_MAX, ymax=-FLT_MAX, zmax=-FLT_MAX;
-    for (unsigned int i=0; i<m_groupData->getNumChildren(); ++i){
-        osg::Geode* gi = dynamic_cast<osg::Geode*>( m_groupData->getChild(i));
-        if (!gi) continue;
-        osg::BoundingBox bi = gi->getBoundingBox();
-        if (!bi.valid()) continue;
-        xmin = std::min(bi.xMin(), xmin);
-        ymin = std::min(bi.yMin(), ymin);
-        zmin = std::min(bi.zMin(), zmin);
-        xmax = std::max(bi.xMax(), xmax);
-        ymax = std::max(bi.yMax(), ymax);
-        zmax = std::max(bi.zMax(), zmax);
-        result.set(xmin, ymin, zmin, xmax, ymax, zmax);
-    }
+    if (!m_bounds.isValid())
+        m_bounds.rebuild(m_groupData.get());
+    osg::BoundingBox result = m_bounds.getBoundingBox();
+
+    /* the entities which are being drawn change on every event without notifying the bounds */
+    if (m_strokeCurrent.get()) result.expandBy(m_strokeCurrent->getBoundingBox());
+    if (m_polygonCurrent.get()) result.expandBy(m_polygonCurrent->getBoundingBox());
 
     return result.valid()? result : this->getToolFrame()->getGeodeWire()->getBoundingBox();
 }
@@ -625,31 +671,41 @@ osg::BoundingBox entity::Canvas::getBoundingBox() const
 void entity::Canvas::moveEntities(std::vector<entity::Entity2D *>& entities, double du, double dv)
 {
     m_selectedGroup.move(entities, du, dv);
+    this->updateStrokeIndex(entities);
+    this->updateBounds(entities);
 }
 
 void entity::Canvas::moveEntitiesSelected(double du, double dv)
 {
+    /* the vertices are not changed until the move is committed, the index is updated by moveEntities() */
     m_selectedGroup.move(du, dv);
+    this->updateBounds(m_selectedGroup.getEntities());
 }
 
 void entity::Canvas::scaleEntities(std::vector<Entity2D *> &entities, double sx, double sy, osg::Vec3f center)
 {
     m_selectedGroup.scale(entities, sx,sy,center);
+    this->updateStrokeIndex(entities);
+    this->updateBounds(entities);
 }
 
 void entity::Canvas::scaleEntitiesSelected(double sx, double sy)
 {
     m_selectedGroup.scale(sx,sy);
+    this->updateBounds(m_selectedGroup.getEntities());
 }
 
 void entity::Canvas::rotateEntities(std::vector<Entity2D *> entities, double theta, osg::Vec3f center)
 {
     m_selectedGroup.rotate(entities, theta, center);
+    this->updateStrokeIndex(entities);
+    this->updateBounds(entities);
 }
 
 void entity::Canvas::rotateEntitiesSelected(double theta)
 {
     m_selectedGroup.rotate(theta);
+    this->updateBounds(m_selectedGroup.getEntities());
 //    m_toolFrame->rotate(theta, m_selectedGroup.getCenter2DCustom());
 }
 
@@ -774,6 +830,9 @@ entity::Canvas *entity::Canvas::clone() const
     clone->initializeSG();
     clone->setMatrixRotation(this->getMatrixRotation());
     clone->setMatrixTranslation(this->getMatrixTranslation());
+    clone->setMatrixOffset(this->getMatrixOffset());
+    clone->setStrokeBatching(this->getStrokeBatching());
+    clone->setStrokeLod(this->getStrokeLod());
     clone->setName(this->getName());
 
     for (unsigned int i=0; i<this->getNumEntities(); ++i){
@@ -827,6 +886,9 @@ entity::Canvas *entity::Canvas::separate()
     clone->initializeSG();
     clone->setMatrixRotation(this->getMatrixRotation());
     clone->setMatrixTranslation(this->getMatrixTranslation());
+    clone->setMatrixOffset(this->getMatrixOffset());
+    clone->setStrokeBatching(this->getStrokeBatching());
+    clone->setStrokeLod(this->getStrokeLod());
     clone->setName(this->getName());
 
     for (auto i=0; i<m_selectedGroup.getSize(); ++i){
@@ -857,14 +919,14 @@ entity::Canvas *entity::Canvas::separate()
 void entity::Canvas::updateTransforms()
 {
     /* update how the drawables look */
-    osg::Matrix M = m_mR * m_mT;
+    osg::Matrix M = m_mO * m_mR * m_mT;
     m_transform->setMatrix(M);
 
-    /* update plane parameters */
+    /* update plane parameters; the center is the origin before the local offset */
     m_normal = cher::NORMAL;
     m_center = cher::CENTER;
     osg::Plane plane(m_normal, m_center);
-    m_center = m_center * M;
+    m_center = m_center * m_mR * m_mT;
     plane.transform(M);
     m_normal = plane.getNormal();
     if (!plane.valid()){
@@ -880,7 +942,8 @@ void entity::Canvas::resetTransforms()
     /* reset transform params */
     m_mR = osg::Matrix::rotate(0, cher::NORMAL);
     m_mT = osg::Matrix::translate(0,0,0);
-    m_transform->setMatrix(m_mR * m_mT);
+    m_mO = osg::Matrix::identity();
+    m_transform->setMatrix(m_mO * m_mR * m_mT);
 
     /* reset plane params */
     m_normal = cher::NORMAL;
@@ -1023,6 +1086,8 @@ bool entity::Canvas::addEntity(entity::Entity2D *entity)
     switch(entity->getEntityType()){
     case cher::ENTITY_STROKE:
         result = m_geodeStrokes->addDrawable(entity);
+        if (result && m_strokeIndex.isValid())
+            m_strokeIndex.insert(dynamic_cast<entity::Stroke*>(entity));
         break;
     case cher::ENTITY_PHOTO:        
         result = m_geodePhotos->addDrawable(entity);
@@ -1033,6 +1098,8 @@ bool entity::Canvas::addEntity(entity::Entity2D *entity)
     default:
         break;
     }
+    if (result && m_bounds.isValid())
+        m_bounds.insert(entity);
 
     return result;
 }
@@ -1046,6 +1113,7 @@ bool entity::Canvas::removeEntity(entity::Entity2D *entity)
     case cher::ENTITY_STROKE:
         /* remove from scene graph */
         result = m_geodeStrokes->removeDrawable(entity);
+        if (result) m_strokeIndex.remove(dynamic_cast<entity::Stroke*>(entity));
         break;
     case cher::ENTITY_PHOTO:
         result = m_geodePhotos->removeDrawable(entity);
@@ -1056,6 +1124,7 @@ bool entity::Canvas::removeEntity(entity::Entity2D *entity)
     default:
         break;
     }
+    if (result) m_bounds.remove(entity);
 
     return result;
 }
@@ -1065,6 +1134,72 @@ bool entity::Canvas::containsEntity(entity::Entity2D *entity) const
     return (m_geodeStrokes->containsDrawable(entity) || m_geodePhotos->containsDrawable(entity) || m_geodePolygons->containsDrawable(entity));
 }
 
+const entity::StrokeIndex *entity::Canvas::getStrokeIndex()
+{
+    if (!m_strokeIndex.isValid())
+        m_strokeIndex.rebuild(m_geodeStrokes.get());
+    return &m_strokeIndex;
+}
+
+void entity::Canvas::updateStrokeIndex(const std::vector<entity::Entity2D *> &entities)
+{
+    if (!m_strokeIndex.isValid()) return;
+    for (auto entity : entities){
+        if (!entity || entity->getEntityType() != cher::ENTITY_STROKE) continue;
+        entity::Stroke* stroke = dynamic_cast<entity::Stroke*>(entity);
+        if (stroke && m_geodeStrokes->containsDrawable(stroke))
+            m_strokeIndex.update(stroke);
+    }
+}
+
+void entity::Canvas::setStrokeBatching(bool batching)
+{
+    m_strokeBatch->setEnabled(batching);
+}
+
+bool entity::Canvas::getStrokeBatching() const
+{
+    return m_strokeBatch->getEnabled();
+}
+
+void entity::Canvas::setStrokeLod(bool lod)
+{
+    m_strokeBatch->setLodEnabled(lod);
+}
+
+bool entity::Canvas::getStrokeLod() const
+{
+    return m_strokeBatch->getLodEnabled();
+}
+
+const entity::StrokeBatch *entity::Canvas::getStrokeBatch() const
+{
+    return m_strokeBatch.get();
+}
+
+void entity::Canvas::updateBounds(const std::vector<entity::Entity2D *> &entities)
+{
+    if (!m_bounds.isValid()) return;
+    for (auto entity : entities)
+        m_bounds.update(entity);
+}
+
+void entity::Canvas::setDirty(bool dirty)
+{
+    m_dirty = dirty;
+    if (dirty) ++m_revision;
+}
+
+bool entity::Canvas::isDirty() const
+{
+    return m_dirty;
+}
+
+unsigned int entity::Canvas::getRevision() const
+{
+    return m_revision;
+}
+
 REGISTER_OBJECT_WRAPPER(Canvas_Wrapper
                         , new entity::Canvas
                         , entity::Canvas
@@ -1072,6 +1207,7 @@ REGISTER_OBJECT_WRAPPER(Canvas_Wrapper
 {
     ADD_MATRIX_SERIALIZER(MatrixRotation, osg::Matrix());
     ADD_MATRIX_SERIALIZER(MatrixTranslation, osg::Matrix());
+    ADD_MATRIX_SERIALIZER(MatrixOffset, osg::Matrix());
 
     ADD_OBJECT_SERIALIZER(Transform, osg::MatrixTransform, NULL);
     ADD_OBJECT_SERIALIZER(Switch, osg::Switch, NULL);
@@ -7,6 +7,9 @@
 #include "Photo.h"
 #include "ToolGlobal.h"
 #include "SelectedGroup.h"
+#include "StrokeIndex.h"
+#include "EntityBounds.h"
+#include "StrokeBatch.h"
 #include "ProtectedGroup.h"
 #include "libSGControls/ProgramStroke.h"
 #include "libSGControls/ProgramPolygon.h"
@@ -69,6 +72,9 @@ public:
     void setMatrixTranslation(const osg::Matrix& T);
     const osg::Matrix& getMatrixTranslation() const;
 
+    void setMatrixOffset(const osg::Matrix& O);
+    const osg::Matrix& getMatrixOffset() const;
+
     void setTransform(osg::MatrixTransform* t);
     const osg::MatrixTransform* getTransform() const;
     osg::MatrixTransform* getTransform();
@@ -193,6 +199,13 @@ public:
     /*! \param entity is entity to substract from entity::SelectedGroup. */
     void removeEntitySelected(entity::Entity2D* entity);
 
+    /*! A method to add a set of entities to entity::SelectedGroup at once, e.g., when selecting all or by area.
+     * As in addEntitySelected(), only strokes and photos can be selected. */
+    void addEntitiesSelected(const std::vector<entity::Entity2D*>& entities);
+
+    /*! A method to substract a set of entities from entity::SelectedGroup at once. */
+    void removeEntitiesSelected(const std::vector<entity::Entity2D*>& entities);
+
     /*! \return vector of pointers on selected entities within the canvas. */
     const std::vector<Entity2D *> &getEntitiesSelected() const;
 
@@ -208,7 +221,8 @@ public:
     /*! \return local 2D center of SelectedGroup. */
     osg::Vec3f getEntitiesSelectedCenter2D() const;
 
-    /*! \return local 2D center of canvas. \sa getCenter() */
+    /*! \return local 2D center of canvas in the coordinates of its entities; it is not the local origin once the
+     * canvas is recentered, see getMatrixOffset(). \sa getCenter() */
     osg::Vec3f getCenter2D() const;
 
     /*! \return global 3D mean center of canvas; used as a default rotation point when rotating the canvas. */
@@ -217,14 +231,17 @@ public:
     /*! \return local 2D center which is calculated based on bounding box of the whole canvas. */
     osg::Vec3f getBoundingBoxCenter2D() const;
 
-    /*! \return a bounding box of the whole canvas. */
+    /*! \return a bounding box of the whole canvas in local coordinates. The box is maintained incrementally
+     * by entity::EntityBounds, only the strokes and polygons which are being drawn are bounded on every call. */
     osg::BoundingBox getBoundingBox() const;
 
 
     /*! \param entities is the vector of entities to move, \param du is delta-u local 2D coordinate, \param dv is delta-V local 2D coordinate.  \sa moveEntitiesSelected() */
     void moveEntities(std::vector<Entity2D *> &entities, double du, double dv);
 
-    /*! \param du is delta-u local 2D coordinate, \param dv is delta-V local 2D coordinate.  \sa moveEntitiesSelected(). \sa moveEntities() */
+    /*! A method to move the selected entities while the user drags them. The shadered entities are moved by
+     * their pending shader transform, their vertices and the stroke index are only updated by moveEntities().
+     * \param du is delta-u local 2D coordinate, \param dv is delta-V local 2D coordinate.  \sa moveEntities() */
     void moveEntitiesSelected(double du, double dv);
 
     /*! \param entities is the vector of entities to scale,
@@ -234,7 +251,8 @@ public:
      * \sa scaleEntitiesSelected() */
     void scaleEntities(std::vector<Entity2D *> &entities, double sx, double sy, osg::Vec3f center);
 
-    /*! \param sx is scale along X axis, \param sy is scale along Y axis, \sa scaleEntities() */
+    /*! \param sx is scale along X axis, \param sy is scale along Y axis. As moveEntitiesSelected(), the vertices
+     * are not changed. \sa scaleEntities() */
     void scaleEntitiesSelected(double sx, double sy);
 
     /*! \param entities is the vector of entities to rotate,
@@ -243,7 +261,8 @@ public:
      * \sa rotateEntitiesSelected() */
     void rotateEntities(std::vector<entity::Entity2D*> entities, double theta, osg::Vec3f center);
 
-    /*! \param theta is angle of rotation. \sa rotateEntities() */
+    /*! \param theta is angle of rotation. As moveEntitiesSelected(), the vertices are not changed.
+     * \sa rotateEntities() */
     void rotateEntitiesSelected(double theta);
 
     /*! Method to re-calculate frame's geometry and plane center transform based on canvas content location.
@@ -340,6 +359,48 @@ public:
     /*! \param entity is the pointer on entity, \return true if the canvas contains given entity, false otherwise. */
     bool containsEntity(entity::Entity2D* entity) const;
 
+    /*! \return spatial index of canvas strokes in local coordinates. If the index is outdated, e.g., right after
+     * the scene was read from file, it is re-built before being returned. \sa StrokeIntersector */
+    const entity::StrokeIndex* getStrokeIndex();
+
+    /*! A method to re-register the strokes of the given set within the stroke index; must be called each time
+     * the strokes' geometry was changed while the strokes belong to the canvas. */
+    void updateStrokeIndex(const std::vector<entity::Entity2D*>& entities);
+
+    /*! A method to take into account the new geometry of the given entities within the canvas bounding box;
+     * must be called each time the entities' geometry was changed while they belong to the canvas. */
+    void updateBounds(const std::vector<entity::Entity2D*>& entities);
+
+    /*! A method to turn on or off the batched drawing of the canvas strokes, see entity::StrokeBatch. It only
+     * affects rendering, picking and editing work on the separate strokes in both cases.
+     * The default is cher::STROKE_BATCHING. */
+    void setStrokeBatching(bool batching);
+
+    /*! \return true if the canvas strokes are drawn from a single vertex buffer. */
+    bool getStrokeBatching() const;
+
+    /*! A method to turn on or off the level of detail of the batched strokes, see entity::StrokeBatch::getLevel().
+     * The default is cher::STROKE_LOD. */
+    void setStrokeLod(bool lod);
+
+    /*! \return true if the batched strokes of the distant canvas are drawn simplified. */
+    bool getStrokeLod() const;
+
+    /*! \return batch that draws the canvas strokes, it is the cull callback of the stroke geode. */
+    const entity::StrokeBatch* getStrokeBatch() const;
+
+    /*! A method to mark the canvas as changed since it was last saved, so that it is re-written by the next
+     * incremental save. It is called by the undo commands that edit the canvas and its content.
+     * \sa SceneChunkFile::save() */
+    void setDirty(bool dirty);
+
+    /*! \return true if the canvas changed since it was last saved or read from the chunked scene file. */
+    bool isDirty() const;
+
+    /*! \return counter of changes of the canvas, it is incremented every time the canvas is marked as dirty.
+     * Unlike isDirty(), it is not reset by saving, so that several writers can track changes, e.g., the autosave. */
+    unsigned int getRevision() const;
+
 protected:
     void updateTransforms();
     void resetTransforms();
@@ -354,6 +415,7 @@ public:
 private:
     osg::Matrix                 m_mR; /* part of m_transform */
     osg::Matrix                 m_mT; /* part of m_transform */
+    osg::Matrix                 m_mO; /* part of m_transform, local offset of the entities from the canvas center */
     osg::ref_ptr<osg::MatrixTransform> m_transform; /* matrix transform in 3D space */
     osg::ref_ptr<osg::Switch>   m_switch; /* inisible or not, the whole canvas content */
     osg::ref_ptr<osg::Group>    m_groupData; /* keeps user canvas 2d entities such as strokes and photos */
@@ -362,6 +424,7 @@ private:
     osg::ref_ptr<osg::Geode>    m_geodePolygons; // contains all the polygons as children
     osg::ref_ptr<ProgramStroke> m_programStroke; /*!< Shader program for all the strokes of the canvas, is applied to m_geodeStrokes */
     osg::ref_ptr<ProgramPolygon> m_programPolygon; /*!< Shader program for all the polygons of the canvas, is applied to m_geodePolygons */
+    osg::ref_ptr<entity::StrokeBatch> m_strokeBatch; /* cull callback of m_geodeStrokes, its data is not serialized */
 
     /* construction geodes */
     osg::ref_ptr<entity::FrameTool> m_toolFrame;
@@ -369,10 +432,14 @@ private:
     osg::observer_ptr<entity::Stroke> m_strokeCurrent; /* for stroke drawing */
     osg::observer_ptr<entity::Polygon> m_polygonCurrent; /* for polygon drawing, see UserScene::addPolygon */
     entity::SelectedGroup m_selectedGroup;
+    entity::StrokeIndex m_strokeIndex; /* not serialized, re-built on demand */
+    mutable entity::EntityBounds m_bounds; /* not serialized, re-built on demand */
     osg::Vec3f m_center; /* 3D global - virtual plane parameter */
     osg::Vec3f m_normal; /* 3D global - virtual plane parameter*/
 
     bool m_edit;
+    bool m_dirty; /* not serialized, changed since the last save */
+    unsigned int m_revision; /* not serialized, incremented on every change */
 
 };
 }
@@ -0,0 +1,138 @@
+#include "EntityBounds.h"
+
+#include <osg/Geode>
+
+#include "Entity2D.h"
+
+#include <QtGlobal>
+#include <QDebug>
+
+entity::EntityBounds::EntityBounds()
+    : m_valid(true)
+    , m_box()
+    , m_dirty(false)
+    , m_sumCenters(0,0,0)
+    , m_numValid(0)
+{
+}
+
+bool entity::EntityBounds::isValid() const
+{
+    return m_valid;
+}
+
+void entity::EntityBounds::invalidate()
+{
+    m_valid = false;
+}
+
+void entity::EntityBounds::rebuild(const osg::Group *groupData)
+{
+    this->clear();
+    if (!groupData){
+        qWarning("EntityBounds::rebuild: group is NULL");
+        return;
+    }
+    for (unsigned int i=0; i<groupData->getNumChildren(); ++i){
+        const osg::Geode* geode = dynamic_cast<const osg::Geode*>(groupData->getChild(i));
+        if (!geode) continue;
+        for (unsigned int j=0; j<geode->getNumDrawables(); ++j){
+            const entity::Entity2D* entity = dynamic_cast<const entity::Entity2D*>(geode->getDrawable(j));
+            if (entity) this->insert(entity);
+        }
+    }
+}
+
+void entity::EntityBounds::clear()
+{
+    m_boxes.clear();
+    m_box.init();
+    m_dirty = false;
+    m_sumCenters.set(0,0,0);
+    m_numValid = 0;
+    m_valid = true;
+}
+
+void entity::EntityBounds::insert(const entity::Entity2D *entity)
+{
+    if (!entity) return;
+    if (m_boxes.find(entity) != m_boxes.end()){
+        this->update(entity);
+        return;
+    }
+    const osg::BoundingBox& bb = entity->getBoundingBox();
+    m_boxes[entity] = bb;
+    if (!m_dirty) m_box.expandBy(bb);
+    if (bb.valid()){
+        m_sumCenters += osg::Vec3d(bb.center());
+        ++m_numValid;
+    }
+}
+
+bool entity::EntityBounds::remove(const entity::Entity2D *entity)
+{
+    auto it = m_boxes.find(entity);
+    if (it == m_boxes.end()) return false;
+    if (!m_dirty && this->isExtremal(it->second)) m_dirty = true;
+    if (it->second.valid()){
+        m_sumCenters -= osg::Vec3d(it->second.center());
+        --m_numValid;
+    }
+    m_boxes.erase(it);
+    return true;
+}
+
+void entity::EntityBounds::update(const entity::Entity2D *entity)
+{
+    auto it = m_boxes.find(entity);
+    if (it == m_boxes.end()) return;
+    const osg::BoundingBox& bb = entity->getBoundingBox();
+
+    /* a box which only grew cannot shrink the total box */
+    bool grown = !it->second.valid() || (bb.valid() && bb.contains(it->second._min) && bb.contains(it->second._max));
+    if (!m_dirty){
+        if (!grown && this->isExtremal(it->second))
+            m_dirty = true;
+        else
+            m_box.expandBy(bb);
+    }
+    if (it->second.valid()){
+        m_sumCenters -= osg::Vec3d(it->second.center());
+        --m_numValid;
+    }
+    if (bb.valid()){
+        m_sumCenters += osg::Vec3d(bb.center());
+        ++m_numValid;
+    }
+    it->second = bb;
+}
+
+const osg::BoundingBox &entity::EntityBounds::getBoundingBox() const
+{
+    if (m_dirty){
+        m_box.init();
+        for (const auto& entry : m_boxes)
+            m_box.expandBy(entry.second);
+        m_dirty = false;
+    }
+    return m_box;
+}
+
+osg::Vec3f entity::EntityBounds::getMeanCenter() const
+{
+    if (m_numValid == 0) return osg::Vec3f(0,0,0);
+    return osg::Vec3f(m_sumCenters / m_numValid);
+}
+
+unsigned int entity::EntityBounds::getNumEntities() const
+{
+    return static_cast<unsigned int>(m_boxes.size());
+}
+
+bool entity::EntityBounds::isExtremal(const osg::BoundingBox &bb) const
+{
+    /* the entities lie within the canvas plane, so only the local U and V sides are compared */
+    if (!bb.valid() || !m_box.valid()) return false;
+    return bb.xMin() <= m_box.xMin() || bb.yMin() <= m_box.yMin()
+            || bb.xMax() >= m_box.xMax() || bb.yMax() >= m_box.yMax();
+}
@@ -0,0 +1,77 @@
+#ifndef ENTITYBOUNDS_H
+#define ENTITYBOUNDS_H
+
+#include <unordered_map>
+
+#include <osg/Group>
+#include <osg/BoundingBox>
+
+namespace entity {
+class Entity2D;
+
+/*! \class EntityBounds
+ * \brief Bounding box of a set of entities which is maintained incrementally.
+ *
+ * The box of every entity is remembered as it was when the entity was inserted or last updated. Adding an
+ * entity, or an update which only grows the entity, expands the total box at once. The total box is marked
+ * to be re-computed only when a removed or updated entity touched one of its sides; the re-computation is
+ * performed on the next getBoundingBox() and only goes through the remembered boxes. Therefore the box of the
+ * canvas or of the selection costs O(1) amortized per edit instead of a pass over all the entities.
+ *
+ * The bounds are owned by entity::Canvas and entity::SelectedGroup which have to call update() whenever the
+ * geometry of an entity is changed. The canvas bounds are not serialized: after the scene is read from file,
+ * they are marked as invalid and re-built on the first request, as entity::StrokeIndex.
+*/
+class EntityBounds
+{
+public:
+    EntityBounds();
+
+    /*! \return true if the bounds represent the current content. \sa invalidate(), rebuild() */
+    bool isValid() const;
+
+    /*! A method to mark the bounds as outdated, e.g., when the geodes of the canvas were replaced. */
+    void invalidate();
+
+    /*! A method to re-create the bounds from all the entities of the geodes of the group. */
+    void rebuild(const osg::Group* groupData);
+
+    /*! A method to remove all the entities. The bounds stay valid. */
+    void clear();
+
+    /*! A method to add the entity or, if it is already present, to update it. */
+    void insert(const entity::Entity2D* entity);
+
+    /*! A method to remove the entity. \return true if the entity was present. */
+    bool remove(const entity::Entity2D* entity);
+
+    /*! A method to take into account the new geometry of the entity. Entities which are not present are
+     * ignored. */
+    void update(const entity::Entity2D* entity);
+
+    /*! \return the box of all the entities, invalid box if there is none. */
+    const osg::BoundingBox& getBoundingBox() const;
+
+    /*! \return mean of the box centers of the entities, which is maintained along with the boxes; zero vector
+     * if there is no entity with a valid box. */
+    osg::Vec3f getMeanCenter() const;
+
+    /*! \return number of entities within the bounds. */
+    unsigned int getNumEntities() const;
+
+protected:
+    /*! \return true if the box touches one of the U or V sides of the total box. */
+    bool isExtremal(const osg::BoundingBox& bb) const;
+
+private:
+    bool m_valid;
+    std::unordered_map<const entity::Entity2D*, osg::BoundingBox> m_boxes; /* last known box of every entity */
+    mutable osg::BoundingBox m_box; /* total box */
+    mutable bool m_dirty; /* whether the total box has to be re-computed from m_boxes */
+    osg::Vec3d m_sumCenters; /* sum of the centers of the valid boxes */
+    unsigned int m_numValid; /* number of the valid boxes */
+};
+
+} // namespace entity
+
+#endif // ENTITYBOUNDS_H
@@ -0,0 +1,183 @@
+#include "LatencyMonitor.h"
+
+#include <algorithm>
+
+#include <QSaveFile>
+#include <QTextStream>
+#include <QString>
+#include <QtGlobal>
+#include <QDebug>
+
+#include "Settings.h"
+
+entity::LatencyMonitor &entity::LatencyMonitor::instance()
+{
+    static entity::LatencyMonitor monitor;
+    return monitor;
+}
+
+const char *entity::LatencyMonitor::getStageName(entity::LatencyMonitor::Stage stage)
+{
+    switch (stage){
+    case STAGE_QUEUE:
+        return "queue";
+    case STAGE_SKETCH:
+        return "sketch";
+    case STAGE_RENDER:
+        return "render";
+    case STAGE_TOTAL:
+        return "total";
+    default:
+        return "";
+    }
+}
+
+void entity::LatencyMonitor::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    this->clear();
+}
+
+bool entity::LatencyMonitor::getEnabled() const
+{
+    return m_enabled;
+}
+
+void entity::LatencyMonitor::setStartTick(osg::Timer_t tick)
+{
+    m_startTick = tick;
+    m_pending.clear();
+}
+
+double entity::LatencyMonitor::getTime() const
+{
+    return osg::Timer::instance()->delta_s(m_startTick, osg::Timer::instance()->tick());
+}
+
+void entity::LatencyMonitor::markHandled(double input)
+{
+    if (!m_enabled) return;
+    Sample sample;
+    sample.input = input;
+    sample.handled = this->getTime();
+    sample.appended = -1;
+    sample.frame = -1;
+    m_pending.push_back(sample);
+}
+
+void entity::LatencyMonitor::markAppended()
+{
+    /* strokes which are not sketched by pen, e.g., by tests, have no started sample */
+    if (!m_enabled || m_pending.empty() || m_pending.back().appended >= 0) return;
+    m_pending.back().appended = this->getTime();
+}
+
+void entity::LatencyMonitor::markFrame()
+{
+    if (!m_enabled || m_pending.empty()) return;
+    double frame = this->getTime();
+    for (auto& sample : m_pending){
+        if (sample.appended < 0) continue;
+        sample.frame = frame;
+        if (m_samples.size() < static_cast<size_t>(cher::LATENCY_SAMPLES))
+            m_samples.push_back(sample);
+        else
+            m_samples[m_next] = sample;
+        m_next = (m_next + 1) % cher::LATENCY_SAMPLES;
+    }
+    m_pending.clear();
+}
+
+unsigned int entity::LatencyMonitor::getNumSamples() const
+{
+    return static_cast<unsigned int>(m_samples.size());
+}
+
+double entity::LatencyMonitor::getPercentile(entity::LatencyMonitor::Stage stage, double p) const
+{
+    if (m_samples.empty()) return 0;
+    std::vector<double> latency;
+    latency.reserve(m_samples.size());
+    for (const auto& sample : m_samples)
+        latency.push_back(sample.getLatency(stage));
+    size_t n = std::min(latency.size()-1, static_cast<size_t>(std::max(0.0, p) * latency.size()));
+    std::nth_element(latency.begin(), latency.begin() + n, latency.end());
+    return latency[n];
+}
+
+bool entity::LatencyMonitor::write(const std::string &path) const
+{
+    QSaveFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)){
+        qWarning("LatencyMonitor: could not open file for writing");
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "# input-to-photon latency of " << m_samples.size() << " sketch events, ms\n";
+    for (int i=0; i<STAGE_COUNT; ++i){
+        Stage stage = static_cast<Stage>(i);
+        out << "# " << getStageName(stage) << " p50 " << this->getPercentile(stage, 0.5)
+            << " p99 " << this->getPercentile(stage, 0.99) << "\n";
+    }
+    out << "input_s";
+    for (int i=0; i<STAGE_COUNT; ++i)
+        out << "," << getStageName(static_cast<Stage>(i)) << "_ms";
+    out << "\n";
+    for (const auto& sample : this->getSamples()){
+        out << sample.input;
+        for (int i=0; i<STAGE_COUNT; ++i)
+            out << "," << sample.getLatency(static_cast<Stage>(i));
+        out << "\n";
+    }
+
+    out.flush();
+    if (out.status() != QTextStream::Ok || !file.commit()){
+        qWarning("LatencyMonitor: could not write file");
+        return false;
+    }
+    return true;
+}
+
+void entity::LatencyMonitor::clear()
+{
+    m_pending.clear();
+    m_samples.clear();
+    m_next = 0;
+}
+
+entity::LatencyMonitor::LatencyMonitor()
+    : m_pending()
+    , m_samples()
+    , m_next(0)
+    , m_startTick(osg::Timer::instance()->getStartTick())
+    , m_enabled(false)
+{
+}
+
+std::vector<entity::LatencyMonitor::Sample> entity::LatencyMonitor::getSamples() const
+{
+    /* once the ring buffer is full, the oldest sample is at the write position */
+    std::vector<Sample> samples;
+    samples.reserve(m_samples.size());
+    unsigned int first = m_samples.size() < static_cast<size_t>(cher::LATENCY_SAMPLES) ? 0 : m_next;
+    for (unsigned int i=0; i<m_samples.size(); ++i)
+        samples.push_back(m_samples[(first + i) % m_samples.size()]);
+    return samples;
+}
+
+double entity::LatencyMonitor::Sample::getLatency(entity::LatencyMonitor::Stage stage) const
+{
+    switch (stage){
+    case STAGE_QUEUE:
+        return 1e3 * (handled - input);
+    case STAGE_SKETCH:
+        return 1e3 * (appended - handled);
+    case STAGE_RENDER:
+        return 1e3 * (frame - appended);
+    case STAGE_TOTAL:
+        return 1e3 * (frame - input);
+    default:
+        return 0;
+    }
+}
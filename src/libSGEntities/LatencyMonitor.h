@@ -0,0 +1,100 @@
+#ifndef LATENCYMONITOR_H
+#define LATENCYMONITOR_H
+
+#include <string>
+#include <vector>
+
+#include <osg/Timer>
+
+namespace entity {
+
+/*! \class LatencyMonitor
+ * \brief Input-to-photon latency of the sketch path, split into stages.
+ *
+ * Every pen or mouse event is time stamped by the event queue of GLWidget when the Qt event arrives (e.g.,
+ * GLWidget::tabletEvent()); the time stamp travels with osgGA::GUIEventAdapter. A sample of a sketch event is
+ * then marked along its way:
+ * * markHandled() when EventHandler::doSketch() starts to process the event;
+ * * markAppended() when entity::UserScene::strokeAppend() has appended the point and the stroke arrays are dirty;
+ * * markFrame() when the viewer frame which processed the event is drawn, see GLWidget::paintGL().
+ *
+ * The stages are the time spent in the event queue, the sketch processing, the rendering, and their total.
+ * The last cher::LATENCY_SAMPLES samples are kept, so that their percentiles can be shown in the heads-up
+ * display and written to a file, see write(). The monitor is disabled by default, then the marks do nothing.
+ * All the methods have to be called from the GUI thread.
+*/
+class LatencyMonitor
+{
+public:
+    enum Stage
+    {
+        STAGE_QUEUE = 0,
+        STAGE_SKETCH,
+        STAGE_RENDER,
+        STAGE_TOTAL,
+        STAGE_COUNT
+    };
+
+    /*! \return the application-wide monitor. */
+    static LatencyMonitor& instance();
+
+    /*! \return short name of the stage, e.g., "queue". */
+    static const char* getStageName(Stage stage);
+
+    /*! A method to enable or disable the monitor; the samples are cleared in both cases. */
+    void setEnabled(bool enabled);
+    bool getEnabled() const;
+
+    /*! A method to set the start tick of the event queue, the event times are counted from it. */
+    void setStartTick(osg::Timer_t tick);
+
+    /*! \return current time in seconds in the clock of the event queue. */
+    double getTime() const;
+
+    /*! A method to start a sample. \param input is the time of the event, osgGA::GUIEventAdapter::getTime(). */
+    void markHandled(double input);
+
+    /*! A method to mark that the point of the last started sample is appended to the stroke. */
+    void markAppended();
+
+    /*! A method to complete the samples of the frame; the samples without appended point are dropped. */
+    void markFrame();
+
+    /*! \return number of the kept samples. */
+    unsigned int getNumSamples() const;
+
+    /*! \return p-th percentile (0 <= p <= 1) of the stage latency in milliseconds over the kept samples,
+     * or 0 if there are none. */
+    double getPercentile(Stage stage, double p) const;
+
+    /*! A method to write the percentiles and the kept samples, oldest first, as a text file.
+     * \return true if the file was written. */
+    bool write(const std::string& path) const;
+
+    void clear();
+
+protected:
+    LatencyMonitor();
+
+    /* time stamps in seconds */
+    struct Sample
+    {
+        double input, handled, appended, frame;
+
+        double getLatency(Stage stage) const;
+    };
+
+    /*! \return kept samples, oldest first. */
+    std::vector<Sample> getSamples() const;
+
+private:
+    std::vector<Sample> m_pending; /* samples of the current frame */
+    std::vector<Sample> m_samples; /* ring buffer of the complete samples */
+    unsigned int m_next; /* ring buffer position */
+    osg::Timer_t m_startTick;
+    bool m_enabled;
+};
+
+} // namespace entity
+
+#endif // LATENCYMONITOR_H
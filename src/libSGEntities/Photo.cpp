@@ -2,6 +2,8 @@
 #include "Settings.h"
 #include "Utilities.h"
 #include "DraggableWire.h"
+#include "PhotoStore.h"
+#include "PhotoPyramid.h"
 #include "MainWindow.h"
 
 #include <QDebug>
@@ -23,12 +25,16 @@ entity::Photo::Photo()
     , m_height(0)
     , m_angle(0)
     , m_color(cher::PHOTO_CLR_REST)
+    , m_digest("")
 {
     qDebug("New Photo ctor complete");
     this->setName("Photo");
     this->getOrCreateStateSet()->setMode(GL_BLEND, osg::StateAttribute::ON);
     this->getOrCreateStateSet()->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
     this->getOrCreateStateSet()->setAttributeAndModes(new osg::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+
+    /* large images are shown from their tiles */
+    this->setCullCallback(new entity::PhotoTileCallback);
 }
 
 entity::Photo::Photo(const entity::Photo& photo, const osg::CopyOp& copyop)
@@ -38,7 +44,9 @@ entity::Photo::Photo(const entity::Photo& photo, const osg::CopyOp& copyop)
     , m_width(photo.m_width)
     , m_height(photo.m_height)
     , m_angle(photo.m_angle)
+    , m_digest(photo.m_digest)
 {
+    this->setCullCallback(new entity::PhotoTileCallback);
     qDebug("New Photo ctor by copy complete");
 }
 
@@ -96,18 +104,44 @@ float entity::Photo::getAngle() const
     return m_angle;
 }
 
+void entity::Photo::setDigest(const std::string &digest)
+{
+    m_digest = digest;
+}
+
+const std::string &entity::Photo::getDigest() const
+{
+    return m_digest;
+}
+
 /* width and height represent half size width and height
 */
 void entity::Photo::loadImage(const std::string& fname)
 {
     qDebug() << "Trying to load image data...";
-    osg::Image* image = osgDB::readImageFile(fname);
-    if (!image) return;
+    osg::ref_ptr<osg::Image> image = osgDB::readImageFile(fname);
+    if (!image.get()) return;
     qDebug() << "DONE: Image read from file name";
-    m_texture->setImage(image);
-    qDebug() << "DONE: Texure extracted from image";
+    this->loadImage(image.get());
+}
+
+void entity::Photo::loadImage(osg::Image *image)
+{
+    if (!image) return;
+    std::string digest;
+    osg::Texture2D* texture = entity::PhotoStore::instance().getTexture(image, digest);
+    this->loadTexture(texture, digest);
+}
 
-    float aspectRatio = static_cast<float>(image->s()) / static_cast<float>(image->t());
+void entity::Photo::loadTexture(osg::Texture2D *texture, const std::string &digest)
+{
+    if (!texture) return;
+    m_texture = texture;
+    m_digest = digest;
+
+    /* the image may be still decoding, then the caller sets the size */
+    osg::Image* image = m_texture->getImage();
+    float aspectRatio = image? static_cast<float>(image->s()) / static_cast<float>(image->t()) : 1.f;
     m_width = cher::PHOTO_MINW;
     m_height = m_width / aspectRatio;
 
@@ -134,6 +168,28 @@ void entity::Photo::loadImage(const std::string& fname)
     this->setColorArray(colors, osg::Array::BIND_OVERALL);
 }
 
+void entity::Photo::shareTexture()
+{
+    if (!m_texture.get() || !m_texture->getImage()) return;
+    osg::Texture2D* texture = entity::PhotoStore::instance().getTexture(m_texture->getImage(), m_digest);
+    if (texture == m_texture.get()) return;
+
+    /* identical image is already in memory */
+    m_texture = texture;
+    this->getOrCreateStateSet()->setTextureAttributeAndModes(0, this->getTextureAsAttribute());
+}
+
+bool entity::Photo::storeImage(const std::string &scenePath)
+{
+    this->shareTexture();
+    osg::Image* image = entity::PhotoStore::instance().restoreImage(m_digest);
+    if (!image && m_texture.get()) image = m_texture->getImage();
+    if (!image || !entity::PhotoStore::instance().storeImage(image, m_digest, scenePath))
+        return false;
+    image->setFileName(entity::PhotoStore::getStoreFileName(scenePath, m_digest));
+    return true;
+}
+
 osg::StateAttribute* entity::Photo::getTextureAsAttribute() const
 {
     return dynamic_cast<osg::StateAttribute*>(m_texture.get());
@@ -442,4 +498,5 @@ REGISTER_OBJECT_WRAPPER(Photo_Wrapper
     ADD_FLOAT_SERIALIZER(Width, 0.f);
     ADD_FLOAT_SERIALIZER(Height, 0.f);
     ADD_FLOAT_SERIALIZER(Angle, 0.f);
+    ADD_STRING_SERIALIZER(Digest, "");
 }
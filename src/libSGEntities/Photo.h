@@ -18,6 +18,9 @@ namespace entity {
 
 /*! \class Photo
  * \brief Quad that uses texture to represent a 2D photo in 3D space.
+ *
+ * Images larger than cher::PHOTO_PYRAMID_THRESHOLD are not uploaded as a whole; the photo is drawn from the
+ * tiles of its entity::PhotoPyramid instead, see entity::PhotoTileCallback.
 */
 class Photo: public entity::Entity2D{
 public:
@@ -44,7 +47,29 @@ public:
     void setAngle(float a);
     float getAngle() const;
 
+    void setDigest(const std::string& digest);
+    const std::string& getDigest() const;
+
     void loadImage(const std::string& fname);
+    /*! A method to set up the photo geometry and texture from an already decoded image, e.g., when the image
+     * is read from the blob of entity::SceneChunkFile. The width and height are reset to the default values.
+     * The texture is shared with all the photos of identical content, see entity::PhotoStore. */
+    void loadImage(osg::Image* image);
+
+    /*! A method to set up the photo geometry from a texture which is already within entity::PhotoStore.
+     * \param texture is the shared texture; if its image is not decoded yet, the photo is square until
+     * the size is set
+     * \param digest is the digest of the texture image */
+    void loadTexture(osg::Texture2D* texture, const std::string& digest);
+
+    /*! A method to replace the texture that was read from a scene file by the texture of identical content which
+     * is already in use by other photos. It also computes the digest if it was not read from file. */
+    void shareTexture();
+
+    /*! A method to put the photo image into the sidecar store of the given scene file and to make the image refer
+     * to the stored file, so that the scene file can be written without the image data.
+     * \return true if the image is within the store. */
+    bool storeImage(const std::string& scenePath);
     osg::StateAttribute* getTextureAsAttribute() const;
 
     /*! A method to change location of the Photo center.
@@ -111,6 +136,7 @@ private:
     float m_width, m_height; /*!< half-width and half-height of the photo quad. */
     float m_angle;
     osg::Vec4f m_color;
+    std::string m_digest; /*!< content digest of the texture image, see entity::PhotoStore. */
 };
 }
 
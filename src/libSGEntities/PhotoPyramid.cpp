@@ -0,0 +1,468 @@
+#include "PhotoPyramid.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#include <osg/Geometry>
+#include <osgDB/ReadFile>
+#include <osgDB/WriteFile>
+#include <osgUtil/CullVisitor>
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QStringList>
+#include <QtGlobal>
+#include <QDebug>
+
+#include "Photo.h"
+#include "PhotoStore.h"
+#include "MainWindow.h"
+
+static const char* PYRAMID_INDEX = "pyramid.txt";
+
+/* copies a rectangle of pixels into a new image of the same format */
+static osg::Image* cropImage(const osg::Image* image, int x, int y, int w, int h)
+{
+    osg::ref_ptr<osg::Image> tile = new osg::Image;
+    tile->allocateImage(w, h, 1, image->getPixelFormat(), image->getDataType(), image->getPacking());
+    tile->setInternalTextureFormat(image->getInternalTextureFormat());
+    unsigned int bytes = image->getPixelSizeInBits() * w / 8;
+    for (int row=0; row<h; ++row)
+        std::memcpy(tile->data(0, row), image->data(x, y+row), bytes);
+    return tile.release();
+}
+
+/* next pyramid level by 2x2 box filter; the images of other data types than bytes are scaled by OSG */
+static osg::Image* halveImage(const osg::Image* image)
+{
+    int s = std::max(1, (image->s()+1)/2), t = std::max(1, (image->t()+1)/2);
+    if (image->getDataType() != GL_UNSIGNED_BYTE){
+        osg::ref_ptr<osg::Image> copy = new osg::Image(*image, osg::CopyOp::DEEP_COPY_ALL);
+        copy->scaleImage(s, t, 1);
+        return copy.release();
+    }
+
+    unsigned int n = osg::Image::computeNumComponents(image->getPixelFormat());
+    osg::ref_ptr<osg::Image> half = new osg::Image;
+    half->allocateImage(s, t, 1, image->getPixelFormat(), GL_UNSIGNED_BYTE, image->getPacking());
+    half->setInternalTextureFormat(image->getInternalTextureFormat());
+    for (int y=0; y<t; ++y){
+        const unsigned char* r0 = image->data(0, std::min(2*y, image->t()-1));
+        const unsigned char* r1 = image->data(0, std::min(2*y+1, image->t()-1));
+        unsigned char* dst = half->data(0, y);
+        for (int x=0; x<s; ++x){
+            int xa = 2*x, xb = std::min(2*x+1, image->s()-1);
+            for (unsigned int c=0; c<n; ++c)
+                dst[x*n+c] = static_cast<unsigned char>((r0[xa*n+c] + r0[xb*n+c] + r1[xa*n+c] + r1[xb*n+c] + 2) / 4);
+        }
+    }
+    return half.release();
+}
+
+entity::PhotoPyramid::PhotoPyramid(const std::string &digest, int tileSize)
+    : osg::Referenced()
+    , m_digest(digest)
+    , m_tileSize(tileSize)
+    , m_width(0)
+    , m_height(0)
+    , m_levels(0)
+{
+}
+
+bool entity::PhotoPyramid::isLarge(const osg::Image *image)
+{
+    return image && std::max(image->s(), image->t()) > cher::PHOTO_PYRAMID_THRESHOLD;
+}
+
+std::string entity::PhotoPyramid::getDirectory(const std::string &digest)
+{
+    QDir dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    return dir.filePath(cher::PHOTO_PYRAMID_CACHE + "/" + QString::fromStdString(digest)).toStdString();
+}
+
+bool entity::PhotoPyramid::build(const osg::Image *image, const std::string &digest, int tileSize)
+{
+    if (!image || !image->data() || digest.empty() || tileSize <= 0) return false;
+
+    osg::ref_ptr<PhotoPyramid> pyramid = new PhotoPyramid(digest, tileSize);
+    if (pyramid->load() && pyramid->getLevelWidth(0) == image->s() && pyramid->getLevelHeight(0) == image->t())
+        return true;
+
+    QDir dir(QString::fromStdString(getDirectory(digest)));
+    if (!QDir().mkpath(dir.absolutePath())){
+        qWarning("PhotoPyramid::build: could not create pyramid directory");
+        return false;
+    }
+
+    /* every level is cut into tiles, then halved into the next one until it fits a single tile */
+    pyramid->m_width = image->s();
+    pyramid->m_height = image->t();
+    osg::ref_ptr<const osg::Image> level = image;
+    int levels = 0;
+    while (true){
+        for (int y=0; y*tileSize < level->t(); ++y){
+            for (int x=0; x*tileSize < level->s(); ++x){
+                osg::ref_ptr<osg::Image> tile = cropImage(level.get(), x*tileSize, y*tileSize,
+                                                          std::min(tileSize, level->s() - x*tileSize),
+                                                          std::min(tileSize, level->t() - y*tileSize));
+                if (!osgDB::writeImageFile(*tile, pyramid->getTileFileName(levels, x, y))){
+                    qWarning() << "PhotoPyramid::build: could not write tile of " << digest.c_str();
+                    return false;
+                }
+            }
+        }
+        ++levels;
+        if (std::max(level->s(), level->t()) <= tileSize) break;
+        level = halveImage(level.get());
+    }
+
+    /* the index is written last, so that an interrupted build is not taken for a complete one */
+    QSaveFile index(dir.filePath(PYRAMID_INDEX));
+    if (!index.open(QIODevice::WriteOnly)) return false;
+    index.write(QString("%1 %2 %3 %4\n").arg(image->s()).arg(image->t()).arg(tileSize).arg(levels).toLatin1());
+    return index.commit();
+}
+
+QFuture<bool> entity::PhotoPyramid::buildLater(const osg::Image *image, const std::string &digest)
+{
+    /* finished builds are forgotten, a later call for the same digest finds the pyramid on disk */
+    static std::unordered_map<std::string, QFuture<bool> > running;
+    for (auto it = running.begin(); it != running.end(); ){
+        if (it->second.isFinished()) it = running.erase(it);
+        else ++it;
+    }
+    auto it = running.find(digest);
+    if (it != running.end())
+        return it->second;
+
+    osg::ref_ptr<const osg::Image> source = image;
+    QFuture<bool> future = QtConcurrent::run([source, digest]() -> bool {
+        return entity::PhotoPyramid::build(source.get(), digest);
+    });
+    running[digest] = future;
+    return future;
+}
+
+bool entity::PhotoPyramid::load()
+{
+    QFile index(QDir(QString::fromStdString(getDirectory(m_digest))).filePath(PYRAMID_INDEX));
+    if (!index.open(QIODevice::ReadOnly)) return false;
+    QStringList values = QString::fromLatin1(index.readAll()).trimmed().split(' ', QString::SkipEmptyParts);
+    if (values.size() != 4 || values[2].toInt() != m_tileSize) return false;
+    m_width = values[0].toInt();
+    m_height = values[1].toInt();
+    m_levels = values[3].toInt();
+    return m_width > 0 && m_height > 0 && m_levels > 0;
+}
+
+const std::string &entity::PhotoPyramid::getDigest() const
+{
+    return m_digest;
+}
+
+int entity::PhotoPyramid::getTileSize() const
+{
+    return m_tileSize;
+}
+
+int entity::PhotoPyramid::getNumLevels() const
+{
+    return m_levels;
+}
+
+int entity::PhotoPyramid::getLevelWidth(int level) const
+{
+    int w = m_width;
+    for (int i=0; i<level; ++i) w = std::max(1, (w+1)/2);
+    return w;
+}
+
+int entity::PhotoPyramid::getLevelHeight(int level) const
+{
+    int h = m_height;
+    for (int i=0; i<level; ++i) h = std::max(1, (h+1)/2);
+    return h;
+}
+
+int entity::PhotoPyramid::getNumTilesX(int level) const
+{
+    return (this->getLevelWidth(level) + m_tileSize - 1) / m_tileSize;
+}
+
+int entity::PhotoPyramid::getNumTilesY(int level) const
+{
+    return (this->getLevelHeight(level) + m_tileSize - 1) / m_tileSize;
+}
+
+std::string entity::PhotoPyramid::getTileFileName(int level, int x, int y) const
+{
+    QDir dir(QString::fromStdString(getDirectory(m_digest)));
+    return dir.filePath(QString("%1_%2_%3.").arg(level).arg(x).arg(y)
+                        + QString::fromStdString(cher::PHOTO_STORE_FORMAT)).toStdString();
+}
+
+osg::Image *entity::PhotoPyramid::readRegion(int level, int x0, int y0, int x1, int y1) const
+{
+    if (level < 0 || level >= m_levels || x0 < 0 || y0 < 0 || x1 > this->getNumTilesX(level)
+            || y1 > this->getNumTilesY(level) || x0 >= x1 || y0 >= y1)
+        return 0;
+
+    int w = std::min(x1 * m_tileSize, this->getLevelWidth(level)) - x0 * m_tileSize;
+    int h = std::min(y1 * m_tileSize, this->getLevelHeight(level)) - y0 * m_tileSize;
+    osg::ref_ptr<osg::Image> region;
+    for (int y=y0; y<y1; ++y){
+        for (int x=x0; x<x1; ++x){
+            osg::ref_ptr<osg::Image> tile = osgDB::readImageFile(this->getTileFileName(level, x, y));
+            if (!tile.get() || !tile->data()){
+                qWarning() << "PhotoPyramid::readRegion: could not read tile of " << m_digest.c_str();
+                return 0;
+            }
+            if (!region.get()){
+                region = new osg::Image;
+                region->allocateImage(w, h, 1, tile->getPixelFormat(), tile->getDataType(), tile->getPacking());
+                region->setInternalTextureFormat(tile->getInternalTextureFormat());
+            }
+            int ox = (x - x0) * m_tileSize, oy = (y - y0) * m_tileSize;
+            if (tile->getPixelFormat() != region->getPixelFormat() || tile->getDataType() != region->getDataType()
+                    || ox + tile->s() > w || oy + tile->t() > h)
+                return 0;
+            unsigned int bytes = tile->getPixelSizeInBits() * tile->s() / 8;
+            for (int row=0; row<tile->t(); ++row)
+                std::memcpy(region->data(ox, oy+row), tile->data(0, row), bytes);
+        }
+    }
+    return region.release();
+}
+
+entity::PhotoPyramid::~PhotoPyramid()
+{
+}
+
+bool entity::PhotoTileCallback::Region::operator==(const Region &other) const
+{
+    return level == other.level && x0 == other.x0 && y0 == other.y0 && x1 == other.x1 && y1 == other.y1;
+}
+
+bool entity::PhotoTileCallback::Region::contains(const Region &other) const
+{
+    return level == other.level && x0 <= other.x0 && y0 <= other.y0 && x1 >= other.x1 && y1 >= other.y1;
+}
+
+entity::PhotoTileCallback::PhotoTileCallback()
+    : osg::Drawable::CullCallback()
+    , m_pyramid(0)
+    , m_texture(new osg::Texture2D)
+    , m_texmat(new osg::TexMat)
+    , m_stateset(new osg::StateSet)
+    , m_small(false)
+{
+    m_stateset->setTextureAttributeAndModes(0, m_texture.get());
+    m_stateset->setTextureAttributeAndModes(0, m_texmat.get());
+    m_texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    m_texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    m_texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    m_texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    m_texture->setResizeNonPowerOfTwoHint(false);
+    m_region.level = m_requested.level = -1;
+}
+
+bool entity::PhotoTileCallback::cull(osg::NodeVisitor *nv, osg::Drawable *drawable, osg::RenderInfo *) const
+{
+    entity::Photo* photo = dynamic_cast<entity::Photo*>(drawable);
+    if (!photo || photo->getDigest().empty()) return false;
+
+    /* a photo shown from its pyramid does not need the source image, which is then left to be evicted */
+    bool paged = !m_small && m_pyramid.valid() && m_pyramid->getDigest() == photo->getDigest()
+            && m_pyramid->getNumLevels() > 0;
+    if (!paged && entity::PhotoStore::instance().touch(photo->getDigest())) this->requestUpdate();
+    if (m_small) return false;
+    const osg::Image* image = photo->getTexture()? photo->getTexture()->getImage() : 0;
+
+    /* the image may be still decoding or reading back from the cache */
+    if (!paged && (!image || !image->data())) return false;
+    if (!m_pyramid.valid() || m_pyramid->getDigest() != photo->getDigest()){
+        if (!PhotoPyramid::isLarge(image)){
+            m_small = true;
+            return false;
+        }
+        m_pyramid = new PhotoPyramid(photo->getDigest());
+        m_building = PhotoPyramid::buildLater(image, photo->getDigest());
+        m_reading = QFuture< osg::ref_ptr<osg::Image> >();
+        m_region.level = m_requested.level = -1;
+        m_texture->setImage(0);
+    }
+
+    if (!m_building.isFinished()){
+        this->requestUpdate();
+        return this->cullRegion(nv, drawable);
+    }
+    if (m_pyramid->getNumLevels() == 0 && (!m_building.result() || !m_pyramid->load())){
+        qWarning("PhotoTileCallback: could not build the pyramid, the photo is shown at full resolution");
+        m_small = true;
+        return false;
+    }
+
+    /* a finished read becomes the region texture */
+    if (m_requested.level >= 0 && m_reading.isFinished()){
+        osg::ref_ptr<osg::Image> region = m_reading.result();
+        if (region.get()){
+            float lw = m_pyramid->getLevelWidth(m_requested.level), lh = m_pyramid->getLevelHeight(m_requested.level);
+            float T = m_pyramid->getTileSize();
+            float s0 = m_requested.x0 * T / lw, s1 = std::min(m_requested.x1 * T, lw) / lw;
+            float t0 = m_requested.y0 * T / lh, t1 = std::min(m_requested.y1 * T, lh) / lh;
+            m_texture->setImage(region.get());
+            m_texmat->setMatrix(osg::Matrix::translate(-s0, -t0, 0) * osg::Matrix::scale(1.f/(s1-s0), 1.f/(t1-t0), 1.f));
+            m_region = m_requested;
+        }
+        m_requested.level = -1;
+        m_reading = QFuture< osg::ref_ptr<osg::Image> >();
+    }
+
+    Region wanted;
+    if (m_requested.level < 0 && this->computeRegion(nv, drawable, wanted) && !m_region.contains(wanted)){
+        m_requested = wanted;
+        osg::ref_ptr<PhotoPyramid> pyramid = m_pyramid;
+        m_reading = QtConcurrent::run([pyramid, wanted]() -> osg::ref_ptr<osg::Image> {
+            return pyramid->readRegion(wanted.level, wanted.x0, wanted.y0, wanted.x1, wanted.y1);
+        });
+    }
+    if (m_requested.level >= 0) this->requestUpdate();
+    return this->cullRegion(nv, drawable);
+}
+
+const entity::PhotoPyramid *entity::PhotoTileCallback::getPyramid() const
+{
+    return m_small? 0 : m_pyramid.get();
+}
+
+int entity::PhotoTileCallback::getLevel() const
+{
+    return m_region.level;
+}
+
+/* The full resolution texture is never applied. The region texture and its matrix are pushed as a transient
+ * state set over the one of the photo while the photo is added to the render graph, as osgUtil::CullVisitor does
+ * for any drawable; the state set of the photo is saved to file and it is left untouched. */
+bool entity::PhotoTileCallback::cullRegion(osg::NodeVisitor *nv, osg::Drawable *drawable) const
+{
+    osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+    if (!cv || !cv->getModelViewMatrix()) return false;
+
+    const osg::BoundingBox& bb = drawable->getBoundingBox();
+    if (drawable->isCullingActive() && cv->isCulled(bb)) return true;
+    osg::RefMatrix& matrix = *cv->getModelViewMatrix();
+    if (cv->getComputeNearFarMode() && bb.valid() && !cv->updateCalculatedNearFar(matrix, *drawable, false))
+        return true;
+    float depth = bb.valid()? cv->getDistanceFromEyePoint(bb.center(), false) : 0.f;
+    if (osg::isNaN(depth)) return true;
+
+    osg::StateSet* stateset = drawable->getStateSet();
+    if (stateset) cv->pushStateSet(stateset);
+    cv->pushStateSet(m_stateset.get());
+    cv->addDrawableAndDepth(drawable, &matrix, depth);
+    cv->popStateSet();
+    if (stateset) cv->popStateSet();
+    return true;
+}
+
+/* The photo quad is sampled by a grid of cells. The visible cells are the ones whose screen bounding box
+ * intersects the viewport; they define the texture window, and the screen length of their edges defines
+ * how many texels per photo side are needed, i.e., the level. */
+bool entity::PhotoTileCallback::computeRegion(osg::NodeVisitor *nv, osg::Drawable *drawable, Region &region) const
+{
+    osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+    osg::Geometry* geometry = drawable->asGeometry();
+    if (!cv || !cv->getViewport() || !cv->getModelViewMatrix() || !cv->getProjectionMatrix() || !geometry)
+        return false;
+    const osg::Vec3Array* verts = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+    const osg::Vec2Array* texcoords = dynamic_cast<const osg::Vec2Array*>(geometry->getTexCoordArray(0));
+    if (!verts || verts->size() != 4 || !texcoords || texcoords->size() != 4) return false;
+
+    osg::Matrix MVPW = (*cv->getModelViewMatrix()) * (*cv->getProjectionMatrix())
+            * cv->getViewport()->computeWindowMatrix();
+    const osg::Viewport* vp = cv->getViewport();
+    const int N = 8;
+    osg::Vec2f screen[N+1][N+1];
+    bool valid[N+1][N+1];
+    osg::Vec3f A = (*verts)[1] - (*verts)[0], B = (*verts)[3] - (*verts)[0];
+    osg::Vec2f TA = (*texcoords)[1] - (*texcoords)[0], TB = (*texcoords)[3] - (*texcoords)[0];
+    for (int i=0; i<=N; ++i){
+        for (int j=0; j<=N; ++j){
+            osg::Vec3f P = (*verts)[0] + A * (float(i)/N) + B * (float(j)/N);
+            osg::Vec4d h = osg::Vec4d(P, 1.0) * MVPW;
+            valid[i][j] = h.w() > 0;
+            if (valid[i][j]) screen[i][j] = osg::Vec2f(h.x()/h.w(), h.y()/h.w());
+        }
+    }
+
+    float smin = 1, smax = 0, tmin = 1, tmax = 0, needA = 0, needB = 0;
+    for (int i=0; i<N; ++i){
+        for (int j=0; j<N; ++j){
+            if (!valid[i][j] || !valid[i+1][j] || !valid[i][j+1] || !valid[i+1][j+1]) continue;
+            osg::Vec2f lo = screen[i][j], hi = screen[i][j];
+            for (int k=0; k<4; ++k){
+                const osg::Vec2f& p = screen[i + k%2][j + k/2];
+                lo = osg::Vec2f(std::min(lo.x(), p.x()), std::min(lo.y(), p.y()));
+                hi = osg::Vec2f(std::max(hi.x(), p.x()), std::max(hi.y(), p.y()));
+            }
+            if (hi.x() < vp->x() || lo.x() > vp->x() + vp->width() || hi.y() < vp->y() || lo.y() > vp->y() + vp->height())
+                continue;
+
+            needA = std::max(needA, std::max((screen[i+1][j] - screen[i][j]).length(),
+                                             (screen[i+1][j+1] - screen[i][j+1]).length()) * N);
+            needB = std::max(needB, std::max((screen[i][j+1] - screen[i][j]).length(),
+                                             (screen[i+1][j+1] - screen[i+1][j]).length()) * N);
+            for (int k=0; k<4; ++k){
+                osg::Vec2f tc = (*texcoords)[0] + TA * (float(i + k%2)/N) + TB * (float(j + k/2)/N);
+                smin = std::min(smin, tc.x());
+                smax = std::max(smax, tc.x());
+                tmin = std::min(tmin, tc.y());
+                tmax = std::max(tmax, tc.y());
+            }
+        }
+    }
+
+    /* texture axes of the quad edges, the texture coordinates are only flipped or swapped */
+    bool swapped = std::fabs(TA.x()) < std::fabs(TA.y());
+    float needS = swapped? needB : needA, needT = swapped? needA : needB;
+
+    /* an invisible photo keeps only the coarsest level */
+    int levels = m_pyramid->getNumLevels();
+    if (smin > smax || tmin > tmax){
+        region.level = levels - 1;
+        smin = tmin = 0;
+        smax = tmax = 1;
+    }
+    else{
+        region.level = levels - 1;
+        while (region.level > 0 && (m_pyramid->getLevelWidth(region.level) < needS
+                                    || m_pyramid->getLevelHeight(region.level) < needT))
+            --region.level;
+    }
+
+    /* the region is limited in size, a coarser level is taken if needed */
+    float T = m_pyramid->getTileSize();
+    smin = std::max(0.f, smin), tmin = std::max(0.f, tmin), smax = std::min(1.f, smax), tmax = std::min(1.f, tmax);
+    for (; region.level < levels; ++region.level){
+        int nx = m_pyramid->getNumTilesX(region.level), ny = m_pyramid->getNumTilesY(region.level);
+        float lw = m_pyramid->getLevelWidth(region.level), lh = m_pyramid->getLevelHeight(region.level);
+        region.x0 = std::min(nx-1, static_cast<int>(std::floor(smin * lw / T)));
+        region.y0 = std::min(ny-1, static_cast<int>(std::floor(tmin * lh / T)));
+        region.x1 = std::max(region.x0+1, std::min(nx, static_cast<int>(std::ceil(smax * lw / T))));
+        region.y1 = std::max(region.y0+1, std::min(ny, static_cast<int>(std::ceil(tmax * lh / T))));
+        if ((region.x1 - region.x0) * T <= cher::PHOTO_TEXTURE_MAX && (region.y1 - region.y0) * T <= cher::PHOTO_TEXTURE_MAX)
+            break;
+    }
+    return region.level < levels;
+}
+
+void entity::PhotoTileCallback::requestUpdate() const
+{
+    /* every photo polls its jobs on every cull, the redraws are coalesced by the main window */
+    MainWindow::instance().requestUpdateLater(cher::PHOTO_TILE_POLL);
+}
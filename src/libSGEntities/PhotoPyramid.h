@@ -0,0 +1,142 @@
+#ifndef PHOTOPYRAMID_H
+#define PHOTOPYRAMID_H
+
+#include <string>
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Image>
+#include <osg/Texture2D>
+#include <osg/TexMat>
+#include <osg/StateSet>
+#include <osg/Drawable>
+
+#include <QFuture>
+
+#include "Settings.h"
+
+namespace entity {
+
+/*! \class PhotoPyramid
+ * \brief Multi-resolution tiles of a large photo image stored on disk.
+ *
+ * Level 0 is the image at full resolution, every next level has half of the size of the previous one, and the
+ * last level fits into a single tile. Each level is cut into square tiles of getTileSize() pixels which are
+ * written as separate files into the application cache, one directory per image digest (see getDirectory()).
+ * The pyramid is built once per image by build(); any region of tiles of any level can then be read by
+ * readRegion() without touching the full resolution image.
+ *
+ * The pyramid is used to display photos whose images are larger than cher::PHOTO_PYRAMID_THRESHOLD, see
+ * PhotoTileCallback.
+*/
+class PhotoPyramid : public osg::Referenced
+{
+public:
+    /*! Constructor. The pyramid is not read from disk, see load(). */
+    PhotoPyramid(const std::string& digest, int tileSize = cher::PHOTO_TILE_SIZE);
+
+    /*! \return true if the image is large enough to be shown from a pyramid. */
+    static bool isLarge(const osg::Image* image);
+
+    /*! \return directory of the pyramid tiles of the given image digest. */
+    static std::string getDirectory(const std::string& digest);
+
+    /*! A method to write all the tiles of the image, unless a complete pyramid of the same digest is on disk
+     * already. It does not modify the image and therefore can be run from a worker thread; however, only one
+     * build per digest can run at the same time, see buildLater().
+     * \return true if the pyramid is complete. */
+    static bool build(const osg::Image* image, const std::string& digest, int tileSize = cher::PHOTO_TILE_SIZE);
+
+    /*! A method to run build() on the global thread pool. If a build of the same digest is already running,
+     * its future is returned. It has to be called from the GUI thread. */
+    static QFuture<bool> buildLater(const osg::Image* image, const std::string& digest);
+
+    /*! A method to read the pyramid description from disk.
+     * \return true if the pyramid is complete. */
+    bool load();
+
+    const std::string& getDigest() const;
+    int getTileSize() const;
+    int getNumLevels() const;
+    int getLevelWidth(int level) const;
+    int getLevelHeight(int level) const;
+    int getNumTilesX(int level) const;
+    int getNumTilesY(int level) const;
+
+    /*! \return file name of the tile. */
+    std::string getTileFileName(int level, int x, int y) const;
+
+    /*! A method to compose a region of tiles into a single image. It only reads the tile files, and therefore
+     * can be run from a worker thread.
+     * \param level is the pyramid level
+     * \param x0, y0 are the first tile of the region
+     * \param x1, y1 are one past the last tile of the region
+     * \return the image of the region or NULL if any of the tiles could not be read. */
+    osg::Image* readRegion(int level, int x0, int y0, int x1, int y1) const;
+
+protected:
+    ~PhotoPyramid();
+
+private:
+    std::string m_digest;
+    int m_tileSize;
+    int m_width, m_height, m_levels;
+};
+
+/*! \class PhotoTileCallback
+ * \brief Cull callback of entity::Photo which shows large images from their pyramid.
+ *
+ * The callback does nothing while the photo image is smaller than cher::PHOTO_PYRAMID_THRESHOLD. Otherwise the
+ * full resolution texture of the photo is never applied; instead, the photo is drawn with its own texture which
+ * contains only the visible region of tiles, at the pyramid level that matches the on-screen size of the photo.
+ * The region texture is mapped onto the photo by a texture matrix, and it is limited to cher::PHOTO_TEXTURE_MAX
+ * texels per side, so that the texture memory of a photo is bounded by its footprint on the screen rather than
+ * by the image resolution. Both are applied by a state set that is pushed only while the photo is culled, so the
+ * state set of the photo, which is saved with the scene, keeps the full resolution texture.
+ *
+ * The pyramid is built and the regions are read on the global thread pool; the viewer is asked to redraw every
+ * cher::PHOTO_TILE_POLL milliseconds until they are ready.
+ *
+ * The callback also marks the image of every drawn photo as shown within entity::PhotoStore, except for the photos
+ * shown from their pyramid, whose full resolution images can be evicted from memory.
+*/
+class PhotoTileCallback : public osg::Drawable::CullCallback
+{
+public:
+    PhotoTileCallback();
+
+    virtual bool cull(osg::NodeVisitor* nv, osg::Drawable* drawable, osg::RenderInfo* renderInfo) const;
+
+    /*! \return the pyramid of the photo or NULL if the photo is not shown from a pyramid. */
+    const PhotoPyramid* getPyramid() const;
+
+    /*! \return pyramid level of the region texture, or -1 if no region is shown yet. */
+    int getLevel() const;
+
+protected:
+    struct Region
+    {
+        int level, x0, y0, x1, y1;
+        bool operator==(const Region& other) const;
+        bool contains(const Region& other) const;
+    };
+
+    bool computeRegion(osg::NodeVisitor* nv, osg::Drawable* drawable, Region& region) const;
+    bool cullRegion(osg::NodeVisitor* nv, osg::Drawable* drawable) const;
+    void requestUpdate() const;
+
+private:
+    /* cull is a const method of the callback, the paging state is changed from it */
+    mutable osg::ref_ptr<PhotoPyramid> m_pyramid;
+    mutable osg::ref_ptr<osg::Texture2D> m_texture;
+    mutable osg::ref_ptr<osg::TexMat> m_texmat;
+    osg::ref_ptr<osg::StateSet> m_stateset; /* transient state set with the region texture, never saved */
+    mutable QFuture<bool> m_building;
+    mutable QFuture< osg::ref_ptr<osg::Image> > m_reading;
+    mutable Region m_region, m_requested;
+    mutable bool m_small;
+};
+
+} // namespace entity
+
+#endif // PHOTOPYRAMID_H
@@ -0,0 +1,308 @@
+#include "PhotoStore.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <osgDB/ReadFile>
+#include <osgDB/WriteFile>
+
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtGlobal>
+#include <QDebug>
+
+#include "Settings.h"
+
+entity::PhotoStore &entity::PhotoStore::instance()
+{
+    static entity::PhotoStore store;
+    return store;
+}
+
+std::string entity::PhotoStore::computeDigest(const osg::Image *image)
+{
+    if (!image || !image->data()) return "";
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    int header[6] = {image->s(), image->t(), image->r(),
+                     static_cast<int>(image->getPixelFormat()), static_cast<int>(image->getDataType()),
+                     static_cast<int>(image->getPacking())};
+    hash.addData(reinterpret_cast<const char*>(header), sizeof(header));
+    hash.addData(reinterpret_cast<const char*>(image->data()), static_cast<int>(image->getTotalSizeInBytes()));
+    return hash.result().toHex().toStdString();
+}
+
+std::string entity::PhotoStore::getStoreDirectory(const std::string &scenePath)
+{
+    QFileInfo info(QString::fromStdString(scenePath));
+    return info.dir().filePath(info.completeBaseName() + QString::fromStdString(cher::PHOTO_STORE_SUFFIX)).toStdString();
+}
+
+std::string entity::PhotoStore::getStoreFileName(const std::string &scenePath, const std::string &digest)
+{
+    QFileInfo info(QString::fromStdString(scenePath));
+    return (info.completeBaseName() + QString::fromStdString(cher::PHOTO_STORE_SUFFIX) + "/"
+            + QString::fromStdString(digest + "." + cher::PHOTO_STORE_FORMAT)).toStdString();
+}
+
+osg::Texture2D *entity::PhotoStore::getTexture(osg::Image *image, std::string &digest)
+{
+    if (!image) return 0;
+    if (digest.empty()) digest = computeDigest(image);
+
+    osg::Texture2D* texture = this->findTexture(digest);
+    if (texture){
+        /* the pixels of an evicted texture are at hand */
+        Entry& entry = m_textures[digest];
+        if (entry.evicted) this->restore(entry, image);
+        return texture;
+    }
+
+    texture = new osg::Texture2D(image);
+    if (!digest.empty()) this->add(digest, texture);
+    return texture;
+}
+
+osg::Texture2D *entity::PhotoStore::createTexture(const std::string &digest)
+{
+    if (digest.empty()) return 0;
+    osg::Texture2D* texture = this->findTexture(digest);
+    if (texture) return texture;
+
+    texture = new osg::Texture2D;
+    this->add(digest, texture);
+    return texture;
+}
+
+osg::Texture2D *entity::PhotoStore::findTexture(const std::string &digest) const
+{
+    auto it = m_textures.find(digest);
+    if (it == m_textures.end()) return 0;
+    return it->second.texture.get();
+}
+
+bool entity::PhotoStore::storeImage(const osg::Image *image, const std::string &digest, const std::string &scenePath) const
+{
+    if (!image || digest.empty()) return false;
+
+    QDir dir(QFileInfo(QString::fromStdString(scenePath)).dir());
+    QString name = QString::fromStdString(getStoreFileName(scenePath, digest));
+    if (QFileInfo(dir.filePath(name)).exists()) return true;
+
+    if (!QDir().mkpath(QString::fromStdString(getStoreDirectory(scenePath)))){
+        qWarning("PhotoStore::storeImage: could not create store directory");
+        return false;
+    }
+    if (!osgDB::writeImageFile(*image, dir.filePath(name).toStdString())){
+        qWarning() << "PhotoStore::storeImage: could not write " << name;
+        return false;
+    }
+    return true;
+}
+
+unsigned int entity::PhotoStore::getNumTextures()
+{
+    for (auto it = m_textures.begin(); it != m_textures.end(); ){
+        if (!it->second.texture.valid()){
+            removeCacheFile(it->first, it->second);
+            it = m_textures.erase(it);
+        }
+        else ++it;
+    }
+    return m_textures.size();
+}
+
+void entity::PhotoStore::setMemoryBudget(unsigned long long bytes)
+{
+    m_budget = bytes;
+}
+
+unsigned long long entity::PhotoStore::getMemoryBudget() const
+{
+    return m_budget;
+}
+
+bool entity::PhotoStore::touch(const std::string &digest)
+{
+    auto it = m_textures.find(digest);
+    if (it == m_textures.end() || !it->second.texture.valid()) return false;
+    Entry& entry = it->second;
+    entry.frame = m_frame;
+    if (!entry.evicted || entry.unreadable) return false;
+
+    if (!entry.reloading){
+        std::string path = getCacheFileName(digest);
+        entry.loading = QtConcurrent::run([path]() -> osg::ref_ptr<osg::Image> {
+            return osgDB::readImageFile(path);
+        });
+        entry.reloading = true;
+        return true;
+    }
+    if (!entry.loading.isFinished()) return true;
+    this->restore(entry, entry.loading.result().get());
+    return false;
+}
+
+unsigned int entity::PhotoStore::beginFrame()
+{
+    ++m_frame;
+
+    /* resident images which were not shown by the previous frame, least recently shown first */
+    unsigned long long resident = 0;
+    std::vector< std::pair<unsigned int, std::string> > candidates;
+    for (auto it = m_textures.begin(); it != m_textures.end(); ){
+        if (!it->second.texture.valid()){
+            removeCacheFile(it->first, it->second);
+            it = m_textures.erase(it);
+            continue;
+        }
+        const osg::Image* image = it->second.texture->getImage();
+        if (image && image->data()){
+            resident += image->getTotalSizeInBytes();
+            if (it->second.frame + 1 < m_frame) candidates.push_back(std::make_pair(it->second.frame, it->first));
+        }
+        ++it;
+    }
+    if (resident <= m_budget) return 0;
+    std::sort(candidates.begin(), candidates.end());
+
+    unsigned int count = 0;
+    for (size_t i=0; i<candidates.size() && resident > m_budget; ++i){
+        Entry& entry = m_textures[candidates[i].second];
+        unsigned long long bytes = entry.texture->getImage()->getTotalSizeInBytes();
+        if (!this->evict(candidates[i].second, entry)) continue;
+        resident -= bytes;
+        ++count;
+    }
+    if (count) qInfo() << "PhotoStore: evicted" << count << "images, resident" << resident << "bytes";
+    return count;
+}
+
+osg::Image *entity::PhotoStore::restoreImage(const std::string &digest)
+{
+    auto it = m_textures.find(digest);
+    if (it == m_textures.end() || !it->second.texture.valid()) return 0;
+    Entry& entry = it->second;
+    if (entry.evicted){
+        /* an image which could not be read back in the background is tried once more */
+        osg::ref_ptr<osg::Image> image;
+        if (entry.reloading) image = entry.loading.result();
+        if (!image.get()) image = osgDB::readImageFile(getCacheFileName(digest));
+        this->restore(entry, image.get());
+    }
+    return entry.texture->getImage();
+}
+
+unsigned long long entity::PhotoStore::getResidentBytes() const
+{
+    unsigned long long bytes = 0;
+    for (auto it = m_textures.begin(); it != m_textures.end(); ++it){
+        const osg::Texture2D* texture = it->second.texture.get();
+        if (texture && texture->getImage()) bytes += texture->getImage()->getTotalSizeInBytes();
+    }
+    return bytes;
+}
+
+unsigned long long entity::PhotoStore::getEvictedBytes() const
+{
+    unsigned long long bytes = 0;
+    for (auto it = m_textures.begin(); it != m_textures.end(); ++it){
+        if (it->second.texture.valid() && it->second.evicted) bytes += it->second.bytes;
+    }
+    return bytes;
+}
+
+std::string entity::PhotoStore::getCacheFileName(const std::string &digest)
+{
+    QDir dir(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath(cher::PHOTO_EVICTION_CACHE));
+    return dir.filePath(QString::fromStdString(digest + "." + cher::PHOTO_STORE_FORMAT)).toStdString();
+}
+
+unsigned int entity::PhotoStore::clearCache()
+{
+    unsigned int count = 0;
+    for (auto it = m_textures.begin(); it != m_textures.end(); ++it){
+        it->second.saving.waitForFinished();
+        if (QFile::remove(QString::fromStdString(getCacheFileName(it->first)))) ++count;
+    }
+    return count;
+}
+
+entity::PhotoStore::PhotoStore()
+    : m_budget(cher::PHOTO_MEMORY_BUDGET)
+    , m_frame(0)
+{
+}
+
+entity::PhotoStore::Entry::Entry()
+    : frame(0)
+    , bytes(0)
+    , evicted(false)
+    , reloading(false)
+    , unreadable(false)
+{
+}
+
+void entity::PhotoStore::add(const std::string &digest, osg::Texture2D *texture)
+{
+    /* the entry of a released texture may be left in the map */
+    Entry& entry = m_textures[digest];
+    entry = Entry();
+    entry.texture = texture;
+    entry.frame = m_frame;
+}
+
+/* runs within the thread pool; the file is renamed once complete, so that a partial file is never read back */
+static bool writeCacheFile(osg::ref_ptr<const osg::Image> image, const std::string& path)
+{
+    if (!QDir().mkpath(QFileInfo(QString::fromStdString(path)).path())) return false;
+    std::string partial = path + ".part";
+    if (!osgDB::writeImageFile(*image, partial)) return false;
+    return QFile::rename(QString::fromStdString(partial), QString::fromStdString(path));
+}
+
+bool entity::PhotoStore::evict(const std::string &digest, Entry &entry)
+{
+    std::string path = getCacheFileName(digest);
+    if (entry.saving.isRunning()) return false;
+    if (!QFileInfo::exists(QString::fromStdString(path))){
+        /* a failed write is not repeated, the image then stays resident */
+        if (entry.saving.resultCount() > 0 && !entry.saving.result()) return false;
+        osg::ref_ptr<const osg::Image> image = entry.texture->getImage();
+        entry.saving = QtConcurrent::run(writeCacheFile, image, path);
+        return false;
+    }
+
+    entry.bytes = entry.texture->getImage()->getTotalSizeInBytes();
+    entry.texture->setImage(0);
+    entry.texture->releaseGLObjects();
+    entry.evicted = true;
+    entry.reloading = false;
+    return true;
+}
+
+void entity::PhotoStore::restore(Entry &entry, osg::Image *image)
+{
+    entry.loading = QFuture< osg::ref_ptr<osg::Image> >();
+    entry.reloading = false;
+
+    /* the entry stays evicted, so that the texture is not taken for a resident one */
+    if (!image){
+        qWarning("PhotoStore: could not read evicted image back from the cache");
+        entry.unreadable = true;
+        return;
+    }
+    entry.texture->setImage(image);
+    entry.evicted = entry.unreadable = false;
+    entry.bytes = 0;
+}
+
+void entity::PhotoStore::removeCacheFile(const std::string &digest, Entry &entry)
+{
+    entry.saving.waitForFinished();
+    QFile::remove(QString::fromStdString(getCacheFileName(digest)));
+}
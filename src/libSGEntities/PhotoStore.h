@@ -0,0 +1,142 @@
+#ifndef PHOTOSTORE_H
+#define PHOTOSTORE_H
+
+#include <string>
+#include <unordered_map>
+
+#include <osg/Image>
+#include <osg/Texture2D>
+#include <osg/observer_ptr>
+#include <osg/ref_ptr>
+
+#include <QFuture>
+
+namespace entity {
+
+/*! \class PhotoStore
+ * \brief Content-addressed storage of photo images.
+ *
+ * Every image is identified by a digest (SHA-1) of its pixel data. The store has two roles:
+ *
+ * * in memory, all the entity::Photo that show identical images share a single osg::Texture2D, see getTexture();
+ * * on disk, the images of a scene are written once into the sidecar directory next to the scene file
+ *   (the scene file name with cher::PHOTO_STORE_SUFFIX), one file per digest, see storeImage(). The scene file
+ *   only refers to the stored file by its relative name.
+ *
+ * The store only keeps observer pointers on textures, so that a texture is released together with its last photo.
+ *
+ * The store also keeps the photo images within a memory budget, see setMemoryBudget(). Every photo which is
+ * drawn marks its image as shown by touch(); at the beginning of a frame, beginFrame() evicts the images which
+ * were not shown by the previous frame, least recently shown first, until the resident images fit the budget.
+ * An evicted image is written to the application cache (cher::PHOTO_EVICTION_CACHE), then both its data and
+ * its GL texture object are released. It is read back on the global thread pool once its photo is shown again,
+ * or at once by restoreImage() when the pixels are needed, e.g., to save the scene. The cache file is kept while
+ * the texture is alive, so that the image can be evicted again without encoding; it is removed together with
+ * the texture entry or by clearCache() at exit.
+*/
+class PhotoStore
+{
+public:
+    /*! \return the application-wide store. */
+    static PhotoStore& instance();
+
+    /*! \return the hexadecimal SHA-1 digest of image dimensions, format and pixel data; empty string if the
+     * image has no data. */
+    static std::string computeDigest(const osg::Image* image);
+
+    /*! \return the directory of stored photos for a given scene file. */
+    static std::string getStoreDirectory(const std::string& scenePath);
+
+    /*! \return the file name of a stored image relative to the directory of the scene file. */
+    static std::string getStoreFileName(const std::string& scenePath, const std::string& digest);
+
+    /*! A method to obtain a texture for the given image. If a texture of an identical image is alive, it is
+     * returned instead of creating a new one.
+     * \param image is the decoded image
+     * \param digest is the digest of the image; if empty, it is computed and returned through this parameter
+     * \return the shared texture, or NULL if the image is NULL. */
+    osg::Texture2D* getTexture(osg::Image* image, std::string& digest);
+
+    /*! A method to obtain a texture for an image which is not decoded yet, e.g., see SceneChunkFile::decodePhotos().
+     * If there is no alive texture of the digest, an empty texture is created and registered under the digest;
+     * the image has to be set to it once decoded.
+     * \return the shared texture, or NULL if the digest is empty. */
+    osg::Texture2D* createTexture(const std::string& digest);
+
+    /*! \return the alive texture of the given digest or NULL if there is none. */
+    osg::Texture2D* findTexture(const std::string& digest) const;
+
+    /*! A method to write the image to the sidecar directory of the scene, unless the file of the same digest
+     * is already there.
+     * \return true if the stored file exists after the call. */
+    bool storeImage(const osg::Image* image, const std::string& digest, const std::string& scenePath) const;
+
+    /*! \return number of alive textures within the store. */
+    unsigned int getNumTextures();
+
+    /*! A method to set the maximal number of bytes of resident photo images, see cher::PHOTO_MEMORY_BUDGET. */
+    void setMemoryBudget(unsigned long long bytes);
+    unsigned long long getMemoryBudget() const;
+
+    /*! A method to mark the image of the given digest as shown by the current frame. If the image is evicted,
+     * it is read back in the background.
+     * \return true if the image is not resident yet, i.e., the frame has to be drawn again later. */
+    bool touch(const std::string& digest);
+
+    /*! A method to start a new frame: the images which were not shown by the previous frame are evicted while
+     * the resident images exceed the budget. It has to be called from the GUI thread before the cull traversal.
+     * \return number of images evicted. */
+    unsigned int beginFrame();
+
+    /*! A method to read an evicted image back at once, e.g., before the image is written to a scene file.
+     * \return the resident image of the digest or NULL if there is none. */
+    osg::Image* restoreImage(const std::string& digest);
+
+    /*! \return number of bytes of the resident images. */
+    unsigned long long getResidentBytes() const;
+
+    /*! \return number of bytes of the evicted images whose textures are alive. */
+    unsigned long long getEvictedBytes() const;
+
+    /*! \return file name of the evicted image of a given digest within the application cache. */
+    static std::string getCacheFileName(const std::string& digest);
+
+    /*! A method to remove the cache files of all the images written by the store, e.g., at exit. The running
+     * writes are waited for; the evicted images can no longer be read back.
+     * \return number of files removed. */
+    unsigned int clearCache();
+
+protected:
+    PhotoStore();
+
+    struct Entry
+    {
+        Entry();
+
+        osg::observer_ptr<osg::Texture2D> texture;
+        unsigned int frame; /* last frame the image was shown */
+        unsigned long long bytes; /* size of the evicted image */
+        bool evicted, reloading;
+        bool unreadable; /* the evicted image could not be read back, it is not retried by touch() */
+        QFuture<bool> saving;
+        QFuture< osg::ref_ptr<osg::Image> > loading;
+    };
+
+    void add(const std::string& digest, osg::Texture2D* texture);
+
+    /* \return true if the image is evicted, false if it is still being written to the cache */
+    bool evict(const std::string& digest, Entry& entry);
+    void restore(Entry& entry, osg::Image* image);
+
+    /* removes the cache file of an entry whose texture is released */
+    static void removeCacheFile(const std::string& digest, Entry& entry);
+
+private:
+    std::unordered_map<std::string, Entry> m_textures;
+    unsigned long long m_budget;
+    unsigned int m_frame;
+};
+
+} // namespace entity
+
+#endif // PHOTOSTORE_H
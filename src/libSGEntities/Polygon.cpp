@@ -14,7 +14,7 @@
 const GLenum POLYGON_PHANTOM_TYPE = GL_LINE_STRIP;
 
 entity::Polygon::Polygon()
-    : entity::ShaderedEntity2D(POLYGON_PHANTOM_TYPE, osg::Geometry::BIND_PER_VERTEX, "Polygon", cher::POLYGON_CLR_PHANTOM)
+    : entity::ShaderedEntity2D(POLYGON_PHANTOM_TYPE, osg::Geometry::BIND_OVERALL, "Polygon", cher::POLYGON_CLR_PHANTOM)
 {
 }
 
@@ -40,6 +40,7 @@ bool entity::Polygon::copyFrom(const ShaderedEntity2D *copy)
 
 void entity::Polygon::editLastPoint(float u, float v)
 {
+    this->detachArrays();
     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
     Q_CHECK_PTR(verts);
     (*verts)[verts->size()-1] = osg::Vec3f(u, v, 0.f);
@@ -50,6 +51,7 @@ void entity::Polygon::editLastPoint(float u, float v)
 
 void entity::Polygon::removeLastPoint()
 {
+    this->detachArrays();
     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
     Q_CHECK_PTR(verts);
     verts->pop_back();
@@ -57,8 +59,10 @@ void entity::Polygon::removeLastPoint()
 
     osg::Vec4Array* colors = static_cast<osg::Vec4Array*>(this->getColorArray());
     Q_CHECK_PTR(colors);
-    colors->pop_back();
-    colors->dirty();
+    if (colors->getBinding() != osg::Array::BIND_OVERALL){
+        colors->pop_back();
+        colors->dirty();
+    }
 
     m_lines->setFirst(0);
     m_lines->setCount(verts->size());
@@ -117,11 +121,12 @@ bool entity::Polygon::redefineToShader(osg::MatrixTransform *t)
     /* reset the primitive type */
     m_lines->set(GL_POLYGON, 0, this->getNumPoints());
 
-    /* set shader attributes */
+    /* set shader attributes; the color is a constant attribute of the whole polygon */
+    this->compactColors();
     this->setVertexAttribArray(0, points, osg::Array::BIND_PER_VERTEX);
     osg::Vec4Array* colors = dynamic_cast<osg::Vec4Array*>(this->getColorArray());
     Q_CHECK_PTR(colors);
-    this->setVertexAttribArray(1, colors, osg::Array::BIND_PER_VERTEX);
+    this->setVertexAttribArray(1, colors, osg::Array::BIND_OVERALL);
 
     /* apply shader to the state set */
     Q_ASSERT(this->getOrCreateStateSet());
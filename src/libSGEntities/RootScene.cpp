@@ -2,23 +2,74 @@
 
 #include "iostream"
 #include <sstream>
+#include <cstring>
+#include <map>
 #include <stdlib.h>
 
 #include <QtGlobal>
 #include <QDebug>
 #include <QMessageBox>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentMap>
 
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 #include <osgDB/ReaderWriter>
 #include <osgDB/Registry>
 #include <osgDB/Options>
+#include <osgDB/FileUtils>
 
 #include "Settings.h"
 #include "Utilities.h"
+#include "SceneChunkFile.h"
 #include "EditEntityCommand.h"
 #include "MainWindow.h"
 
+/* Defers the image reads of scene deserialization: every image is returned empty with its file name, and the
+ * files are decoded in parallel by decode() once the whole scene is read. */
+class DeferredImageCallback : public osgDB::ReadFileCallback
+{
+public:
+    virtual osgDB::ReaderWriter::ReadResult readImage(const std::string& filename, const osgDB::Options* options)
+    {
+        std::string path = osgDB::findDataFile(filename, options);
+        if (path.empty()) return osgDB::ReaderWriter::ReadResult::FILE_NOT_FOUND;
+        osg::ref_ptr<osg::Image> image = new osg::Image;
+        image->setFileName(filename);
+        m_images[path].push_back(image);
+        return image.get();
+    }
+
+    /* every distinct file is decoded by a single thread and copied into its empty images */
+    int decode()
+    {
+        std::vector<std::pair<std::string, std::vector< osg::ref_ptr<osg::Image> > > > files(m_images.begin(), m_images.end());
+        QtConcurrent::blockingMap(files, [](std::pair<std::string, std::vector< osg::ref_ptr<osg::Image> > >& file){
+            osg::ref_ptr<osg::Image> decoded = osgDB::readImageFile(file.first);
+            if (!decoded.get() || !decoded->data()){
+                qWarning() << "loadSceneFromFile: could not read image " << file.first.c_str();
+                return;
+            }
+            for (osg::ref_ptr<osg::Image>& image : file.second){
+                image->allocateImage(decoded->s(), decoded->t(), decoded->r(),
+                                     decoded->getPixelFormat(), decoded->getDataType(), decoded->getPacking());
+                image->setInternalTextureFormat(decoded->getInternalTextureFormat());
+                image->setOrigin(decoded->getOrigin());
+                std::memcpy(image->data(), decoded->data(), decoded->getTotalSizeInBytes());
+            }
+        });
+        m_images.clear();
+        return static_cast<int>(files.size());
+    }
+
+protected:
+    ~DeferredImageCallback() {}
+
+private:
+    std::map<std::string, std::vector< osg::ref_ptr<osg::Image> > > m_images; /* file path to the images read from it */
+};
+
 RootScene::RootScene(QUndoStack *undoStack)
     : osg::ProtectedGroup()
     , m_userScene(new entity::UserScene)
@@ -110,6 +161,7 @@ void RootScene::setCanvasVisibilityAll(entity::Canvas *canvas, bool vis)
 {
     if (!canvas) return;
     canvas->setVisibilityAll(vis);
+    canvas->setDirty(true);
     emit m_userScene->canvasVisibilitySet(m_userScene->getCanvasIndex(canvas), vis);
 }
 
@@ -123,6 +175,21 @@ bool RootScene::writeScenetoFile()
     bool result = true;
     if (m_userScene->getFilePath() == "") return false;
 
+    /* the native format is written from the canvas data directly and only the changes since the last save
+     * are appended, so neither the frames nor the pending canvases have to be touched */
+    if (entity::SceneChunkFile::isChunkFileName(m_userScene->getFilePath())){
+        osg::ref_ptr<entity::SceneChunkFile> archive = m_userScene->getArchive();
+        if (!archive.get()) archive = new entity::SceneChunkFile;
+        result = archive->save(m_userScene.get(), m_userScene->getFilePath());
+        if (result) m_userScene->setArchive(archive.get());
+        m_saved = result;
+        return result;
+    }
+
+    /* canvases that are still within the scene file must be read before it is overwritten */
+    if (!m_userScene->materializeCanvases())
+        qWarning("RootScene::writeSceneToFile: some of the canvases could not be read from file");
+
     /* save current scene state */
     osg::ref_ptr<entity::SceneState> state = new entity::SceneState;
     state->stripDataFrom(this);
@@ -135,7 +202,20 @@ bool RootScene::writeScenetoFile()
         canvas->detachFrame();
     }
 
-    if (!osgDB::writeNodeFile(*(m_userScene.get()), m_userScene->getFilePath(), new osgDB::Options("WriteImageHint=IncludeData")))
+    /* each distinct image is kept once in the sidecar photo store and the scene only refers to it;
+     * if the store cannot be written, the images are embedded as before */
+    bool external = true;
+    for (int i=0; i<m_userScene->getNumCanvases(); ++i){
+        entity::Canvas* canvas = m_userScene->getCanvas(i);
+        if (!canvas) continue;
+        for (size_t j=0; j<canvas->getNumPhotos(); ++j){
+            entity::Photo* photo = canvas->getPhoto(j);
+            if (photo && !photo->storeImage(m_userScene->getFilePath()))
+                external = false;
+        }
+    }
+    std::string hint = external? "WriteImageHint=UseExternal" : "WriteImageHint=IncludeData";
+    if (!osgDB::writeNodeFile(*(m_userScene.get()), m_userScene->getFilePath(), new osgDB::Options(hint)))
         result = false;
 
     /* for each canvas, attach its tools back */
@@ -159,6 +239,7 @@ bool RootScene::writeScenetoFile()
 bool RootScene::exportSceneToFile(const std::string &name)
 {
     if (name == "") return false;
+    m_userScene->materializeCanvases();
 
     /* save current scene state */
     osg::ref_ptr<entity::SceneState> state = new entity::SceneState;
@@ -227,11 +308,27 @@ bool RootScene::loadSceneFromFile()
     }
     if (m_userScene->getFilePath() == "")
         return false;
-    osg::Node* node = osgDB::readNodeFile(m_userScene->getFilePath());
+    if (entity::SceneChunkFile::isChunkFile(m_userScene->getFilePath()))
+        return this->loadSceneFromChunkFile();
+
+    QElapsedTimer timer, timerTotal;
+    timer.start();
+    timerTotal.start();
+
+    osg::ref_ptr<DeferredImageCallback> images = new DeferredImageCallback;
+    osg::ref_ptr<osgDB::Options> options = osgDB::Registry::instance()->getOptions()?
+                static_cast<osgDB::Options*>(osgDB::Registry::instance()->getOptions()->clone(osg::CopyOp::SHALLOW_COPY))
+              : new osgDB::Options;
+    options->setReadFileCallback(images.get());
+    osg::Node* node = osgDB::readNodeFile(m_userScene->getFilePath(), options.get());
     if (!node){
         qWarning("loadSceneFromFile: node is NULL");
         return false;
     }
+    QElapsedTimer timerDecode;
+    timerDecode.start();
+    int files = images->decode();
+    qInfo() << "loadSceneFromFile: decode photos in parallel, files=" << files << ", ms=" << timerDecode.elapsed();
 
     osg::ref_ptr<entity::UserScene> newscene = dynamic_cast<entity::UserScene*>(node);
     if (!newscene.get()){
@@ -240,6 +337,7 @@ bool RootScene::loadSceneFromFile()
     }
     qDebug() << "Loaded scene, number of children: " << newscene->getNumChildren();
     qDebug() << "Loaded scene, number of canvases: " << newscene->getNumCanvases();
+    qInfo() << "loadSceneFromFile: read file, ms=" << timer.restart();
 
     /* replace the original */
     if (!this->replaceChild(m_userScene.get(), newscene.get())){
@@ -250,7 +348,10 @@ bool RootScene::loadSceneFromFile()
     /* update pointer */
     m_userScene = newscene.get();
 
-    /* load the construction tools, set photo textures */
+    /* load the construction tools, set photo textures, initialize stroke programs */
+    std::vector<entity::Stroke*> strokes;
+    std::vector<entity::Canvas*> owners;
+    std::vector<char> fitted; /* strokes whose geometry will change during preparation */
     for (int i=0; i<m_userScene->getNumCanvases(); ++i){
         entity::Canvas* cnv = m_userScene->getCanvas(i);
         if (!cnv) qFatal("RootScene::loadSceneFromFile() canvas is NULL");
@@ -264,10 +365,10 @@ bool RootScene::loadSceneFromFile()
         for (size_t j=0; j<cnv->getNumPhotos(); ++j){
             entity::Photo* photo = cnv->getPhoto(j);
             if (!photo) continue;
+            photo->shareTexture();
             photo->getOrCreateStateSet()->setTextureAttributeAndModes(0, photo->getTextureAsAttribute());
         }
 
-        /* stroke curved */
         for (size_t k=0; k<cnv->getNumStrokes(); ++k){
             entity::Stroke* stroke = cnv->getStroke(k);
             if (!stroke) {
@@ -275,10 +376,35 @@ bool RootScene::loadSceneFromFile()
                 continue;
             }
             stroke->initializeProgram(cnv->getProgramStroke());
-            if (!stroke->redefineToShape(cnv->getTransform()))
-                qWarning("Could not redefine stroke as curve");
+            strokes.push_back(stroke);
+            owners.push_back(cnv);
+            fitted.push_back(stroke->getIsCurved()? 0 : 1);
         }
     }
+    qInfo() << "loadSceneFromFile: initialize canvases, ms=" << timer.restart();
+
+    /* CPU part of stroke re-shaping: curve fitting and bounding boxes of the strokes that keep their points;
+     * every stroke is processed by a single thread and the geometry is not changed */
+    std::vector<char> prepared(strokes.size(), 0);
+    std::vector<int> indices(strokes.size());
+    for (size_t k=0; k<indices.size(); ++k) indices[k] = static_cast<int>(k);
+    QtConcurrent::blockingMap(indices, [&strokes, &prepared, &fitted](int k){
+        entity::Stroke* stroke = strokes[k];
+        if (!stroke->prepareShape()) return;
+        if (!fitted[k]) stroke->getBoundingBox();
+        prepared[k] = 1;
+    });
+    qInfo() << "loadSceneFromFile: prepare strokes, n=" << strokes.size()
+            << ", threads=" << QThreadPool::globalInstance()->maxThreadCount()
+            << ", ms=" << timer.restart();
+
+    /* scene graph part of stroke re-shaping: the fitted curves are swapped in and the shaders attached */
+    for (size_t k=0; k<strokes.size(); ++k){
+        if (!prepared[k] || !strokes[k]->finishShape(owners[k]->getTransform()))
+            qWarning("Could not redefine stroke as curve");
+        if (fitted[k]) strokes[k]->dirtyBound();
+    }
+    qInfo() << "loadSceneFromFile: attach strokes, ms=" << timer.restart();
 
     /* update current/previous canvases */
     for (int i=0; i<m_userScene->getNumCanvases(); ++i){
@@ -287,6 +413,54 @@ bool RootScene::loadSceneFromFile()
         cnv->setColor(cher::CANVAS_CLR_REST);
         m_userScene->setCanvasCurrent(cnv);
     }
+    qInfo() << "loadSceneFromFile: set canvases, ms=" << timer.restart();
+    qInfo() << "loadSceneFromFile: total, ms=" << timerTotal.elapsed();
+
+    newscene = 0;
+    m_saved = true;
+    return true;
+}
+
+/* Only the canvas headers are read here; the strokes and photos of the current and previous canvases are read
+ * right away, and the rest of the canvases are materialized from the event loop. */
+bool RootScene::loadSceneFromChunkFile()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    osg::ref_ptr<entity::SceneChunkFile> archive = new entity::SceneChunkFile;
+    if (!archive->open(m_userScene->getFilePath())){
+        qWarning("loadSceneFromChunkFile: could not open file");
+        return false;
+    }
+    osg::ref_ptr<entity::UserScene> newscene = archive->readScene();
+    if (!newscene.get()){
+        qWarning("loadSceneFromChunkFile: could not read scene from file");
+        return false;
+    }
+    newscene->setFilePath(m_userScene->getFilePath());
+    qInfo() << "loadSceneFromChunkFile: read headers, chunks=" << archive->getNumChunks() << ", ms=" << timer.restart();
+
+    if (!this->replaceChild(m_userScene.get(), newscene.get())){
+        qWarning("loadSceneFromChunkFile: could not replace the original child");
+        return false;
+    }
+    m_userScene = newscene.get();
+
+    /* same current/previous assignment as for OSG files, without touching the other canvases */
+    int sz = m_userScene->getNumCanvases();
+    for (int i=0; i<sz; ++i){
+        entity::Canvas* cnv = m_userScene->getCanvas(i);
+        if (!cnv) qFatal("RootScene::loadSceneFromChunkFile() canvas is NULL");
+        cnv->setColor(cher::CANVAS_CLR_REST);
+    }
+    if (sz > 1) m_userScene->setCanvasCurrent(m_userScene->getCanvas(sz-2));
+    if (sz > 0) m_userScene->setCanvasCurrent(m_userScene->getCanvas(sz-1));
+    qInfo() << "loadSceneFromChunkFile: read current canvases, pending=" << m_userScene->getNumCanvasesPending()
+            << ", ms=" << timer.restart();
+
+    m_userScene->materializeLater();
+    m_userScene->attachPhotosLater();
     newscene = 0;
     m_saved = true;
     return true;
@@ -760,7 +934,8 @@ void RootScene::editStrokeDelete(entity::Stroke *stroke)
     m_saved = false;
 }
 
-/* copies the selected strokes into buffer, makes a deep copy */
+/* copies the selected strokes into buffer; the copies share the point arrays with the selected strokes
+ * until either of them is edited, see entity::ShaderedEntity2D::copyFrom() */
 void RootScene::copyToBuffer()
 {
     m_buffer.clear();
@@ -779,7 +954,6 @@ void RootScene::copyToBuffer()
             continue;
         }
         stroke->copyFrom(&copy);
-        stroke->redefineToShape(copy.getProgram()->getTransform());
         m_buffer.push_back(stroke);
     }
 }
@@ -846,6 +1020,7 @@ bool RootScene::setSceneState(const entity::SceneState *state)
     this->setBookmarkToolVisibility(state->getBookmarksFlag());
 
     if (state->isEmpty()) return false;
+    m_userScene->materializeCanvases();
 
     const std::vector<bool>& cdf = state->getCanvasDataFlags();
     const std::vector<bool>& ctf = state->getCanvasToolFlags();
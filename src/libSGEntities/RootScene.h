@@ -87,14 +87,17 @@ public:
     /*! \return true if canvas visible. */
     bool getCanvasVisibilityAll(entity::Canvas* canvas) const;
 
-    /*! A method to write the user scene to file. */
+    /*! A method to write the user scene to file. If the file path has the extension cher::SCENE_CHUNK_EXTENSION,
+     * the native chunked format is used (see entity::SceneChunkFile), otherwise the scene is written by OpenSceneGraph
+     * serialization. */
     bool writeScenetoFile();
 
     /*! A method to export the user scene to OBJ or 3DS format. It uses Parallel Transport Frame algorithm
      * in order to convert shadered strokes into triangular meshes. */
     bool exportSceneToFile(const std::string& name);
 
-    /*! \return true if scene was loaded successfully from file. */
+    /*! \return true if scene was loaded successfully from file. Chunked scene files are recognized by their content;
+     * their canvases are read on demand, see entity::UserScene::materializeCanvas(). */
     bool loadSceneFromFile();
 
     /*! \return the depth of where entity::Stroke geometries are located. */
@@ -239,6 +242,7 @@ public:
     entity::BookmarkTool* getBookmarkTool(int index);
 
 protected:
+    bool loadSceneFromChunkFile();
 
 private:
     osg::ref_ptr<entity::UserScene> m_userScene;
@@ -0,0 +1,207 @@
+#include "SceneAutosave.h"
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QStandardPaths>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QtGlobal>
+#include <QDebug>
+
+#include "RootScene.h"
+#include "UserScene.h"
+#include "Canvas.h"
+#include "Photo.h"
+#include "PhotoStore.h"
+
+entity::SceneAutosave::SceneAutosave(RootScene *root, QObject *parent)
+    : QObject(parent)
+    , m_root(root)
+    , m_timeSnapshot(0)
+    , m_timeWrite(0)
+{
+    m_last.idCanvas = m_last.idPhoto = m_last.idBookmark = 0;
+    QObject::connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+    QObject::connect(&m_watcher, SIGNAL(finished()), this, SLOT(onFinished()));
+}
+
+entity::SceneAutosave::~SceneAutosave()
+{
+    m_watcher.waitForFinished();
+}
+
+void entity::SceneAutosave::start(int interval)
+{
+    m_timer.start(interval);
+}
+
+void entity::SceneAutosave::stop()
+{
+    m_timer.stop();
+}
+
+std::string entity::SceneAutosave::getFilePath() const
+{
+    QString name = "untitled";
+    QDir dir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    entity::UserScene* scene = m_root.valid()? m_root->getUserScene() : 0;
+    if (scene && scene->isSetFilePath()){
+        QFileInfo info(QString::fromStdString(scene->getFilePath()));
+        name = info.completeBaseName();
+        dir = info.dir();
+    }
+    return dir.filePath(name + QString::fromStdString(cher::AUTOSAVE_SUFFIX + "." + cher::SCENE_CHUNK_EXTENSION)).toStdString();
+}
+
+bool entity::SceneAutosave::autosave()
+{
+    if (m_watcher.isRunning() || !m_root.valid()) return false;
+    entity::UserScene* scene = m_root->getUserScene();
+    if (!scene || scene->isEmptyScene() || scene->isEntityCurrent() || scene->getNumCanvasesPending() > 0
+            || scene->getNumPhotosPending() > 0)
+        return false;
+
+    m_clock.start();
+    SceneChunkFile::Snapshot snapshot;
+    if (!this->takeSnapshot(scene, snapshot)) return false;
+    if (this->isSameSnapshot(snapshot)) return false;
+    m_timeSnapshot = static_cast<int>(m_clock.restart());
+
+    m_snapshot = snapshot;
+    m_recordsWriting = m_records;
+    m_path = this->getFilePath();
+    QDir().mkpath(QFileInfo(QString::fromStdString(m_path)).absolutePath());
+
+    /* the worker only touches its own snapshot, which the GUI thread does not read until the write is finished */
+    SceneChunkFile::Snapshot* data = &m_snapshot;
+    std::string path = m_path;
+    m_watcher.setFuture(QtConcurrent::run([data, path]() -> bool {
+        return entity::SceneChunkFile::writeSnapshot(*data, path);
+    }));
+    return true;
+}
+
+bool entity::SceneAutosave::isRunning() const
+{
+    return m_watcher.isRunning();
+}
+
+void entity::SceneAutosave::waitForFinished()
+{
+    m_watcher.waitForFinished();
+}
+
+void entity::SceneAutosave::discard()
+{
+    m_watcher.waitForFinished();
+    QFile::remove(QString::fromStdString(this->getFilePath()));
+    m_records.clear();
+    m_recordsWriting.clear();
+    m_recordsWritten.clear();
+    m_blobs.clear();
+    m_last = SceneChunkFile::Snapshot();
+    m_last.idCanvas = m_last.idPhoto = m_last.idBookmark = 0;
+}
+
+int entity::SceneAutosave::getTimeSnapshot() const
+{
+    return m_timeSnapshot;
+}
+
+int entity::SceneAutosave::getTimeWrite() const
+{
+    return m_timeWrite;
+}
+
+void entity::SceneAutosave::onTimeout()
+{
+    this->autosave();
+}
+
+void entity::SceneAutosave::onFinished()
+{
+    m_timeWrite = static_cast<int>(m_clock.elapsed());
+    if (!m_watcher.result()){
+        qWarning() << "SceneAutosave: could not write " << m_path.c_str();
+        return;
+    }
+
+    /* encoded images are re-used by the next snapshots */
+    for (size_t i=0; i<m_snapshot.digests.size() && i<m_snapshot.blobs.size(); ++i){
+        if (!m_snapshot.blobs[i].isEmpty())
+            m_blobs[m_snapshot.digests[i]] = m_snapshot.blobs[i];
+    }
+    m_snapshot.images.clear();
+    m_last = m_snapshot;
+    m_recordsWritten.swap(m_recordsWriting);
+    m_recordsWriting.clear();
+
+    qInfo() << "SceneAutosave: canvases=" << m_last.canvases.size() << ", photos=" << m_last.digests.size()
+            << ", snapshot ms=" << m_timeSnapshot << ", write ms=" << m_timeWrite;
+    emit this->autosaved(QString::fromStdString(m_path), m_timeSnapshot, m_timeWrite);
+}
+
+bool entity::SceneAutosave::takeSnapshot(entity::UserScene *scene, SceneChunkFile::Snapshot &snapshot)
+{
+    snapshot.idCanvas = scene->getIdCanvas();
+    snapshot.idPhoto = scene->getIdPhoto();
+    snapshot.idBookmark = scene->getIdBookmark();
+
+    std::vector<Record> records;
+    std::unordered_map<std::string, size_t> digests;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        entity::Canvas* cnv = scene->getCanvas(i);
+        if (!cnv) continue;
+
+        /* distinct photo images, the encoded blobs are taken from the cache if possible */
+        for (unsigned int j=0; j<cnv->getNumPhotos(); ++j){
+            entity::Photo* photo = cnv->getPhoto(j);
+            if (!photo) continue;
+            if (photo->getDigest().empty()) photo->shareTexture();
+            const std::string& digest = photo->getDigest();
+            if (digest.empty() || digests.find(digest) != digests.end()) continue;
+            digests[digest] = snapshot.digests.size();
+            snapshot.digests.push_back(digest);
+            /* an evicted image is only read back if it was not encoded by a previous snapshot */
+            auto blob = m_blobs.find(digest);
+            const osg::Image* image = photo->getTexture()? photo->getTexture()->getImage() : 0;
+            if (!image && blob == m_blobs.end()) image = entity::PhotoStore::instance().restoreImage(digest);
+            snapshot.images.push_back(image);
+            snapshot.blobs.push_back(blob != m_blobs.end()? blob->second : QByteArray());
+        }
+
+        /* unchanged canvases share the record of the previous snapshot */
+        Record record;
+        record.canvas = cnv;
+        record.revision = cnv->getRevision();
+        for (const Record& saved : m_records){
+            if (saved.canvas.get() == cnv && saved.revision == record.revision){
+                record.data = saved.data;
+                break;
+            }
+        }
+        if (record.data.isEmpty())
+            record.data = SceneChunkFile::encodeCanvas(cnv, std::vector<unsigned int>());
+        snapshot.canvases.push_back(record.data);
+        records.push_back(record);
+    }
+    snapshot.bookmarks = SceneChunkFile::encodeBookmarks(scene->getBookmarks());
+
+    m_records.swap(records);
+    return true;
+}
+
+/* a canvas record is re-encoded only when the canvas revision changes, so the canvases are compared by their
+ * revisions against the last written snapshot; only the ids, the digests and the bookmarks are compared by content */
+bool entity::SceneAutosave::isSameSnapshot(const SceneChunkFile::Snapshot &snapshot) const
+{
+    if (snapshot.idCanvas != m_last.idCanvas || snapshot.idPhoto != m_last.idPhoto
+            || snapshot.idBookmark != m_last.idBookmark || m_records.size() != m_recordsWritten.size())
+        return false;
+    for (size_t i=0; i<m_records.size(); ++i){
+        if (m_records[i].canvas.get() != m_recordsWritten[i].canvas.get()
+                || m_records[i].revision != m_recordsWritten[i].revision)
+            return false;
+    }
+    return snapshot.digests == m_last.digests && snapshot.bookmarks == m_last.bookmarks;
+}
@@ -0,0 +1,124 @@
+#ifndef SCENEAUTOSAVE_H
+#define SCENEAUTOSAVE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <osg/observer_ptr>
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QByteArray>
+
+#include "Settings.h"
+#include "SceneChunkFile.h"
+
+class RootScene;
+
+namespace entity {
+class UserScene;
+class Canvas;
+
+/*! \class SceneAutosave
+ * \brief Periodic autosave of the user scene that is written from a worker thread.
+ *
+ * On every timer tick the GUI thread takes a SceneChunkFile::Snapshot of the scene: canvas records, bookmarks and
+ * references on photo images. The record of a canvas is re-encoded only if the canvas changed since the previous
+ * snapshot (see Canvas::getRevision()), otherwise the previous record is shared, so that the GUI thread pause is
+ * proportional to the amount of edits rather than to the scene size; the same revisions tell whether the scene
+ * changed since the last autosave. The snapshot is then written by SceneChunkFile::writeSnapshot() on the global
+ * thread pool, including the encoding of photo images, which are cached by digest for the next snapshots.
+ *
+ * The autosave file is a regular chunked scene file next to the scene file, see getFilePath(); it can be opened
+ * as any other scene. The time spent on snapshot and write are reported by autosaved().
+*/
+class SceneAutosave : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*! Constructor.
+     * \param root is the scene to autosave, its user scene is obtained on every tick since it is replaced on file load
+     * \param parent is the QObject parent */
+    SceneAutosave(RootScene* root, QObject* parent = 0);
+
+    /*! Destructor waits for the running write to finish. */
+    ~SceneAutosave();
+
+    /*! A method to start the periodic autosave.
+     * \param interval is the time between two autosaves in milliseconds */
+    void start(int interval = cher::AUTOSAVE_INTERVAL);
+
+    /*! A method to stop the periodic autosave; the running write is not interrupted. */
+    void stop();
+
+    /*! \return file name of the autosave for the current scene: the scene file name with cher::AUTOSAVE_SUFFIX,
+     * or a file within the application data directory if the scene was never saved. */
+    std::string getFilePath() const;
+
+    /*! A method to take a snapshot of the scene and to start writing it in the background. Nothing is done if the
+     * previous write is still running, if the user is in the middle of an edit, if some of the canvases or photos are
+     * not read from file yet or if the scene did not change since the last autosave.
+     * \return true if a write was started. */
+    bool autosave();
+
+    /*! \return true if a write is running. */
+    bool isRunning() const;
+
+    /*! A method to block until the running write is finished. */
+    void waitForFinished();
+
+    /*! A method to remove the autosave file and to forget the cached records, e.g., once the scene was saved by the
+     * user or closed. */
+    void discard();
+
+    /*! \return time in milliseconds that the GUI thread spent on the last snapshot. */
+    int getTimeSnapshot() const;
+
+    /*! \return time in milliseconds of the last background write. */
+    int getTimeWrite() const;
+
+signals:
+    /*! A signal which is emitted once the autosave file is written.
+     * \param path is the autosave file name
+     * \param snapshot is the GUI thread time in milliseconds
+     * \param write is the background write time in milliseconds */
+    void autosaved(const QString& path, int snapshot, int write);
+
+protected slots:
+    void onTimeout();
+    void onFinished();
+
+protected:
+    bool takeSnapshot(entity::UserScene* scene, SceneChunkFile::Snapshot& snapshot);
+    bool isSameSnapshot(const SceneChunkFile::Snapshot& snapshot) const;
+
+private:
+    struct Record
+    {
+        osg::observer_ptr<entity::Canvas> canvas;
+        unsigned int revision;
+        QByteArray data;
+    };
+
+    osg::observer_ptr<RootScene> m_root;
+    QTimer m_timer;
+    QFutureWatcher<bool> m_watcher;
+    QElapsedTimer m_clock;
+    SceneChunkFile::Snapshot m_snapshot; /* owned by the worker while it is running */
+    SceneChunkFile::Snapshot m_last; /* last written snapshot */
+    std::vector<Record> m_records; /* canvas records of the last snapshot */
+    std::vector<Record> m_recordsWriting; /* canvas records of the snapshot being written */
+    std::vector<Record> m_recordsWritten; /* canvas records of the last written snapshot */
+    std::unordered_map<std::string, QByteArray> m_blobs; /* encoded images by digest */
+    std::string m_path; /* file being written */
+    int m_timeSnapshot;
+    int m_timeWrite;
+};
+
+} // namespace entity
+
+#endif // SCENEAUTOSAVE_H
@@ -0,0 +1,1030 @@
+#include "SceneChunkFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <osg/Texture2D>
+#include <osgDB/Registry>
+#include <osgDB/ReaderWriter>
+
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QtGlobal>
+#include <QDebug>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include "Settings.h"
+#include "UserScene.h"
+#include "Canvas.h"
+#include "Stroke.h"
+#include "Polygon.h"
+#include "Photo.h"
+#include "PhotoStore.h"
+#include "Bookmarks.h"
+
+static const char CHUNK_MAGIC[4] = {'C', 'H', 'E', 'R'};
+static const unsigned int CHUNK_NONE = 0xFFFFFFFF;
+static const unsigned int CANVAS_VISIBLE_ALL = 1;
+static const unsigned int CANVAS_VISIBLE_DATA = 2;
+
+/* header: magic, version, number of chunks, reserved, TOC offset */
+static const unsigned long long CHUNK_HEADER_SIZE = 4 + 4 + 4 + 4 + 8;
+
+template <typename T>
+static void putValue(QByteArray& buffer, const T& value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/* strings are stored as length and bytes, padded to 4 bytes so that the float arrays stay aligned */
+static void putString(QByteArray& buffer, const std::string& value)
+{
+    putValue(buffer, static_cast<unsigned int>(value.size()));
+    buffer.append(value.data(), static_cast<int>(value.size()));
+    while (buffer.size() % 4) buffer.append('\0');
+}
+
+static void putMatrix(QByteArray& buffer, const osg::Matrix& M)
+{
+    buffer.append(reinterpret_cast<const char*>(M.ptr()), 16*sizeof(osg::Matrix::value_type));
+}
+
+/* zigzag mapping keeps small negative deltas small, then 7 bits per byte with the high bit as continuation */
+static void putVarInt(QByteArray& buffer, int value)
+{
+    unsigned int v = (static_cast<unsigned int>(value) << 1) ^ static_cast<unsigned int>(value >> 31);
+    while (v >= 0x80){
+        buffer.append(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    buffer.append(static_cast<char>(v));
+}
+
+static bool getVarInt(const unsigned char*& data, const unsigned char* end, int& value)
+{
+    unsigned int v = 0;
+    for (int shift=0; shift<32; shift+=7){
+        if (data >= end) return false;
+        unsigned char byte = *data++;
+        v |= static_cast<unsigned int>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)){
+            value = static_cast<int>(v >> 1) ^ -static_cast<int>(v & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* entities that are drawn by shaders share the same record: name, color, curved flag, primitive mode
+ * and the encoded points, see SceneChunkFile::encodePoints() */
+static void putShadered(QByteArray& buffer, const entity::ShaderedEntity2D* entity, bool curved)
+{
+    const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(entity->getVertexArray());
+    unsigned int sz = verts? verts->size() : 0;
+    putString(buffer, entity->getName());
+    putValue(buffer, entity->getColor());
+    putValue(buffer, static_cast<unsigned int>(curved? 1 : 0));
+    putValue(buffer, static_cast<unsigned int>(entity->getLines()? entity->getLines()->getMode() : GL_LINE_STRIP));
+    putValue(buffer, sz);
+    if (sz) entity::SceneChunkFile::encodePoints(buffer, verts);
+}
+
+static osg::ref_ptr<osgDB::ReaderWriter> getReaderWriter(const std::string& extension)
+{
+    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(extension);
+    if (!rw) qWarning() << "SceneChunkFile: no plugin for extension " << extension.c_str();
+    return rw;
+}
+
+entity::SceneChunkFile::SceneChunkFile()
+    : osg::Referenced()
+    , m_data(0)
+    , m_size(0)
+    , m_end(0)
+    , m_scene(CHUNK_NONE)
+    , m_bookmarks(CHUNK_NONE)
+{
+}
+
+entity::SceneChunkFile::~SceneChunkFile()
+{
+    this->close();
+}
+
+bool entity::SceneChunkFile::isChunkFileName(const std::string &path)
+{
+    return QFileInfo(QString::fromStdString(path)).suffix().toStdString() == cher::SCENE_CHUNK_EXTENSION;
+}
+
+bool entity::SceneChunkFile::isChunkFile(const std::string &path)
+{
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    char magic[4];
+    if (file.read(magic, 4) != 4) return false;
+    return std::memcmp(magic, CHUNK_MAGIC, 4) == 0;
+}
+
+bool entity::SceneChunkFile::save(entity::UserScene *scene, const std::string &path)
+{
+    if (!scene) return false;
+    this->waitForPhotos();
+    bool compact = m_end > 0 && this->getSizeFree() > cher::SCENE_CHUNK_GARBAGE * m_end;
+    if (path == m_path && !compact && this->append(scene))
+        return true;
+    return this->write(scene, path);
+}
+
+bool entity::SceneChunkFile::write(entity::UserScene *scene, const std::string &path)
+{
+    if (!scene) return false;
+    if (!scene->materializeCanvases()){
+        qWarning("SceneChunkFile::write: some of the canvases could not be read");
+        return false;
+    }
+    this->close();
+
+    QSaveFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly)){
+        qWarning() << "SceneChunkFile::write: could not open file " << path.c_str();
+        return false;
+    }
+
+    /* placeholder header, it is re-written once the TOC is known */
+    QByteArray header(static_cast<int>(CHUNK_HEADER_SIZE), '\0');
+    if (file.write(header) != header.size() || !this->writeJournal(file, scene, true) || !file.commit()){
+        qWarning() << "SceneChunkFile::write: could not write file " << path.c_str();
+        this->close();
+        return false;
+    }
+    m_path = path;
+    return true;
+}
+
+bool entity::SceneChunkFile::append(entity::UserScene *scene)
+{
+    if (!scene || m_path.empty()) return false;
+
+    QFile file(QString::fromStdString(m_path));
+    if (!file.open(QIODevice::ReadWrite)){
+        qWarning() << "SceneChunkFile::append: could not open file " << m_path.c_str();
+        return false;
+    }
+    if (static_cast<unsigned long long>(file.size()) != m_end || !file.seek(m_end)){
+        qWarning("SceneChunkFile::append: file was modified since it was last read or written");
+        return false;
+    }
+
+    /* if anything fails, the old table of contents is still the one in effect */
+    std::vector<Chunk> toc = m_toc;
+    std::unordered_map<std::string, unsigned int> photos = m_photos;
+    unsigned int sceneChunk = m_scene, bookmarks = m_bookmarks;
+    QByteArray bookmarksDigest = m_bookmarksDigest;
+    if (!this->writeJournal(file, scene, false)){
+        qWarning("SceneChunkFile::append: could not append to file");
+        m_toc = toc;
+        m_photos = photos;
+        m_scene = sceneChunk;
+        m_bookmarks = bookmarks;
+        m_bookmarksDigest = bookmarksDigest;
+        file.resize(m_end);
+        return false;
+    }
+    return true;
+}
+
+bool entity::SceneChunkFile::writeSnapshot(Snapshot &snapshot, const std::string &path)
+{
+    QSaveFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly)){
+        qWarning() << "SceneChunkFile::writeSnapshot: could not open file " << path.c_str();
+        return false;
+    }
+    QByteArray header(static_cast<int>(CHUNK_HEADER_SIZE), '\0');
+    if (file.write(header) != header.size()) return false;
+
+    /* image encoding is the expensive part, the blobs are kept by the caller for the next snapshot */
+    std::vector<Chunk> toc;
+    std::unordered_map<std::string, unsigned int> photos;
+    osg::ref_ptr<osgDB::ReaderWriter> rwImage = getReaderWriter(cher::PHOTO_STORE_FORMAT);
+    snapshot.blobs.resize(snapshot.digests.size());
+    for (size_t i=0; i<snapshot.digests.size(); ++i){
+        if (snapshot.blobs[i].isEmpty()){
+            const osg::Image* image = i < snapshot.images.size()? snapshot.images[i].get() : 0;
+            std::stringstream ss;
+            if (!image || !rwImage.get() || !rwImage->writeImage(*image, ss).success()){
+                qWarning("SceneChunkFile::writeSnapshot: could not encode photo image");
+                continue;
+            }
+            std::string blob = ss.str();
+            snapshot.blobs[i] = QByteArray(blob.data(), static_cast<int>(blob.size()));
+        }
+        unsigned int chunk = appendChunk(file, toc, CHUNK_PHOTO, snapshot.blobs[i]);
+        if (chunk == CHUNK_NONE) return false;
+        photos[snapshot.digests[i]] = chunk;
+    }
+
+    std::vector<unsigned int> canvases;
+    for (const QByteArray& data : snapshot.canvases){
+        canvases.push_back(appendChunk(file, toc, CHUNK_CANVAS, data));
+        if (canvases.back() == CHUNK_NONE) return false;
+    }
+    unsigned int bookmarks = appendChunk(file, toc, CHUNK_BOOKMARKS, snapshot.bookmarks);
+    QByteArray data = encodeScene(snapshot.idCanvas, snapshot.idPhoto, snapshot.idBookmark, canvases, bookmarks, photos);
+    unsigned long long end = 0;
+    if (bookmarks == CHUNK_NONE || appendChunk(file, toc, CHUNK_SCENE, data) == CHUNK_NONE
+            || !writeTable(file, toc, end) || !file.commit()){
+        qWarning() << "SceneChunkFile::writeSnapshot: could not write file " << path.c_str();
+        return false;
+    }
+    return true;
+}
+
+bool entity::SceneChunkFile::open(const std::string &path)
+{
+    this->close();
+    m_file.setFileName(QString::fromStdString(path));
+    if (!m_file.open(QIODevice::ReadOnly)){
+        qWarning() << "SceneChunkFile::open: could not open file " << path.c_str();
+        return false;
+    }
+    m_size = m_file.size();
+    m_data = m_size >= CHUNK_HEADER_SIZE? m_file.map(0, m_size) : 0;
+    if (!m_data){
+        qWarning("SceneChunkFile::open: could not map the file");
+        this->close();
+        return false;
+    }
+
+    Cursor cursor(m_data, m_size);
+    char magic[4];
+    unsigned int version = 0, count = 0, reserved = 0;
+    unsigned long long tocOffset = 0;
+    if (!cursor.read(magic, 4) || std::memcmp(magic, CHUNK_MAGIC, 4) != 0
+            || !cursor.readUInt(version) || !cursor.readUInt(count) || !cursor.readUInt(reserved)
+            || !cursor.read(&tocOffset, sizeof(tocOffset))){
+        qWarning("SceneChunkFile::open: not a chunked scene file");
+        this->close();
+        return false;
+    }
+    if (version != cher::SCENE_CHUNK_VERSION){
+        qWarning("SceneChunkFile::open: file version is not supported");
+        this->close();
+        return false;
+    }
+    if (tocOffset > m_size || (m_size - tocOffset) / sizeof(Chunk) < count){
+        qWarning("SceneChunkFile::open: table of contents is corrupted");
+        this->close();
+        return false;
+    }
+
+    m_toc.resize(count);
+    if (count) std::memcpy(&m_toc[0], m_data + tocOffset, count * sizeof(Chunk));
+    for (const Chunk& chunk : m_toc){
+        if (chunk.offset > m_size || chunk.size > m_size - chunk.offset){
+            qWarning("SceneChunkFile::open: chunk is out of file bounds");
+            this->close();
+            return false;
+        }
+    }
+
+    m_path = path;
+    m_end = m_size;
+    if (!this->readJournal()){
+        qWarning("SceneChunkFile::open: scene chunk is corrupted");
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+void entity::SceneChunkFile::close()
+{
+    this->unmap();
+    m_toc.clear();
+    m_path.clear();
+    m_end = 0;
+    m_scene = CHUNK_NONE;
+    m_bookmarks = CHUNK_NONE;
+    m_bookmarksDigest.clear();
+    m_photos.clear();
+    m_canvases.clear();
+}
+
+void entity::SceneChunkFile::unmap()
+{
+    this->waitForPhotos();
+    if (m_data) m_file.unmap(const_cast<unsigned char*>(m_data));
+    m_data = 0;
+    m_size = 0;
+    if (m_file.isOpen()) m_file.close();
+}
+
+bool entity::SceneChunkFile::isOpen() const
+{
+    return m_data != 0;
+}
+
+const std::string &entity::SceneChunkFile::getPath() const
+{
+    return m_path;
+}
+
+unsigned int entity::SceneChunkFile::getNumChunks() const
+{
+    return m_toc.size();
+}
+
+unsigned long long entity::SceneChunkFile::getSize() const
+{
+    return m_end;
+}
+
+unsigned long long entity::SceneChunkFile::getSizeFree() const
+{
+    unsigned long long used = CHUNK_HEADER_SIZE + m_toc.size() * sizeof(Chunk);
+    for (const Chunk& chunk : m_toc){
+        if (chunk.type != CHUNK_FREE) used += chunk.size;
+    }
+    return m_end > used? m_end - used : 0;
+}
+
+entity::UserScene *entity::SceneChunkFile::readScene()
+{
+    Cursor cursor(0, 0);
+    if (!this->getChunk(m_scene, CHUNK_SCENE, cursor)){
+        qWarning("SceneChunkFile::readScene: no scene chunk found");
+        return 0;
+    }
+
+    unsigned int idCanvas = 0, idPhoto = 0, idBookmark = 0, numCanvases = 0;
+    if (!cursor.readUInt(idCanvas) || !cursor.readUInt(idPhoto) || !cursor.readUInt(idBookmark)
+            || !cursor.readUInt(numCanvases)){
+        qWarning("SceneChunkFile::readScene: scene chunk is corrupted");
+        return 0;
+    }
+    std::vector<unsigned int> canvases(numCanvases);
+    for (unsigned int i=0; i<numCanvases; ++i){
+        if (!cursor.readUInt(canvases[i])) return 0;
+    }
+
+    osg::ref_ptr<entity::UserScene> scene = new entity::UserScene;
+
+    /* bookmarks have their own chunk, so that they are re-written only when they change */
+    unsigned int sz = 0;
+    const unsigned char* bytes = 0;
+    Cursor record(0, 0);
+    if (this->getChunk(m_bookmarks, CHUNK_BOOKMARKS, record)){
+        sz = static_cast<unsigned int>(m_toc[m_bookmarks].size);
+        bytes = record.skip(sz);
+    }
+    osg::ref_ptr<osgDB::ReaderWriter> rwNode = getReaderWriter("osgb");
+    if (bytes && sz && rwNode.get()){
+        std::istringstream ss(std::string(reinterpret_cast<const char*>(bytes), sz));
+        osg::ref_ptr<osg::Node> node = rwNode->readNode(ss).getNode();
+        entity::Bookmarks* bookmarks = dynamic_cast<entity::Bookmarks*>(node.get());
+        if (bookmarks){
+            bookmarks->setName("groupBookmarks");
+            scene->setBookmarks(bookmarks);
+        }
+        else
+            qWarning("SceneChunkFile::readScene: could not read bookmarks");
+    }
+
+    osg::ref_ptr<osg::Group> group = new osg::Group;
+    group->setName("groupCanvases");
+    scene->setGroupCanvases(group.get());
+    scene->initializeSG();
+
+    for (unsigned int chunk : canvases){
+        if (!this->getChunk(chunk, CHUNK_CANVAS, cursor)) return 0;
+
+        osg::ref_ptr<entity::Canvas> cnv = new entity::Canvas;
+        cnv->initializeSG();
+        if (!this->readCanvasHeader(cursor, cnv.get())){
+            qWarning("SceneChunkFile::readScene: canvas header is corrupted");
+            return 0;
+        }
+        group->addChild(cnv.get());
+        scene->addCanvasPending(cnv.get(), this, chunk);
+        m_canvases.push_back(std::make_pair(osg::observer_ptr<entity::Canvas>(cnv.get()), chunk));
+        cnv->setDirty(false);
+    }
+
+    scene->setIdCanvas(idCanvas);
+    scene->setIdPhoto(idPhoto);
+    scene->setIdBookmark(idBookmark);
+
+    unsigned int decoding = this->decodePhotos();
+    if (decoding) qInfo() << "SceneChunkFile::readScene: decoding photos in background, count=" << decoding;
+
+    return scene.release();
+}
+
+bool entity::SceneChunkFile::readCanvas(unsigned int chunk, entity::Canvas *canvas)
+{
+    Cursor cursor(0, 0);
+    if (!canvas || !this->getChunk(chunk, CHUNK_CANVAS, cursor)) return false;
+
+    /* the header was applied when the canvas was created */
+    if (!this->readCanvasHeader(cursor, 0)) return false;
+
+    for (int type=0; type<2; ++type){
+        unsigned int count = 0;
+        if (!cursor.readUInt(count)) return false;
+        for (unsigned int i=0; i<count; ++i){
+            std::string name;
+            osg::Vec4f color;
+            unsigned int curved = 0, mode = 0, sz = 0;
+            if (!cursor.readString(name) || !cursor.read(&color, sizeof(color)) || !cursor.readUInt(curved)
+                    || !cursor.readUInt(mode) || !cursor.readUInt(sz))
+                return false;
+
+            unsigned long long bytes = 0;
+            const unsigned char* points = 0;
+            if (sz){
+                unsigned int encoded = 0;
+                points = cursor.skip(4*sizeof(float));
+                if (!points || !cursor.readUInt(encoded)
+                        || !cursor.skip(static_cast<unsigned long long>(encoded) + (4 - encoded % 4) % 4))
+                    return false;
+                bytes = 4*sizeof(float) + sizeof(unsigned int) + encoded;
+            }
+
+            osg::ref_ptr<entity::ShaderedEntity2D> shadered;
+            if (type == 0){
+                osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+                stroke->setIsCurved(curved != 0);
+                shadered = stroke.get();
+            }
+            else
+                shadered = new entity::Polygon;
+            shadered->setName(name);
+
+            osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(shadered->getVertexArray());
+            if (!decodePoints(points, bytes, sz, verts)) return false;
+            shadered->setColor(color);
+
+            if (type == 0)
+                shadered->initializeProgram(canvas->getProgramStroke());
+            else
+                shadered->initializeProgram(canvas->getProgramPolygon(), mode);
+            if (!canvas->addEntity(shadered.get())){
+                qWarning("SceneChunkFile::readCanvas: could not add entity to canvas");
+                continue;
+            }
+            if (!shadered->redefineToShape(canvas->getTransform()))
+                qWarning("Could not redefine entity as curve");
+            /* polygon re-shaping applies the current color of the application */
+            shadered->setColor(color);
+        }
+    }
+
+    unsigned int count = 0;
+    if (!cursor.readUInt(count)) return false;
+    for (unsigned int i=0; i<count; ++i){
+        std::string name, digest;
+        unsigned int blob = CHUNK_NONE;
+        osg::Vec3f center;
+        float width = 0, height = 0, angle = 0, transparency = 1;
+        osg::Vec2f texcoords[4];
+        if (!cursor.readString(name) || !cursor.readString(digest) || !cursor.readUInt(blob) || !cursor.read(&center, sizeof(center))
+                || !cursor.read(&width, sizeof(float)) || !cursor.read(&height, sizeof(float))
+                || !cursor.read(&angle, sizeof(float)) || !cursor.read(&transparency, sizeof(float))
+                || !cursor.read(texcoords, sizeof(texcoords)))
+            return false;
+
+        /* the digest is preferred to the chunk index since snapshots do not record the index */
+        auto it = m_photos.find(digest);
+        if (it != m_photos.end()) blob = it->second;
+
+        /* blobs of images that are already in memory are not decoded again */
+        osg::ref_ptr<osg::Texture2D> texture = entity::PhotoStore::instance().findTexture(digest);
+        if (!texture.get()){
+            osg::ref_ptr<osg::Image> image = this->readImage(blob);
+            if (!image.get()){
+                qWarning("SceneChunkFile::readCanvas: could not decode photo, skipping");
+                continue;
+            }
+            texture = entity::PhotoStore::instance().getTexture(image.get(), digest);
+        }
+        osg::ref_ptr<entity::Photo> photo = new entity::Photo;
+        photo->loadTexture(texture.get(), digest);
+        photo->setName(name);
+        photo->setWidth(width);
+        photo->setHeight(height);
+        photo->setCenter(center);
+        photo->setAngle(angle);
+        photo->setTransparency(transparency);
+        osg::Vec2Array* tc = static_cast<osg::Vec2Array*>(photo->getTexCoordArray(0));
+        if (tc && tc->size() == 4){
+            for (unsigned int k=0; k<4; ++k) (*tc)[k] = texcoords[k];
+            tc->dirty();
+        }
+        photo->getOrCreateStateSet()->setTextureAttributeAndModes(0, photo->getTextureAsAttribute());
+        if (!canvas->addEntity(photo.get()))
+            qWarning("SceneChunkFile::readCanvas: could not add photo to canvas");
+    }
+
+    return true;
+}
+
+void entity::SceneChunkFile::encodePoints(QByteArray &buffer, const osg::Vec3Array *points)
+{
+    if (!points || points->empty()) return;
+
+    osg::Vec2f pmin(points->front().x(), points->front().y()), pmax = pmin;
+    for (const auto& p : *points){
+        pmin.set(std::min(pmin.x(), p.x()), std::min(pmin.y(), p.y()));
+        pmax.set(std::max(pmax.x(), p.x()), std::max(pmax.y(), p.y()));
+    }
+    putValue(buffer, pmin);
+    putValue(buffer, pmax);
+
+    /* the stream size goes first, so that the reader can skip the record without decoding it */
+    int sizePos = buffer.size();
+    putValue(buffer, static_cast<unsigned int>(0));
+    int start = buffer.size();
+
+    const float levels = static_cast<float>(cher::SCENE_CHUNK_QUANTIZATION);
+    osg::Vec2f extent = pmax - pmin;
+    int prev[2] = {0, 0};
+    for (const auto& p : *points){
+        float value[2] = {p.x(), p.y()};
+        for (int k=0; k<2; ++k){
+            int q = extent[k] > 0.f? static_cast<int>(std::lround((value[k] - pmin[k]) / extent[k] * levels)) : 0;
+            putVarInt(buffer, q - prev[k]);
+            prev[k] = q;
+        }
+    }
+
+    unsigned int encoded = static_cast<unsigned int>(buffer.size() - start);
+    std::memcpy(buffer.data() + sizePos, &encoded, sizeof(encoded));
+    while (buffer.size() % 4) buffer.append('\0');
+}
+
+bool entity::SceneChunkFile::decodePoints(const unsigned char *data, unsigned long long size, unsigned int count, osg::Vec3Array *points)
+{
+    if (!points) return false;
+    points->clear();
+    if (count == 0) return true;
+    if (!data || size < 4*sizeof(float) + sizeof(unsigned int)) return false;
+
+    osg::Vec2f pmin, pmax;
+    unsigned int encoded = 0;
+    std::memcpy(pmin.ptr(), data, 2*sizeof(float));
+    std::memcpy(pmax.ptr(), data + 2*sizeof(float), 2*sizeof(float));
+    std::memcpy(&encoded, data + 4*sizeof(float), sizeof(unsigned int));
+    const unsigned char* ptr = data + 4*sizeof(float) + sizeof(unsigned int);
+    if (encoded > size - 4*sizeof(float) - sizeof(unsigned int)) return false;
+    const unsigned char* end = ptr + encoded;
+
+    const int levels = static_cast<int>(cher::SCENE_CHUNK_QUANTIZATION);
+    osg::Vec2f extent = pmax - pmin;
+    int q[2] = {0, 0};
+    points->resize(count);
+    for (unsigned int i=0; i<count; ++i){
+        float value[2];
+        for (int k=0; k<2; ++k){
+            int delta = 0;
+            if (!getVarInt(ptr, end, delta)) return false;
+            q[k] += delta;
+            if (q[k] < 0 || q[k] > levels) return false;
+            /* the box corners are restored exactly */
+            value[k] = q[k] == levels? pmax[k] : pmin[k] + extent[k] * (static_cast<float>(q[k]) / levels);
+        }
+        (*points)[i] = osg::Vec3f(value[0], value[1], 0.f);
+    }
+    return ptr == end;
+}
+
+entity::SceneChunkFile::Cursor::Cursor(const unsigned char *data, unsigned long long size)
+    : m_data(data)
+    , m_size(size)
+    , m_pos(0)
+{
+}
+
+bool entity::SceneChunkFile::Cursor::read(void *dst, unsigned long long size)
+{
+    const unsigned char* src = this->skip(size);
+    if (!src) return false;
+    std::memcpy(dst, src, size);
+    return true;
+}
+
+bool entity::SceneChunkFile::Cursor::readUInt(unsigned int &value)
+{
+    return this->read(&value, sizeof(unsigned int));
+}
+
+bool entity::SceneChunkFile::Cursor::readString(std::string &value)
+{
+    unsigned int sz = 0;
+    if (!this->readUInt(sz)) return false;
+    const unsigned char* src = this->skip(sz);
+    if (!src) return false;
+    value.assign(reinterpret_cast<const char*>(src), sz);
+    return this->skip((4 - sz % 4) % 4) != 0;
+}
+
+const unsigned char *entity::SceneChunkFile::Cursor::skip(unsigned long long size)
+{
+    if (!m_data || size > m_size - m_pos) return 0;
+    const unsigned char* ptr = m_data + m_pos;
+    m_pos += size;
+    return ptr;
+}
+
+bool entity::SceneChunkFile::getChunk(unsigned int index, unsigned int type, Cursor &cursor) const
+{
+    /* chunks appended after the file was mapped are never read back */
+    if (!m_data || index >= m_toc.size() || m_toc[index].type != type
+            || m_toc[index].offset > m_size || m_toc[index].size > m_size - m_toc[index].offset)
+        return false;
+    cursor = Cursor(m_data + m_toc[index].offset, m_toc[index].size);
+    return true;
+}
+
+bool entity::SceneChunkFile::readCanvasHeader(Cursor &cursor, entity::Canvas *canvas) const
+{
+    std::string name;
+    osg::Matrix R, T, O;
+    osg::Vec3f center, normal;
+    unsigned int flags = 0;
+    if (!cursor.readString(name) || !cursor.read(R.ptr(), 16*sizeof(osg::Matrix::value_type))
+            || !cursor.read(T.ptr(), 16*sizeof(osg::Matrix::value_type))
+            || !cursor.read(O.ptr(), 16*sizeof(osg::Matrix::value_type))
+            || !cursor.read(&center, sizeof(center)) || !cursor.read(&normal, sizeof(normal))
+            || !cursor.readUInt(flags))
+        return false;
+    if (!canvas) return true;
+
+    canvas->setName(name);
+    canvas->setMatrixRotation(R);
+    canvas->setMatrixTranslation(T);
+    canvas->setMatrixOffset(O);
+    canvas->setCenter(center);
+    canvas->setNormal(normal);
+    canvas->setVisibilityData(flags & CANVAS_VISIBLE_DATA);
+    canvas->setVisibilityFrame(flags & CANVAS_VISIBLE_ALL);
+    return true;
+}
+
+osg::Image *entity::SceneChunkFile::readImage(unsigned int chunk) const
+{
+    Cursor cursor(0, 0);
+    if (!this->getChunk(chunk, CHUNK_PHOTO, cursor)) return 0;
+    osg::ref_ptr<osgDB::ReaderWriter> rwImage = getReaderWriter(cher::PHOTO_STORE_FORMAT);
+    if (!rwImage.get()) return 0;
+
+    const unsigned char* bytes = cursor.skip(m_toc[chunk].size);
+    std::istringstream ss(std::string(reinterpret_cast<const char*>(bytes), m_toc[chunk].size));
+    osg::ref_ptr<osg::Image> image = rwImage->readImage(ss).getImage();
+    return image.release();
+}
+
+entity::SceneChunkFile::ImageDecoder::result_type entity::SceneChunkFile::ImageDecoder::operator()(unsigned int chunk) const
+{
+    return file->readImage(chunk);
+}
+
+unsigned int entity::SceneChunkFile::decodePhotos()
+{
+    this->waitForPhotos();
+    std::vector<unsigned int> chunks;
+    for (const auto& photo : m_photos){
+        if (entity::PhotoStore::instance().findTexture(photo.first)) continue;
+        m_decoded.push_back(entity::PhotoStore::instance().createTexture(photo.first));
+        chunks.push_back(photo.second);
+    }
+    if (chunks.empty()) return 0;
+
+    ImageDecoder decoder;
+    decoder.file = this;
+    m_decoding = QtConcurrent::mapped(chunks, decoder);
+    return static_cast<unsigned int>(chunks.size());
+}
+
+QFuture<osg::ref_ptr<osg::Image> > entity::SceneChunkFile::getPhotosDecoded() const
+{
+    return m_decoding;
+}
+
+bool entity::SceneChunkFile::attachPhoto(int index)
+{
+    if (index < 0 || index >= static_cast<int>(m_decoded.size()) || !m_decoded[index].get()) return false;
+    osg::ref_ptr<osg::Texture2D> texture = m_decoded[index];
+    m_decoded[index] = 0;
+    osg::ref_ptr<osg::Image> image = m_decoding.resultAt(index);
+    if (!image.get()){
+        qWarning("SceneChunkFile::attachPhoto: could not decode photo");
+        return false;
+    }
+    texture->setImage(image.get());
+    return true;
+}
+
+void entity::SceneChunkFile::waitForPhotos()
+{
+    if (m_decoded.empty()) return;
+    m_decoding.waitForFinished();
+    for (int i=0; i<static_cast<int>(m_decoded.size()); ++i)
+        this->attachPhoto(i);
+    m_decoded.clear();
+    m_decoding = QFuture< osg::ref_ptr<osg::Image> >();
+}
+
+int entity::SceneChunkFile::getNumPhotosPending() const
+{
+    int count = 0;
+    for (const auto& texture : m_decoded){
+        if (texture.get()) ++count;
+    }
+    return count;
+}
+
+bool entity::SceneChunkFile::readJournal()
+{
+    /* the replaced scene chunks are free, so there is only one */
+    m_scene = CHUNK_NONE;
+    for (unsigned int i=0; i<m_toc.size(); ++i){
+        if (m_toc[i].type == CHUNK_SCENE) m_scene = i;
+    }
+    Cursor cursor(0, 0);
+    if (!this->getChunk(m_scene, CHUNK_SCENE, cursor)) return false;
+
+    unsigned int id = 0, numCanvases = 0, numPhotos = 0;
+    if (!cursor.readUInt(id) || !cursor.readUInt(id) || !cursor.readUInt(id) || !cursor.readUInt(numCanvases)
+            || !cursor.skip(static_cast<unsigned long long>(numCanvases) * sizeof(unsigned int))
+            || !cursor.readUInt(m_bookmarks))
+        return false;
+
+    Cursor bookmarks(0, 0);
+    if (this->getChunk(m_bookmarks, CHUNK_BOOKMARKS, bookmarks)){
+        int sz = static_cast<int>(m_toc[m_bookmarks].size);
+        const char* bytes = reinterpret_cast<const char*>(bookmarks.skip(sz));
+        m_bookmarksDigest = QCryptographicHash::hash(QByteArray::fromRawData(bytes, sz), QCryptographicHash::Sha1);
+    }
+    else
+        m_bookmarks = CHUNK_NONE;
+
+    if (!cursor.readUInt(numPhotos)) return false;
+    for (unsigned int i=0; i<numPhotos; ++i){
+        std::string digest;
+        unsigned int chunk = CHUNK_NONE;
+        if (!cursor.readString(digest) || !cursor.readUInt(chunk)) return false;
+        if (chunk < m_toc.size() && m_toc[chunk].type == CHUNK_PHOTO)
+            m_photos[digest] = chunk;
+    }
+    return true;
+}
+
+unsigned int entity::SceneChunkFile::findCanvas(const entity::Canvas *canvas) const
+{
+    for (const auto& saved : m_canvases){
+        if (saved.first.get() != canvas) continue;
+        if (saved.second < m_toc.size() && m_toc[saved.second].type == CHUNK_CANVAS)
+            return saved.second;
+        break;
+    }
+    return CHUNK_NONE;
+}
+
+unsigned int entity::SceneChunkFile::appendChunk(QFileDevice &file, std::vector<Chunk> &toc, unsigned int type, const QByteArray &data)
+{
+    Chunk chunk = {type, 0, static_cast<unsigned long long>(file.pos()), static_cast<unsigned long long>(data.size())};
+    if (file.write(data) != data.size()) return CHUNK_NONE;
+    /* keep every chunk 8 byte aligned */
+    while (file.pos() % 8) file.write("\0", 1);
+    toc.push_back(chunk);
+    return static_cast<unsigned int>(toc.size()-1);
+}
+
+QByteArray entity::SceneChunkFile::encodeScene(unsigned int idCanvas, unsigned int idPhoto, unsigned int idBookmark,
+                                               const std::vector<unsigned int> &canvases, unsigned int bookmarks,
+                                               const std::unordered_map<std::string, unsigned int> &photos)
+{
+    QByteArray data;
+    putValue(data, idCanvas);
+    putValue(data, idPhoto);
+    putValue(data, idBookmark);
+    putValue(data, static_cast<unsigned int>(canvases.size()));
+    for (unsigned int chunk : canvases)
+        putValue(data, chunk);
+    putValue(data, bookmarks);
+    putValue(data, static_cast<unsigned int>(photos.size()));
+    for (const auto& blob : photos){
+        putString(data, blob.first);
+        putValue(data, blob.second);
+    }
+    return data;
+}
+
+/* the table of contents is written after the chunks; the header is switched to it only then */
+bool entity::SceneChunkFile::writeTable(QFileDevice &file, const std::vector<Chunk> &toc, unsigned long long &end)
+{
+    unsigned long long tocOffset = file.pos();
+    for (const Chunk& chunk : toc){
+        if (file.write(reinterpret_cast<const char*>(&chunk), sizeof(Chunk)) != sizeof(Chunk))
+            return false;
+    }
+    if (!file.flush()) return false;
+
+    QByteArray header;
+    header.append(CHUNK_MAGIC, 4);
+    putValue(header, cher::SCENE_CHUNK_VERSION);
+    putValue(header, static_cast<unsigned int>(toc.size()));
+    putValue(header, static_cast<unsigned int>(0));
+    putValue(header, tocOffset);
+    if (!file.seek(0) || file.write(header) != header.size() || !file.flush()) return false;
+
+    end = tocOffset + toc.size() * sizeof(Chunk);
+    return true;
+}
+
+unsigned int entity::SceneChunkFile::writeChunk(QFileDevice &file, unsigned int type, const QByteArray &data)
+{
+    return appendChunk(file, m_toc, type, data);
+}
+
+QByteArray entity::SceneChunkFile::encodeCanvas(entity::Canvas *cnv, const std::vector<unsigned int> &blobs)
+{
+    QByteArray data;
+    putString(data, cnv->getName());
+    putMatrix(data, cnv->getMatrixRotation());
+    putMatrix(data, cnv->getMatrixTranslation());
+    putMatrix(data, cnv->getMatrixOffset());
+    putValue(data, cnv->getCenter());
+    putValue(data, cnv->getNormal());
+    unsigned int flags = (cnv->getVisibilityAll()? CANVAS_VISIBLE_ALL : 0) | (cnv->getVisibilityData()? CANVAS_VISIBLE_DATA : 0);
+    putValue(data, flags);
+
+    putValue(data, cnv->getNumStrokes());
+    for (unsigned int j=0; j<cnv->getNumStrokes(); ++j){
+        entity::Stroke* stroke = cnv->getStroke(j);
+        if (!stroke) qFatal("SceneChunkFile::encodeCanvas: stroke is NULL");
+        putShadered(data, stroke, stroke->getIsCurved());
+    }
+
+    putValue(data, cnv->getNumPolygons());
+    for (unsigned int j=0; j<cnv->getNumPolygons(); ++j){
+        entity::Polygon* poly = cnv->getPolygon(j);
+        if (!poly) qFatal("SceneChunkFile::encodeCanvas: polygon is NULL");
+        putShadered(data, poly, false);
+    }
+
+    putValue(data, cnv->getNumPhotos());
+    for (unsigned int j=0; j<cnv->getNumPhotos(); ++j){
+        entity::Photo* photo = cnv->getPhoto(j);
+        if (!photo) qFatal("SceneChunkFile::encodeCanvas: photo is NULL");
+        putString(data, photo->getName());
+        putString(data, photo->getDigest());
+        putValue(data, j < blobs.size()? blobs[j] : CHUNK_NONE);
+        putValue(data, photo->getCenter());
+        putValue(data, photo->getWidth());
+        putValue(data, photo->getHeight());
+        putValue(data, photo->getAngle());
+        putValue(data, photo->getTransparency());
+        const osg::Vec2Array* texcoords = static_cast<const osg::Vec2Array*>(photo->getTexCoordArray(0));
+        for (unsigned int k=0; k<4; ++k)
+            putValue(data, (texcoords && texcoords->size() == 4)? (*texcoords)[k] : osg::Vec2f(0,0));
+    }
+
+    return data;
+}
+
+QByteArray entity::SceneChunkFile::encodeBookmarks(const entity::Bookmarks *bookmarks)
+{
+    QByteArray data;
+    osg::ref_ptr<osgDB::ReaderWriter> rwNode = getReaderWriter("osgb");
+    if (!bookmarks || !rwNode.get()) return data;
+    std::stringstream ss;
+    if (rwNode->writeNode(*bookmarks, ss).success()){
+        std::string str = ss.str();
+        data = QByteArray(str.data(), static_cast<int>(str.size()));
+    }
+    else
+        qWarning("SceneChunkFile::encodeBookmarks: could not serialize bookmarks");
+    return data;
+}
+
+unsigned int entity::SceneChunkFile::writeCanvas(QFileDevice &file, entity::Canvas *cnv)
+{
+    /* photo blobs first, so that the canvas chunk can refer to them; identical images are written once */
+    osg::ref_ptr<osgDB::ReaderWriter> rwImage = getReaderWriter(cher::PHOTO_STORE_FORMAT);
+    std::vector<unsigned int> photos;
+    for (unsigned int j=0; j<cnv->getNumPhotos(); ++j){
+        entity::Photo* photo = cnv->getPhoto(j);
+        if (photo && photo->getDigest().empty()) photo->shareTexture();
+        auto it = photo? m_photos.find(photo->getDigest()) : m_photos.end();
+        if (it != m_photos.end()){
+            photos.push_back(it->second);
+            continue;
+        }
+        const osg::Image* image = (photo && photo->getTexture())? photo->getTexture()->getImage() : 0;
+        if (photo && !image) image = entity::PhotoStore::instance().restoreImage(photo->getDigest());
+        std::stringstream ss;
+        if (!image || !rwImage.get() || !rwImage->writeImage(*image, ss).success()){
+            qWarning("SceneChunkFile::write: could not encode photo image");
+            photos.push_back(CHUNK_NONE);
+            continue;
+        }
+        std::string blob = ss.str();
+        photos.push_back(this->writeChunk(file, CHUNK_PHOTO, QByteArray(blob.data(), static_cast<int>(blob.size()))));
+        if (!photo->getDigest().empty() && photos.back() != CHUNK_NONE) m_photos[photo->getDigest()] = photos.back();
+    }
+
+    unsigned int chunk = this->writeChunk(file, CHUNK_CANVAS, encodeCanvas(cnv, photos));
+    if (chunk == CHUNK_NONE)
+        qWarning("SceneChunkFile::write: could not write canvas chunk");
+    return chunk;
+}
+
+bool entity::SceneChunkFile::writeJournal(QFileDevice &file, entity::UserScene *scene, bool all)
+{
+    while (file.pos() % 8){
+        if (file.write("\0", 1) != 1) return false;
+    }
+
+    /* dirty canvases and the ones that are not in the file yet are written, the others keep their chunks */
+    std::vector<char> used(m_toc.size(), 0);
+    std::vector< std::pair<osg::observer_ptr<entity::Canvas>, unsigned int> > canvases;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        entity::Canvas* cnv = scene->getCanvas(i);
+        if (!cnv) continue;
+        unsigned int chunk = all? CHUNK_NONE : this->findCanvas(cnv);
+        if (chunk == CHUNK_NONE || cnv->isDirty()){
+            /* a pending canvas can only be dirty by its header, its content is read before it is re-written */
+            if (!scene->materializeCanvas(cnv)) return false;
+            chunk = this->writeCanvas(file, cnv);
+            if (chunk == CHUNK_NONE) return false;
+        }
+        else
+            used[chunk] = 1;
+        canvases.push_back(std::make_pair(osg::observer_ptr<entity::Canvas>(cnv), chunk));
+    }
+
+    /* canvases that were re-written or removed from the scene */
+    for (unsigned int i=0; i<used.size(); ++i){
+        if (m_toc[i].type == CHUNK_CANVAS && !used[i]) this->freeChunk(i);
+    }
+
+    /* photo blobs that no canvas refers to anymore are dropped from the photo table; the photos of a pending
+     * canvas are not known until it is read, then all the blobs are kept */
+    std::unordered_set<std::string> digests;
+    bool pending = false;
+    for (const auto& saved : canvases){
+        entity::Canvas* cnv = saved.first.get();
+        if (scene->isCanvasPending(cnv)){
+            pending = true;
+            break;
+        }
+        for (unsigned int j=0; j<cnv->getNumPhotos(); ++j){
+            entity::Photo* photo = cnv->getPhoto(j);
+            if (photo) digests.insert(photo->getDigest());
+        }
+    }
+    for (auto it = m_photos.begin(); !pending && it != m_photos.end(); ){
+        if (digests.find(it->first) != digests.end()){
+            ++it;
+            continue;
+        }
+        this->freeChunk(it->second);
+        it = m_photos.erase(it);
+    }
+
+    /* bookmarks are edited in place from many places, e.g., the SVM wires, so they are compared by content */
+    QByteArray bookmarks = encodeBookmarks(scene->getBookmarks());
+    QByteArray digest = QCryptographicHash::hash(bookmarks, QCryptographicHash::Sha1);
+    if (m_bookmarks == CHUNK_NONE || digest != m_bookmarksDigest){
+        this->freeChunk(m_bookmarks);
+        m_bookmarks = this->writeChunk(file, CHUNK_BOOKMARKS, bookmarks);
+        if (m_bookmarks == CHUNK_NONE) return false;
+        m_bookmarksDigest = digest;
+    }
+
+    /* scene chunk: ids, canvas chunks, bookmarks chunk and photo table */
+    std::vector<unsigned int> chunks;
+    for (const auto& saved : canvases)
+        chunks.push_back(saved.second);
+    this->freeChunk(m_scene);
+    m_scene = this->writeChunk(file, CHUNK_SCENE, encodeScene(scene->getIdCanvas(), scene->getIdPhoto(), scene->getIdBookmark(),
+                                                              chunks, m_bookmarks, m_photos));
+    if (m_scene == CHUNK_NONE || !writeTable(file, m_toc, m_end)) return false;
+
+    m_canvases = canvases;
+    for (const auto& saved : m_canvases)
+        saved.first->setDirty(false);
+    return true;
+}
+
+void entity::SceneChunkFile::freeChunk(unsigned int index)
+{
+    if (index < m_toc.size()) m_toc[index].type = CHUNK_FREE;
+}
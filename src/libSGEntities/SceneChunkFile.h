@@ -0,0 +1,273 @@
+#ifndef SCENECHUNKFILE_H
+#define SCENECHUNKFILE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <osg/Referenced>
+#include <osg/Array>
+#include <osg/Image>
+#include <osg/Texture2D>
+#include <osg/observer_ptr>
+
+#include <QFile>
+#include <QByteArray>
+#include <QFuture>
+
+namespace entity {
+class UserScene;
+class Canvas;
+class Bookmarks;
+
+/*! \class SceneChunkFile
+ * \brief Native binary scene format of cherish with lazy canvas loading and incremental saves.
+ *
+ * The file is a journal of chunks, followed by a table of contents:
+ *
+ *     [header: magic, version, number of chunks, TOC offset]
+ *     [chunk PHOTO]     -> encoded image blob, one per distinct image digest
+ *     [chunk CANVAS]    -> canvas header, strokes and polygons with quantized points, photo records
+ *     ...
+ *     [chunk BOOKMARKS] -> bookmarks as OSG binary stream
+ *     [chunk SCENE]     -> ids, list of CANVAS chunks, BOOKMARKS chunk, digests of PHOTO chunks
+ *     [TOC: type, offset and size of every chunk]
+ *
+ * Every CANVAS chunk starts with the canvas header (name, matrices, center, normal and visibility), so that
+ * an empty canvas can be created by touching only the beginning of the chunk. The file is read through
+ * memory mapping: readScene() creates the UserScene with all the canvases empty and registers them as pending
+ * within the scene; the content of a canvas is read by readCanvas() only when the canvas is materialized,
+ * see UserScene::materializeCanvas(). The photo blobs are decoded on the global thread pool as soon as the scene
+ * is read, see decodePhotos(); a canvas can be materialized before its images are decoded.
+ *
+ * Once read or written, the object is kept by the scene (UserScene::getArchive()) and remembers which chunk
+ * holds each canvas. A later save() only appends the canvases that are dirty (see Canvas::isDirty()), the photo
+ * blobs whose digests are not in the file yet, the bookmarks if they changed, a new SCENE chunk and a new table
+ * of contents; the replaced chunks and the photo blobs that are no longer used are marked as free. The header
+ * is re-written last, so that an interrupted save leaves the previous table of contents in effect. When the free
+ * space exceeds cher::SCENE_CHUNK_GARBAGE of the file, the whole scene is re-written instead, see write().
+ *
+ * The format is chosen by the file extension cher::SCENE_CHUNK_EXTENSION from RootScene::writeScenetoFile()
+ * and by the magic number from RootScene::loadSceneFromFile(); all the other extensions are handled by
+ * OpenSceneGraph serialization as before.
+*/
+class SceneChunkFile : public osg::Referenced
+{
+public:
+    /*! Type of a chunk within the table of contents. */
+    enum ChunkType {
+        CHUNK_FREE = 0,
+        CHUNK_SCENE = 1,
+        CHUNK_CANVAS = 2,
+        CHUNK_PHOTO = 3,
+        CHUNK_BOOKMARKS = 4
+    };
+
+    /*! \struct Snapshot
+     * \brief Serialized state of a scene that can be written to file from any thread, see writeSnapshot().
+     *
+     * All the members are either implicitly shared Qt buffers or reference counted images which are never
+     * modified after they are loaded, so that a copy is cheap and is not affected by further edits of the scene. */
+    struct Snapshot
+    {
+        unsigned int idCanvas, idPhoto, idBookmark;
+        std::vector<QByteArray> canvases; /*!< Canvas records by encodeCanvas(), the photos are referred to by digest. */
+        QByteArray bookmarks; /*!< Bookmarks by encodeBookmarks(). */
+        std::vector<std::string> digests; /*!< Digests of the distinct photo images. */
+        std::vector< osg::ref_ptr<const osg::Image> > images; /*!< Photo images in the same order as digests. */
+        std::vector<QByteArray> blobs; /*!< Encoded images, the empty ones are encoded and filled by writeSnapshot(). */
+    };
+
+    /*! Constructor. The file is not opened. */
+    SceneChunkFile();
+
+    /*! \return true if the file name has the extension of the chunked format. */
+    static bool isChunkFileName(const std::string& path);
+
+    /*! \return true if the file under the given path starts with the magic number of the chunked format. */
+    static bool isChunkFile(const std::string& path);
+
+    /*! A method to save the scene to a chunked file. If the scene was last read from or written to the same file
+     * by this object, only the changes are appended, see append(); otherwise, or if the file has too much free
+     * space, the whole file is re-written, see write().
+     * \param scene is the scene to save
+     * \param path is the file name
+     * \return true if the file was saved successfully. */
+    bool save(entity::UserScene* scene, const std::string& path);
+
+    /*! A method to write the whole scene to a new chunked file; the pending canvases are materialized first.
+     * The file is replaced only after it was written completely.
+     * \param scene is the scene to write
+     * \param path is the file name
+     * \return true if the file was written successfully. */
+    bool write(entity::UserScene* scene, const std::string& path);
+
+    /*! A method to append the changes of the scene to the file that was last read or written by this object.
+     * \param scene is the scene to save
+     * \return true if the file was updated; false if it could not be, e.g., if it was modified by another program. */
+    bool append(entity::UserScene* scene);
+
+    /*! A method to write a scene snapshot to a new chunked file. It does not touch the scene graph and therefore
+     * can be run from a worker thread.
+     * \param snapshot is the scene snapshot, its missing blobs are filled
+     * \param path is the file name
+     * \return true if the file was written successfully. */
+    static bool writeSnapshot(Snapshot& snapshot, const std::string& path);
+
+    /*! \return record of a CANVAS chunk: canvas header, strokes, polygons and photo records.
+     * \param canvas is the canvas to encode, it must be materialized
+     * \param blobs are the PHOTO chunks of the canvas photos; if empty, the photos are found by their digests */
+    static QByteArray encodeCanvas(entity::Canvas* canvas, const std::vector<unsigned int>& blobs);
+
+    /*! A method to append the compact encoding of entity points to the buffer. The points are taken as 2D, since
+     * the entities lie in the canvas plane; each coordinate is quantized to cher::SCENE_CHUNK_QUANTIZATION levels
+     * within the bounding box of the points, and the differences between consecutive points are written as
+     * variable length integers. The record is: box minimum and maximum, stream size in bytes, the stream, and
+     * padding to 4 bytes. A Bezier control point takes about 4 bytes instead of 12.
+     * \sa decodePoints() */
+    static void encodePoints(QByteArray& buffer, const osg::Vec3Array* points);
+
+    /*! A method to restore the points written by encodePoints().
+     * \param data is the start of the record, \param size is the number of bytes available,
+     * \param count is the number of points, \param points is the array to fill, its z-coordinates are zero.
+     * \return false if the record is corrupted. */
+    static bool decodePoints(const unsigned char* data, unsigned long long size, unsigned int count, osg::Vec3Array* points);
+
+    /*! \return bookmarks serialized as OSG binary stream, or empty array if they could not be serialized. */
+    static QByteArray encodeBookmarks(const entity::Bookmarks* bookmarks);
+
+    /*! A method to open and memory map the file, and to read its table of contents.
+     * \return true if the file is a valid chunked file of version cher::SCENE_CHUNK_VERSION. */
+    bool open(const std::string& path);
+
+    /*! A method to unmap and close the file and to forget its table of contents. It is also called by the destructor. */
+    void close();
+
+    /*! A method to unmap the file once there are no pending canvases; the table of contents is kept so that
+     * the file can still be appended to. */
+    void unmap();
+
+    /*! \return true if the file is opened and mapped. */
+    bool isOpen() const;
+
+    /*! \return name of the file that was last read or written, or empty string. */
+    const std::string& getPath() const;
+
+    /*! \return number of chunks within the table of contents, including the free ones. */
+    unsigned int getNumChunks() const;
+
+    /*! \return size of the file in bytes as of the last read or write. */
+    unsigned long long getSize() const;
+
+    /*! \return number of bytes within the file that are not used by the current table of contents, including
+     * the replaced chunks and the photo blobs that no canvas refers to. */
+    unsigned long long getSizeFree() const;
+
+    /*! A method to create a scene out of the SCENE chunk. The canvases are created with their frames,
+     * transforms and programs, but without any content; each of them is registered within the scene
+     * as pending by UserScene::addCanvasPending().
+     * \return the new scene or NULL if the data is corrupted. */
+    entity::UserScene* readScene();
+
+    /*! A method to read strokes, polygons and photos of a CANVAS chunk into the given canvas.
+     * \param chunk is the index of the CANVAS chunk
+     * \param canvas is the empty canvas that was created by readScene()
+     * \return true if all the entities were read. */
+    bool readCanvas(unsigned int chunk, entity::Canvas* canvas);
+
+    /*! A method to start decoding of all the photo blobs of the file on the global thread pool. Every image that
+     * is not in memory yet gets an empty texture within entity::PhotoStore right away, so that readCanvas() does
+     * not wait for the decoding; the decoded images are set to the textures by attachPhoto(). It is called by
+     * readScene().
+     * \return number of images to decode. */
+    unsigned int decodePhotos();
+
+    /*! \return future of the decoded images, its result indices are the ones of attachPhoto(). */
+    QFuture< osg::ref_ptr<osg::Image> > getPhotosDecoded() const;
+
+    /*! A method to set the decoded image to its texture. It has to be called from the GUI thread once the result
+     * is ready, e.g., by a QFutureWatcher on getPhotosDecoded().
+     * \param index is the index of the decoded image
+     * \return true if the image was set, false if it was set before or could not be decoded. */
+    bool attachPhoto(int index);
+
+    /*! A method to block until all the images are decoded and to set them to their textures. */
+    void waitForPhotos();
+
+    /*! \return number of textures whose images are not set yet. */
+    int getNumPhotosPending() const;
+
+protected:
+    ~SceneChunkFile();
+
+    struct Chunk
+    {
+        unsigned int type;
+        unsigned int reserved;
+        unsigned long long offset;
+        unsigned long long size;
+    };
+
+    /* read cursor over a mapped chunk, all the reads are bounds checked */
+    class Cursor
+    {
+    public:
+        Cursor(const unsigned char* data, unsigned long long size);
+        bool read(void* dst, unsigned long long size);
+        bool readUInt(unsigned int& value);
+        bool readString(std::string& value);
+        const unsigned char* skip(unsigned long long size);
+    private:
+        const unsigned char* m_data;
+        unsigned long long m_size;
+        unsigned long long m_pos;
+    };
+
+    bool getChunk(unsigned int index, unsigned int type, Cursor& cursor) const;
+    bool readCanvasHeader(Cursor& cursor, entity::Canvas* canvas) const;
+    osg::Image* readImage(unsigned int chunk) const;
+
+    /* functor of the decoding stage, it only reads the mapped file */
+    struct ImageDecoder
+    {
+        typedef osg::ref_ptr<osg::Image> result_type;
+        const SceneChunkFile* file;
+        result_type operator()(unsigned int chunk) const;
+    };
+    bool readJournal();
+
+    static unsigned int appendChunk(QFileDevice& file, std::vector<Chunk>& toc, unsigned int type, const QByteArray& data);
+    static QByteArray encodeScene(unsigned int idCanvas, unsigned int idPhoto, unsigned int idBookmark,
+                                  const std::vector<unsigned int>& canvases, unsigned int bookmarks,
+                                  const std::unordered_map<std::string, unsigned int>& photos);
+    static bool writeTable(QFileDevice& file, const std::vector<Chunk>& toc, unsigned long long& end);
+
+    unsigned int findCanvas(const entity::Canvas* canvas) const;
+    unsigned int writeChunk(QFileDevice& file, unsigned int type, const QByteArray& data);
+    unsigned int writeCanvas(QFileDevice& file, entity::Canvas* canvas);
+    bool writeJournal(QFileDevice& file, entity::UserScene* scene, bool all);
+    void freeChunk(unsigned int index);
+
+private:
+    QFile m_file;
+    const unsigned char* m_data;
+    unsigned long long m_size;
+    std::vector<Chunk> m_toc;
+
+    /* state of the journal, valid after open() or write() */
+    std::string m_path;
+    unsigned long long m_end; /* file size, chunks are appended from here */
+    unsigned int m_scene;
+    unsigned int m_bookmarks;
+    QByteArray m_bookmarksDigest;
+    std::unordered_map<std::string, unsigned int> m_photos; /* digest to PHOTO chunk */
+    std::vector< std::pair<osg::observer_ptr<entity::Canvas>, unsigned int> > m_canvases; /* saved canvases and their chunks */
+
+    /* decoding stage; the file stays mapped and the TOC unchanged until it is finished */
+    QFuture< osg::ref_ptr<osg::Image> > m_decoding;
+    std::vector< osg::ref_ptr<osg::Texture2D> > m_decoded; /* textures waiting for their images, by result index */
+};
+
+} // namespace entity
+
+#endif // SCENECHUNKFILE_H
@@ -70,6 +70,7 @@ const std::vector<float> &entity::SceneState::getPhotoTransparencies() const
 void entity::SceneState::stripDataFrom(RootScene *scene)
 {
     this->clear();
+    scene->getUserScene()->materializeCanvases();
     m_axisFlag = scene->getAxesVisibility();
     m_bookmarksFlag = scene->getBookmarkToolVisibility();
 
@@ -7,6 +7,7 @@
 #include <osg/BoundingBox>
 #include <osg/BoundingBox>
 #include "Settings.h"
+#include "ShaderedEntity2D.h"
 
 
 entity::SelectedGroup::SelectedGroup(const osg::Vec3f &canvasCenter)
@@ -19,56 +20,72 @@ entity::SelectedGroup::SelectedGroup(const osg::Vec3f &canvasCenter)
 
 void entity::SelectedGroup::addEntity(entity::Entity2D *entity, osg::Geode *geodeData)
 {
-    if (!entity){
-        qWarning("addEntity: ptr is NULL");
-        return;
-    }
-    if (!geodeData->containsDrawable(entity)){
-        qWarning("The entity does not belong to Canvas, selection is impossible");
-        return;
-    }
-
-    /* initialize center, axis params for ToolFrame */
-    if (m_group.size() == 0){
-        m_theta = 0;
-        m_centerEdited = false;
-    }
+    if (!this->insertEntity(entity, geodeData)) return;
+    if (!m_centerEdited) m_center = this->getCenter2D();
+}
 
-    if (this->isEntitySelected(entity) == -1){
-        this->setEntitySelectedColor(entity, true);
-        m_group.push_back(entity);
-        if (!m_centerEdited) m_center = this->getCenter2D();
-    }
+void entity::SelectedGroup::addEntities(const std::vector<entity::Entity2D *> &entities, osg::Geode *geodeData)
+{
+    for (size_t i=0; i<entities.size(); ++i)
+        this->insertEntity(entities.at(i), geodeData);
+    if (!m_centerEdited) m_center = this->getCenter2D();
 }
 
 bool entity::SelectedGroup::removeEntity(entity::Entity2D *entity)
 {
-    if (!entity) return false;
     int idx = this->isEntitySelected(entity);
-    if (idx >=0 && idx < static_cast<int>(m_group.size())){
+    if (idx < 0) return false;
+
+    this->setEntitySelectedColor(entity, false);
+    m_group.erase(m_group.begin()+idx);
+    m_index.erase(entity);
+    m_bounds.remove(entity);
+    /* keep the order of selection */
+    for (size_t i=idx; i<m_group.size(); ++i)
+        m_index[m_group.at(i)] = i;
+
+    if (!m_centerEdited) m_center = this->getCenter2D();
+    if (m_group.size() == 0) m_centerEdited = false;
+    return true;
+}
+
+void entity::SelectedGroup::removeEntities(const std::vector<entity::Entity2D *> &entities)
+{
+    bool removed = false;
+    for (size_t i=0; i<entities.size(); ++i){
+        entity::Entity2D* entity = entities.at(i);
+        if (this->isEntitySelected(entity) < 0) continue;
         this->setEntitySelectedColor(entity, false);
-        m_group.erase(m_group.begin()+idx);
-        if (!m_centerEdited) m_center = this->getCenter2D();
-        if (m_group.size() == 0) m_centerEdited = false;
-        return true;
+        m_index.erase(entity);
+        m_bounds.remove(entity);
+        removed = true;
+    }
+    if (!removed) return;
+
+    /* single pass over the selection, the order is kept */
+    std::vector<entity::Entity2D*> group;
+    group.reserve(m_index.size());
+    for (size_t i=0; i<m_group.size(); ++i){
+        entity::Entity2D* entity = m_group.at(i);
+        if (m_index.find(entity) == m_index.end()) continue;
+        m_index[entity] = group.size();
+        group.push_back(entity);
     }
-    return false;
+    m_group.swap(group);
+
+    if (!m_centerEdited) m_center = this->getCenter2D();
+    if (m_group.size() == 0) m_centerEdited = false;
 }
 
 void entity::SelectedGroup::resetAll()
 {
-    while (m_group.size() > 0){
-        entity::Entity2D* entity = m_group.at(m_group.size()-1);
-        if (!entity) {
-            qWarning("resetEntitiesSelected: entity is NULL");
-            return;
-        }
-        if (!this->removeEntity(entity)){
-            qWarning("SelectedGroup::resetAll: canot remove entity");
-            return;
-        }
-    }
+    for (size_t i=0; i<m_group.size(); ++i)
+        this->setEntitySelectedColor(m_group.at(i), false);
+    m_group.clear();
+    m_index.clear();
+    m_bounds.clear();
     m_centerEdited = false;
+    m_center = this->getCenter2D();
 }
 
 void entity::SelectedGroup::selectAll(osg::Geode *geodeData)
@@ -76,11 +93,13 @@ void entity::SelectedGroup::selectAll(osg::Geode *geodeData)
     bool tmp = m_centerEdited;
     this->resetAll();
     m_centerEdited = tmp;
-    for (size_t i = 0; i <geodeData->getNumChildren(); ++i){
-        entity::Entity2D* entity = dynamic_cast<entity::Entity2D*>(geodeData->getChild(i));
-        if (!entity) continue;
-        this->addEntity(entity, geodeData);
+    std::vector<entity::Entity2D*> entities;
+    entities.reserve(geodeData->getNumDrawables());
+    for (unsigned int i = 0; i <geodeData->getNumDrawables(); ++i){
+        entity::Entity2D* entity = dynamic_cast<entity::Entity2D*>(geodeData->getDrawable(i));
+        if (entity) entities.push_back(entity);
     }
+    this->addEntities(entities, geodeData);
 }
 
 const std::vector<entity::Entity2D *> &entity::SelectedGroup::getEntities() const
@@ -113,23 +132,8 @@ osg::Vec3f entity::SelectedGroup::getCenter3D(const osg::Matrix &M) const
 
 osg::Vec3f entity::SelectedGroup::getCenter2D() const
 {
-    double mu = 0, mv = 0;
-    for (size_t i=0; i<m_group.size(); ++i)
-    {
-        entity::Entity2D* entity = m_group.at(i);
-        if (!entity){
-            qWarning("getStrokesSelecterCenter: one of entities ptr is NULL");
-            break;
-        }
-        osg::BoundingBox bb = entity->getBoundingBox();
-        mu += bb.center().x();
-        mv += bb.center().y();
-    }
-    if (m_group.size() > 0){
-        mu /= m_group.size();
-        mv /= m_group.size();
-    }
-    return osg::Vec3f(mu, mv, 0);
+    osg::Vec3f center = m_bounds.getMeanCenter();
+    return osg::Vec3f(center.x(), center.y(), 0);
 }
 
 osg::Vec3f entity::SelectedGroup::getCenter3DCustom(const osg::Matrix &M) const
@@ -158,24 +162,7 @@ void entity::SelectedGroup::setCenter2DCustom(const osg::Vec3f &center)
 
 osg::BoundingBox entity::SelectedGroup::getBoundingBox() const
 {
-    osg::BoundingBox bb;
-    double xmin = FLT_MAX, ymin = FLT_MAX, xmax = -FLT_MAX, ymax = -FLT_MAX;
-    for (size_t i=0; i<m_group.size(); ++i){
-        entity::Entity2D* entity = m_group.at(i);
-        if (!entity){
-            qWarning("getStrokesSelecterCenter: one of entities ptr is NULL");
-            break;
-        }
-        osg::BoundingBox bbi = entity->getBoundingBox();
-        if (!bbi.valid()) continue;
-        xmin = std::min(xmin, double(bbi.xMin()));
-        ymin = std::min(ymin, double(bbi.yMin()));
-        xmax = std::max(xmax, double(bbi.xMax()));
-        ymax = std::max(ymax, double(bbi.yMax()));
-
-    }
-    bb.set(xmin, ymin, 0, xmax, ymax, 0);
-    return bb;
+    return m_bounds.getBoundingBox();
 }
 
 double entity::SelectedGroup::getRotationAngle() const
@@ -185,7 +172,13 @@ double entity::SelectedGroup::getRotationAngle() const
 
 void entity::SelectedGroup::move(double du, double dv)
 {
-    this->move(m_group, du, dv);
+    for (size_t i=0; i<m_group.size(); ++i){
+        entity::ShaderedEntity2D* entity = dynamic_cast<entity::ShaderedEntity2D*>(m_group.at(i));
+        if (entity) entity->moveDeferred(du, dv);
+        else if (m_group.at(i)) m_group.at(i)->moveDelta(du, dv);
+        m_bounds.update(m_group.at(i));
+    }
+    m_center = m_center + osg::Vec3f(du, dv, 0);
 }
 
 void entity::SelectedGroup::move(std::vector<entity::Entity2D *> &entities, double du, double dv)
@@ -196,14 +189,23 @@ void entity::SelectedGroup::move(std::vector<entity::Entity2D *> &entities, doub
             qWarning("moveEntities: one of entity ptr is NULL");
             break;
         }
+        /* the drag is reverted by the caller before committing, its pending transform is dropped */
+        entity::ShaderedEntity2D* shadered = dynamic_cast<entity::ShaderedEntity2D*>(entity);
+        if (shadered) shadered->applyDeferredTransform();
         entity->moveDelta(du, dv);
+        m_bounds.update(entity);
     }
     m_center = m_center + osg::Vec3f(du, dv, 0);
 }
 
 void entity::SelectedGroup::scale(double sx, double sy)
 {
-    this->scale(m_group, sx, sy, m_center);
+    for (size_t i=0; i<m_group.size(); ++i){
+        entity::ShaderedEntity2D* entity = dynamic_cast<entity::ShaderedEntity2D*>(m_group.at(i));
+        if (entity) entity->scaleDeferred(sx, sy, m_center);
+        else if (m_group.at(i)) m_group.at(i)->scale(sx, sy, m_center);
+        m_bounds.update(m_group.at(i));
+    }
 }
 
 void entity::SelectedGroup::scale(std::vector<entity::Entity2D *> &entities, double sx, double sy, const osg::Vec3f &center)
@@ -214,13 +216,22 @@ void entity::SelectedGroup::scale(std::vector<entity::Entity2D *> &entities, dou
             qWarning("scaleEntities: one of strokes ptr is NULL");
             break;
         }
+        entity::ShaderedEntity2D* shadered = dynamic_cast<entity::ShaderedEntity2D*>(entity);
+        if (shadered) shadered->applyDeferredTransform();
         entity->scale(sx, sy, center);
+        m_bounds.update(entity);
     }
 }
 
 void entity::SelectedGroup::rotate(double theta)
 {
-    this->rotate(m_group, theta, m_center);
+    for (size_t i=0; i<m_group.size(); ++i){
+        entity::ShaderedEntity2D* entity = dynamic_cast<entity::ShaderedEntity2D*>(m_group.at(i));
+        if (entity) entity->rotateDeferred(theta, m_center);
+        else if (m_group.at(i)) m_group.at(i)->rotate(theta, m_center);
+        m_bounds.update(m_group.at(i));
+    }
+    m_theta += theta;
 }
 
 void entity::SelectedGroup::rotate(std::vector<entity::Entity2D *> &entities, double theta, const osg::Vec3f &center)
@@ -231,18 +242,47 @@ void entity::SelectedGroup::rotate(std::vector<entity::Entity2D *> &entities, do
             qWarning("rotateEntities: one of entities ptr is NULL");
             break;
         }
+        entity::ShaderedEntity2D* shadered = dynamic_cast<entity::ShaderedEntity2D*>(entity);
+        if (shadered) shadered->applyDeferredTransform();
         entity->rotate(theta, center);
+        m_bounds.update(entity);
     }
     m_theta += theta;
 }
 
 int entity::SelectedGroup::isEntitySelected(entity::Entity2D *entity) const
 {
-    for (size_t i = 0; i < m_group.size(); ++i){
-        if (entity == m_group.at(i))
-            return i;
+    auto it = m_index.find(entity);
+    return it == m_index.end()? -1 : static_cast<int>(it->second);
+}
+
+bool entity::SelectedGroup::insertEntity(entity::Entity2D *entity, osg::Geode *geodeData)
+{
+    if (!entity){
+        qWarning("addEntity: ptr is NULL");
+        return false;
+    }
+    /* the parents of a drawable are few, unlike the drawables of the geode */
+    bool contained = false;
+    for (unsigned int i=0; i<entity->getNumParents() && !contained; ++i)
+        contained = (entity->getParent(i) == geodeData);
+    if (!geodeData || !contained){
+        qWarning("The entity does not belong to Canvas, selection is impossible");
+        return false;
+    }
+
+    /* initialize center, axis params for ToolFrame */
+    if (m_group.size() == 0){
+        m_theta = 0;
+        m_centerEdited = false;
     }
-    return -1;
+
+    if (this->isEntitySelected(entity) != -1) return false;
+    this->setEntitySelectedColor(entity, true);
+    m_index[entity] = m_group.size();
+    m_group.push_back(entity);
+    m_bounds.insert(entity);
+    return true;
 }
 
 void entity::SelectedGroup::setEntitySelectedColor(entity::Entity2D *entity, bool selected)
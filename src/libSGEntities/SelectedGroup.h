@@ -2,14 +2,22 @@
 #define SELECTEDGROUP_H
 
 #include <vector>
+#include <unordered_map>
 #include <osg/Geode>
 #include <osg/BoundingBox>
 #include "Entity2D.h"
+#include "EntityBounds.h"
 
 namespace entity {
 
 /*! \class SelectedGroup
- * Class description
+ * \brief Entities of a canvas which are selected by the user.
+ *
+ * The selection keeps the order in which the entities were selected. Membership is looked up in a hash map from
+ * entity to its position, and the bounding box and mean center of the selection are maintained by
+ * entity::EntityBounds, so that adding or removing an entity does not go through the whole selection.
+ * Large sets of entities, e.g., when selecting all, are added and removed by addEntities() and
+ * removeEntities().
 */
 class SelectedGroup
 {
@@ -18,6 +26,13 @@ public:
 
     void addEntity(entity::Entity2D* entity, osg::Geode* geodeData);
     bool removeEntity(entity::Entity2D* entity);
+
+    /*! A method to select all the given entities of the geode; the center is updated once. */
+    void addEntities(const std::vector<entity::Entity2D*>& entities, osg::Geode* geodeData);
+
+    /*! A method to unselect all the given entities in a single pass over the selection. */
+    void removeEntities(const std::vector<entity::Entity2D*>& entities);
+
     void resetAll();
     void selectAll(osg::Geode* geodeData);
     const std::vector<Entity2D *> &getEntities() const;
@@ -30,21 +45,30 @@ public:
     void setCenter3DCustom(const osg::Vec3f& center, const osg::Matrix& M);
     osg::Vec3f getCenter2DCustom() const;
     void setCenter2DCustom(const osg::Vec3f& center);
+    /*! \return the local box of the selected entities, it is maintained incrementally by entity::EntityBounds. */
     osg::BoundingBox getBoundingBox() const;
     double getRotationAngle() const;
 
+    /*! Methods to transform the selected entities while the user drags them. The shadered entities are
+     * transformed by their pending shader matrix and their vertices are not changed, see
+     * ShaderedEntity2D::moveDeferred(). */
     void move(double du, double dv);
-    void move(std::vector<Entity2D *> &entities, double du, double dv);
     void scale(double sx, double sy);
-    void scale(std::vector<Entity2D *> &entities, double sx, double sy, const osg::Vec3f& center);
     void rotate(double theta);
+
+    /*! Methods to transform the vertices of the given entities, e.g., when an edit command is done or undone. */
+    void move(std::vector<Entity2D *> &entities, double du, double dv);
+    void scale(std::vector<Entity2D *> &entities, double sx, double sy, const osg::Vec3f& center);
     void rotate(std::vector<Entity2D *> &entities, double theta, const osg::Vec3f& center);
 
 protected:
     int isEntitySelected(entity::Entity2D* entity) const;
+    bool insertEntity(entity::Entity2D* entity, osg::Geode* geodeData);
     void setEntitySelectedColor(entity::Entity2D* entity, bool selected = true);
 
     std::vector<entity::Entity2D*> m_group;
+    std::unordered_map<entity::Entity2D*, size_t> m_index; /* entity to its position within m_group */
+    entity::EntityBounds m_bounds; /* box of m_group */
 
     osg::Vec3f m_center; /* local center for rotation and scaling */
     float m_theta; /* whether axis was rotated */
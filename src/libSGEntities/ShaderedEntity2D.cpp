@@ -3,6 +3,8 @@
 #include <QtGlobal>
 #include <QDebug>
 
+#include <cmath>
+
 #include "Settings.h"
 #include "Utilities.h"
 #include "MainWindow.h"
@@ -13,8 +15,15 @@ entity::ShaderedEntity2D::ShaderedEntity2D(unsigned int drawing, AttributeBindin
     , m_program(0)
     , m_isShadered(false)
     , m_color(color)
+    , m_deferred(osg::Matrix::identity())
+    , m_generation(0)
+    , m_localBoundArray(0)
+    , m_localBoundCount(0)
+    , m_verticesOwner(0)
+    , m_colorsOwner(0)
 {
     osg::Vec4Array* colors = new osg::Vec4Array;
+    if (binding == osg::Geometry::BIND_OVERALL) colors->push_back(color);
     osg::Vec3Array* verts = new osg::Vec3Array;
 
     this->addPrimitiveSet(m_lines.get());
@@ -36,7 +45,18 @@ entity::ShaderedEntity2D::ShaderedEntity2D(const entity::ShaderedEntity2D &copy,
     , m_program(copy.m_program)
     , m_isShadered(copy.m_isShadered)
     , m_color(copy.m_color)
+    , m_deferred(osg::Matrix::identity())
+    , m_generation(0)
+    , m_localBoundArray(0)
+    , m_localBoundCount(0)
+    , m_verticesOwner(0)
+    , m_colorsOwner(0)
 {
+    /* a shallow copy references the arrays of the source */
+    if (!(copyop.getCopyFlags() & osg::CopyOp::DEEP_COPY_ARRAYS)){
+        m_verticesOwner = copy.getVerticesOwner();
+        m_colorsOwner = copy.getColorsOwner();
+    }
 }
 
 void entity::ShaderedEntity2D::initializeProgram(ProgramEntity2D *p, unsigned int mode)
@@ -62,10 +82,16 @@ bool entity::ShaderedEntity2D::copyFrom(const entity::ShaderedEntity2D *copy)
     if (!copy || !this->getLines()) return false;
     if (this->getNumPoints() != 0 || copy->getNumPoints() == 0) return false;
 
-    for (int i=0; i<copy->getNumPoints(); i++){
-        osg::Vec2f p = copy->getPoint(i);
-        this->appendPoint(p.x(), p.y(), copy->getColor());
-    }
+    /* copy on write: the arrays are only referenced, they are copied by detachArrays() once edited */
+    this->setVertexArray(const_cast<osg::Array*>(copy->getVertexArray()));
+    this->setColorArray(const_cast<osg::Array*>(copy->getColorArray()));
+    m_verticesOwner = copy->getVerticesOwner();
+    m_colorsOwner = copy->getColorsOwner();
+    ++m_generation;
+    m_lines->setFirst(0);
+    m_lines->setCount(this->getNumPoints());
+    m_color = copy->getColor();
+    this->dirtyBound();
 
     this->setProgram(copy->getProgram());
     if (copy->getProgram())
@@ -74,10 +100,23 @@ bool entity::ShaderedEntity2D::copyFrom(const entity::ShaderedEntity2D *copy)
     return true;
 }
 
+void entity::ShaderedEntity2D::detachArrays()
+{
+    this->detachVertices();
+    this->detachColors();
+}
+
 void entity::ShaderedEntity2D::appendPoint(const float u, const float v, osg::Vec4f color)
 {
+    this->detachArrays();
     osg::Vec4Array* colors = static_cast<osg::Vec4Array*>(this->getColorArray());
-    colors->push_back(color);
+    if (colors->getBinding() == osg::Array::BIND_OVERALL){
+        /* the single color is shared by all the points */
+        if (colors->empty()) colors->push_back(color);
+        else (*colors)[0] = color;
+    }
+    else
+        colors->push_back(color);
     colors->dirty();
 
     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
@@ -159,6 +198,7 @@ int entity::ShaderedEntity2D::getNumPoints() const
 
 void entity::ShaderedEntity2D::moveDelta(double du, double dv)
 {
+    this->detachVertices();
     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
     for (unsigned int i=0; i<verts->size(); ++i){
         osg::Vec3f vi = (*verts)[i];
@@ -170,6 +210,7 @@ void entity::ShaderedEntity2D::moveDelta(double du, double dv)
 
 void entity::ShaderedEntity2D::scale(double scaleX, double scaleY, osg::Vec3f center)
 {
+    this->detachVertices();
     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
     for (unsigned int i=0; i<verts->size(); ++i){
         osg::Vec3f vi = (*verts)[i] - center;
@@ -181,6 +222,7 @@ void entity::ShaderedEntity2D::scale(double scaleX, double scaleY, osg::Vec3f ce
 
 void entity::ShaderedEntity2D::scale(double scale, osg::Vec3f center)
 {
+    this->detachVertices();
     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
     for (unsigned int i=0; i<verts->size(); ++i){
         osg::Vec3f vi = (*verts)[i] - center;
@@ -192,6 +234,7 @@ void entity::ShaderedEntity2D::scale(double scale, osg::Vec3f center)
 
 void entity::ShaderedEntity2D::rotate(double theta, osg::Vec3f center)
 {
+    this->detachVertices();
     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
     for (unsigned int i=0; i<verts->size(); ++i){
         (*verts)[i] = Utilities::rotate2DPointAround(center, theta, (*verts)[i]);
@@ -200,6 +243,171 @@ void entity::ShaderedEntity2D::rotate(double theta, osg::Vec3f center)
     this->dirtyBound();
 }
 
+/* the references from outside of the entities, e.g., by a render batch or a command, do not count */
+bool entity::ShaderedEntity2D::isShared(const osg::Array *array) const
+{
+    if (!array) return false;
+    const osg::Referenced* owner = 0;
+    if (this->getVertexArray() == array) owner = m_verticesOwner.get();
+    else if (this->getColorArray() == array) owner = m_colorsOwner.get();
+    return owner && owner->referenceCount() > 1;
+}
+
+osg::Referenced *entity::ShaderedEntity2D::getVerticesOwner() const
+{
+    if (!m_verticesOwner.get()) m_verticesOwner = new osg::Referenced;
+    return m_verticesOwner.get();
+}
+
+osg::Referenced *entity::ShaderedEntity2D::getColorsOwner() const
+{
+    if (!m_colorsOwner.get()) m_colorsOwner = new osg::Referenced;
+    return m_colorsOwner.get();
+}
+
+void entity::ShaderedEntity2D::detachVertices()
+{
+    osg::Array* verts = this->getVertexArray();
+    if (!this->isShared(verts)) return;
+
+    osg::ref_ptr<osg::Array> copy = static_cast<osg::Array*>(verts->clone(osg::CopyOp::DEEP_COPY_ARRAYS));
+    this->replaceVertexArray(copy.get());
+}
+
+void entity::ShaderedEntity2D::detachColors()
+{
+    osg::Array* colors = this->getColorArray();
+    if (!this->isShared(colors)) return;
+
+    osg::ref_ptr<osg::Array> copy = static_cast<osg::Array*>(colors->clone(osg::CopyOp::DEEP_COPY_ARRAYS));
+    this->replaceColorArray(copy.get(), copy->getBinding());
+}
+
+void entity::ShaderedEntity2D::compactColors()
+{
+    osg::Array* colors = this->getColorArray();
+    if (colors && colors->getBinding() == osg::Array::BIND_OVERALL && colors->getNumElements() == 1) return;
+
+    osg::ref_ptr<osg::Vec4Array> compact = new osg::Vec4Array(osg::Array::BIND_OVERALL);
+    compact->push_back(m_color);
+    this->replaceColorArray(compact.get(), osg::Array::BIND_OVERALL);
+}
+
+void entity::ShaderedEntity2D::replaceVertexArray(osg::Array *array)
+{
+    osg::Array* verts = this->getVertexArray();
+    for (unsigned int i=0; i<this->getNumVertexAttribArrays(); ++i){
+        if (verts && this->getVertexAttribArray(i) == verts) this->setVertexAttribArray(i, array, osg::Array::BIND_PER_VERTEX);
+    }
+    this->setVertexArray(array);
+    m_verticesOwner = 0;
+    ++m_generation;
+}
+
+void entity::ShaderedEntity2D::replaceColorArray(osg::Array *array, osg::Array::Binding binding)
+{
+    osg::Array* colors = this->getColorArray();
+    for (unsigned int i=0; i<this->getNumVertexAttribArrays(); ++i){
+        if (colors && this->getVertexAttribArray(i) == colors) this->setVertexAttribArray(i, array, binding);
+    }
+    this->setColorArray(array, binding);
+    m_colorsOwner = 0;
+    ++m_generation;
+}
+
+void entity::ShaderedEntity2D::moveDeferred(double du, double dv)
+{
+    if (!m_isShadered){
+        this->moveDelta(du, dv);
+        return;
+    }
+    this->setDeferredTransform(m_deferred * osg::Matrix::translate(du, dv, 0));
+}
+
+void entity::ShaderedEntity2D::scaleDeferred(double scaleX, double scaleY, const osg::Vec3f &center)
+{
+    if (!m_isShadered){
+        this->scale(scaleX, scaleY, center);
+        return;
+    }
+    this->setDeferredTransform(m_deferred * osg::Matrix::translate(-center)
+                               * osg::Matrix::scale(scaleX, scaleY, 1) * osg::Matrix::translate(center));
+}
+
+void entity::ShaderedEntity2D::rotateDeferred(double theta, const osg::Vec3f &center)
+{
+    if (!m_isShadered){
+        this->rotate(theta, center);
+        return;
+    }
+    /* counter-clockwise as Utilities::rotate2DPointAround() */
+    this->setDeferredTransform(m_deferred * osg::Matrix::translate(-center)
+                               * osg::Matrix::rotate(theta, osg::Z_AXIS) * osg::Matrix::translate(center));
+}
+
+const osg::Matrix &entity::ShaderedEntity2D::getDeferredTransform() const
+{
+    return m_deferred;
+}
+
+unsigned int entity::ShaderedEntity2D::getArraysGeneration() const
+{
+    return m_generation;
+}
+
+void entity::ShaderedEntity2D::applyDeferredTransform()
+{
+    if (m_deferred.isIdentity()) return;
+
+    /* the drag is reverted before the edit is committed, the round-off of the reverted transform is dropped */
+    bool identity = true;
+    for (int i=0; i<4 && identity; ++i){
+        for (int j=0; j<4 && identity; ++j)
+            identity = std::fabs(m_deferred(i,j) - (i==j? 1.0 : 0.0)) <= cher::EPSILON;
+    }
+    if (identity){
+        this->setDeferredTransform(osg::Matrix::identity());
+        return;
+    }
+
+    this->detachVertices();
+    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
+    for (unsigned int i=0; i<verts->size(); ++i){
+        osg::Vec3f p = (*verts)[i] * m_deferred;
+        (*verts)[i] = osg::Vec3f(p.x(), p.y(), 0);
+    }
+    verts->dirty();
+    this->setDeferredTransform(osg::Matrix::identity());
+}
+
+osg::BoundingBox entity::ShaderedEntity2D::computeBoundingBox() const
+{
+    const osg::Array* verts = this->getVertexArray();
+    if (!verts || verts != m_localBoundArray || verts->getModifiedCount() != m_localBoundCount){
+        m_localBound = entity::Entity2D::computeBoundingBox();
+        m_localBoundArray = verts;
+        m_localBoundCount = verts? verts->getModifiedCount() : 0;
+    }
+    if (m_deferred.isIdentity() || !m_localBound.valid()) return m_localBound;
+
+    osg::BoundingBox result;
+    for (unsigned int i=0; i<8; ++i)
+        result.expandBy(m_localBound.corner(i) * m_deferred);
+    return result;
+}
+
+void entity::ShaderedEntity2D::setDeferredTransform(const osg::Matrix &M)
+{
+    m_deferred = M;
+
+    osg::StateSet* stateset = this->getOrCreateStateSet();
+    if (m_deferred.isIdentity())
+        stateset->removeUniform("EntityMatrix");
+    else
+        stateset->getOrCreateUniform("EntityMatrix", osg::Uniform::FLOAT_MAT4)->set(osg::Matrixf(m_deferred));
+    this->dirtyBound();
+}
+
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void entity::ShaderedEntity2D::setLines(osg::DrawArrays *lines)
 {
@@ -214,6 +422,7 @@ const osg::DrawArrays *entity::ShaderedEntity2D::getLines() const
 void entity::ShaderedEntity2D::setColor(const osg::Vec4f &color)
 {
     m_color = color;
+    this->detachColors();
     osg::Vec4Array* colors = static_cast<osg::Vec4Array*>(this->getColorArray());
     if (!colors) throw std::runtime_error("setColors: colors is NULL");
 
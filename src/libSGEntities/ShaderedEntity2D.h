@@ -14,7 +14,10 @@ namespace entity{
 class ShaderedEntity2D : public entity::Entity2D
 {
 public:
-    /*! Constructor that creates an empty shadered entity */
+    /*! Constructor that creates an empty shadered entity.
+     * \param binding is the color binding. With osg::Geometry::BIND_OVERALL the color array holds a single color
+     * which is passed to the shader as a constant attribute, so that re-coloring the entity, e.g., when it is
+     * selected, costs O(1) and no memory is spent on a color per vertex. */
     ShaderedEntity2D(unsigned int drawing, osg::Geometry::AttributeBinding binding,
                      const std::string& name, const osg::Vec4f& color);
 
@@ -25,10 +28,21 @@ public:
      * for shadering. */
     virtual void initializeProgram(ProgramEntity2D* p, unsigned int mode = GL_LINE_STRIP);
 
-    /*! A method to be used to copy the input geometry data. It is assumed *this is empty.
+    /*! A method to be used to copy the input geometry data. It is assumed *this is empty. The vertex and color
+     * arrays are not copied, but shared with the source entity until either of them is edited, see detachArrays().
      * \param copy is the source geometry to copy from. */
     virtual bool copyFrom(const entity::ShaderedEntity2D* copy);
 
+    /*! A method to make sure the vertex and color arrays are owned by this entity only. The arrays that are shared
+     * with other entities are replaced by their copies. It must be called before the arrays are modified in place;
+     * all the editing methods of the entity do so. */
+    void detachArrays();
+
+    /*! \return number of times the vertex or color array was replaced by another one, e.g., by detachArrays().
+     * Together with the array pointer and its modified count, it tells whether the points or colors changed,
+     * without keeping a reference to the arrays. \sa entity::StrokeBatch */
+    unsigned int getArraysGeneration() const;
+
     /*! A method to add a point to the end of the entity. It is normally used when constructing an emtity in-motion while sketching.
      * \param u is local U coordinate, \param v is local V coordinate. */
     virtual void appendPoint(const float u, const float v, osg::Vec4f color);
@@ -69,6 +83,26 @@ public:
 
     virtual cher::ENTITY_TYPE getEntityType() const = 0;
 
+    /*! Methods to transform the entity without re-writing its vertices. The transforms are accumulated into a
+     * pending 2D affine matrix which is applied by the entity shader, so that each call costs O(1). They are used
+     * while the user drags a selection; the vertices are only changed once the edit is committed, see
+     * applyDeferredTransform(). An entity which is not shadered is transformed at once.
+     * \sa moveDelta(), scale(), rotate() for the meaning of parameters. */
+    void moveDeferred(double du, double dv);
+    void scaleDeferred(double scaleX, double scaleY, const osg::Vec3f& center);
+    void rotateDeferred(double theta, const osg::Vec3f& center);
+
+    /*! \return the pending transform, identity if there is none. \sa moveDeferred() */
+    const osg::Matrix& getDeferredTransform() const;
+
+    /*! A method to bake the pending transform into the vertices and reset it to identity. A transform which
+     * is close to identity, e.g., of a drag that is reverted, is dropped without changing the vertices. */
+    void applyDeferredTransform();
+
+    /*! \return bounding box of the vertices with the pending transform applied. The box of the vertices is
+     * cached as long as the vertex array is not modified, so that a pending transform is bounded in O(1). */
+    virtual osg::BoundingBox computeBoundingBox() const;
+
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     void setLines(osg::DrawArrays* lines);
     const osg::DrawArrays* getLines() const;
@@ -85,10 +119,44 @@ public:
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 protected:
+    /*! \return true if the vertex or color array is shared with another entity, see copyFrom(). */
+    bool isShared(const osg::Array* array) const;
+
+    void detachVertices();
+    void detachColors();
+
+    /*! Methods to replace the vertex or color array, also where it is bound as a vertex attribute. The new array
+     * belongs to this entity only, and the arrays generation is incremented, see getArraysGeneration(). */
+    void replaceVertexArray(osg::Array* array);
+    void replaceColorArray(osg::Array* array, osg::Array::Binding binding);
+
+    /*! A method to replace the color array by a single color bound overall, unless it is such already. The
+     * entities read from older files carry a color per vertex. */
+    void compactColors();
+
+    /*! A method to set the pending transform and the corresponding shader uniform. */
+    void setDeferredTransform(const osg::Matrix& M);
+
     osg::ref_ptr<osg::DrawArrays>       m_lines;
     osg::observer_ptr<ProgramEntity2D>  m_program;
     bool                                m_isShadered;
     osg::Vec4f                          m_color;
+    osg::Matrix                         m_deferred; /* pending transform, not saved to file */
+    unsigned int                        m_generation; /* incremented when the vertex or color array is replaced */
+
+private:
+    /* cached box of untransformed vertices, valid while the array and its modified count are the same */
+    mutable osg::BoundingBox            m_localBound;
+    mutable const osg::Array*           m_localBoundArray;
+    mutable unsigned int                m_localBoundCount;
+
+    /* The entities which share an array also share its owner; the array is shared as long as the owner is
+     * referenced by more than one entity. It is created by the first copy and released once the array is
+     * detached or replaced. */
+    osg::Referenced* getVerticesOwner() const;
+    osg::Referenced* getColorsOwner() const;
+    mutable osg::ref_ptr<osg::Referenced> m_verticesOwner;
+    mutable osg::ref_ptr<osg::Referenced> m_colorsOwner;
 };
 
 } // namespace entity
@@ -2,6 +2,8 @@
 
 #include <QDebug>
 #include <QtGlobal>
+#include <cfloat>
+#include <vector>
 #include "MainWindow.h"
 
 #include <osg/Program>
@@ -15,14 +17,24 @@
 const GLenum STROKE_PHANTOM_TYPE = GL_LINE_STRIP;
 
 entity::Stroke::Stroke()
-    : entity::ShaderedEntity2D(STROKE_PHANTOM_TYPE, osg::Geometry::BIND_PER_VERTEX, "Stroke", cher::STROKE_CLR_NORMAL)
+    : entity::ShaderedEntity2D(STROKE_PHANTOM_TYPE, osg::Geometry::BIND_OVERALL, "Stroke", cher::STROKE_CLR_NORMAL)
     , m_isCurved(false)
+    , m_isFitOnline(false)
+    , m_path(0)
+    , m_tailStart(0)
+    , m_numFrozen(0)
+    , m_fitted(0)
 {
 }
 
 entity::Stroke::Stroke(const entity::Stroke& copy, const osg::CopyOp& copyop)
     : entity::ShaderedEntity2D(copy, copyop)
     , m_isCurved(copy.m_isCurved)
+    , m_isFitOnline(false)
+    , m_path(0)
+    , m_tailStart(0)
+    , m_numFrozen(0)
+    , m_fitted(0)
 {
 }
 
@@ -58,46 +70,55 @@ bool entity::Stroke::redefineToShape(osg::MatrixTransform *t)
 {
     if (m_isCurved && m_isShadered) return true;
 
-    if (!m_isCurved){
-        osg::ref_ptr<osg::Vec3Array> path = static_cast<osg::Vec3Array*>(this->getVertexArray());
-        if (!path.get()){
-            qWarning("Vertex data is NULL");
-            return false;
-        }
-        qDebug() << "path.samples=" << path->size();
+    if (!this->prepareShape()) return false;
+    this->finishShape(t);
+    this->dirtyBound();
 
-        osg::Vec4Array* colors = static_cast<osg::Vec4Array*>(this->getColorArray());
-        if (!colors){
-            qWarning("Color data is NULL");
-            return false;
-        }
+    return true;
+}
 
-        /* set up auto threshold if necessary */
-        float tolerance = -1.f;
-        if (tolerance < 0.f){
-            /* auto threshold helps to avoid under-fitting or over-fitting of the curve
-         * depending on the scale of drawn stroke. */
-//            float length = this->getLength();
-//            const double scale = 0.001;
-            tolerance = 0.0001; //length * scale;
-        }
+bool entity::Stroke::prepareShape()
+{
+    const osg::Vec3Array* path = static_cast<const osg::Vec3Array*>(this->getVertexArray());
+    if (!path){
+        qWarning("Vertex data is NULL");
+        return false;
+    }
+    if (!this->getColorArray()){
+        qWarning("Color data is NULL");
+        return false;
+    }
 
-        // normalize the coordinates
-        osg::Vec3f center = this->getBoundingBox().center();
-        double scale = this->normalize(path.get(), center);
-        OsgPathFitter<osg::Vec3Array, osg::Vec3f, float> fitter;
-        fitter.init(*(path.get()));
-        osg::ref_ptr<osg::Vec3Array> curves = fitter.fit(tolerance);
-        if (!curves.get()){
+    /* the fitter normalizes the points in place, so a local copy is fitted; the geometry is only changed by
+     * finishShape(), since replacing or detaching the vertex array dirties the bounds of the parent nodes */
+    m_fitted = 0;
+    if (!m_isCurved){
+        qDebug() << "path.samples=" << path->size();
+        osg::ref_ptr<osg::Vec3Array> points = new osg::Vec3Array(path->begin(), path->end());
+        m_fitted = this->fitPath(points.get());
+        if (!m_fitted.get()){
             qWarning("Curves is NULL");
             return false;
         }
-        // denormalize the coordinates
-        this->denormalize(curves.get(), center, scale);
+    }
+    return true;
+}
 
-        this->setVertexArray(curves.get());
+bool entity::Stroke::finishShape(osg::MatrixTransform *t)
+{
+    if (m_fitted.get()){
+        /* the points must not be shared with a copy of the stroke */
+        this->detachVertices();
+        osg::Vec3Array* path = static_cast<osg::Vec3Array*>(this->getVertexArray());
+        path->asVector().swap(m_fitted->asVector());
+        path->dirty();
+        m_fitted = 0;
         m_isCurved = true;
     }
+    if (!m_isCurved){
+        qWarning("finishShape: the stroke must be prepared first");
+        return false;
+    }
 
     if (this->redefineToShader(t==0? MainWindow::instance().getCanvasCurrent()->getTransform() : t) ) {
         m_isShadered = true;
@@ -107,30 +128,22 @@ bool entity::Stroke::redefineToShape(osg::MatrixTransform *t)
         qWarning("Could not re-define to shader, re-defining to curve points instead");
         osg::Vec3Array* curves = static_cast<osg::Vec3Array*>(this->getVertexArray());
         osg::ref_ptr<osg::Vec3Array> points = this->getCurvePoints(curves);
-        this->setVertexArray(points);
+        this->replaceVertexArray(points.get());
 
         qDebug() << "curves.points=" << points->size();
-        m_isCurved = true;
         m_isShadered = false;
     }
 
-    /* update sizing of vertices and color arrays */
+    /* update sizing of vertices, the color is bound overall */
     osg::Vec3Array* finalPts = static_cast<osg::Vec3Array*>(this->getVertexArray());
     if (finalPts){
         m_lines->setFirst(0);
         m_lines->setCount(finalPts->size());
         finalPts->dirty();
-        osg::Vec4Array* colors = static_cast<osg::Vec4Array*>(this->getColorArray());
-        if (colors){
-            colors->resize(finalPts->size(), m_color);
-            colors->dirty();
-        }
     }
     else
         qCritical("Unable to update geometry correctly");
 
-    this->dirtyBound();
-
     return true;
 }
 
@@ -160,6 +173,26 @@ osg::Node *entity::Stroke::getMeshRepresentation() const
     return extrusion.generateTriMesh();
 }
 
+osg::Vec3Array *entity::Stroke::getSimplified(float tolerance) const
+{
+    const osg::Vec3Array* curves = dynamic_cast<const osg::Vec3Array*>(this->getVertexArray());
+    if (!m_isCurved || !curves || curves->size() < 4 || curves->size() % 4 != 0) return NULL;
+
+    /* sample the curves, the joints of neighbouring curves are taken once */
+    osg::ref_ptr<osg::Vec3Array> samples = this->getCurvePoints(curves);
+    osg::ref_ptr<osg::Vec3Array> path = new osg::Vec3Array;
+    path->reserve(samples->size());
+    for (unsigned int i=0; i<samples->size(); ++i){
+        if (!path->empty() && path->back() == (*samples)[i]) continue;
+        path->push_back((*samples)[i]);
+    }
+
+    osg::ref_ptr<osg::Vec3Array> simplified = this->fitPath(path.get(), tolerance);
+    if (!simplified.get() || simplified->empty() || simplified->size() % 4 != 0) return NULL;
+    if (simplified->size() > curves->size()) return NULL;
+    return simplified.release();
+}
+
 // read more on why: http://stackoverflow.com/questions/36655888/opengl-thick-and-smooth-non-broken-lines-in-3d
 bool entity::Stroke::redefineToShader(osg::MatrixTransform *t)
 {
@@ -177,11 +210,12 @@ bool entity::Stroke::redefineToShader(osg::MatrixTransform *t)
     /* reset the primitive type */
     m_lines->set(GL_LINES_ADJACENCY_EXT, 0, bezierPts->size());
 
-    /* set shader attributes */
+    /* set shader attributes; the color is a constant attribute of the whole stroke */
+    this->compactColors();
     this->setVertexAttribArray(0, bezierPts, osg::Array::BIND_PER_VERTEX);
     osg::Vec4Array* colors = dynamic_cast<osg::Vec4Array*>(this->getColorArray());
     Q_CHECK_PTR(colors);
-    this->setVertexAttribArray(1, colors, osg::Array::BIND_PER_VERTEX);
+    this->setVertexAttribArray(1, colors, osg::Array::BIND_OVERALL);
 
     /* apply shader to the state set */
     this->getOrCreateStateSet()->setAttributeAndModes(m_program.get(), osg::StateAttribute::ON);
@@ -219,7 +253,167 @@ ProgramStroke *entity::Stroke::getProgram() const
 
 void entity::Stroke::appendPoint(const float u, const float v)
 {
-    entity::ShaderedEntity2D::appendPoint(u,v, cher::STROKE_CLR_NORMAL);
+    if (!m_isFitOnline){
+        entity::ShaderedEntity2D::appendPoint(u,v, cher::STROKE_CLR_NORMAL);
+        return;
+    }
+
+    m_path->push_back(osg::Vec3f(u,v,0.f));
+    if (m_path->size() < 2){
+        /* nothing to fit yet, show the raw point */
+        entity::ShaderedEntity2D::appendPoint(u,v, cher::STROKE_CLR_NORMAL);
+        return;
+    }
+    if (!this->fitTail())
+        qWarning("Stroke::appendPoint: could not fit the tail of the stroke");
+}
+
+void entity::Stroke::setFitOnline(bool online)
+{
+    if (online == m_isFitOnline) return;
+    if (online && (this->getNumPoints() != 0 || !m_program.get())){
+        qWarning("Stroke::setFitOnline: online fitting requires an empty stroke with initialized program");
+        return;
+    }
+    m_isFitOnline = online;
+    m_path = online? new osg::Vec3Array : 0;
+    m_tailStart = 0;
+    m_numFrozen = 0;
+}
+
+bool entity::Stroke::getFitOnline() const
+{
+    return m_isFitOnline;
+}
+
+osg::Vec3Array *entity::Stroke::fitPath(osg::Vec3Array *path, float tolerance) const
+{
+    if (!path || path->size() < 2) return NULL;
+
+    /* the tolerance is set for normalized coordinates which helps to avoid under-fitting or over-fitting
+     * of the curve depending on the scale of drawn stroke */
+    osg::BoundingBox bb;
+    for (unsigned int i=0; i<path->size(); ++i)
+        bb.expandBy((*path)[i]);
+    osg::Vec3f center = bb.center();
+    double scale = this->normalize(path, center);
+
+    OsgPathFitter<osg::Vec3Array, osg::Vec3f, float> fitter;
+    fitter.init(*path);
+    osg::ref_ptr<osg::Vec3Array> curves = fitter.fit(tolerance);
+    if (!curves.get()) return NULL;
+
+    this->denormalize(curves.get(), center, scale);
+    return curves.release();
+}
+
+/* The open tail is the part of raw path that follows the last frozen Bezier segment.
+ * After fitting the tail, all its segments but the last one are frozen since the new points are not
+ * likely to change them; if the tail is too long and is fitted by a single segment, it is frozen as well.
+ * The end point of every fitted segment is one of the raw points, so the new tail starts from the raw point
+ * closest to the end of the last frozen segment. This way each call costs O(tail) rather than O(n). */
+bool entity::Stroke::fitTail()
+{
+    this->detachArrays();
+    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(this->getVertexArray());
+    osg::Vec4Array* colors = static_cast<osg::Vec4Array*>(this->getColorArray());
+    if (!verts || !colors || !m_path.get()) return false;
+
+    osg::ref_ptr<osg::Vec3Array> tail = new osg::Vec3Array(m_path->begin() + m_tailStart, m_path->end());
+    osg::ref_ptr<osg::Vec3Array> curves = this->fitPath(tail.get());
+    if (!curves.get() || curves->size() < 4) return false;
+    if (m_numFrozen >= 4) this->alignTail(curves.get());
+
+    unsigned int nSegments = curves->size() / 4;
+    unsigned int nFreeze = 0;
+    if (nSegments > 1) nFreeze = nSegments - 1;
+    else if (m_path->size() - m_tailStart > cher::STROKE_FIT_TAIL_MAX) nFreeze = nSegments;
+
+    /* the vertex array consists of frozen segments followed by the tail segments */
+    verts->resize(m_numFrozen);
+    verts->insert(verts->end(), curves->begin(), curves->end());
+
+    if (nFreeze > 0){
+        osg::Vec3f end = (*curves)[4*nFreeze-1];
+        unsigned int idx = m_tailStart;
+        float dmin = FLT_MAX;
+        for (unsigned int i=m_tailStart; i<m_path->size(); ++i){
+            float d = ((*m_path)[i] - end).length2();
+            if (d < dmin){
+                dmin = d;
+                idx = i;
+            }
+        }
+        m_tailStart = idx;
+        m_numFrozen += 4*nFreeze;
+    }
+
+    verts->dirty();
+    m_isCurved = true;
+
+    /* the phantom shows the fitted curve right away */
+    if (!this->redefineToShader(m_program->getTransform())){
+        m_lines->set(GL_LINE_STRIP, 0, verts->size());
+        m_isShadered = false;
+    }
+    this->dirtyBound();
+    return true;
+}
+
+/* The start tangent is fixed to the end tangent of the last frozen segment and the end tangent is the one
+ * found by the fitter. With both directions known, the tangent lengths minimize the squared distance between
+ * the raw points and the curve taken at chord length parameters, see Schneider, "An algorithm for automatically
+ * fitting digitized curves", Graphics Gems, 1990. */
+void entity::Stroke::alignTail(osg::Vec3Array *curves) const
+{
+    const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(this->getVertexArray());
+    if (!curves || curves->size() < 4 || !verts || m_numFrozen < 4 || verts->size() < m_numFrozen) return;
+
+    osg::Vec3f P0 = (*verts)[m_numFrozen-1];
+    osg::Vec3f tan1 = P0 - (*verts)[m_numFrozen-2];
+    if (tan1.length2() == 0) tan1 = P0 - (*verts)[m_numFrozen-4];
+    if (tan1.normalize() == 0) return;
+
+    osg::Vec3f P3 = (*curves)[3];
+    osg::Vec3f tan2 = (*curves)[2] - P3;
+    if (tan2.length2() == 0) tan2 = P0 - P3;
+    if (tan2.normalize() == 0) return;
+
+    /* raw points from the tail start up to the one closest to the segment end */
+    unsigned int last = m_tailStart;
+    float dmin = FLT_MAX;
+    for (unsigned int i=m_tailStart; i<m_path->size(); ++i){
+        float d = ((*m_path)[i] - P3).length2();
+        if (d < dmin){
+            dmin = d;
+            last = i;
+        }
+    }
+    std::vector<double> u(1, 0.0);
+    for (unsigned int i=m_tailStart+1; i<=last; ++i)
+        u.push_back(u.back() + ((*m_path)[i] - (*m_path)[i-1]).length());
+
+    double C00 = 0, C01 = 0, C11 = 0, X0 = 0, X1 = 0;
+    for (unsigned int i=0; i<u.size() && u.back() > 0; ++i){
+        double t = u[i] / u.back(), s = 1.0 - t;
+        double b0 = s*s*s, b1 = 3*t*s*s, b2 = 3*t*t*s, b3 = t*t*t;
+        osg::Vec3f A0 = tan1 * b1, A1 = tan2 * b2;
+        osg::Vec3f r = (*m_path)[m_tailStart+i] - (P0 * (b0+b1) + P3 * (b2+b3));
+        C00 += A0*A0; C01 += A0*A1; C11 += A1*A1;
+        X0 += A0*r; X1 += A1*r;
+    }
+    double det = C00*C11 - C01*C01;
+    double chord = (P3 - P0).length();
+    double alpha1 = (std::fabs(det) > cher::EPSILON)? (X0*C11 - X1*C01) / det : 0;
+    double alpha2 = (std::fabs(det) > cher::EPSILON)? (C00*X1 - C01*X0) / det : 0;
+
+    /* too few points or a fit that turns the tangents around: use the usual heuristic */
+    if (alpha1 <= cher::EPSILON*chord || alpha2 <= cher::EPSILON*chord)
+        alpha1 = alpha2 = chord / 3.0;
+
+    (*curves)[0] = P0;
+    (*curves)[1] = P0 + tan1 * alpha1;
+    (*curves)[2] = P3 + tan2 * alpha2;
 }
 
 osg::Vec3Array *entity::Stroke::getCurvePoints(const osg::Vec3Array *bezierPts) const
@@ -248,7 +442,7 @@ osg::Vec3Array *entity::Stroke::getCurvePoints(const osg::Vec3Array *bezierPts)
     return points.release();
 }
 
-double entity::Stroke::normalize(osg::Vec3Array *path, const osg::Vec3f &center)
+double entity::Stroke::normalize(osg::Vec3Array *path, const osg::Vec3f &center) const
 {
     if (!path) return 1.0;
     double deltas = 0.0;
@@ -266,7 +460,7 @@ double entity::Stroke::normalize(osg::Vec3Array *path, const osg::Vec3f &center)
     return scale;
 }
 
-void entity::Stroke::denormalize(osg::Vec3Array *path, const osg::Vec3f &center, double scale)
+void entity::Stroke::denormalize(osg::Vec3Array *path, const osg::Vec3f &center, double scale) const
 {
     if (!path) return;
     for (unsigned int i=0; i<path->size(); ++i){
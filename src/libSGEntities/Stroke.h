@@ -38,15 +38,19 @@ namespace entity {
  * // initialize the shader program
  * original->initializeProgram(p); // e.g. Canvas::getProgramStroke()
  *
+ * // optionally, fit the curve while the user draws so that the phantom shows the final shape
+ * original->setFitOnline(true);
+ *
  * // as user draws, add mouse coordinates, in an event loop:
- * original->addPoint(u,v);
+ * original->appendPoint(u,v);
  *
  * \\ after user is finished drawing, re-define the look (shaderize as well)
  * original->redefineToShape();
  * \endcode
  *
  * The below example provides details on how to copy/clone a stroke that is already present on the
- * scene graph:
+ * scene graph. The copy shares the vertex and color arrays of the original until either of them is edited,
+ * so copying costs no array copies and no curve fitting:
  * \code{.cpp}
  * // create an empty stroke
  * entity::Stroke* copy = new entity::Stroke;
@@ -55,7 +59,7 @@ namespace entity {
  * // it also copies shader data
  * copy->copyFrom(original);
  *
- * // as before, we re-define the stroke to be shadered
+ * // as before, we re-define the stroke to be shadered; the copy of a curved stroke is not fitted again
  * copy->redefineToShape();
  * \endcode
 */
@@ -83,10 +87,29 @@ public:
      * \return true upon success. */
     virtual bool redefineToShape(osg::MatrixTransform* t = 0);
 
+    /*! First part of redefineToShape(): fits a copy of the raw points into curves unless the stroke is already
+     * curved. The geometry of the stroke is not changed, the curves are kept until finishShape(); the method
+     * performs no scene graph or state set calls, so it can be run from a worker thread as long as no other
+     * thread accesses the same stroke. \return true upon success. \sa finishShape() */
+    bool prepareShape();
+
+    /*! Second part of redefineToShape(): sets the fitted curves as the stroke points, then attaches the shader
+     * program or, if it fails, samples the curve into a polyline. Must be called from the GUI thread after
+     * prepareShape(). Unlike redefineToShape(), the bound is not marked as dirty. \return true upon success. */
+    bool finishShape(osg::MatrixTransform* t);
+
     /*! A method that generates mesh representation of the stroke using Parallel Transport Algorithm.
      * \return pointer on the cretated mesh structure. The structure is not attached to the scene graph. */
     osg::Node* getMeshRepresentation() const;
 
+    /*! A method to obtain a simplified version of the shadered stroke for the distant views. The curves are
+     * sampled and fitted again by the same fitter as in redefineToShape(), but with a larger tolerance.
+     * \param tolerance is the fitting threshold on normalized coordinates, see cher::STROKE_FIT_TOLERANCE.
+     * \return Bezier control points which are fewer than or as many as the ones of the stroke, or NULL if the
+     * stroke is not curved, or the fitting failed or gave more curves. The stroke itself is not changed.
+     * \sa entity::StrokeBatch */
+    osg::Vec3Array* getSimplified(float tolerance) const;
+
 protected:
     /*! A method to tune the look of the stroke with smoother connections and thicker linewidth.
      * So that to avoid broken and thin look of the default OpenGL functionality when using GL_LINE_STRIP_ADJACENCY and such. */
@@ -106,9 +129,21 @@ public:
     virtual ProgramStroke* getProgram() const;
 
     /*! A method to add a point to the end of the entity. It is normally used when constructing an emtity in-motion while sketching.
-     * \param u is local U coordinate, \param v is local V coordinate. */
+     * If online fitting is on, the point is added to the raw path and the open tail of the curve is re-fitted.
+     * \param u is local U coordinate, \param v is local V coordinate.
+     * \sa setFitOnline() */
     virtual void appendPoint(const float u, const float v);
 
+    /*! A method to turn on or off online curve fitting. When it is on, the raw points passed to appendPoint()
+     * are fitted as they come: the Bezier segments that are considered stable are frozen, and only the open
+     * tail is re-fitted. The vertex array thus always contains the fitted curve which is shadered right away,
+     * and redefineToShape() does not have to fit the whole path again.
+     * Must be called on an empty stroke with initialized program. */
+    void setFitOnline(bool online);
+
+    /*! \return true if online curve fitting is on. \sa setFitOnline() */
+    bool getFitOnline() const;
+
 protected:
 
     /*! \return Sampled points from provided set of bezier control points. */
@@ -125,14 +160,35 @@ protected:
      * \param path is the point array to normalize,
      * \param center is local 2d center (e.g., bounding box center).
      * \return scaling factor. */
-    double normalize(osg::Vec3Array* path, const osg::Vec3f& center);
+    double normalize(osg::Vec3Array* path, const osg::Vec3f& center) const;
 
     /*! A method to denormalize the curve coordinates. Should be used after the curve fitting algorithm.
      * \sa normalize(). */
-    void denormalize(osg::Vec3Array* path, const osg::Vec3f& center, double scale);
+    void denormalize(osg::Vec3Array* path, const osg::Vec3f& center, double scale) const;
+
+    /*! A method to fit the points of the given path into a set of Bezier curves. Normalization is performed
+     * internally. \return pointer on the control points, or NULL if fitting failed. */
+    osg::Vec3Array* fitPath(osg::Vec3Array* path, float tolerance = cher::STROKE_FIT_TOLERANCE) const;
+
+    /*! A method to re-fit the open tail of the raw path when fitting online; the stable segments of the
+     * result are frozen. \sa setFitOnline() */
+    bool fitTail();
+
+    /*! A method to re-fit the first Bezier segment of the tail so that it starts at the end of the last frozen
+     * segment with the same tangent. The end point and end tangent of the segment are kept; the lengths of the
+     * tangents are fitted to the raw points of the segment by least squares. */
+    void alignTail(osg::Vec3Array* curves) const;
 
 private:
     bool                                m_isCurved; // saved to file
+
+    /* online fitting data, not saved to file */
+    bool                                m_isFitOnline;
+    osg::ref_ptr<osg::Vec3Array>        m_path; /* raw points */
+    unsigned int                        m_tailStart; /* index of the first raw point of the open tail */
+    unsigned int                        m_numFrozen; /* number of frozen control points in the vertex array */
+
+    osg::ref_ptr<osg::Vec3Array>        m_fitted; /* curves by prepareShape() waiting for finishShape() */
 };
 }
 
@@ -0,0 +1,397 @@
+#include "StrokeBatch.h"
+
+#include <cmath>
+#include <unordered_map>
+
+#include <osg/NodeVisitor>
+#include <osg/TextureBuffer>
+#include <osgDB/ObjectWrapper>
+#include <osgUtil/CullVisitor>
+
+#include <QtGlobal>
+
+#include "Settings.h"
+#include "Stroke.h"
+
+namespace {
+
+/* the z of the packed points is the index of the stroke color, while the strokes lie on the canvas plane */
+class PlanarBound : public osg::Drawable::ComputeBoundingBoxCallback
+{
+public:
+    PlanarBound() {}
+    PlanarBound(const PlanarBound& copy, const osg::CopyOp& copyop)
+        : osg::Drawable::ComputeBoundingBoxCallback(copy, copyop) {}
+
+    META_Object(entity, PlanarBound)
+
+    virtual osg::BoundingBox computeBound(const osg::Drawable& drawable) const
+    {
+        osg::BoundingBox bound;
+        const osg::Geometry* geometry = drawable.asGeometry();
+        const osg::Vec3Array* vertices = geometry ? dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray()) : 0;
+        if (!vertices) return bound;
+        for (const auto& point : *vertices)
+            bound.expandBy(point.x(), point.y(), 0.f);
+        return bound;
+    }
+};
+
+} // namespace
+
+entity::StrokeBatch::StrokeBatch()
+    : osg::NodeCallback()
+    , m_geometry(new osg::Geometry)
+    , m_vertices(new osg::Vec3Array)
+    , m_colors(new osg::Vec4Array)
+    , m_colorImage(new osg::Image)
+    , m_stateset(new osg::StateSet)
+    , m_lines(new osg::DrawArrays(GL_LINES_ADJACENCY_EXT, 0, 0))
+    , m_levels(cher::STROKE_LOD_LEVELS)
+    , m_numBatched(0)
+    , m_revision(0)
+    , m_level(0)
+    , m_enabled(cher::STROKE_BATCHING)
+    , m_lodEnabled(cher::STROKE_LOD)
+{
+    this->initializeLevels();
+}
+
+entity::StrokeBatch::StrokeBatch(const entity::StrokeBatch &copy, const osg::CopyOp &copyop)
+    : osg::NodeCallback(copy, copyop)
+    , m_geometry(new osg::Geometry)
+    , m_vertices(new osg::Vec3Array)
+    , m_colors(new osg::Vec4Array)
+    , m_colorImage(new osg::Image)
+    , m_stateset(new osg::StateSet)
+    , m_lines(new osg::DrawArrays(GL_LINES_ADJACENCY_EXT, 0, 0))
+    , m_levels(cher::STROKE_LOD_LEVELS)
+    , m_numBatched(0)
+    , m_revision(0)
+    , m_level(0)
+    , m_enabled(copy.m_enabled)
+    , m_lodEnabled(copy.m_lodEnabled)
+{
+    this->initializeLevels();
+}
+
+void entity::StrokeBatch::operator()(osg::Node *node, osg::NodeVisitor *nv)
+{
+    osg::Geode* geode = node ? node->asGeode() : 0;
+    if (!m_enabled || !geode || !nv || nv->getVisitorType() != osg::NodeVisitor::CULL_VISITOR){
+        this->traverse(node, nv);
+        return;
+    }
+
+    /* the geode state set, and thus the stroke program, is already pushed by the cull visitor */
+    this->update(geode);
+    if (m_numBatched > 0){
+        /* the level is chosen by the projected size of all the canvas strokes */
+        osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+        m_level = (m_lodEnabled && cv)? StrokeBatch::getLevel(cv->clampedPixelSize(geode->getBound())) : 0;
+        if (m_level > 0){
+            this->updateLevel(m_level);
+            m_levels[m_level-1].geometry->accept(*nv);
+        }
+        else
+            m_geometry->accept(*nv);
+    }
+
+    for (unsigned int i=0; i<m_entries.size(); ++i){
+        if (!m_entries[i].batched)
+            geode->getDrawable(i)->accept(*nv);
+    }
+}
+
+void entity::StrokeBatch::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool entity::StrokeBatch::getEnabled() const
+{
+    return m_enabled;
+}
+
+void entity::StrokeBatch::setLodEnabled(bool enabled)
+{
+    m_lodEnabled = enabled;
+}
+
+bool entity::StrokeBatch::getLodEnabled() const
+{
+    return m_lodEnabled;
+}
+
+unsigned int entity::StrokeBatch::getLevel(float pixels)
+{
+    unsigned int level = 0;
+    float threshold = cher::STROKE_LOD_PIXELS;
+    while (level < cher::STROKE_LOD_LEVELS && pixels < threshold){
+        ++level;
+        threshold /= cher::STROKE_LOD_STEP;
+    }
+    return level;
+}
+
+unsigned int entity::StrokeBatch::getLevel() const
+{
+    return m_level;
+}
+
+bool entity::StrokeBatch::update(const osg::Geode *geode)
+{
+    if (!geode) return false;
+    unsigned int numDrawables = geode->getNumDrawables();
+    bool changed = false;
+
+    /* find the first drawable that changed its layout; the arrays modified in place are copied on the way */
+    unsigned int i = 0;
+    for (; i<numDrawables && i<m_entries.size(); ++i){
+        Entry entry;
+        this->makeEntry(geode->getDrawable(i), entry);
+        Entry& old = m_entries[i];
+        if (entry.drawable != old.drawable || entry.batched != old.batched
+                || entry.vertices != old.vertices || entry.colors != old.colors || entry.generation != old.generation
+                || (entry.batched && entry.vertices->getNumElements() != old.count))
+            break;
+
+        if (entry.verticesModified != old.verticesModified || entry.colorsModified != old.colorsModified){
+            if (entry.verticesModified != old.verticesModified) old.simplified.clear();
+            old.verticesModified = entry.verticesModified;
+            old.colorsModified = entry.colorsModified;
+            if (old.batched){
+                this->copy(old);
+                changed = true;
+            }
+        }
+    }
+
+    if (i < numDrawables || i < m_entries.size()){
+        /* re-pack the tail, the ranges of the preceding strokes stay the same */
+        unsigned int first = i < m_entries.size()? m_entries[i].first : m_vertices->size();
+        unsigned int index = i < m_entries.size()? m_entries[i].index : m_colors->size();
+        std::unordered_map<const osg::Drawable*, Entry> tail;
+        for (unsigned int j=i; j<m_entries.size(); ++j)
+            if (!m_entries[j].simplified.empty()) tail[m_entries[j].drawable] = m_entries[j];
+        m_entries.resize(i);
+        m_vertices->resize(first);
+        m_colors->resize(index);
+        for (; i<numDrawables; ++i){
+            Entry entry;
+            this->makeEntry(geode->getDrawable(i), entry);
+            this->pack(entry);
+
+            /* the strokes which were re-packed without changing their points keep their simplified versions */
+            auto it = tail.find(entry.drawable);
+            if (it != tail.end() && it->second.vertices == entry.vertices && it->second.generation == entry.generation
+                    && it->second.verticesModified == entry.verticesModified)
+                entry.simplified.swap(it->second.simplified);
+            m_entries.push_back(entry);
+        }
+
+        m_numBatched = 0;
+        for (const auto& entry : m_entries)
+            if (entry.batched) ++m_numBatched;
+        m_lines->set(GL_LINES_ADJACENCY_EXT, 0, m_vertices->size());
+        changed = true;
+    }
+
+    if (changed){
+        m_vertices->dirty();
+        this->updateColors();
+        m_geometry->dirtyBound();
+        ++m_revision;
+    }
+    return changed;
+}
+
+bool entity::StrokeBatch::updateLevel(unsigned int level)
+{
+    if (level == 0 || level > m_levels.size()) return false;
+    Level& lod = m_levels[level-1];
+    if (lod.revision == m_revision) return false;
+
+    lod.vertices->clear();
+    for (auto& entry : m_entries){
+        if (!entry.batched) continue;
+        const osg::Vec3Array* vertices = this->getSimplified(entry, level);
+        StrokeBatch::packPoints(vertices, entry.index, lod.vertices.get(), lod.vertices->size());
+    }
+    lod.lines->set(GL_LINES_ADJACENCY_EXT, 0, lod.vertices->size());
+    lod.vertices->dirty();
+    lod.geometry->dirtyBound();
+    lod.revision = m_revision;
+    return true;
+}
+
+const osg::Geometry *entity::StrokeBatch::getGeometry(unsigned int level) const
+{
+    if (level == 0 || level > m_levels.size()) return m_geometry.get();
+    return m_levels[level-1].geometry.get();
+}
+
+const osg::Vec4Array *entity::StrokeBatch::getColors() const
+{
+    return m_colors.get();
+}
+
+unsigned int entity::StrokeBatch::getNumBytes() const
+{
+    unsigned int bytes = m_vertices->getTotalDataSize() + m_colors->getTotalDataSize();
+    for (const auto& lod : m_levels)
+        bytes += lod.vertices->getTotalDataSize();
+    return bytes;
+}
+
+unsigned int entity::StrokeBatch::getNumBatched() const
+{
+    return m_numBatched;
+}
+
+bool entity::StrokeBatch::isBatched(const osg::Drawable *drawable) const
+{
+    for (const auto& entry : m_entries)
+        if (entry.drawable == drawable) return entry.batched;
+    return false;
+}
+
+bool entity::StrokeBatch::isBatchable(const osg::Drawable *drawable)
+{
+    const entity::Stroke* stroke = dynamic_cast<const entity::Stroke*>(drawable);
+    if (!stroke || !stroke->getIsShadered()) return false;
+
+    /* pending transforms and custom node masks require the stroke's own traversal */
+    if (!stroke->getDeferredTransform().isIdentity()) return false;
+    if (stroke->getNodeMask() != 0xffffffff) return false;
+
+    const osg::Vec3Array* vertices = dynamic_cast<const osg::Vec3Array*>(stroke->getVertexArray());
+    const osg::Vec4Array* colors = dynamic_cast<const osg::Vec4Array*>(stroke->getColorArray());
+    if (!vertices || !colors) return false;
+    if (vertices->empty() || vertices->size() % 4 != 0) return false;
+
+    /* the batch keeps a single color per stroke, as set by ShaderedEntity2D::compactColors() */
+    if (colors->getBinding() != osg::Array::BIND_OVERALL || colors->size() != 1) return false;
+
+    /* the stroke has to be drawn as whole by the lines adjacency, as set by Stroke::redefineToShader() */
+    const osg::DrawArrays* lines = stroke->getLines();
+    return lines && lines->getMode() == GL_LINES_ADJACENCY_EXT
+            && lines->getFirst() == 0 && lines->getCount() == GLsizei(vertices->size());
+}
+
+entity::StrokeBatch::~StrokeBatch()
+{
+}
+
+void entity::StrokeBatch::initializeLevels()
+{
+    /* the stroke colors are fetched by Stroke.vert from the buffer texture, see getColors() */
+    this->updateColors();
+    osg::ref_ptr<osg::TextureBuffer> texture = new osg::TextureBuffer(m_colorImage.get());
+    texture->setInternalFormat(GL_RGBA32F_ARB);
+    m_stateset->setTextureAttribute(cher::STROKE_BATCH_COLORS_UNIT, texture.get());
+    m_stateset->getOrCreateUniform("BatchColors", osg::Uniform::SAMPLER_BUFFER)->set(cher::STROKE_BATCH_COLORS_UNIT);
+    m_stateset->getOrCreateUniform("IsBatched", osg::Uniform::BOOL)->set(true);
+
+    this->initializeGeometry(m_geometry.get(), m_vertices.get(), m_lines.get());
+    for (auto& lod : m_levels){
+        lod.geometry = new osg::Geometry;
+        lod.vertices = new osg::Vec3Array;
+        lod.lines = new osg::DrawArrays(GL_LINES_ADJACENCY_EXT, 0, 0);
+        lod.revision = m_revision - 1; /* packed when first drawn */
+        this->initializeGeometry(lod.geometry.get(), lod.vertices.get(), lod.lines.get());
+    }
+}
+
+void entity::StrokeBatch::initializeGeometry(osg::Geometry *geometry, osg::Vec3Array *vertices, osg::DrawArrays *lines)
+{
+    /* the packed buffer is changed from the cull traversal, see update() */
+    geometry->setName("StrokeBatch");
+    geometry->setDataVariance(osg::Object::DYNAMIC);
+    geometry->setUseDisplayList(false);
+    geometry->setUseVertexBufferObjects(true);
+
+    /* same vertex layout as entity::Stroke::redefineToShader(), the colors are bound by the shared state set;
+     * the program is applied by the canvas stroke geode */
+    geometry->setVertexArray(vertices);
+    geometry->setVertexAttribArray(0, vertices, osg::Array::BIND_PER_VERTEX);
+    geometry->setStateSet(m_stateset.get());
+    geometry->setComputeBoundingBoxCallback(new PlanarBound);
+    geometry->addPrimitiveSet(lines);
+}
+
+void entity::StrokeBatch::makeEntry(const osg::Drawable *drawable, entity::StrokeBatch::Entry &entry) const
+{
+    const osg::Geometry* geometry = drawable ? drawable->asGeometry() : 0;
+    const entity::ShaderedEntity2D* entity = dynamic_cast<const entity::ShaderedEntity2D*>(drawable);
+    entry.drawable = drawable;
+    entry.vertices = geometry ? geometry->getVertexArray() : 0;
+    entry.colors = geometry ? geometry->getColorArray() : 0;
+    entry.verticesModified = entry.vertices ? entry.vertices->getModifiedCount() : 0;
+    entry.colorsModified = entry.colors ? entry.colors->getModifiedCount() : 0;
+    entry.generation = entity ? entity->getArraysGeneration() : 0;
+    entry.first = m_vertices->size();
+    entry.count = 0;
+    entry.index = m_colors->size();
+    entry.batched = StrokeBatch::isBatchable(drawable);
+}
+
+void entity::StrokeBatch::pack(entity::StrokeBatch::Entry &entry)
+{
+    entry.first = m_vertices->size();
+    entry.index = m_colors->size();
+    if (!entry.batched) return;
+
+    const osg::Vec3Array* vertices = static_cast<const osg::Vec3Array*>(entry.vertices);
+    const osg::Vec4Array* colors = static_cast<const osg::Vec4Array*>(entry.colors);
+    StrokeBatch::packPoints(vertices, entry.index, m_vertices.get(), entry.first);
+    m_colors->push_back(colors->front());
+    entry.count = vertices->size();
+}
+
+void entity::StrokeBatch::copy(const entity::StrokeBatch::Entry &entry)
+{
+    const osg::Vec3Array* vertices = static_cast<const osg::Vec3Array*>(entry.vertices);
+    const osg::Vec4Array* colors = static_cast<const osg::Vec4Array*>(entry.colors);
+    Q_ASSERT(entry.first + vertices->size() <= m_vertices->size() && entry.index < m_colors->size());
+    StrokeBatch::packPoints(vertices, entry.index, m_vertices.get(), entry.first);
+    (*m_colors)[entry.index] = colors->front();
+}
+
+void entity::StrokeBatch::updateColors()
+{
+    /* the image refers to the color array, whose data may be re-allocated on every change */
+    unsigned char* data = m_colors->empty()? 0 : reinterpret_cast<unsigned char*>(&m_colors->front());
+    m_colorImage->setImage(m_colors->size(), 1, 1, GL_RGBA32F_ARB, GL_RGBA, GL_FLOAT, data, osg::Image::NO_DELETE);
+}
+
+void entity::StrokeBatch::packPoints(const osg::Vec3Array *points, unsigned int index, osg::Vec3Array *packed,
+                                     unsigned int first)
+{
+    if (packed->size() < first + points->size()) packed->resize(first + points->size());
+    for (unsigned int i=0; i<points->size(); ++i)
+        (*packed)[first+i] = osg::Vec3f((*points)[i].x(), (*points)[i].y(), float(index));
+}
+
+const osg::Vec3Array *entity::StrokeBatch::getSimplified(entity::StrokeBatch::Entry &entry, unsigned int level) const
+{
+    const osg::Vec3Array* vertices = static_cast<const osg::Vec3Array*>(entry.vertices);
+    if (entry.simplified.size() < level) entry.simplified.resize(level);
+    Simplified& simplified = entry.simplified[level-1];
+    if (!simplified.fitted){
+        /* a stroke that cannot be simplified any further is drawn as is */
+        float tolerance = cher::STROKE_FIT_TOLERANCE * std::pow(cher::STROKE_LOD_TOLERANCE, float(level));
+        const entity::Stroke* stroke = static_cast<const entity::Stroke*>(entry.drawable);
+        simplified.vertices = stroke->getSimplified(tolerance);
+        simplified.fitted = true;
+    }
+    return simplified.vertices.get()? simplified.vertices.get() : vertices;
+}
+
+/* the batch is written as the cull callback of the stroke geode; only its type is saved */
+REGISTER_OBJECT_WRAPPER(StrokeBatch_Wrapper
+                        , new entity::StrokeBatch
+                        , entity::StrokeBatch
+                        , "osg::Object osg::Callback osg::NodeCallback entity::StrokeBatch")
+{
+}
@@ -0,0 +1,165 @@
+#ifndef STROKEBATCH_H
+#define STROKEBATCH_H
+
+#include <vector>
+
+#include <osg/ref_ptr>
+#include <osg/Callback>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Array>
+#include <osg/PrimitiveSet>
+#include <osg/Image>
+#include <osg/StateSet>
+
+namespace entity {
+class Stroke;
+
+/*! \class StrokeBatch
+ * \brief Cull callback of the canvas stroke geode which draws all the strokes of the canvas at once.
+ *
+ * The Bezier control points of every shadered stroke are packed one after another into a single vertex buffer,
+ * and the whole buffer is drawn by one GL_LINES_ADJACENCY_EXT primitive set with the stroke program of the canvas.
+ * Since Stroke.geom treats every group of four control points as an independent segment, the packed buffer looks
+ * exactly like the separate strokes. The strokes lie on the canvas plane, so the z of every packed point is replaced
+ * by the index of its stroke color. The colors are kept once per stroke in a buffer texture which is shared by all
+ * the levels of detail, and Stroke.vert looks them up when the IsBatched uniform is set, see getColors(). The strokes that cannot be packed, e.g., the ones
+ * that are not shadered yet or carry a pending transform (see ShaderedEntity2D::moveDeferred()), are drawn
+ * separately as before.
+ *
+ * The strokes stay the children of the geode, so that picking, selection and editing work on them as usual;
+ * only the cull traversal is replaced. The packed buffer is synchronized at every cull: the strokes whose arrays
+ * were modified in place are copied into their ranges, and the buffer is re-packed starting from the first stroke
+ * that was added, removed, or changed its number of points.
+ *
+ * When the canvas is far away, the batch is drawn at a lower level of detail. Besides the full detail, there are
+ * cher::STROKE_LOD_LEVELS packed sets of simplified strokes (see entity::Stroke::getSimplified()), each fitted
+ * with a larger tolerance than the previous one. The level is chosen at every cull by the projected size of the
+ * canvas strokes, see getLevel(). The simplified strokes are computed when their level is first drawn, and kept
+ * until the stroke changes its points.
+ *
+ * The batch is owned by entity::Canvas, see entity::Canvas::setStrokeBatching(). It is saved as the cull callback
+ * of the geode, but none of its data is serialized.
+*/
+class StrokeBatch : public osg::NodeCallback
+{
+public:
+    StrokeBatch();
+
+    /*! Copy constructor, only used for serialization; the batch data is not copied. */
+    StrokeBatch(const StrokeBatch& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY);
+
+    META_Object(entity, StrokeBatch)
+
+    /*! The cull callback: draws the batch and then each of the strokes that are not batched. The other visitors
+     * traverse the geode as usual. */
+    virtual void operator()(osg::Node* node, osg::NodeVisitor* nv);
+
+    /*! A method to turn the batching on or off; when it is off, the geode is traversed as usual. */
+    void setEnabled(bool enabled);
+    bool getEnabled() const;
+
+    /*! A method to turn the level of detail on or off; when it is off, the full detail is always drawn. */
+    void setLodEnabled(bool enabled);
+    bool getLodEnabled() const;
+
+    /*! \return level of detail for the projected size of the canvas strokes: 0 is the full detail, and
+     * cher::STROKE_LOD_LEVELS is the coarsest one. */
+    static unsigned int getLevel(float pixels);
+
+    /*! \return level of detail that was drawn at the last cull. */
+    unsigned int getLevel() const;
+
+    /*! A method to bring the packed buffer up to date with the given geode. It is called from the cull callback
+     * and normally does not have to be called otherwise. \return true if the packed buffer was changed. */
+    bool update(const osg::Geode* geode);
+
+    /*! A method to bring the packed buffer of a simplified level up to date with the full detail, which
+     * has to be updated first. The strokes that were not simplified yet are fitted on the way.
+     * \return true if the packed buffer of the level was changed. */
+    bool updateLevel(unsigned int level);
+
+    /*! \return geometry which contains the packed strokes of the given level of detail; it is not a part of
+     * the scene graph. */
+    const osg::Geometry* getGeometry(unsigned int level = 0) const;
+
+    /*! \return colors of the batched strokes, one per stroke; the z of a packed point is the index of its color. */
+    const osg::Vec4Array* getColors() const;
+
+    /*! \return size in bytes of the packed points of all the levels of detail and of the stroke colors. */
+    unsigned int getNumBytes() const;
+
+    /*! \return number of strokes that are drawn from the packed buffer. */
+    unsigned int getNumBatched() const;
+
+    /*! \return true if the drawable is drawn from the packed buffer. */
+    bool isBatched(const osg::Drawable* drawable) const;
+
+    /*! \return true if the drawable is a stroke that can be drawn from the packed buffer. */
+    static bool isBatchable(const osg::Drawable* drawable);
+
+protected:
+    ~StrokeBatch();
+
+    /* packed buffer of one level of detail */
+    struct Level
+    {
+        osg::ref_ptr<osg::Geometry> geometry;
+        osg::ref_ptr<osg::Vec3Array> vertices;
+        osg::ref_ptr<osg::DrawArrays> lines;
+        unsigned int revision; /* of the full detail that was packed */
+    };
+
+    /* simplified stroke of one level of detail */
+    struct Simplified
+    {
+        osg::ref_ptr<const osg::Vec3Array> vertices; /* null if the stroke is drawn as is */
+        bool fitted;
+    };
+
+    /* The stroke arrays are not referenced, since a reference would make the stroke copy its arrays on every
+     * edit, see ShaderedEntity2D::detachArrays(). An array is identified by its address, its modified count and
+     * the generation of the stroke arrays, as the address of a replaced array can be re-used. */
+    struct Entry
+    {
+        const osg::Drawable* drawable;
+        const osg::Array* vertices;
+        const osg::Array* colors;
+        unsigned int verticesModified, colorsModified;
+        unsigned int generation; /* see ShaderedEntity2D::getArraysGeneration() */
+        unsigned int first, count; /* range within the packed buffer, count is zero if not batched */
+        unsigned int index; /* of the stroke color, see getColors() */
+        bool batched;
+        std::vector<Simplified> simplified; /* per simplified level, filled when drawn */
+    };
+
+    void initializeLevels();
+    void initializeGeometry(osg::Geometry* geometry, osg::Vec3Array* vertices, osg::DrawArrays* lines);
+    void makeEntry(const osg::Drawable* drawable, Entry& entry) const;
+    void pack(Entry& entry);
+    void copy(const Entry& entry);
+    void updateColors();
+
+    static void packPoints(const osg::Vec3Array* points, unsigned int index, osg::Vec3Array* packed, unsigned int first);
+
+    const osg::Vec3Array* getSimplified(Entry& entry, unsigned int level) const;
+
+private:
+    std::vector<Entry> m_entries; /* one per geode drawable, in the same order */
+    osg::ref_ptr<osg::Geometry> m_geometry;
+    osg::ref_ptr<osg::Vec3Array> m_vertices;
+    osg::ref_ptr<osg::Vec4Array> m_colors; /* one per batched stroke */
+    osg::ref_ptr<osg::Image> m_colorImage; /* refers to m_colors, the data of the buffer texture */
+    osg::ref_ptr<osg::StateSet> m_stateset; /* of all the levels, binds the colors to Stroke.vert */
+    osg::ref_ptr<osg::DrawArrays> m_lines;
+    std::vector<Level> m_levels; /* simplified levels, starting from the level 1 */
+    unsigned int m_numBatched;
+    unsigned int m_revision; /* incremented at every change of the full detail */
+    unsigned int m_level;
+    bool m_enabled;
+    bool m_lodEnabled;
+};
+
+} // namespace entity
+
+#endif // STROKEBATCH_H
@@ -0,0 +1,167 @@
+#include "StrokeIndex.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <osg/Array>
+
+#include "Stroke.h"
+
+#include <QtGlobal>
+#include <QDebug>
+
+entity::StrokeIndex::StrokeIndex(float cellSize)
+    : m_cellSize(cellSize > cher::EPSILON ? cellSize : cher::STROKE_INDEX_CELL)
+    , m_valid(false)
+{
+}
+
+bool entity::StrokeIndex::isValid() const
+{
+    return m_valid;
+}
+
+void entity::StrokeIndex::invalidate()
+{
+    m_valid = false;
+}
+
+void entity::StrokeIndex::rebuild(const osg::Geode *geodeStrokes)
+{
+    this->clear();
+    if (!geodeStrokes){
+        qWarning("StrokeIndex::rebuild: geode is NULL");
+        return;
+    }
+    for (unsigned int i=0; i<geodeStrokes->getNumDrawables(); ++i){
+        const entity::Stroke* stroke = dynamic_cast<const entity::Stroke*>(geodeStrokes->getDrawable(i));
+        if (!stroke) continue;
+        this->insert(stroke);
+    }
+}
+
+void entity::StrokeIndex::clear()
+{
+    m_cells.clear();
+    m_strokes.clear();
+    m_overflow.clear();
+    m_valid = true;
+}
+
+void entity::StrokeIndex::insert(const entity::Stroke *stroke)
+{
+    if (!stroke) return;
+    this->remove(stroke);
+
+    std::vector<long long>& keys = m_strokes[stroke];
+    const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(stroke->getVertexArray());
+    if (!verts || verts->size() < 2) return;
+
+    /* every Bezier segment is represented by 4 control points; the box of segment k also includes
+     * the last point of segment k-1 so that the connecting line is covered */
+    unsigned int n = verts->size();
+    for (unsigned int k=0; 4*k<n; ++k){
+        unsigned int first = (k==0)? 0 : 4*k-1;
+        unsigned int last = std::min(4*k+3, n-1);
+        osg::BoundingBox bb;
+        for (unsigned int i=first; i<=last; ++i)
+            bb.expandBy((*verts)[i]);
+
+        int i0 = this->getCell(bb.xMin()), i1 = this->getCell(bb.xMax());
+        int j0 = this->getCell(bb.yMin()), j1 = this->getCell(bb.yMax());
+        Entry entry = {stroke, k};
+
+        /* segments that would cover too many cells are checked on every query */
+        if ( static_cast<long long>(i1-i0+1) * static_cast<long long>(j1-j0+1) > cher::STROKE_INDEX_MAXCELLS ){
+            m_overflow.push_back(entry);
+            continue;
+        }
+
+        for (int i=i0; i<=i1; ++i){
+            for (int j=j0; j<=j1; ++j){
+                long long key = this->getKey(i,j);
+                m_cells[key].push_back(entry);
+                keys.push_back(key);
+            }
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+bool entity::StrokeIndex::remove(const entity::Stroke *stroke)
+{
+    auto it = m_strokes.find(stroke);
+    if (it == m_strokes.end()) return false;
+
+    auto isStroke = [stroke](const Entry& e){ return e.stroke == stroke; };
+    for (long long key : it->second){
+        auto cell = m_cells.find(key);
+        if (cell == m_cells.end()) continue;
+        std::vector<Entry>& entries = cell->second;
+        entries.erase(std::remove_if(entries.begin(), entries.end(), isStroke), entries.end());
+        if (entries.empty()) m_cells.erase(cell);
+    }
+    m_overflow.erase(std::remove_if(m_overflow.begin(), m_overflow.end(), isStroke), m_overflow.end());
+    m_strokes.erase(it);
+    return true;
+}
+
+void entity::StrokeIndex::update(const entity::Stroke *stroke)
+{
+    this->insert(stroke);
+}
+
+bool entity::StrokeIndex::query(const osg::Vec3f &center, float radius,
+                                std::unordered_map<const entity::Stroke *, std::vector<unsigned int> > &result) const
+{
+    result.clear();
+    if (radius < 0 || radius/m_cellSize > std::sqrt(float(cher::STROKE_INDEX_MAXCELLS))) return false;
+
+    int i0 = this->getCell(center.x() - radius), i1 = this->getCell(center.x() + radius);
+    int j0 = this->getCell(center.y() - radius), j1 = this->getCell(center.y() + radius);
+
+    for (int i=i0; i<=i1; ++i){
+        for (int j=j0; j<=j1; ++j){
+            auto cell = m_cells.find(this->getKey(i,j));
+            if (cell == m_cells.end()) continue;
+            for (const Entry& e : cell->second)
+                result[e.stroke].push_back(e.segment);
+        }
+    }
+    for (const Entry& e : m_overflow)
+        result[e.stroke].push_back(e.segment);
+
+    for (auto& r : result){
+        std::vector<unsigned int>& segments = r.second;
+        std::sort(segments.begin(), segments.end());
+        segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+    }
+    return true;
+}
+
+unsigned int entity::StrokeIndex::getNumStrokes() const
+{
+    return m_strokes.size();
+}
+
+unsigned int entity::StrokeIndex::getNumCells() const
+{
+    return m_cells.size();
+}
+
+float entity::StrokeIndex::getCellSize() const
+{
+    return m_cellSize;
+}
+
+long long entity::StrokeIndex::getKey(int i, int j) const
+{
+    unsigned long long ui = static_cast<unsigned int>(i), uj = static_cast<unsigned int>(j);
+    return static_cast<long long>((ui << 32) | uj);
+}
+
+int entity::StrokeIndex::getCell(float x) const
+{
+    return static_cast<int>(std::floor(x / m_cellSize));
+}
@@ -0,0 +1,98 @@
+#ifndef STROKEINDEX_H
+#define STROKEINDEX_H
+
+#include <vector>
+#include <unordered_map>
+
+#include <osg/Vec3f>
+#include <osg/Geode>
+#include <osg/BoundingBox>
+
+#include "Settings.h"
+
+namespace entity {
+class Stroke;
+
+/*! \class StrokeIndex
+ * \brief Uniform grid over the Bezier segments of all the strokes of a canvas.
+ *
+ * The grid is defined in local canvas (UV) coordinates. Each Bezier segment, i.e., each group of four
+ * control points of entity::Stroke, is registered in every cell covered by its control hull box. The hull
+ * box also includes the last control point of the previous segment so that the line connecting two
+ * consecutive segments is covered as well. The index is used by StrokeIntersector so that the picking ray
+ * is only tested against the segments which lie next to the ray's projection on the canvas plane.
+ *
+ * The index is owned by entity::Canvas and is kept up to date by entity::Canvas::addEntity(),
+ * entity::Canvas::removeEntity() and the entity transformations. It is not serialized: after the scene
+ * is read from file, the index is marked as invalid and it is re-built on the first request.
+*/
+class StrokeIndex
+{
+public:
+    /*! Constructor. \param cellSize is the size of a grid cell in local canvas coordinates. */
+    StrokeIndex(float cellSize = cher::STROKE_INDEX_CELL);
+
+    /*! \return true if the index represents the current canvas content. \sa invalidate(), rebuild() */
+    bool isValid() const;
+
+    /*! A method to mark the index as outdated, e.g., when all the canvas strokes were transformed at once. */
+    void invalidate();
+
+    /*! A method to re-create the index from scratch.
+     * \param geodeStrokes is the geode which contains all the strokes of the canvas. */
+    void rebuild(const osg::Geode* geodeStrokes);
+
+    /*! A method to remove all the data from the index. The index stays valid. */
+    void clear();
+
+    /*! A method to register all the segments of the given stroke. If the stroke is already present in the
+     * index, its segments are updated. */
+    void insert(const entity::Stroke* stroke);
+
+    /*! A method to remove all the segments of the given stroke from the index.
+     * \return true if the stroke was present in the index. */
+    bool remove(const entity::Stroke* stroke);
+
+    /*! A method to re-register the stroke after its geometry was changed. */
+    void update(const entity::Stroke* stroke);
+
+    /*! A method to obtain all the segments whose boxes lie within the given distance from a local point.
+     * \param center is the local 2D point, normally a projection of the picking ray onto the canvas plane.
+     * \param radius is the search radius.
+     * \param result is the output: a list of Bezier segment indices for each stroke found. The indices are
+     * sorted and unique for each stroke.
+     * \return false if the search area covers too many cells for the index to be efficient; in this case
+     * the result is left empty and the caller is expected to fall back to a linear search. */
+    bool query(const osg::Vec3f& center, float radius,
+               std::unordered_map<const entity::Stroke*, std::vector<unsigned int> >& result) const;
+
+    /*! \return number of strokes that are registered in the index. */
+    unsigned int getNumStrokes() const;
+
+    /*! \return number of non-empty grid cells. */
+    unsigned int getNumCells() const;
+
+    /*! \return cell size in local canvas coordinates. */
+    float getCellSize() const;
+
+protected:
+    struct Entry
+    {
+        const entity::Stroke* stroke;
+        unsigned int segment;
+    };
+
+    long long getKey(int i, int j) const;
+    int getCell(float x) const;
+
+private:
+    float m_cellSize;
+    bool m_valid;
+    std::unordered_map<long long, std::vector<Entry> > m_cells; /* cell key to list of segments */
+    std::unordered_map<const entity::Stroke*, std::vector<long long> > m_strokes; /* stroke to list of cell keys */
+    std::vector<Entry> m_overflow; /* segments that are too large to be registered cell by cell */
+};
+
+} // namespace entity
+
+#endif // STROKEINDEX_H
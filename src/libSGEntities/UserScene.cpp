@@ -2,12 +2,15 @@
 
 #include <QDebug>
 #include <QtGlobal>
+#include <QTimer>
+#include <QElapsedTimer>
 
 #include "Settings.h"
 #include "Utilities.h"
 #include "AddEntityCommand.h"
 #include "EditEntityCommand.h"
 #include "FindNodeVisitor.h"
+#include "LatencyMonitor.h"
 
 #include <osgDB/WriteFile>
 #include <osgDB/ReadFile>
@@ -33,10 +36,12 @@ entity::UserScene::UserScene()
     , m_idPhoto(0)
     , m_idBookmark(0)
     , m_filePath("")
+    , m_archive(0)
 {
     this->setName("UserScene");
     m_groupBookmarks->setName("groupBookmarks");
     m_groupCanvases->setName("groupCanvases");
+    QObject::connect(&m_photosDecoded, SIGNAL(resultReadyAt(int)), this, SLOT(onPhotoDecoded(int)));
 }
 
 entity::UserScene::UserScene(const entity::UserScene& scene, const osg::CopyOp& copyop)
@@ -60,7 +65,9 @@ entity::UserScene::UserScene(const entity::UserScene& scene, const osg::CopyOp&
     , m_idPhoto(scene.m_idPhoto)
     , m_idBookmark(scene.m_idBookmark)
     , m_filePath(scene.m_filePath)
+    , m_archive(0)
 {
+    QObject::connect(&m_photosDecoded, SIGNAL(resultReadyAt(int)), this, SLOT(onPhotoDecoded(int)));
 }
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
@@ -349,6 +356,10 @@ int entity::UserScene::getPhotoLevel() const
 
 bool entity::UserScene::setCanvasCurrent(entity::Canvas* cnv)
 {
+    if (cnv && !this->materializeCanvas(cnv))
+        qWarning("setCanvasCurrent(): could not read canvas content from file");
+
+
     // if current and previous are equal, search for the nearest
     // valiable candidate to assign the previous to;
     // if no canvases available at all, the observer ptrs are set to NULL
@@ -400,6 +411,10 @@ bool entity::UserScene::setCanvasCurrent(entity::Canvas* cnv)
 
 bool entity::UserScene::setCanvasPrevious(entity::Canvas* cnv)
 {
+    if (cnv && !this->materializeCanvas(cnv))
+        qWarning("setCanvasPrevious(): could not read canvas content from file");
+
+
     if (cnv == m_canvasPrevious.get())
         return true;
     if (m_canvasPrevious.valid()){
@@ -724,6 +739,7 @@ void entity::UserScene::editPhotoTransparency(entity::Photo *photo, entity::Canv
         return;
     }
     photo->setTransparency(t);
+    canvas->setDirty(true);
     int index = this->getPhotoIndex(photo, canvas);
     for (int i=0; i<m_groupBookmarks->getNumBookmarks(); ++i){
         entity::SceneState* state = m_groupBookmarks->getSceneState(i);
@@ -925,6 +941,9 @@ bool entity::UserScene::clearUserData()
     m_idCanvas=0;
     m_idPhoto=0;
     m_idBookmark=0;
+    m_canvasesPending.clear();
+    m_photosDecoded.setFuture(QFuture< osg::ref_ptr<osg::Image> >());
+    m_archive = 0;
     return m_groupCanvases->removeChildren(0, this->getNumCanvases());
 }
 
@@ -965,6 +984,108 @@ void entity::UserScene::resetModel(CanvasPhotoWidget *widget)
     }
 }
 
+void entity::UserScene::addCanvasPending(entity::Canvas *canvas, entity::SceneChunkFile *archive, unsigned int chunk)
+{
+    if (!canvas || !archive) return;
+    m_archive = archive;
+    m_canvasesPending.push_back(std::make_pair(osg::observer_ptr<entity::Canvas>(canvas), chunk));
+}
+
+bool entity::UserScene::materializeCanvas(entity::Canvas *canvas)
+{
+    auto it = m_canvasesPending.begin();
+    for (; it != m_canvasesPending.end(); ++it){
+        if (it->first.get() == canvas) break;
+    }
+    if (it == m_canvasesPending.end()) return true;
+
+    /* remove from the list first so that the canvas is never read twice */
+    unsigned int chunk = it->second;
+    m_canvasesPending.erase(it);
+    bool result = m_archive.get() && m_archive->readCanvas(chunk, canvas);
+
+    /* the file stays mapped only while there is something to read; it is still kept for incremental saves */
+    if (m_archive.get() && m_canvasesPending.empty() && m_archive->getNumPhotosPending() == 0) m_archive->unmap();
+    if (!result){
+        qWarning() << "materializeCanvas: could not read content of " << canvas->getName().c_str();
+        return false;
+    }
+    canvas->updateFrame(canvas == m_canvasCurrent.get()? m_canvasPrevious.get() : 0);
+
+    /* photos were not known to the canvas-photo widget */
+    int row = this->getCanvasIndex(canvas);
+    for (size_t j=0; row>=0 && j<canvas->getNumPhotos(); ++j){
+        entity::Photo* photo = canvas->getPhoto(j);
+        if (!photo) continue;
+        emit this->photoAdded(photo->getName(), row);
+    }
+    this->updateWidgets();
+    return true;
+}
+
+bool entity::UserScene::materializeCanvases()
+{
+    bool result = true;
+    while (!m_canvasesPending.empty()){
+        osg::ref_ptr<entity::Canvas> canvas = m_canvasesPending.front().first.get();
+        if (!canvas.get()){
+            m_canvasesPending.erase(m_canvasesPending.begin());
+            continue;
+        }
+        if (!this->materializeCanvas(canvas.get()))
+            result = false;
+    }
+    this->waitForPhotos();
+    return result;
+}
+
+void entity::UserScene::materializeLater()
+{
+    if (m_canvasesPending.empty()) return;
+    QTimer::singleShot(0, this, SLOT(onMaterializeNext()));
+}
+
+bool entity::UserScene::isCanvasPending(const entity::Canvas *canvas) const
+{
+    for (const auto& pending : m_canvasesPending){
+        if (pending.first.get() == canvas) return true;
+    }
+    return false;
+}
+
+int entity::UserScene::getNumCanvasesPending() const
+{
+    return static_cast<int>(m_canvasesPending.size());
+}
+
+void entity::UserScene::attachPhotosLater()
+{
+    if (!m_archive.get() || m_archive->getNumPhotosPending() == 0) return;
+    m_photosDecoded.setFuture(m_archive->getPhotosDecoded());
+}
+
+void entity::UserScene::waitForPhotos()
+{
+    if (!m_archive.get() || m_archive->getNumPhotosPending() == 0) return;
+    m_archive->waitForPhotos();
+    if (m_canvasesPending.empty()) m_archive->unmap();
+}
+
+int entity::UserScene::getNumPhotosPending() const
+{
+    return m_archive.get()? m_archive->getNumPhotosPending() : 0;
+}
+
+void entity::UserScene::setArchive(entity::SceneChunkFile *archive)
+{
+    m_archive = archive;
+}
+
+entity::SceneChunkFile *entity::UserScene::getArchive() const
+{
+    return m_archive.get();
+}
+
 void entity::UserScene::onItemChanged(QTreeWidgetItem *item, int column)
 {
     QTreeWidget* widget = item->treeWidget();
@@ -978,6 +1099,7 @@ void entity::UserScene::onItemChanged(QTreeWidgetItem *item, int column)
         entity::Canvas* cnv = this->getCanvasFromIndex(row);
         if (!cnv) qFatal("UserScene::onItemChanged() - canvas is NULL");
         cnv->setName(item->text(column).toStdString());
+        cnv->setDirty(true);
     }
     /* if photo */
     else{
@@ -993,6 +1115,7 @@ void entity::UserScene::onItemChanged(QTreeWidgetItem *item, int column)
         entity::Photo* photo = this->getPhoto(canvas, row);
         if (!photo) qFatal("UserScene::onItemChanged() - photo is NULL");
         photo->setName(item->text(column).toStdString());
+        canvas->setDirty(true);
         qDebug("photo name changed");
     }
 }
@@ -1036,6 +1159,28 @@ void entity::UserScene::onRightClicked(const QModelIndex &index)
     }
 }
 
+void entity::UserScene::onMaterializeNext()
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_canvasesPending.empty() && timer.elapsed() < cher::SCENE_CHUNK_BUDGET){
+        osg::ref_ptr<entity::Canvas> canvas = m_canvasesPending.front().first.get();
+        if (!canvas.get()){
+            m_canvasesPending.erase(m_canvasesPending.begin());
+            continue;
+        }
+        this->materializeCanvas(canvas.get());
+    }
+    if (!m_canvasesPending.empty()) this->materializeLater();
+}
+
+void entity::UserScene::onPhotoDecoded(int index)
+{
+    if (!m_archive.get()) return;
+    m_archive->attachPhoto(index);
+    if (m_archive->getNumPhotosPending() == 0 && m_canvasesPending.empty()) m_archive->unmap();
+}
+
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
 std::string entity::UserScene::getCanvasName()
@@ -1079,6 +1224,7 @@ void entity::UserScene::strokeStart()
     }
     entity::Stroke* stroke = new entity::Stroke();
     stroke->initializeProgram(m_canvasCurrent->getProgramStroke());
+    stroke->setFitOnline(true);
     m_canvasCurrent->setStrokeCurrent(stroke);
     m_canvasCurrent->addEntity(stroke);
 }
@@ -1089,6 +1235,7 @@ void entity::UserScene::strokeAppend(float u, float v)
         entity::Stroke* stroke = m_canvasCurrent->getStrokeCurrent();
         stroke->appendPoint(u, v);
         this->updateWidgets();
+        entity::LatencyMonitor::instance().markAppended();
     }
     else
         qWarning("strokeAppend: pointer is NULL");
@@ -1729,6 +1876,10 @@ bool entity::UserScene::removeCanvas(entity::Canvas *canvas)
 {
     if (!canvas) qFatal("UserScene::removeCanvas(Canvas*): canvas is NULL");
 
+    /* the canvas leaves the scene with its content, e.g., to be restored by undo */
+    if (!this->materializeCanvas(canvas))
+        qWarning("UserScene::removeCanvas: could not read canvas content");
+
     int index = this->getCanvasIndex(canvas);
     // for each bookmark's state, remove data of the canvas
     for (int i=0; i<m_groupBookmarks->getNumBookmarks(); ++i){
@@ -1808,6 +1959,7 @@ bool entity::UserScene::addEntity(entity::Canvas *canvas, Entity2D *entity)
 
     /* add entity to scene graph */
     result = canvas->addEntity(entity);
+    if (result) canvas->setDirty(true);
 
     /* gui elements, if needed */
     if (result){
@@ -1853,6 +2005,7 @@ bool entity::UserScene::removeEntity(entity::Canvas *canvas, Entity2D *entity)
 
     /* remove entity from scene graph */
     result = canvas->removeEntity(entity);
+    if (result) canvas->setDirty(true);
 
     /* make sure it is not a part of selected group, or it will stay within the scene graph */
     canvas->removeEntitySelected(entity);
@@ -6,6 +6,7 @@
 #include <QUndoStack>
 #include <QObject>
 #include <QModelIndex>
+#include <QFutureWatcher>
 #include <QTreeWidgetItem>
 
 #include <osg/Group>
@@ -20,6 +21,7 @@
 #include "Polygon.h"
 #include "Photo.h"
 #include "Bookmarks.h"
+#include "SceneChunkFile.h"
 #include "../libGUI/ListWidget.h"
 #include "../libGUI/TreeWidget.h"
 #include "../libSGControls/AddEntityCommand.h"
@@ -500,6 +502,53 @@ public:
      * \param widget is the CanvasPhotoWidget to update */
     void resetModel(CanvasPhotoWidget* widget);
 
+    /*! A method to register an empty canvas whose content is still stored within the chunked scene file. The canvas
+     * is filled by materializeCanvas(), either on demand or from the event loop, see materializeLater().
+     * \param canvas is the empty canvas, it must already be a child of the scene
+     * \param archive is the opened scene file, it is kept mapped while there are pending canvases
+     * \param chunk is the index of the canvas chunk within the file
+     * \sa SceneChunkFile::readScene() */
+    void addCanvasPending(entity::Canvas* canvas, entity::SceneChunkFile* archive, unsigned int chunk);
+
+    /*! A method to read the content of a pending canvas from the scene file. It is called whenever the canvas content
+     * is about to be used, e.g., when the canvas becomes current or previous.
+     * \param canvas is the canvas to materialize
+     * \return true if the canvas was read successfully or if it was not pending at all. */
+    bool materializeCanvas(entity::Canvas* canvas);
+
+    /*! A method to materialize all the pending canvases, e.g., before the scene is saved or a scene state is taken.
+     * \return true if all the canvases were read successfully. */
+    bool materializeCanvases();
+
+    /*! A method to schedule the materialization of the pending canvases from the event loop. Each iteration reads
+     * canvases during at most cher::SCENE_CHUNK_BUDGET milliseconds. */
+    void materializeLater();
+
+    /*! \return true if the content of the canvas is not read from the scene file yet. */
+    bool isCanvasPending(const entity::Canvas* canvas) const;
+
+    /*! \return number of canvases whose content is not read from the scene file yet. */
+    int getNumCanvasesPending() const;
+
+    /*! A method to set the photo images to their textures as soon as they are decoded by the scene file,
+     * see SceneChunkFile::decodePhotos(). The canvases and their photos can be used before, the photos are
+     * shown without texture until then. */
+    void attachPhotosLater();
+
+    /*! A method to block until all the photo images of the scene file are decoded and set, e.g., before the
+     * images are written or compared. It is called by materializeCanvases(). */
+    void waitForPhotos();
+
+    /*! \return number of photo textures whose images are still decoding. */
+    int getNumPhotosPending() const;
+
+    /*! A method to keep the chunked scene file that the scene was last saved to, so that the next save only
+     * appends the changes. \sa SceneChunkFile::save() */
+    void setArchive(entity::SceneChunkFile* archive);
+
+    /*! \return the chunked scene file that the scene was last read from or saved to, or NULL. */
+    entity::SceneChunkFile* getArchive() const;
+
 signals:
     /*! A signal which is connected with MainWindow::onRequestUpdate() to request for GLWidget update. */
     void sendRequestUpdate();
@@ -549,6 +598,13 @@ public slots:
      * the slots changes the corresponding canvas status to previous. This slot is connected with CanvasPhotoWidget::rightClicked(). */
     void onRightClicked(const QModelIndex& index);
 
+    /*! A slot which materializes the pending canvases within the time budget and re-schedules itself if
+     * any of them are left. \sa materializeLater() */
+    void onMaterializeNext();
+
+    /*! A slot which sets a decoded image to its texture. \sa attachPhotosLater() */
+    void onPhotoDecoded(int index);
+
 protected:
     std::string getCanvasName();
     std::string getPhotoName();
@@ -643,6 +699,10 @@ private:
     unsigned int    m_idPhoto;     /*!< Naming convention identification number for photos. */
     unsigned int    m_idBookmark;  /*!< Naming convention identification number for bookmarks. */
     std::string     m_filePath;     /*!< File path where the scene is saved to. */
+
+    osg::ref_ptr<entity::SceneChunkFile> m_archive; /*!< Scene file that was last read or saved, it contains the pending canvases. */
+    std::vector< std::pair<osg::observer_ptr<entity::Canvas>, unsigned int> > m_canvasesPending; /*!< Canvases to read and their chunks. */
+    QFutureWatcher< osg::ref_ptr<osg::Image> > m_photosDecoded; /*!< Photo images decoded by m_archive. */
 };
 
 }
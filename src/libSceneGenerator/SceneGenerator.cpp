@@ -0,0 +1,194 @@
+#include "SceneGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QDir>
+#include <QImage>
+#include <QColor>
+#include <QtGlobal>
+#include <QDebug>
+
+#include "Settings.h"
+#include "RootScene.h"
+#include "UserScene.h"
+#include "Canvas.h"
+#include "Bookmarks.h"
+#include "ListWidget.h"
+
+SceneGenerator::Options::Options()
+    : canvases(10)
+    , strokes(100)
+    , points(100)
+    , photos(0)
+    , photoSize(512)
+    , bookmarks(0)
+    , extent(10.f)
+    , seed(1)
+{
+}
+
+SceneGenerator::SceneGenerator(const SceneGenerator::Options &options)
+    : m_options(options)
+    , m_random(options.seed)
+{
+}
+
+bool SceneGenerator::generate(RootScene *root, BookmarkWidget *widget, const QString &directory)
+{
+    if (!root || !root->getUserScene() || !widget){
+        qCritical("Scene generator: scene or bookmark widget is NULL");
+        return false;
+    }
+    entity::UserScene* scene = root->getUserScene();
+
+    /* canvases and their strokes, every stroke is sketched as a sequence of pen events */
+    std::vector<entity::Canvas*> canvases;
+    for (int i=0; i<m_options.canvases; ++i){
+        osg::Matrix R, T;
+        this->createPose(R, T);
+        root->addCanvas(R, T);
+        entity::Canvas* canvas = root->getCanvasCurrent();
+        if (!canvas || std::find(canvases.begin(), canvases.end(), canvas) != canvases.end()){
+            qCritical("Scene generator: could not add canvas");
+            return false;
+        }
+        canvases.push_back(canvas);
+
+        unsigned int strokes = canvas->getNumStrokes();
+        for (int j=0; j<m_options.strokes; ++j){
+            std::vector<osg::Vec2f> path = this->createPath();
+            for (unsigned int k=0; k<path.size(); ++k){
+                cher::EVENT event = k == 0 ? cher::EVENT_PRESSED
+                                           : (k+1 == path.size() ? cher::EVENT_RELEASED : cher::EVENT_DRAGGED);
+                root->addStroke(path[k].x(), path[k].y(), event);
+            }
+        }
+        if (canvas->getNumStrokes() != strokes + static_cast<unsigned int>(m_options.strokes)){
+            qCritical("Scene generator: could not add strokes");
+            return false;
+        }
+    }
+
+    /* photos are added to the canvases in turn */
+    if (m_options.photos > 0 && canvases.empty()){
+        qCritical("Scene generator: photos require at least one canvas");
+        return false;
+    }
+    for (int i=0; i<m_options.photos; ++i){
+        QString path = QDir(directory).filePath(QString("photo%1.png").arg(i));
+        if (!this->createImage(path, m_options.photoSize)){
+            qCritical("Scene generator: could not write photo image");
+            return false;
+        }
+        entity::Canvas* canvas = canvases[i % canvases.size()];
+        unsigned int photos = canvas->getNumPhotos();
+        root->setCanvasCurrent(canvas);
+        root->addPhoto(path.toStdString());
+        if (canvas->getNumPhotos() != photos + 1){
+            qCritical("Scene generator: could not add photo");
+            return false;
+        }
+    }
+
+    /* bookmarks look at the origin, the svm data is added as by the GUI when there are two canvases */
+    for (int i=0; i<m_options.bookmarks; ++i){
+        int bookmarks = scene->getBookmarksModel()->getNumBookmarks();
+        double phi = this->getUniform(-cher::PI, cher::PI), z = this->getUniform(-1.f, 1.f);
+        osg::Vec3d dir(std::sqrt(1-z*z) * std::cos(phi), std::sqrt(1-z*z) * std::sin(phi), z);
+        osg::Vec3d eye = dir * 3.0 * m_options.extent;
+        root->addBookmark(widget, eye, osg::Vec3d(0,0,0), osg::Vec3d(0,0,1), 60.0); // whole angle, as GLWidget gives
+        if (scene->getBookmarksModel()->getNumBookmarks() != bookmarks + 1){
+            qCritical("Scene generator: could not add bookmark");
+            return false;
+        }
+        if (root->getCanvasPrevious()) root->addSVMData();
+    }
+    return true;
+}
+
+bool SceneGenerator::write(RootScene *root, const std::string &path)
+{
+    if (!root) return false;
+    root->setFilePath(path);
+    if (!root->writeScenetoFile()){
+        qCritical("Scene generator: could not write scene to file");
+        return false;
+    }
+    return true;
+}
+
+void SceneGenerator::createPose(osg::Matrix &R, osg::Matrix &T)
+{
+    /* the values are drawn one by one, since the order of evaluation of the function arguments is unspecified */
+    float ax = this->getUniform(-cher::PI, cher::PI);
+    float ay = this->getUniform(-cher::PI, cher::PI);
+    float az = this->getUniform(-cher::PI, cher::PI);
+    float x = this->getUniform(-m_options.extent, m_options.extent);
+    float y = this->getUniform(-m_options.extent, m_options.extent);
+    float z = this->getUniform(-m_options.extent, m_options.extent);
+    R = osg::Matrix::rotate(ax, osg::Vec3f(1,0,0))
+            * osg::Matrix::rotate(ay, osg::Vec3f(0,1,0))
+            * osg::Matrix::rotate(az, osg::Vec3f(0,0,1));
+    T = osg::Matrix::translate(x, y, z);
+}
+
+std::vector<osg::Vec2f> SceneGenerator::createPath()
+{
+    /* the pen moves with a nearly constant speed and its direction changes smoothly */
+    float x = this->getUniform(-cher::CANVAS_MINW, cher::CANVAS_MINW);
+    float y = this->getUniform(-cher::CANVAS_MINW, cher::CANVAS_MINW);
+    osg::Vec2f p(x, y);
+    float heading = this->getUniform(-cher::PI, cher::PI);
+    float curvature = 0.f;
+
+    std::vector<osg::Vec2f> path;
+    path.reserve(std::max(2, m_options.points));
+    for (int i=0; i<std::max(2, m_options.points); ++i){
+        path.push_back(p);
+        curvature = std::max(-0.2f, std::min(0.2f, curvature + this->getNormal(0.f, 0.02f)));
+        heading += curvature;
+        p += osg::Vec2f(std::cos(heading), std::sin(heading)) * std::max(0.001f, this->getNormal(0.01f, 0.001f));
+    }
+    return path;
+}
+
+bool SceneGenerator::createImage(const QString &path, int size)
+{
+    /* smooth color waves, so that the image is compressed as a photo rather than as a flat color */
+    float fx = this->getUniform(1.f, 8.f), fy = this->getUniform(1.f, 8.f);
+    float px = this->getUniform(0.f, 2*cher::PI), py = this->getUniform(0.f, 2*cher::PI);
+    QImage image(size, size, QImage::Format_RGB32);
+    for (int y=0; y<size; ++y){
+        for (int x=0; x<size; ++x){
+            float u = float(x) / size, v = float(y) / size;
+            int r = static_cast<int>(127.5f * (1 + std::sin(2*cher::PI*fx*u + px)));
+            int g = static_cast<int>(127.5f * (1 + std::sin(2*cher::PI*fy*v + py)));
+            int b = static_cast<int>(127.5f * (1 + std::sin(2*cher::PI*(fx*u + fy*v))));
+            image.setPixel(x, y, qRgb(r, g, b));
+        }
+    }
+    return image.save(path, "PNG");
+}
+
+const SceneGenerator::Options &SceneGenerator::getOptions() const
+{
+    return m_options;
+}
+
+float SceneGenerator::getUniform(float min, float max)
+{
+    /* std::mt19937 gives 32 random bits per call */
+    double u = static_cast<double>(m_random()) / 4294967296.0;
+    return static_cast<float>(min + (max - min) * u);
+}
+
+float SceneGenerator::getNormal(float mean, float sigma)
+{
+    /* the sum of 12 uniform values within [0,1) has the mean of 6 and the variance of 1 (Irwin-Hall),
+     * which is close enough to the normal distribution for the pen noise and needs no math functions */
+    double sum = 0;
+    for (int i=0; i<12; ++i)
+        sum += static_cast<double>(m_random()) / 4294967296.0;
+    return static_cast<float>(mean + sigma * (sum - 6.0));
+}
@@ -0,0 +1,88 @@
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <QString>
+
+#include <osg/Matrix>
+#include <osg/Vec2f>
+
+class RootScene;
+class BookmarkWidget;
+
+/*! \class SceneGenerator
+ * \brief Builds large synthetic scenes for scalability testing and benchmarks.
+ *
+ * The scene is built through the same RootScene and entity::UserScene calls as the GUI uses, so that every canvas,
+ * stroke and photo is added by its undo command (e.g., fur::AddStrokeCommand), and every bookmark gets its
+ * entity::SceneState:
+ * * Options::canvases canvases are placed in random poses within Options::extent from the origin;
+ * * Options::strokes strokes per canvas are sketched as the press, drag and release events of a pen which moves
+ * with a nearly constant speed and turns smoothly, Options::points events per stroke;
+ * * Options::photos photos of Options::photoSize pixels are written as image files and added to the canvases
+ * in turn;
+ * * Options::bookmarks bookmarks look at the origin from random directions.
+ *
+ * The random values are mapped from the raw output of std::mt19937 seeded by Options::seed, whose sequence is
+ * fixed by the standard, and not by the std distributions, whose results are implementation-defined. Since they are
+ * also drawn in a fixed order, the same options give the same scene with any compiler and standard library, up to
+ * the rounding of the math functions, e.g., std::sin(), on different platforms.
+ * The scene can then be written in any supported format, see write().
+*/
+class SceneGenerator
+{
+public:
+    /*! Scene settings. */
+    struct Options
+    {
+        Options();
+
+        int canvases; /*!< number of canvases */
+        int strokes; /*!< number of strokes per canvas */
+        int points; /*!< number of pen events per stroke */
+        int photos; /*!< total number of photos */
+        int photoSize; /*!< side of the photo images in pixels */
+        int bookmarks; /*!< number of bookmarks */
+        float extent; /*!< max distance of the canvas centers from the origin */
+        unsigned int seed; /*!< seed of the random generator */
+    };
+
+    explicit SceneGenerator(const Options& options);
+
+    /*! A method to add the synthetic scene to the current user scene of the root scene.
+     * \param root is the root scene, its undo stack receives the commands
+     * \param widget is the bookmark widget of the main window
+     * \param directory is the folder where the photo images are written to
+     * \return true if all the elements were added. */
+    bool generate(RootScene* root, BookmarkWidget* widget, const QString& directory);
+
+    /*! A method to write the scene to the file; the format is chosen by the file extension, e.g.,
+     * cher::SCENE_CHUNK_EXTENSION or "osgt". \return true if the file was written. */
+    static bool write(RootScene* root, const std::string& path);
+
+    /*! A method to generate a canvas pose, both rotation and translation are random. */
+    void createPose(osg::Matrix& R, osg::Matrix& T);
+
+    /*! \return random pen-like path in the local canvas coordinates. */
+    std::vector<osg::Vec2f> createPath();
+
+    /*! A method to write a random image of the given size. \return true if the image file was written. */
+    bool createImage(const QString& path, int size);
+
+    const Options& getOptions() const;
+
+private:
+    /* uniform value within [min, max) */
+    float getUniform(float min, float max);
+
+    /* nearly normal value, see the implementation */
+    float getNormal(float mean, float sigma);
+
+    Options m_options;
+    std::mt19937 m_random;
+};
+
+#endif // SCENEGENERATOR_H
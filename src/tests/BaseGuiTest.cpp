@@ -1,7 +1,13 @@
 #include "BaseGuiTest.h"
+
+#include <cmath>
+
+#include <osg/ref_ptr>
+
 #include "RootScene.h"
 #include "GLWidget.h"
 #include "RootScene.h"
+#include "Stroke.h"
 
 BaseGuiTest::BaseGuiTest(QWidget *parent)
     : MainWindow(parent)
@@ -40,3 +46,28 @@ void BaseGuiTest::cleanup()
 
     QTest::qWait(1000);
 }
+
+entity::Stroke *BaseGuiTest::addStroke(entity::Canvas *canvas, float u, float v, float size)
+{
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(canvas->getProgramStroke());
+    stroke->appendPoint(u, v);
+    stroke->appendPoint(u+size, v);
+    stroke->appendPoint(u+size, v+size);
+    stroke->appendPoint(u, v+size);
+    if (!stroke->redefineToShape(canvas->getTransform())) return 0;
+    if (!canvas->addEntity(stroke.get())) return 0;
+    return stroke.get();
+}
+
+void BaseGuiTest::fillCanvas(entity::Canvas *canvas, int number)
+{
+    /* square strokes are placed in a grid so that the total area grows with the number of strokes */
+    int side = static_cast<int>(std::ceil(std::sqrt(float(number))));
+    for (int i=0; i<number; ++i){
+        float u = 0.25f * (i % side);
+        float v = 0.25f * (i / side);
+        QVERIFY(this->addStroke(canvas, u, v, 0.2f));
+    }
+    QCOMPARE(static_cast<int>(canvas->getNumStrokes()), number);
+}
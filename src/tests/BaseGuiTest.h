@@ -39,6 +39,14 @@ private slots:
     void cleanup();
 
 protected:
+    /*! A method to add a shadered square stroke to the canvas.
+     * \param u and v are the local coordinates of the first corner, \param size is the side of the square.
+     * \return the added stroke, or NULL upon failure. */
+    entity::Stroke* addStroke(entity::Canvas* canvas, float u, float v, float size);
+
+    /*! A method to fill the canvas by the given number of square strokes placed in a grid. */
+    void fillCanvas(entity::Canvas* canvas, int number);
+
     osg::observer_ptr<entity::Canvas> m_canvas0, m_canvas1, m_canvas2;
     osg::observer_ptr<entity::UserScene> m_scene;
 };
@@ -2,6 +2,8 @@
 
 #include <math.h>
 
+#include <QElapsedTimer>
+
 void CanvasTest::testBasicApi()
 {
     qInfo("Test canvas basic api - create new canvas");
@@ -221,6 +223,147 @@ void CanvasTest::testCloneOrtho()
     this->testOrthogonality(canvas2);
 }
 
+void CanvasTest::testRecenter()
+{
+    qInfo("Create a canvas with a stroke away from its center");
+    osg::ref_ptr<entity::Canvas> canvas = new entity::Canvas();
+    canvas->initializeSG();
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->appendPoint(1, 1);
+    stroke->appendPoint(2, 1.5);
+    stroke->appendPoint(3, 2);
+    QVERIFY(canvas->addEntity(stroke.get()));
+    osg::Vec2f p0 = stroke->getPoint(0);
+    osg::Vec3f P0 = osg::Vec3f(p0.x(), p0.y(), 0) * canvas->getTransform()->getMatrix();
+
+    qInfo("Rotate the canvas around the stroke center");
+    osg::Vec3f center = canvas->getBoundingBoxCenter3D();
+    canvas->rotate(osg::Matrix::rotate(cher::PI/6, osg::Vec3f(1,0,0)), center);
+    this->testOrthogonality(canvas);
+    QVERIFY(differenceWithinThreshold(canvas->getCenter(), center));
+    QVERIFY(differenceWithinThreshold(canvas->getCenter2D(), osg::Vec3f(2,1.5,0)));
+    QVERIFY(!canvas->getMatrixOffset().isIdentity());
+
+    qInfo("The stroke keeps its local points");
+    QCOMPARE(stroke->getPoint(0), p0);
+
+    qInfo("The stroke is rotated around the new center");
+    osg::Vec3f P1 = osg::Vec3f(p0.x(), p0.y(), 0) * canvas->getTransform()->getMatrix();
+    QVERIFY(differenceWithinThreshold(P1 - center, (P0 - center) * osg::Matrix::rotate(cher::PI/6, osg::Vec3f(1,0,0))));
+
+    qInfo("The frame handles are drawn at the new center");
+    canvas->updateFrame();
+    const osg::Vec3Array* frame = canvas->getFrameVertices();
+    QVERIFY(frame && frame->size() >= 4);
+    osg::Vec3f handle = ((*frame)[0] + (*frame)[1] + (*frame)[2] + (*frame)[3]) * 0.25f;
+    QVERIFY(differenceWithinThreshold(handle, canvas->getCenter2D()));
+    QVERIFY(differenceWithinThreshold(handle * canvas->getTransform()->getMatrix(), canvas->getCenter()));
+
+    qInfo("The rotation axes are not skewed by the local offset");
+    osg::Matrix R = osg::Matrix::rotate(cher::PI/6, osg::Vec3f(1,0,0));
+    QVERIFY(differenceWithinThreshold(canvas->getGlobalAxisU(), osg::Vec3f(1,0,0) * R));
+    QVERIFY(differenceWithinThreshold(canvas->getGlobalAxisV(), osg::Vec3f(0,1,0) * R));
+    osg::Vec3f axisV = (canvas->getCenter2D() + osg::Vec3f(0,1,0)) * canvas->getTransform()->getMatrix()
+            - canvas->getCenter();
+    QVERIFY(differenceWithinThreshold(axisV, canvas->getGlobalAxisV()));
+
+    qInfo("Clone keeps the local offset");
+    osg::ref_ptr<entity::Canvas> clone = canvas->clone();
+    QVERIFY(clone.get());
+    QCOMPARE(clone->getMatrixOffset(), canvas->getMatrixOffset());
+    QVERIFY(differenceWithinThreshold(clone->getCenter(), canvas->getCenter()));
+}
+
+void CanvasTest::testBounds()
+{
+    qInfo("Create a canvas with three strokes");
+    osg::ref_ptr<entity::Canvas> canvas = new entity::Canvas();
+    canvas->initializeSG();
+    std::vector< osg::ref_ptr<entity::Stroke> > strokes;
+    for (int i=0; i<3; ++i){
+        osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+        stroke->appendPoint(i, i);
+        stroke->appendPoint(i+0.5, i+1);
+        QVERIFY(canvas->addEntity(stroke.get()));
+        strokes.push_back(stroke);
+    }
+    osg::BoundingBox bb = canvas->getBoundingBox();
+    QVERIFY(differenceWithinThreshold(bb._min, osg::Vec3f(0,0,0)));
+    QVERIFY(differenceWithinThreshold(bb._max, osg::Vec3f(2.5,3,0)));
+
+    qInfo("Removal of an inner stroke keeps the box");
+    QVERIFY(canvas->removeEntity(strokes[1].get()));
+    bb = canvas->getBoundingBox();
+    QVERIFY(differenceWithinThreshold(bb._max, osg::Vec3f(2.5,3,0)));
+
+    qInfo("Removal of an extremal stroke shrinks the box");
+    QVERIFY(canvas->removeEntity(strokes[2].get()));
+    bb = canvas->getBoundingBox();
+    QVERIFY(differenceWithinThreshold(bb._max, osg::Vec3f(0.5,1,0)));
+
+    qInfo("Moved strokes are bounded at their new location");
+    std::vector<entity::Entity2D*> moved(1, strokes[0].get());
+    canvas->moveEntities(moved, 2, 1);
+    bb = canvas->getBoundingBox();
+    QVERIFY(differenceWithinThreshold(bb._min, osg::Vec3f(2,1,0)));
+    QVERIFY(differenceWithinThreshold(bb._max, osg::Vec3f(2.5,2,0)));
+
+    qInfo("Canvas box follows the dragged selection");
+    canvas->addEntitySelected(strokes[0].get());
+    canvas->moveEntitiesSelected(-1, 0);
+    bb = canvas->getBoundingBox();
+    QVERIFY(differenceWithinThreshold(bb._min, osg::Vec3f(1,1,0)));
+    QVERIFY(differenceWithinThreshold(bb._max, osg::Vec3f(1.5,2,0)));
+    canvas->unselectAll();
+}
+
+void CanvasTest::testSelectAll()
+{
+    qInfo("Create a canvas with a row of strokes");
+    osg::ref_ptr<entity::Canvas> canvas = new entity::Canvas();
+    canvas->initializeSG();
+    const int n = 1000;
+    std::vector<entity::Entity2D*> strokes;
+    for (int i=0; i<n; ++i){
+        osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+        stroke->appendPoint(i, 0);
+        stroke->appendPoint(i+1, 1);
+        QVERIFY(canvas->addEntity(stroke.get()));
+        strokes.push_back(stroke.get());
+    }
+
+    qInfo("Select all the strokes at once");
+    QElapsedTimer timer;
+    timer.start();
+    canvas->selectAllEntities();
+    qInfo() << "Select all of" << n << "strokes:" << timer.elapsed() << "ms";
+    QCOMPARE(canvas->getEntitiesSelectedSize(), n);
+    QVERIFY(differenceWithinThreshold(canvas->getEntitiesSelectedCenter2D(), osg::Vec3f(0.5*n, 0.5, 0)));
+    QCOMPARE(canvas->getEntitiesSelected().front(), strokes.front());
+    QCOMPARE(canvas->getEntitiesSelected().back(), strokes.back());
+
+    qInfo("Selecting a stroke twice does not change the selection");
+    canvas->addEntitySelected(strokes.at(10));
+    QCOMPARE(canvas->getEntitiesSelectedSize(), n);
+
+    qInfo("Unselect every other stroke, the order is kept");
+    std::vector<entity::Entity2D*> odd;
+    for (int i=1; i<n; i+=2) odd.push_back(strokes.at(i));
+    canvas->removeEntitiesSelected(odd);
+    QCOMPARE(canvas->getEntitiesSelectedSize(), n/2);
+    for (int i=0; i<n/2; ++i)
+        QCOMPARE(canvas->getEntitiesSelected().at(i), strokes.at(2*i));
+
+    qInfo("Single removal keeps the lookup coherent");
+    canvas->removeEntitySelected(strokes.at(0));
+    canvas->removeEntitySelected(strokes.at(4));
+    QCOMPARE(canvas->getEntitiesSelectedSize(), n/2-2);
+    QCOMPARE(canvas->getEntitiesSelected().at(1), strokes.at(6));
+
+    canvas->unselectAll();
+    QCOMPARE(canvas->getEntitiesSelectedSize(), 0);
+}
+
 bool CanvasTest::differenceWithinThreshold(const osg::Vec3f &X, const osg::Vec3f &Y)
 {
     osg::Vec3f diff = X-Y;
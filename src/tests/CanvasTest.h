@@ -14,6 +14,9 @@ private slots:
     void testNewYZ();
     void testNewXZ();
     void testCloneOrtho();
+    void testRecenter();
+    void testBounds();
+    void testSelectAll();
 
 private:
     bool differenceWithinThreshold(const osg::Vec3f& X, const osg::Vec3f& Y);
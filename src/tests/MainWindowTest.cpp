@@ -2,6 +2,16 @@
 
 #include <QTreeWidgetItem>
 #include <QSignalSpy>
+#include <QFile>
+#include <QImage>
+#include <QDir>
+#include <QSet>
+#include <QTemporaryDir>
+
+#include "GLWidget.h"
+#include "EventRecorder.h"
+#include "LatencyMonitor.h"
+#include "PhotoModel.h"
 
 void MainWindowTest::testToolsOnOff()
 {
@@ -175,5 +185,183 @@ void MainWindowTest::testUndoRedoCanvasMove()
     QCOMPARE(stack->canRedo(), true);
 }
 
+void MainWindowTest::testRecordReplayEvents()
+{
+    qInfo("Record a click of the mouse in the sketch mode");
+    QVERIFY(m_glWidget);
+    EventRecorder* recorder = m_glWidget->getEventRecorder();
+    QVERIFY(recorder);
+    QPoint center(m_glWidget->width()/2, m_glWidget->height()/2);
+    m_glWidget->setRecording(true);
+    QVERIFY(recorder->isRecording());
+    QTest::mousePress(m_glWidget, Qt::LeftButton, 0, center);
+    QTest::mouseRelease(m_glWidget, Qt::LeftButton, 0, center + QPoint(10, 10));
+    QVERIFY(!m_glWidget->grabFramebuffer().isNull());
+    m_glWidget->setRecording(false);
+    QVERIFY(!recorder->isRecording());
+
+    const std::vector<EventRecorder::Record>& records = recorder->getRecords();
+    unsigned int pushes = 0, releases = 0;
+    for (const auto& record : records){
+        QCOMPARE(record.mode, cher::PEN_SKETCH);
+        if (record.event->getEventType() == osgGA::GUIEventAdapter::PUSH) ++pushes;
+        if (record.event->getEventType() == osgGA::GUIEventAdapter::RELEASE) ++releases;
+    }
+    QCOMPARE(pushes, 1u);
+    QCOMPARE(releases, 1u);
+    QVERIFY(recorder->getNumFrames() > 0);
+
+    qInfo("Write the recording to file and read it back");
+    QVERIFY(recorder->write("RW_MainWindowTest.events"));
+    osg::ref_ptr<EventRecorder> recording = new EventRecorder(0);
+    QVERIFY(recording->read("RW_MainWindowTest.events"));
+    QCOMPARE(recording->getRecords().size(), records.size());
+    QCOMPARE(recording->getNumFrames(), recorder->getNumFrames());
+    QCOMPARE(recording->getWidth(), m_glWidget->width());
+    QCOMPARE(recording->getHeight(), m_glWidget->height());
+    for (unsigned int i=0; i<records.size(); ++i){
+        const osgGA::GUIEventAdapter* ea = records[i].event.get();
+        const osgGA::GUIEventAdapter* eb = recording->getRecords()[i].event.get();
+        QCOMPARE(eb->getEventType(), ea->getEventType());
+        QCOMPARE(eb->getX(), ea->getX());
+        QCOMPARE(eb->getY(), ea->getY());
+        QCOMPARE(eb->getButton(), ea->getButton());
+        QCOMPARE(recording->getRecords()[i].mode, records[i].mode);
+    }
+
+    qInfo("Replay the recording from the select mode, the recorded mode is restored");
+    m_glWidget->setMouseMode(cher::SELECT_ENTITY);
+    std::vector<double> frames;
+    QVERIFY(m_glWidget->replay(recording.get(), frames));
+    QCOMPARE(static_cast<unsigned int>(frames.size()), recording->getNumFrames());
+    QCOMPARE(m_glWidget->getMouseMode(), cher::PEN_SKETCH);
+
+    qInfo("Recording in progress cannot be replayed");
+    m_glWidget->setRecording(true);
+    QVERIFY(!m_glWidget->replay(recorder, frames));
+    m_glWidget->setRecording(false);
+}
+
+void MainWindowTest::testSketchLatency()
+{
+    entity::LatencyMonitor& latency = entity::LatencyMonitor::instance();
+    QUndoStack* stack = this->m_undoStack;
+    QVERIFY(stack);
+
+    qInfo("Disabled monitor does not keep samples");
+    latency.setEnabled(false);
+    latency.markHandled(latency.getTime());
+    m_scene->addStroke(stack, 0,0, cher::EVENT_PRESSED);
+    latency.markFrame();
+    QCOMPARE(latency.getNumSamples(), 0u);
+
+    qInfo("Every appended point is a sample once its frame is drawn");
+    latency.setEnabled(true);
+    double input = latency.getTime();
+    latency.markHandled(input);
+    m_scene->addStroke(stack, 1,0, cher::EVENT_DRAGGED);
+    latency.markHandled(input);
+    m_scene->addStroke(stack, 1,1, cher::EVENT_DRAGGED);
+    QCOMPARE(latency.getNumSamples(), 0u);
+    latency.markFrame();
+    QCOMPARE(latency.getNumSamples(), 2u);
+
+    qInfo("Events which did not append a point are dropped");
+    latency.markHandled(latency.getTime());
+    latency.markFrame();
+    QCOMPARE(latency.getNumSamples(), 2u);
+    m_scene->addStroke(stack, 0,1, cher::EVENT_RELEASED);
+
+    qInfo("Stage latencies are consistent");
+    for (int i=0; i<entity::LatencyMonitor::STAGE_COUNT; ++i){
+        entity::LatencyMonitor::Stage stage = static_cast<entity::LatencyMonitor::Stage>(i);
+        QVERIFY(latency.getPercentile(stage, 0.5) >= 0);
+        QVERIFY(latency.getPercentile(stage, 0.99) >= latency.getPercentile(stage, 0.5));
+        QVERIFY(latency.getPercentile(entity::LatencyMonitor::STAGE_TOTAL, 0.99) >= latency.getPercentile(stage, 0.99));
+    }
+
+    qInfo("Only the last samples are kept");
+    for (unsigned int i=0; i<cher::LATENCY_SAMPLES + 10; ++i){
+        latency.markHandled(latency.getTime());
+        latency.markAppended();
+        latency.markFrame();
+    }
+    QCOMPARE(latency.getNumSamples(), cher::LATENCY_SAMPLES);
+
+    qInfo("Samples are written to file");
+    QString fname = "RW_MainWindowTest_latency.csv";
+    QVERIFY(latency.write(fname.toStdString()));
+    QFile file(fname);
+    QVERIFY(file.open(QIODevice::ReadOnly | QIODevice::Text));
+    int lines = 0;
+    while (!file.atEnd()){
+        file.readLine();
+        ++lines;
+    }
+    QCOMPARE(lines, 1 + entity::LatencyMonitor::STAGE_COUNT + 1 + static_cast<int>(cher::LATENCY_SAMPLES));
+
+    latency.setEnabled(false);
+    QCOMPARE(latency.getNumSamples(), 0u);
+}
+
+void MainWindowTest::testPhotoBaseThumbnails()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QImage image(200, 150, QImage::Format_RGB32);
+    image.fill(Qt::green);
+    QVERIFY(image.save(QDir(dir.path()).filePath("lower.png"), "PNG"));
+    QVERIFY(image.save(QDir(dir.path()).filePath("UPPER.PNG"), "PNG"));
+    QFile broken(QDir(dir.path()).filePath("broken.jpg"));
+    QVERIFY(broken.open(QIODevice::WriteOnly));
+    broken.write("not an image");
+    broken.close();
+    QFile notes(QDir(dir.path()).filePath("notes.txt"));
+    QVERIFY(notes.open(QIODevice::WriteOnly));
+    notes.close();
+
+    QDir cache(PhotoModel::getCacheDirectory());
+    QSet<QString> cached = cache.entryList(QStringList("*.png"), QDir::Files).toSet();
+
+    qInfo("Images are listed regardless of the extension case, the thumbnails are made in background");
+    PhotoModel model;
+    QSignalSpy spy(&model, SIGNAL(thumbnailsLoaded()));
+    model.setRootPath(dir.path());
+    QCOMPARE(model.rowCount(), 3);
+    QVERIFY(spy.wait(10000));
+    QVERIFY(!model.isLoading());
+    model.waitForThumbnails();
+    QStandardItem* lower = model.findItems("lower.png").value(0);
+    QStandardItem* upper = model.findItems("UPPER.PNG").value(0);
+    QStandardItem* bad = model.findItems("broken.jpg").value(0);
+    QVERIFY(lower && upper && bad);
+    QVERIFY(lower->isEnabled());
+    QVERIFY(upper->isEnabled());
+    QVERIFY(!bad->isEnabled());
+
+    qInfo("Thumbnails of the readable images are cached on disk");
+    QSet<QString> added = cache.entryList(QStringList("*.png"), QDir::Files).toSet() - cached;
+    QCOMPARE(added.size(), 2);
+
+    qInfo("The next listing reads the cached thumbnails instead of the images");
+    foreach (const QString& name, added){
+        QImage thumbnail(cache.filePath(name), "PNG");
+        QVERIFY(!thumbnail.isNull());
+        thumbnail.fill(Qt::red);
+        QVERIFY(thumbnail.save(cache.filePath(name), "PNG"));
+    }
+    model.setRootPath(dir.path());
+    QVERIFY(spy.wait(10000));
+    model.waitForThumbnails();
+    lower = model.findItems("lower.png").value(0);
+    QVERIFY(lower);
+    QList<QSize> sizes = lower->icon().availableSizes();
+    QVERIFY(!sizes.isEmpty());
+    QCOMPARE(QColor(lower->icon().pixmap(sizes.first()).toImage().pixel(0, 0)), QColor(Qt::red));
+
+    foreach (const QString& name, added)
+        cache.remove(name);
+}
+
 QTEST_MAIN(MainWindowTest)
 #include "MainWindowTest.moc"
@@ -14,6 +14,9 @@ private slots:
     void testToolsOnOff();
     void testUndoRedoSketch();
     void testUndoRedoCanvasMove();
+    void testRecordReplayEvents();
+    void testSketchLatency();
+    void testPhotoBaseThumbnails();
 };
 
 #endif // MAINWINDOWTEST_H
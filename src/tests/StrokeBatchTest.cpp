@@ -0,0 +1,233 @@
+#include "StrokeBatchTest.h"
+
+#include <cmath>
+
+#include <osg/ref_ptr>
+
+#include "Stroke.h"
+#include "StrokeBatch.h"
+
+const int BENCHMARK_STROKES = 5000;
+
+void StrokeBatchTest::testBatchUpdate()
+{
+    qInfo("Fill the canvas by strokes");
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    QCOMPARE(canvas->getStrokeBatching(), cher::STROKE_BATCHING);
+    QVERIFY(canvas->getStrokeBatch());
+    QVERIFY(canvas->getGeodeStrokes()->getCullCallback() == canvas->getStrokeBatch());
+    entity::Stroke* s0 = this->addStroke(canvas, 0.f, 0.f, 0.2f);
+    entity::Stroke* s1 = this->addStroke(canvas, 1.f, 1.f, 0.2f);
+    entity::Stroke* s2 = this->addStroke(canvas, 2.f, 2.f, 0.2f);
+    QVERIFY(s0 && s1 && s2);
+
+    qInfo("All the shadered strokes are packed one after another");
+    osg::ref_ptr<entity::StrokeBatch> batch = new entity::StrokeBatch;
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+    QVERIFY(!batch->update(canvas->getGeodeStrokes()));
+    QCOMPARE(batch->getNumBatched(), 3u);
+    unsigned int n0 = s0->getNumPoints(), n1 = s1->getNumPoints(), n2 = s2->getNumPoints(); // not changed by moves
+    QCOMPARE(batch->getGeometry()->getVertexArray()->getNumElements(), n0+n1+n2);
+    QVERIFY(this->compareRange(batch.get(), s0, 0));
+    QVERIFY(this->compareRange(batch.get(), s1, n0));
+    QVERIFY(this->compareRange(batch.get(), s2, n0+n1));
+
+    qInfo("Every stroke keeps a single color in the batch");
+    QCOMPARE(static_cast<unsigned int>(batch->getColors()->size()), 3u);
+    QVERIFY(!batch->getGeometry()->getColorArray());
+    s1->setColor(cher::STROKE_CLR_SELECTED);
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+    QCOMPARE(static_cast<unsigned int>(batch->getColors()->size()), 3u);
+    QVERIFY(this->compareRange(batch.get(), s1, n0));
+    s1->setColor(cher::STROKE_CLR_NORMAL);
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+
+    qInfo("Strokes modified in place are copied into their range");
+    const osg::Array* verts1 = s1->getVertexArray();
+    std::vector<entity::Entity2D*> entities(1, s1);
+    canvas->moveEntities(entities, 0.5f, 0.5f);
+    QCOMPARE(s1->getVertexArray(), verts1); // the batch does not make the stroke copy its points
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+    QVERIFY(this->compareRange(batch.get(), s1, n0));
+    QVERIFY(this->compareRange(batch.get(), s2, n0+n1));
+
+    qInfo("Stroke with pending transform is drawn separately");
+    s1->moveDeferred(0.5, 0.5);
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+    QVERIFY(!batch->isBatched(s1));
+    QCOMPARE(batch->getNumBatched(), 2u);
+    QCOMPARE(batch->getGeometry()->getVertexArray()->getNumElements(), n0+n2);
+    QVERIFY(this->compareRange(batch.get(), s2, n0));
+    s1->applyDeferredTransform();
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+    QVERIFY(batch->isBatched(s1));
+    QVERIFY(this->compareRange(batch.get(), s1, n0));
+
+    qInfo("Removed stroke is removed from the batch");
+    QVERIFY(canvas->removeEntity(s0));
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+    QCOMPARE(batch->getNumBatched(), 2u);
+    QCOMPARE(static_cast<unsigned int>(batch->getColors()->size()), 2u);
+    QVERIFY(!batch->isBatched(s0));
+    QVERIFY(this->compareRange(batch.get(), s1, 0));
+    QVERIFY(this->compareRange(batch.get(), s2, n1));
+
+    qInfo("Stroke which is not shadered is never batched");
+    osg::ref_ptr<entity::Stroke> phantom = new entity::Stroke;
+    phantom->initializeProgram(canvas->getProgramStroke());
+    phantom->appendPoint(0.f, 0.f);
+    phantom->appendPoint(0.1f, 0.1f);
+    QVERIFY(!entity::StrokeBatch::isBatchable(phantom.get()));
+
+    qInfo("Batching can be turned off");
+    canvas->setStrokeBatching(false);
+    QVERIFY(!canvas->getStrokeBatching());
+    QVERIFY(!canvas->getStrokeBatch()->getEnabled());
+    canvas->setStrokeBatching(true);
+}
+
+void StrokeBatchTest::testOwnership()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    QVERIFY(this->addStroke(canvas, 0.f, 0.f, 0.2f));
+
+    qInfo("Clone keeps batching setting and gets its own batch");
+    canvas->setStrokeBatching(false);
+    osg::ref_ptr<entity::Canvas> clone = canvas->clone();
+    QVERIFY(clone.get());
+    QVERIFY(clone->getStrokeBatch() != canvas->getStrokeBatch());
+    QCOMPARE(clone->getStrokeBatching(), false);
+    QVERIFY(clone->getGeodeStrokes()->getCullCallback() == clone->getStrokeBatch());
+    canvas->setStrokeBatching(true);
+
+    qInfo("Geode without batch, e.g., from an older file, gets the batch of the canvas");
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    clone->setGeodeStrokes(geode.get());
+    QVERIFY(geode->getCullCallback() == clone->getStrokeBatch());
+
+    qInfo("Geode with batch, e.g., from a file, passes it to the canvas");
+    osg::ref_ptr<osg::Geode> saved = new osg::Geode;
+    osg::ref_ptr<entity::StrokeBatch> batch = new entity::StrokeBatch;
+    saved->setCullCallback(batch.get());
+    clone->setGeodeStrokes(saved.get());
+    QVERIFY(clone->getStrokeBatch() == batch.get());
+}
+
+void StrokeBatchTest::testLevels()
+{
+    qInfo("Coarser levels for smaller projected sizes");
+    QCOMPARE(entity::StrokeBatch::getLevel(2.f * cher::STROKE_LOD_PIXELS), 0u);
+    QCOMPARE(entity::StrokeBatch::getLevel(0.5f * cher::STROKE_LOD_PIXELS), 1u);
+    QCOMPARE(entity::StrokeBatch::getLevel(0.f), cher::STROKE_LOD_LEVELS);
+    unsigned int prev = 0;
+    for (float pixels = 4096.f; pixels > 0.1f; pixels /= 2.f){
+        unsigned int level = entity::StrokeBatch::getLevel(pixels);
+        QVERIFY(level >= prev);
+        prev = level;
+    }
+
+    qInfo("Curvy strokes are simplified");
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    QCOMPARE(canvas->getStrokeLod(), cher::STROKE_LOD);
+    for (int i=0; i<20; ++i){
+        osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+        stroke->initializeProgram(canvas->getProgramStroke());
+        for (int j=0; j<60; ++j){
+            float t = j / 60.f;
+            stroke->appendPoint(t, 0.1f * i + 0.05f * std::sin(6.28f * 4.f * t));
+        }
+        QVERIFY(stroke->redefineToShape(canvas->getTransform()));
+        QVERIFY(canvas->addEntity(stroke.get()));
+        osg::ref_ptr<osg::Vec3Array> simplified = stroke->getSimplified(cher::STROKE_FIT_TOLERANCE * cher::STROKE_LOD_TOLERANCE);
+        if (simplified.get()){
+            QVERIFY(simplified->size() % 4 == 0);
+            QVERIFY(simplified->size() <= stroke->getNumPoints());
+        }
+    }
+
+    osg::ref_ptr<entity::StrokeBatch> batch = new entity::StrokeBatch;
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+    QVERIFY(!batch->updateLevel(0));
+    unsigned int size = batch->getGeometry()->getVertexArray()->getNumElements();
+    for (unsigned int level=1; level<=cher::STROKE_LOD_LEVELS; ++level){
+        QVERIFY(batch->updateLevel(level));
+        QVERIFY(!batch->updateLevel(level));
+        const osg::Geometry* geometry = batch->getGeometry(level);
+        QVERIFY(geometry && geometry != batch->getGeometry());
+        unsigned int n = geometry->getVertexArray()->getNumElements();
+        qInfo() << "level" << level << ": points" << n << "of" << batch->getGeometry()->getVertexArray()->getNumElements();
+        QVERIFY(n > 0 && n % 4 == 0);
+        QVERIFY(n <= size);
+        QVERIFY(!geometry->getColorArray());
+        const osg::Vec3Array* points = static_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+        for (const auto& point : *points)
+            QVERIFY(point.z() >= 0.f && static_cast<unsigned int>(point.z()) < batch->getNumBatched());
+        size = n;
+    }
+    QVERIFY(size < batch->getGeometry()->getVertexArray()->getNumElements());
+
+    qInfo("Levels follow the changes of the full detail");
+    entity::Stroke* s0 = canvas->getStroke(0);
+    QVERIFY(s0);
+    QVERIFY(canvas->removeEntity(s0));
+    QVERIFY(batch->update(canvas->getGeodeStrokes()));
+    QVERIFY(batch->updateLevel(cher::STROKE_LOD_LEVELS));
+    QVERIFY(batch->getGeometry(cher::STROKE_LOD_LEVELS)->getVertexArray()->getNumElements() < size);
+
+    qInfo("Level of detail can be turned off");
+    canvas->setStrokeLod(false);
+    QVERIFY(!canvas->getStrokeBatch()->getLodEnabled());
+    canvas->setStrokeLod(true);
+}
+
+void StrokeBatchTest::benchmarkFrameSeparate()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    this->fillCanvas(canvas, BENCHMARK_STROKES);
+    canvas->setStrokeBatching(false);
+    QBENCHMARK {
+        m_glWidget->grabFramebuffer();
+    }
+    canvas->setStrokeBatching(true);
+}
+
+void StrokeBatchTest::benchmarkFrameBatched()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    this->fillCanvas(canvas, BENCHMARK_STROKES);
+    canvas->setStrokeBatching(true);
+    m_glWidget->grabFramebuffer(); // packs the strokes
+    const entity::StrokeBatch* batch = canvas->getStrokeBatch();
+    QCOMPARE(static_cast<int>(batch->getNumBatched()), BENCHMARK_STROKES);
+    QCOMPARE(static_cast<int>(batch->getColors()->size()), BENCHMARK_STROKES);
+    qInfo() << "packed bytes" << batch->getNumBytes() << "of which colors" << batch->getColors()->getTotalDataSize();
+    QBENCHMARK {
+        m_glWidget->grabFramebuffer();
+    }
+}
+
+bool StrokeBatchTest::compareRange(const entity::StrokeBatch *batch, const entity::Stroke *stroke, unsigned int first) const
+{
+    const osg::Vec3Array* packed = static_cast<const osg::Vec3Array*>(batch->getGeometry()->getVertexArray());
+    const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(stroke->getVertexArray());
+    const osg::Vec4Array* colors = batch->getColors();
+    const osg::Vec4Array* color = static_cast<const osg::Vec4Array*>(stroke->getColorArray());
+    if (!packed || !verts || !colors || !color || first + verts->size() > packed->size()) return false;
+
+    /* the packed z is the index of the stroke color */
+    for (unsigned int i=0; i<verts->size(); ++i){
+        const osg::Vec3f& point = (*packed)[first+i];
+        if (point.x() != (*verts)[i].x() || point.y() != (*verts)[i].y()) return false;
+        unsigned int index = static_cast<unsigned int>(point.z());
+        if (index >= colors->size() || (*colors)[index] != color->front()) return false;
+    }
+    return true;
+}
+
+QTEST_MAIN(StrokeBatchTest)
+#include "StrokeBatchTest.moc"
@@ -0,0 +1,20 @@
+#ifndef STROKEBATCHTEST_H
+#define STROKEBATCHTEST_H
+
+#include "BaseGuiTest.h"
+
+class StrokeBatchTest : public BaseGuiTest
+{
+    Q_OBJECT
+private slots:
+    void testBatchUpdate();
+    void testOwnership();
+    void testLevels();
+    void benchmarkFrameSeparate();
+    void benchmarkFrameBatched();
+
+private:
+    bool compareRange(const entity::StrokeBatch* batch, const entity::Stroke* stroke, unsigned int first) const;
+};
+
+#endif // STROKEBATCHTEST_H
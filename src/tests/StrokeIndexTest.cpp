@@ -0,0 +1,127 @@
+#include "StrokeIndexTest.h"
+
+#include <osg/ref_ptr>
+#include <osgUtil/IntersectionVisitor>
+
+#include "Stroke.h"
+#include "StrokeIndex.h"
+#include "StrokeIntersector.h"
+
+const int BENCHMARK_STROKES = 5000;
+
+void StrokeIndexTest::testIndexUpdate()
+{
+    qInfo("Fill the canvas by strokes");
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    entity::Stroke* s0 = this->addStroke(canvas, 0.f, 0.f, 0.2f);
+    entity::Stroke* s1 = this->addStroke(canvas, 2.f, 2.f, 0.2f);
+    QVERIFY(s0 && s1);
+
+    qInfo("Index is re-built on the first request");
+    const entity::StrokeIndex* index = canvas->getStrokeIndex();
+    QVERIFY(index);
+    QVERIFY(index->isValid());
+    QCOMPARE(static_cast<int>(index->getNumStrokes()), 2);
+
+    qInfo("Index is updated by addEntity()");
+    entity::Stroke* s2 = this->addStroke(canvas, -2.f, 1.f, 0.2f);
+    QVERIFY(s2);
+    QCOMPARE(static_cast<int>(index->getNumStrokes()), 3);
+
+    std::unordered_map<const entity::Stroke*, std::vector<unsigned int> > result;
+    QVERIFY(index->query(osg::Vec3f(2.1f, 2.1f, 0.f), 0.05f, result));
+    QVERIFY(result.find(s1) != result.end());
+    QVERIFY(result.find(s0) == result.end());
+
+    qInfo("Index is updated by moveEntities()");
+    std::vector<entity::Entity2D*> entities(1, s1);
+    canvas->moveEntities(entities, 5.f, 5.f);
+    QVERIFY(index->query(osg::Vec3f(2.1f, 2.1f, 0.f), 0.05f, result));
+    QVERIFY(result.find(s1) == result.end());
+    QVERIFY(index->query(osg::Vec3f(7.1f, 7.1f, 0.f), 0.05f, result));
+    QVERIFY(result.find(s1) != result.end());
+
+    qInfo("Index is updated by removeEntity()");
+    QVERIFY(canvas->removeEntity(s1));
+    QCOMPARE(static_cast<int>(index->getNumStrokes()), 2);
+    QVERIFY(index->query(osg::Vec3f(7.1f, 7.1f, 0.f), 0.05f, result));
+    QVERIFY(result.empty());
+}
+
+void StrokeIndexTest::testPicking()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    this->fillCanvas(canvas, 400);
+
+    qInfo("Compare indexed picking against linear search");
+    for (int i=0; i<20; ++i){
+        for (int j=0; j<20; ++j){
+            float u = 0.25f * i, v = 0.25f * j; // first point of a stroke
+            int linear = this->pick(canvas, u, v, false);
+            int indexed = this->pick(canvas, u, v, true);
+            QVERIFY(linear > 0);
+            QVERIFY(indexed > 0);
+            QCOMPARE(indexed, linear);
+        }
+    }
+
+    qInfo("Long straight stroke is hit only by its segment under the ray");
+    osg::ref_ptr<entity::Stroke> line = new entity::Stroke;
+    line->initializeProgram(canvas->getProgramStroke());
+    for (int i=0; i<=32; ++i)
+        line->appendPoint(-8.f + 0.5f*i, -1.f);
+    QVERIFY(canvas->addEntity(line.get()));
+    QCOMPARE(this->pick(canvas, 0.25f, -1.f, false), 1);
+    QCOMPARE(this->pick(canvas, 0.25f, -1.f, true), 1);
+
+    qInfo("Empty area has no hits");
+    QCOMPARE(this->pick(canvas, -3.f, -3.f, true), 0);
+}
+
+void StrokeIndexTest::benchmarkPickingLinear()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    this->fillCanvas(canvas, BENCHMARK_STROKES);
+    QBENCHMARK {
+        this->pick(canvas, 1.f, 1.f, false);
+    }
+}
+
+void StrokeIndexTest::benchmarkPickingIndexed()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    this->fillCanvas(canvas, BENCHMARK_STROKES);
+    QVERIFY(canvas->getStrokeIndex());
+    QBENCHMARK {
+        this->pick(canvas, 1.f, 1.f, true);
+    }
+}
+
+int StrokeIndexTest::pick(entity::Canvas *canvas, float u, float v, bool useIndex)
+{
+    std::vector<osg::Vec3d> ray = this->getRay(canvas, u, v);
+    osg::ref_ptr<StrokeIntersector> intersector = new StrokeIntersector(osgUtil::Intersector::MODEL, ray[0], ray[1]);
+    intersector->setUseIndex(useIndex);
+    osgUtil::IntersectionVisitor iv(intersector.get());
+    canvas->accept(iv);
+    return static_cast<int>(intersector->getIntersections().size());
+}
+
+std::vector<osg::Vec3d> StrokeIndexTest::getRay(entity::Canvas *canvas, float u, float v) const
+{
+    /* the ray is slightly tilted with respect to the canvas normal */
+    osg::Matrix M = canvas->getTransform()->getMatrix();
+    osg::Vec3d P = osg::Vec3d(u, v, 0) * M;
+    osg::Vec3d dir = osg::Vec3d(0.1, 0.1, 1) * osg::Matrix::rotate(M.getRotate());
+    std::vector<osg::Vec3d> ray(2);
+    ray[0] = P + dir * 10;
+    ray[1] = P - dir * 10;
+    return ray;
+}
+
+QTEST_MAIN(StrokeIndexTest)
+#include "StrokeIndexTest.moc"
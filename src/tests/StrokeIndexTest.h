@@ -0,0 +1,24 @@
+#ifndef STROKEINDEXTEST_H
+#define STROKEINDEXTEST_H
+
+#include <vector>
+
+#include <osg/Vec3d>
+
+#include "BaseGuiTest.h"
+
+class StrokeIndexTest : public BaseGuiTest
+{
+    Q_OBJECT
+private slots:
+    void testIndexUpdate();
+    void testPicking();
+    void benchmarkPickingLinear();
+    void benchmarkPickingIndexed();
+
+private:
+    int pick(entity::Canvas* canvas, float u, float v, bool useIndex);
+    std::vector<osg::Vec3d> getRay(entity::Canvas* canvas, float u, float v) const;
+};
+
+#endif // STROKEINDEXTEST_H
@@ -7,7 +7,11 @@
 #include <osg/Camera>
 #include <osg/Program>
 
+#include <cmath>
+#include <vector>
+
 #include "Stroke.h"
+#include "StrokeBatch.h"
 
 void StrokeTest::testAddStroke()
 {
@@ -26,7 +30,7 @@ void StrokeTest::testAddStroke()
     QCOMPARE(stroke->getColor(), cher::STROKE_CLR_NORMAL);
     QVERIFY(stroke->getLines());
     QCOMPARE(static_cast<int>(stroke->getLines()->getMode()), GL_LINE_STRIP);
-    QCOMPARE(stroke->getColorBinding(), osg::Geometry::BIND_PER_VERTEX);
+    QCOMPARE(stroke->getColorBinding(), osg::Geometry::BIND_OVERALL);
 
     qInfo("Add a phantom to the current canvas");
     m_canvas2->setStrokeCurrent(stroke.get());
@@ -327,6 +331,228 @@ void StrokeTest::testCopyPaste()
     QCOMPARE(pasted2->getProgram()->getIsFogged(), this->m_actionStrokeFogFactor->isChecked());
 }
 
+void StrokeTest::testCopyOnWrite()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+
+    qInfo("Create a shadered stroke");
+    osg::ref_ptr<entity::Stroke> original = new entity::Stroke;
+    original->initializeProgram(canvas->getProgramStroke());
+    original->appendPoint(0, 0);
+    original->appendPoint(0.2, 0.2);
+    original->appendPoint(0.4, 0.4);
+    original->appendPoint(0.8, 0.9);
+    QVERIFY(original->redefineToShape(canvas->getTransform()));
+    QVERIFY(canvas->addEntity(original.get()));
+
+    qInfo("The copy shares the arrays of the original");
+    osg::ref_ptr<entity::Stroke> copy = new entity::Stroke;
+    QVERIFY(copy->copyFrom(original.get()));
+    QVERIFY(copy->getIsShadered());
+    QCOMPARE(copy->getVertexArray(), original->getVertexArray());
+    QCOMPARE(copy->getColorArray(), original->getColorArray());
+    QCOMPARE(copy->getVertexAttribArray(0), original->getVertexArray());
+    QCOMPARE(copy->getNumPoints(), original->getNumPoints());
+    QVERIFY(copy->getLines() != original->getLines());
+
+    qInfo("Editing of the copy detaches its points only");
+    const osg::Array* shared = original->getVertexArray();
+    osg::Vec2f p0 = original->getPoint(0);
+    copy->moveDelta(0.2, 0.2);
+    QVERIFY(original->getVertexArray() == shared);
+    QVERIFY(copy->getVertexArray() != shared);
+    QCOMPARE(copy->getVertexAttribArray(0), copy->getVertexArray());
+    QCOMPARE(copy->getColorArray(), original->getColorArray());
+    QCOMPARE(original->getPoint(0), p0);
+    osg::Vec2f delta = copy->getPoint(0) - p0 - osg::Vec2f(0.2, 0.2);
+    QVERIFY(std::fabs(delta.x()) < cher::EPSILON);
+    QVERIFY(std::fabs(delta.y()) < cher::EPSILON);
+
+    qInfo("Re-coloring of the copy detaches its colors");
+    copy->setColor(solarized::cyan);
+    QVERIFY(copy->getColorArray() != original->getColorArray());
+    QCOMPARE(copy->getVertexAttribArray(1), copy->getColorArray());
+    const osg::Vec4Array* colors = static_cast<const osg::Vec4Array*>(original->getColorArray());
+    QCOMPARE(colors->at(0), original->getColor());
+
+    qInfo("Arrays which are not shared are edited in place, even if referenced from outside");
+    osg::ref_ptr<const osg::Array> external = original->getVertexArray();
+    original->moveDelta(0.1, 0.1);
+    QVERIFY(original->getVertexArray() == shared);
+    QVERIFY(canvas->removeEntity(original.get()));
+}
+
+void StrokeTest::testDeferredTransform()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+
+    qInfo("Create a shadered stroke");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(canvas->getProgramStroke());
+    stroke->appendPoint(0, 0);
+    stroke->appendPoint(0.2, 0.2);
+    stroke->appendPoint(0.4, 0.4);
+    stroke->appendPoint(0.8, 0.9);
+    QVERIFY(stroke->redefineToShape(canvas->getTransform()));
+    QVERIFY(canvas->addEntity(stroke.get()));
+    osg::Vec2f p0 = stroke->getPoint(0);
+    osg::BoundingBox bb0 = stroke->getBoundingBox();
+
+    qInfo("Dragging the selection leaves the vertices as they are");
+    canvas->addEntitySelected(stroke.get());
+    canvas->moveEntitiesSelected(0.5, 0.25);
+    canvas->moveEntitiesSelected(0.5, 0.25);
+    QCOMPARE(stroke->getPoint(0), p0);
+    QVERIFY(!stroke->getDeferredTransform().isIdentity());
+    QVERIFY(stroke->getStateSet()->getUniform("EntityMatrix"));
+
+    qInfo("The bounding box follows the pending transform");
+    osg::BoundingBox bb = stroke->getBoundingBox();
+    QVERIFY(std::fabs(bb.xMin() - bb0.xMin() - 1.f) < cher::EPSILON);
+    QVERIFY(std::fabs(bb.yMax() - bb0.yMax() - 0.5f) < cher::EPSILON);
+
+    qInfo("Committing the reverted drag drops the round-off of the transform");
+    canvas->rotateEntitiesSelected(0.3);
+    canvas->rotateEntitiesSelected(-0.3);
+    canvas->moveEntitiesSelected(-1, -0.5);
+    std::vector<entity::Entity2D*> entities(1, stroke.get());
+    canvas->moveEntities(entities, 1, 0.5);
+    QVERIFY(stroke->getDeferredTransform().isIdentity());
+    QVERIFY(!stroke->getStateSet()->getUniform("EntityMatrix"));
+    osg::Vec2f d = stroke->getPoint(0) - p0 - osg::Vec2f(1, 0.5);
+    QVERIFY(std::fabs(d.x()) < cher::EPSILON);
+    QVERIFY(std::fabs(d.y()) < cher::EPSILON);
+
+    qInfo("Applying the transform bakes it into the vertices");
+    osg::Vec2f p1 = stroke->getPoint(1);
+    stroke->rotateDeferred(cher::PI*0.5, osg::Vec3f(0,0,0));
+    stroke->scaleDeferred(2, 2, osg::Vec3f(0,0,0));
+    QCOMPARE(stroke->getPoint(1), p1);
+    stroke->applyDeferredTransform();
+    QVERIFY(stroke->getDeferredTransform().isIdentity());
+    osg::Vec2f q = stroke->getPoint(1);
+    QVERIFY(std::fabs(q.x() + 2*p1.y()) < cher::EPSILON);
+    QVERIFY(std::fabs(q.y() - 2*p1.x()) < cher::EPSILON);
+
+    canvas->unselectAll();
+    QVERIFY(canvas->removeEntity(stroke.get()));
+}
+
+void StrokeTest::testColorOverall()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+
+    qInfo("Stroke keeps a single color for all of its points");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(canvas->getProgramStroke());
+    stroke->appendPoint(0, 0);
+    stroke->appendPoint(0.2, 0.2);
+    stroke->appendPoint(0.4, 0.4);
+    stroke->appendPoint(0.8, 0.9);
+    QCOMPARE(static_cast<int>(stroke->getColorArray()->getNumElements()), 1);
+    QVERIFY(stroke->redefineToShape(canvas->getTransform()));
+    QVERIFY(canvas->addEntity(stroke.get()));
+    QVERIFY(stroke->getNumPoints() >= 4);
+    const osg::Vec4Array* colors = static_cast<const osg::Vec4Array*>(stroke->getColorArray());
+    QCOMPARE(static_cast<int>(colors->size()), 1);
+    QCOMPARE(colors->getBinding(), osg::Array::BIND_OVERALL);
+    QCOMPARE(stroke->getVertexAttribArray(1), stroke->getColorArray());
+
+    qInfo("Highlighting re-writes a single color");
+    unsigned int modified = colors->getModifiedCount();
+    stroke->setColor(cher::STROKE_CLR_SELECTED);
+    QVERIFY(stroke->getColorArray() == colors);
+    QCOMPARE(static_cast<int>(colors->size()), 1);
+    QCOMPARE(colors->front(), cher::STROKE_CLR_SELECTED);
+    QCOMPARE(colors->getModifiedCount(), modified+1);
+    QVERIFY(entity::StrokeBatch::isBatchable(stroke.get()));
+
+    qInfo("Colors per vertex, e.g., from an older file, are compacted once shadered");
+    osg::ref_ptr<entity::Stroke> old = new entity::Stroke;
+    old->initializeProgram(canvas->getProgramStroke());
+    old->appendPoint(0, 0);
+    old->appendPoint(0.2, 0.2);
+    old->appendPoint(0.4, 0.4);
+    old->appendPoint(0.8, 0.9);
+    old->setColorArray(new osg::Vec4Array(old->getNumPoints()), osg::Array::BIND_PER_VERTEX);
+    old->setColor(solarized::cyan);
+    QVERIFY(old->redefineToShape(canvas->getTransform()));
+    colors = static_cast<const osg::Vec4Array*>(old->getColorArray());
+    QCOMPARE(static_cast<int>(colors->size()), 1);
+    QCOMPARE(colors->getBinding(), osg::Array::BIND_OVERALL);
+    QCOMPARE(colors->front(), solarized::cyan);
+    QCOMPARE(old->getVertexAttribArray(1), old->getColorArray());
+    QVERIFY(canvas->removeEntity(stroke.get()));
+}
+
+void StrokeTest::testAdaptiveTessellation()
+{
+    qInfo("Fixed number of segments when the tessellation is off");
+    osg::Vec2f a(0,0), b(10,20), c(30,20), d(40,0);
+    QCOMPARE(ProgramStroke::getSegmentsNumber(a, b, c, d, 0.f), cher::STROKE_SEGMENTS_NUMBER);
+
+    qInfo("Straight and sub-pixel curves");
+    QCOMPARE(ProgramStroke::getSegmentsNumber(osg::Vec2f(0,0), osg::Vec2f(100,0), osg::Vec2f(200,0), osg::Vec2f(300,0)),
+             cher::STROKE_SEGMENTS_MIN);
+    QCOMPARE(ProgramStroke::getSegmentsNumber(a*0.001f, b*0.001f, c*0.001f, d*0.001f), 1);
+
+    qInfo("Long stroke of sub-pixel curves keeps all of its curves");
+    int segments = 0;
+    for (int i=0; i<1000; ++i){
+        osg::Vec2f p0(0.1f*i, 0.f);
+        segments += ProgramStroke::getSegmentsNumber(p0, p0 + osg::Vec2f(0.03f,0), p0 + osg::Vec2f(0.06f,0),
+                                                     p0 + osg::Vec2f(0.1f,0));
+    }
+    QCOMPARE(segments, 1000);
+
+    qInfo("Number of segments grows with the screen size of the curve");
+    int prev = 0;
+    for (float scale = 0.1f; scale < 100.f; scale *= 2.f){
+        int n = ProgramStroke::getSegmentsNumber(a*scale, b*scale, c*scale, d*scale);
+        QVERIFY(n >= prev);
+        QVERIFY(n <= cher::STROKE_SEGMENTS_MAX);
+        prev = n;
+    }
+    QCOMPARE(prev, cher::STROKE_SEGMENTS_MAX);
+
+    qInfo("Benchmark scene: curvy strokes seen from different distances");
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    std::vector< osg::ref_ptr<entity::Stroke> > strokes;
+    for (int i=0; i<100; ++i){
+        osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+        stroke->initializeProgram(canvas->getProgramStroke());
+        for (int j=0; j<50; ++j){
+            float t = 0.02f * j;
+            stroke->appendPoint(t + 0.01f*i, 0.2f * std::sin(6.28f * t * (1 + i%5)));
+        }
+        QVERIFY(stroke->redefineToShape(canvas->getTransform()));
+        strokes.push_back(stroke);
+    }
+
+    /* one segment is drawn as a triangle strip of 4 vertices, see drawSegment() in Stroke.geom */
+    const int zoom[] = {2000, 500, 100, 20, 4};
+    for (int pixels : zoom){
+        int fixed = 0, adaptive = 0;
+        for (const auto& stroke : strokes){
+            const osg::Vec3Array* pts = static_cast<const osg::Vec3Array*>(stroke->getVertexArray());
+            QVERIFY(pts->size() % 4 == 0);
+            for (unsigned int k=0; k<pts->size(); k+=4){
+                osg::Vec2f p[4];
+                for (int m=0; m<4; ++m)
+                    p[m] = osg::Vec2f((*pts)[k+m].x(), (*pts)[k+m].y()) * float(pixels);
+                fixed += 4 * ProgramStroke::getSegmentsNumber(p[0], p[1], p[2], p[3], 0.f);
+                adaptive += 4 * ProgramStroke::getSegmentsNumber(p[0], p[1], p[2], p[3]);
+            }
+        }
+        qInfo() << "Canvas unit of" << pixels << "pixels: fixed vertices" << fixed << ", adaptive vertices" << adaptive;
+        if (pixels <= 100) QVERIFY(adaptive < fixed);
+    }
+}
+
 void StrokeTest::testFogSwitch()
 {
     qInfo("Add couple strokes to the scene");
@@ -368,5 +594,58 @@ void StrokeTest::testFogSwitch()
     QCOMPARE(s2->getProgram()->getIsFogged(), this->m_actionStrokeFogFactor->isChecked());
 }
 
+void StrokeTest::testFitOnline()
+{
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+
+    qInfo("Create a phantom stroke with online fitting");
+    osg::ref_ptr<entity::Stroke> phantom = new entity::Stroke;
+    phantom->initializeProgram(canvas->getProgramStroke());
+    phantom->setFitOnline(true);
+    QVERIFY(phantom->getFitOnline());
+    canvas->setStrokeCurrent(phantom.get());
+    QVERIFY(canvas->addEntity(phantom.get()));
+
+    qInfo("Append the points of a long wavy stroke");
+    const int n = 500;
+    for (int i=0; i<n; ++i){
+        float u = 0.01f * i;
+        phantom->appendPoint(u, 0.3f * std::sin(u * 3.f));
+        if (i > 0){
+            QVERIFY(phantom->getIsCurved());
+            QCOMPARE(phantom->getNumPoints() % 4, 0);
+        }
+    }
+
+    qInfo("Phantom is already shadered and its curve ends at the last point");
+    QVERIFY(phantom->getIsShadered());
+    QCOMPARE(static_cast<int>(phantom->getLines()->getMode()), GL_LINES_ADJACENCY_EXT);
+    osg::Vec2f last = phantom->getPoint(phantom->getNumPoints()-1);
+    QVERIFY(std::fabs(last.x() - 0.01f * (n-1)) < 0.001f);
+    osg::Vec2f first = phantom->getPoint(0);
+    QVERIFY(std::fabs(first.x()) < 0.001f);
+
+    qInfo("Consecutive segments meet with the same tangent, also where the tail was frozen");
+    QVERIFY(phantom->getNumPoints() > 8);
+    for (int k=4; k+1<phantom->getNumPoints(); k+=4){
+        QVERIFY((phantom->getPoint(k) - phantom->getPoint(k-1)).length() < 0.001f);
+        osg::Vec2f tEnd = phantom->getPoint(k-1) - phantom->getPoint(k-2);
+        osg::Vec2f tStart = phantom->getPoint(k+1) - phantom->getPoint(k);
+        if (tEnd.normalize() == 0 || tStart.normalize() == 0) continue;
+        QVERIFY(tEnd * tStart > 0.999f);
+    }
+
+    qInfo("Finish the stroke as UserScene does: the copy does not need re-fitting");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    QVERIFY(stroke->copyFrom(phantom.get()));
+    QVERIFY(stroke->getIsCurved());
+    QVERIFY(stroke->getIsShadered());
+    QCOMPARE(stroke->getNumPoints(), phantom->getNumPoints());
+    QVERIFY(canvas->addEntity(stroke.get()));
+    QVERIFY(canvas->removeEntity(phantom.get()));
+    canvas->setStrokeCurrent(false);
+}
+
 QTEST_MAIN(StrokeTest)
 #include "StrokeTest.moc"
@@ -11,7 +11,12 @@ private slots:
     void testCloneShaderedStroke();
     void testReadWrite();
     void testCopyPaste();
+    void testCopyOnWrite();
+    void testDeferredTransform();
+    void testColorOverall();
+    void testAdaptiveTessellation();
     void testFogSwitch();
+    void testFitOnline();
 
 private:
 
@@ -1,5 +1,18 @@
 #include "UserSceneTest.h"
 
+#include <cmath>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSignalSpy>
+
+#include "Photo.h"
+#include "PhotoStore.h"
+#include "PhotoPyramid.h"
+#include "SceneAutosave.h"
+#include "SceneGenerator.h"
+
 
 void UserSceneTest::testWriteReadCanvases()
 {
@@ -120,5 +133,543 @@ void UserSceneTest::testWriteReadBookmarks()
     QCOMPARE(m_bookmarkWidget->count(), 1);
 }
 
+void UserSceneTest::testWriteReadChunked()
+{
+    /* canvas0 gets a stroke and a photo */
+    m_scene->setCanvasCurrent(m_canvas0.get());
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(m_canvas0->getProgramStroke());
+    QVERIFY(m_canvas0->addEntity(stroke.get()));
+    stroke->appendPoint(0, 0);
+    stroke->appendPoint(1, 0);
+    stroke->appendPoint(1, 1);
+    stroke->appendPoint(0, 1);
+    QVERIFY(stroke->redefineToShape());
+    int n0 = stroke->getNumPoints();
+    osg::ref_ptr<osg::Vec3Array> points0 = new osg::Vec3Array(*static_cast<const osg::Vec3Array*>(stroke->getVertexArray()));
+    QString filename_photo = "../../samples/ds-32.bmp";
+    m_rootScene->addPhoto(filename_photo.toStdString());
+    QCOMPARE(static_cast<int>(m_canvas0->getNumPhotos()), 1);
+    osg::Matrix R = m_canvas0->getMatrixRotation();
+    osg::Matrix T = m_canvas0->getMatrixTranslation();
+    std::string name = m_canvas0->getName();
+
+    /* write scene in native format */
+    QString filename = "RW_UserSceneTest_chunked.cher";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    QVERIFY(m_rootScene->isSavedToFile());
+    QVERIFY(entity::SceneChunkFile::isChunkFile(filename.toStdString()));
+    this->onFileClose();
+
+    /* only the current and previous canvases are read on load */
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    m_scene = m_rootScene->getUserScene();
+    QVERIFY(m_scene.get());
+    QCOMPARE(static_cast<int>(m_scene->getNumCanvases()), 3);
+    QCOMPARE(m_canvasWidget->topLevelItemCount(), 3);
+    m_canvas0 = m_scene->getCanvas(0);
+    QVERIFY(m_canvas0.get());
+    QCOMPARE(m_scene->getNumCanvasesPending(), 1);
+    QVERIFY(m_scene->isCanvasPending(m_canvas0.get()));
+    QVERIFY(!m_scene->isCanvasPending(m_scene->getCanvasCurrent()));
+    QVERIFY(!m_scene->isCanvasPending(m_scene->getCanvasPrevious()));
+    QCOMPARE(static_cast<int>(m_canvas0->getNumStrokes()), 0);
+    QCOMPARE(m_canvas0->getName(), name);
+    QVERIFY(m_canvas0->getMatrixRotation() == R);
+    QVERIFY(m_canvas0->getMatrixTranslation() == T);
+
+    /* content is read on demand */
+    QVERIFY(m_scene->materializeCanvas(m_canvas0.get()));
+    QCOMPARE(m_scene->getNumCanvasesPending(), 0);
+    QCOMPARE(static_cast<int>(m_canvas0->getNumStrokes()), 1);
+    QCOMPARE(static_cast<int>(m_canvas0->getNumPhotos()), 1);
+    entity::Stroke* saved = m_canvas0->getStroke(0);
+    QVERIFY(saved);
+    QVERIFY(saved->getIsCurved());
+    QVERIFY(saved->getIsShadered());
+    QCOMPARE(saved->getNumPoints(), n0);
+    QCOMPARE(saved->getProgram()->getTransform(), m_canvas0->getTransform());
+    QCOMPARE(static_cast<int>(saved->getLines()->getMode()), GL_LINES_ADJACENCY_EXT);
+    const osg::Vec3Array* points = static_cast<const osg::Vec3Array*>(saved->getVertexArray());
+    for (int i=0; i<n0; ++i)
+        QVERIFY(((*points)[i] - (*points0)[i]).length() < 1e-3f);
+
+    /* photo images are decoded in background and set to the shared texture once ready */
+    m_scene->waitForPhotos();
+    QCOMPARE(m_scene->getNumPhotosPending(), 0);
+    QVERIFY(m_canvas0->getPhoto(0)->getTexture()->getImage());
+    QVERIFY(m_canvas0->getPhoto(0)->getTexture()->getImage()->data());
+}
+
+void UserSceneTest::testRejectOtherVersions()
+{
+    QString filename = "RW_UserSceneTest_version.cher";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    QFile file(filename);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QByteArray data = file.readAll();
+    file.close();
+    osg::ref_ptr<entity::SceneChunkFile> archive = new entity::SceneChunkFile;
+    QVERIFY(archive->open(filename.toStdString()));
+    archive->close();
+
+    qInfo("Files of any other format version are rejected, the version follows the magic number");
+    unsigned int versions[2] = {0, cher::SCENE_CHUNK_VERSION + 1};
+    for (unsigned int version : versions){
+        QByteArray patched = data;
+        patched.replace(4, sizeof(unsigned int), reinterpret_cast<const char*>(&version), sizeof(unsigned int));
+        QString other = QString("RW_UserSceneTest_version%1.cher").arg(version);
+        QFile out(other);
+        QVERIFY(out.open(QIODevice::WriteOnly));
+        QCOMPARE(out.write(patched), static_cast<qint64>(patched.size()));
+        out.close();
+        QVERIFY(entity::SceneChunkFile::isChunkFile(other.toStdString()));
+        QVERIFY(!archive->open(other.toStdString()));
+        QVERIFY(!archive->isOpen());
+    }
+}
+
+void UserSceneTest::testPointEncoding()
+{
+    /* control points of a wavy stroke over a few canvas units */
+    osg::ref_ptr<osg::Vec3Array> points = new osg::Vec3Array;
+    for (int i=0; i<4000; ++i)
+        points->push_back(osg::Vec3f(0.001f*i - 1.f, 0.5f*std::sin(0.01f*i), 0.f));
+    const float tolerance = 2.f / cher::SCENE_CHUNK_QUANTIZATION;
+
+    qInfo("Points are encoded into about 4 bytes each");
+    QByteArray buffer;
+    entity::SceneChunkFile::encodePoints(buffer, points.get());
+    QCOMPARE(buffer.size() % 4, 0);
+    QVERIFY(buffer.size() * 3 < static_cast<int>(points->size() * sizeof(osg::Vec3f)));
+    qInfo() << "encoded bytes per point=" << double(buffer.size()) / points->size();
+
+    qInfo("Decoded points are within quantization error, box corners are exact");
+    osg::ref_ptr<osg::Vec3Array> decoded = new osg::Vec3Array;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(buffer.constData());
+    QVERIFY(entity::SceneChunkFile::decodePoints(data, buffer.size(), points->size(), decoded.get()));
+    QCOMPARE(decoded->size(), points->size());
+    for (unsigned int i=0; i<points->size(); ++i){
+        QVERIFY(std::fabs((*decoded)[i].x() - (*points)[i].x()) <= tolerance);
+        QVERIFY(std::fabs((*decoded)[i].y() - (*points)[i].y()) <= tolerance);
+        QCOMPARE((*decoded)[i].z(), 0.f);
+    }
+    QCOMPARE(decoded->front().x(), points->front().x());
+    QCOMPARE(decoded->back().x(), points->back().x());
+
+    qInfo("Truncated or mismatching records are rejected");
+    QVERIFY(!entity::SceneChunkFile::decodePoints(data, buffer.size() / 2, points->size(), decoded.get()));
+    QVERIFY(!entity::SceneChunkFile::decodePoints(data, buffer.size(), points->size() + 1, decoded.get()));
+    QVERIFY(!entity::SceneChunkFile::decodePoints(data, buffer.size(), points->size() - 1, decoded.get()));
+
+    qInfo("Degenerate box is encoded as well");
+    osg::ref_ptr<osg::Vec3Array> single = new osg::Vec3Array(1, osg::Vec3f(0.3f, -0.2f, 0.f));
+    QByteArray small;
+    entity::SceneChunkFile::encodePoints(small, single.get());
+    QVERIFY(entity::SceneChunkFile::decodePoints(reinterpret_cast<const unsigned char*>(small.constData()),
+                                                 small.size(), 1, decoded.get()));
+    QCOMPARE(decoded->front(), single->front());
+}
+
+void UserSceneTest::testWriteIncremental()
+{
+    QString filename = "RW_UserSceneTest_journal.cher";
+    QFile::remove(filename);
+
+    /* the first save writes every canvas */
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_canvas0->isDirty());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    entity::SceneChunkFile* archive = m_scene->getArchive();
+    QVERIFY(archive);
+    QVERIFY(!m_canvas0->isDirty());
+    QVERIFY(!m_canvas1->isDirty());
+    QVERIFY(!m_canvas2->isDirty());
+    QCOMPARE(archive->getSize(), static_cast<unsigned long long>(QFileInfo(filename).size()));
+    unsigned int chunks = archive->getNumChunks();
+
+    /* a photo added by command makes only its canvas dirty */
+    QString filename_photo = "../../samples/ds-32.bmp";
+    m_scene->setCanvasCurrent(m_canvas1.get());
+    m_rootScene->addPhoto(filename_photo.toStdString());
+    QVERIFY(!m_canvas0->isDirty());
+    QVERIFY(m_canvas1->isDirty());
+
+    /* and the next save appends the photo, the canvas and the scene chunks only */
+    QVERIFY(m_rootScene->writeScenetoFile());
+    QCOMPARE(m_scene->getArchive(), archive);
+    QCOMPARE(archive->getNumChunks(), chunks + 3);
+    QVERIFY(archive->getSizeFree() > 0);
+    QVERIFY(!m_canvas1->isDirty());
+
+    /* a save without changes re-writes the scene chunk only */
+    chunks = archive->getNumChunks();
+    QVERIFY(m_rootScene->writeScenetoFile());
+    QCOMPARE(archive->getNumChunks(), chunks + 1);
+    QCOMPARE(archive->getSize(), static_cast<unsigned long long>(QFileInfo(filename).size()));
+    this->onFileClose();
+
+    /* the appended file reads as a whole */
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    m_scene = m_rootScene->getUserScene();
+    QVERIFY(m_scene.get());
+    QCOMPARE(static_cast<int>(m_scene->getNumCanvases()), 3);
+    QVERIFY(m_scene->materializeCanvases());
+    QCOMPARE(static_cast<int>(m_scene->getCanvas(1)->getNumPhotos()), 1);
+    QCOMPARE(static_cast<int>(m_scene->getCanvas(0)->getNumPhotos()), 0);
+    QVERIFY(!m_scene->getCanvas(1)->isDirty());
+
+    /* the blob of a removed photo is freed, and it is most of the file */
+    archive = m_scene->getArchive();
+    QVERIFY(archive);
+    entity::Canvas* cnv = m_scene->getCanvas(1);
+    QVERIFY(cnv->removeEntity(cnv->getPhoto(0)));
+    cnv->setDirty(true);
+    QVERIFY(m_rootScene->writeScenetoFile());
+    QCOMPARE(m_scene->getArchive(), archive);
+    unsigned long long free = archive->getSizeFree();
+    QVERIFY(free > cher::SCENE_CHUNK_GARBAGE * archive->getSize());
+
+    /* so that the next save re-writes the whole file */
+    QVERIFY(m_rootScene->writeScenetoFile());
+    QVERIFY(archive->getSizeFree() < free);
+    QVERIFY(archive->getSize() < free);
+    QCOMPARE(archive->getSize(), static_cast<unsigned long long>(QFileInfo(filename).size()));
+}
+
+void UserSceneTest::testAutosave()
+{
+    QString filename = "RW_UserSceneTest_autosave.cher";
+    m_rootScene->setFilePath(filename.toStdString());
+    entity::SceneAutosave autosave(m_rootScene.get());
+    QString path = QString::fromStdString(autosave.getFilePath());
+    QCOMPARE(path, QString("RW_UserSceneTest_autosave.autosave.cher"));
+    QFile::remove(path);
+
+    /* the snapshot is written in background and does not touch the dirty state */
+    QSignalSpy spy(&autosave, SIGNAL(autosaved(QString,int,int)));
+    QVERIFY(autosave.autosave());
+    QVERIFY(spy.wait(10000));
+    QVERIFY(!autosave.isRunning());
+    QVERIFY(QFileInfo(path).exists());
+    QVERIFY(entity::SceneChunkFile::isChunkFile(path.toStdString()));
+    QVERIFY(m_canvas0->isDirty());
+
+    /* nothing is written until the scene changes */
+    QVERIFY(!autosave.autosave());
+    QString filename_photo = "../../samples/ds-32.bmp";
+    m_scene->setCanvasCurrent(m_canvas1.get());
+    m_rootScene->addPhoto(filename_photo.toStdString());
+    QVERIFY(autosave.autosave());
+    QVERIFY(spy.wait(10000));
+    QCOMPARE(spy.count(), 2);
+
+    /* canvases are compared by revision rather than by content */
+    QVERIFY(!autosave.autosave());
+    m_canvas2->setDirty(true);
+    QVERIFY(autosave.autosave());
+    QVERIFY(spy.wait(10000));
+    QCOMPARE(spy.count(), 3);
+
+    /* the autosave file reads as a regular scene */
+    osg::ref_ptr<entity::SceneChunkFile> archive = new entity::SceneChunkFile;
+    QVERIFY(archive->open(path.toStdString()));
+    osg::ref_ptr<entity::UserScene> scene = archive->readScene();
+    QVERIFY(scene.get());
+    QCOMPARE(static_cast<int>(scene->getNumCanvases()), 3);
+    archive->close();
+
+    /* and is removed once the scene is saved */
+    autosave.discard();
+    QVERIFY(!QFileInfo(path).exists());
+}
+
+void UserSceneTest::testPhotoStore()
+{
+    QString filename = "RW_UserSceneTest_store.osgt";
+    QDir store(QString::fromStdString(entity::PhotoStore::getStoreDirectory(filename.toStdString())));
+    store.removeRecursively();
+
+    /* the same image on two canvases shares the texture */
+    QString filename_photo = "../../samples/ds-32.bmp";
+    m_scene->setCanvasCurrent(m_canvas0.get());
+    m_rootScene->addPhoto(filename_photo.toStdString());
+    m_scene->setCanvasCurrent(m_canvas1.get());
+    m_rootScene->addPhoto(filename_photo.toStdString());
+    entity::Photo* photo0 = m_canvas0->getPhoto(0);
+    entity::Photo* photo1 = m_canvas1->getPhoto(0);
+    QVERIFY(photo0 && photo1);
+    QVERIFY(photo0 != photo1);
+    QVERIFY(!photo0->getDigest().empty());
+    QCOMPARE(photo0->getDigest(), photo1->getDigest());
+    QCOMPARE(photo0->getTexture(), photo1->getTexture());
+
+    /* the image is stored once next to the scene */
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    QVERIFY(store.exists());
+    QCOMPARE(store.entryList(QDir::Files).size(), 1);
+    this->onFileClose();
+
+    /* and it is shared again after re-opening */
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    m_scene = m_rootScene->getUserScene();
+    QVERIFY(m_scene.get());
+    QCOMPARE(static_cast<int>(m_scene->getNumPhotos()), 2);
+    photo0 = m_scene->getCanvas(0)->getPhoto(0);
+    photo1 = m_scene->getCanvas(1)->getPhoto(0);
+    QVERIFY(photo0 && photo1);
+    QCOMPARE(photo0->getTexture(), photo1->getTexture());
+    QVERIFY(photo0->getTexture()->getImage());
+}
+
+void UserSceneTest::testPhotoPyramid()
+{
+    /* synthetic image whose pixels encode their coordinates */
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage(1500, 1000, 1, GL_RGB, GL_UNSIGNED_BYTE);
+    for (int y=0; y<image->t(); ++y){
+        for (int x=0; x<image->s(); ++x){
+            unsigned char* p = image->data(x, y);
+            p[0] = x % 256;
+            p[1] = y % 256;
+            p[2] = (x+y) % 256;
+        }
+    }
+    std::string digest = "RW_UserSceneTest_pyramid";
+    QDir(QString::fromStdString(entity::PhotoPyramid::getDirectory(digest))).removeRecursively();
+    QVERIFY(!entity::PhotoPyramid::isLarge(image.get()));
+
+    /* levels are halved until they fit a single tile */
+    QVERIFY(entity::PhotoPyramid::build(image.get(), digest, 256));
+    osg::ref_ptr<entity::PhotoPyramid> pyramid = new entity::PhotoPyramid(digest, 256);
+    QVERIFY(pyramid->load());
+    QCOMPARE(pyramid->getNumLevels(), 4);
+    QCOMPARE(pyramid->getNumTilesX(0), 6);
+    QCOMPARE(pyramid->getNumTilesY(0), 4);
+    QCOMPARE(pyramid->getLevelWidth(3), 188);
+    QCOMPARE(pyramid->getNumTilesX(3), 1);
+
+    /* a region of tiles is the same as the corresponding part of the image */
+    osg::ref_ptr<osg::Image> region = pyramid->readRegion(0, 1, 1, 3, 3);
+    QVERIFY(region.get());
+    QCOMPARE(region->s(), 512);
+    QCOMPARE(region->t(), 512);
+    QCOMPARE(static_cast<int>(region->data(10, 20)[0]), 10);
+    QCOMPARE(static_cast<int>(region->data(10, 20)[1]), 20);
+    QCOMPARE(static_cast<int>(region->data(10, 20)[2]), (266+276) % 256);
+
+    /* border tiles are smaller */
+    region = pyramid->readRegion(0, 5, 3, 6, 4);
+    QVERIFY(region.get());
+    QCOMPARE(region->s(), 1500 - 5*256);
+    QCOMPARE(region->t(), 1000 - 3*256);
+    QVERIFY(!pyramid->readRegion(0, 5, 3, 7, 4));
+
+    /* a complete pyramid is not built again */
+    QVERIFY(entity::PhotoPyramid::build(image.get(), digest, 256));
+    QDir(QString::fromStdString(entity::PhotoPyramid::getDirectory(digest))).removeRecursively();
+}
+
+void UserSceneTest::testSaveTiledPhoto()
+{
+    /* a photo large enough to be shown from its pyramid */
+    QString filename_photo = "RW_UserSceneTest_tiled.png";
+    QImage image(cher::PHOTO_PYRAMID_THRESHOLD + 100, 64, QImage::Format_RGB32);
+    image.fill(Qt::green);
+    QVERIFY(image.save(filename_photo, "PNG"));
+    m_scene->setCanvasCurrent(m_canvas0.get());
+    m_rootScene->addPhoto(filename_photo.toStdString());
+    QCOMPARE(static_cast<int>(m_canvas0->getNumPhotos()), 1);
+    entity::Photo* photo = m_canvas0->getPhoto(0);
+    QVERIFY(photo);
+    std::string digest = photo->getDigest();
+    const entity::PhotoTileCallback* tiles = dynamic_cast<const entity::PhotoTileCallback*>(photo->getCullCallback());
+    QVERIFY(tiles);
+
+    /* frames are drawn until a region of the pyramid is shown */
+    for (int i=0; i<200 && tiles->getLevel() < 0; ++i){
+        m_glWidget->grabFramebuffer();
+        QTest::qWait(10);
+    }
+    QVERIFY(tiles->getPyramid());
+    QVERIFY(tiles->getLevel() >= 0);
+
+    /* the region texture is not within the state set of the photo */
+    const osg::StateSet* stateset = photo->getStateSet();
+    QVERIFY(stateset);
+    QVERIFY(stateset->getTextureAttribute(0, osg::StateAttribute::TEXTURE) == photo->getTextureAsAttribute());
+    QVERIFY(!stateset->getTextureAttribute(0, osg::StateAttribute::TEXMAT));
+
+    /* the saved photo is read back with its full resolution texture */
+    QString filename = "RW_UserSceneTest_tiled.osgt";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    this->onFileClose();
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    m_scene = m_rootScene->getUserScene();
+    QVERIFY(m_scene.get());
+    m_canvas0 = m_scene->getCanvas(0);
+    QVERIFY(m_canvas0.get());
+    QCOMPARE(static_cast<int>(m_canvas0->getNumPhotos()), 1);
+    photo = m_canvas0->getPhoto(0);
+    QVERIFY(photo && photo->getTexture() && photo->getTexture()->getImage());
+    QCOMPARE(photo->getTexture()->getImage()->s(), image.width());
+    QCOMPARE(photo->getTexture()->getImage()->t(), image.height());
+    stateset = photo->getStateSet();
+    QVERIFY(stateset);
+    QVERIFY(stateset->getTextureAttribute(0, osg::StateAttribute::TEXTURE) == photo->getTextureAsAttribute());
+    QVERIFY(!stateset->getTextureAttribute(0, osg::StateAttribute::TEXMAT));
+
+    QDir(QString::fromStdString(entity::PhotoPyramid::getDirectory(digest))).removeRecursively();
+}
+
+void UserSceneTest::testPhotoBudget()
+{
+    entity::PhotoStore& store = entity::PhotoStore::instance();
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage(64, 32, 1, GL_RGB, GL_UNSIGNED_BYTE);
+    for (int y=0; y<image->t(); ++y){
+        for (int x=0; x<image->s(); ++x){
+            unsigned char* p = image->data(x, y);
+            p[0] = x;
+            p[1] = y;
+            p[2] = 7;
+        }
+    }
+    std::string digest;
+    osg::ref_ptr<osg::Texture2D> texture = store.getTexture(image.get(), digest);
+    QVERIFY(texture.get());
+    QFile::remove(QString::fromStdString(entity::PhotoStore::getCacheFileName(digest)));
+    image = 0;
+    unsigned long long budget = store.getMemoryBudget();
+    store.setMemoryBudget(0);
+
+    /* a shown image is never evicted */
+    for (int i=0; i<10; ++i){
+        store.beginFrame();
+        QVERIFY(!store.touch(digest));
+    }
+    QVERIFY(texture->getImage());
+
+    /* a hidden image is written to the cache, then evicted */
+    for (int i=0; i<100 && texture->getImage(); ++i){
+        store.beginFrame();
+        QTest::qWait(10);
+    }
+    QVERIFY(!texture->getImage());
+    QVERIFY(QFileInfo::exists(QString::fromStdString(entity::PhotoStore::getCacheFileName(digest))));
+    QVERIFY(store.getEvictedBytes() >= 64*32*3);
+
+    /* the image is read back on demand */
+    QVERIFY(store.touch(digest));
+    osg::Image* restored = store.restoreImage(digest);
+    QVERIFY(restored);
+    QCOMPARE(texture->getImage(), restored);
+    QCOMPARE(restored->s(), 64);
+    QCOMPARE(restored->t(), 32);
+    QCOMPARE(static_cast<int>(restored->data(10, 20)[0]), 10);
+    QCOMPARE(static_cast<int>(restored->data(10, 20)[1]), 20);
+    QVERIFY(!store.touch(digest));
+    image = new osg::Image(*restored, osg::CopyOp::DEEP_COPY_ALL);
+
+    /* an image which cannot be read back stays evicted instead of leaving a blank texture */
+    QString cached = QString::fromStdString(entity::PhotoStore::getCacheFileName(digest));
+    for (int i=0; i<100 && texture->getImage(); ++i){
+        store.beginFrame();
+        QTest::qWait(10);
+    }
+    QVERIFY(!texture->getImage());
+    QVERIFY(QFile::remove(cached));
+    QVERIFY(store.touch(digest));
+    for (int i=0; i<100 && store.touch(digest); ++i)
+        QTest::qWait(10);
+    QVERIFY(!store.touch(digest));
+    QVERIFY(!texture->getImage());
+    QVERIFY(store.getEvictedBytes() >= 64*32*3);
+    QVERIFY(!store.restoreImage(digest));
+
+    /* the cache files are removed with their textures */
+    QCOMPARE(store.getTexture(image.get(), digest), texture.get());
+    QVERIFY(texture->getImage());
+    for (int i=0; i<100 && texture->getImage(); ++i){
+        store.beginFrame();
+        QTest::qWait(10);
+    }
+    QVERIFY(QFileInfo::exists(cached));
+    texture = 0;
+    image = 0;
+    store.getNumTextures();
+    QVERIFY(!QFileInfo::exists(cached));
+
+    store.setMemoryBudget(budget);
+}
+
+void UserSceneTest::testSceneGenerator()
+{
+    SceneGenerator::Options options;
+    options.canvases = 3;
+    options.strokes = 4;
+    options.points = 30;
+    options.photos = 2;
+    options.photoSize = 64;
+    options.bookmarks = 2;
+    QDir().mkpath("SceneGeneratorTest");
+
+    qInfo("Synthetic scene is added to the current scene");
+    int canvases = m_scene->getNumCanvases();
+    int photos = m_scene->getNumPhotos();
+    int bookmarks = m_scene->getBookmarksModel()->getNumBookmarks();
+    SceneGenerator generator(options);
+    QVERIFY(generator.generate(m_rootScene.get(), m_bookmarkWidget, "SceneGeneratorTest"));
+    QCOMPARE(m_scene->getNumCanvases(), canvases + options.canvases);
+    QCOMPARE(m_scene->getNumPhotos(), photos + options.photos);
+    QCOMPARE(m_scene->getBookmarksModel()->getNumBookmarks(), bookmarks + options.bookmarks);
+    for (int i=canvases; i<m_scene->getNumCanvases(); ++i){
+        entity::Canvas* canvas = m_scene->getCanvas(i);
+        QVERIFY(canvas);
+        QCOMPARE(static_cast<int>(canvas->getNumStrokes()), options.strokes);
+        for (unsigned int j=0; j<canvas->getNumStrokes(); ++j)
+            QVERIFY(canvas->getStroke(j)->getIsCurved());
+    }
+
+    qInfo("Same options give the same scene");
+    SceneGenerator other(options), third(options);
+    osg::Matrix R0, T0, R1, T1;
+    other.createPose(R0, T0);
+    third.createPose(R1, T1);
+    QVERIFY(R0 == R1);
+    QVERIFY(T0 == T1);
+    QVERIFY(other.createPath() == third.createPath());
+
+    qInfo("Values are mapped from the raw std::mt19937 output, which is the same with any standard library");
+    QCOMPARE(options.seed, 1u);
+    QCOMPARE(options.extent, 10.f);
+    QCOMPARE(static_cast<float>(T0.getTrans().x()), 8.6511469f);
+    QCOMPARE(static_cast<float>(T0.getTrans().y()), -9.9977121f);
+    QCOMPARE(static_cast<float>(T0.getTrans().z()), -7.4375110f);
+
+    qInfo("Scene is written in the supported formats and read back");
+    const char* names[] = {"RW_SceneGeneratorTest.cher", "RW_SceneGeneratorTest.osgt"};
+    int total = m_scene->getNumCanvases();
+    for (const char* name : names){
+        QVERIFY(SceneGenerator::write(m_rootScene.get(), name));
+        this->onFileClose();
+        m_rootScene->setFilePath(name);
+        QVERIFY(this->loadSceneFromFile());
+        m_scene = m_rootScene->getUserScene();
+        QVERIFY(m_scene.get());
+        QCOMPARE(m_scene->getNumCanvases(), total);
+        QCOMPARE(m_scene->getNumPhotos(), photos + options.photos);
+        QCOMPARE(m_scene->getBookmarksModel()->getNumBookmarks(), bookmarks + options.bookmarks);
+    }
+}
+
 QTEST_MAIN(UserSceneTest)
 #include "UserSceneTest.moc"
@@ -13,6 +13,16 @@ private slots:
 
     void testWriteReadCanvases();
     void testWriteReadBookmarks();
+    void testWriteReadChunked();
+    void testRejectOtherVersions();
+    void testPointEncoding();
+    void testWriteIncremental();
+    void testAutosave();
+    void testPhotoStore();
+    void testPhotoPyramid();
+    void testSaveTiledPhoto();
+    void testPhotoBudget();
+    void testSceneGenerator();
 
 //    void testAddCanvas();
 //    void testCurrentPreviousCanvas();